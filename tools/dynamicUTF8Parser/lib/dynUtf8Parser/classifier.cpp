@@ -78,3 +78,17 @@ Classifier::classSet_t Classifier::getClassSet(utf8Char_t aUtf8Char) {
 
   return *classSetPtr;
 }
+
+void Classifier::collectClassSets(VarArray<classSet_t> *someClassSets) {
+  someClassSets->pushItem(unClassifiedSet);
+  hattrie_iter_t *iter = hattrie_iter_begin(utf8Char2classSet, false);
+  for (; !hattrie_iter_finished(iter); hattrie_iter_next(iter)) {
+    classSet_t classSet = *hattrie_iter_val(iter);
+    bool known = false;
+    for (size_t i = 0; i < someClassSets->getNumItems(); i++) {
+      if (someClassSets->getItem(i, 0) == classSet) known = true;
+    }
+    if (!known) someClassSets->pushItem(classSet);
+  }
+  hattrie_iter_free(iter);
+}
@@ -80,6 +80,15 @@ class Classifier {
       const char* aUtf8Char ///< [in] a UTF8 character to be classified. If there are multiple characters **ONLY** the first character is classified.
     );
 
+    /// \brief Collect the distinct class sets which getClassSet can
+    /// return.
+    ///
+    /// This includes the unClassifiedSet as well as the class set of
+    /// every explicitly classified UTF8 character.
+    void collectClassSets(
+      VarArray<classSet_t> *someClassSets ///< [out] the collection to which each distinct class set is pushed
+    );
+
   protected:
     /// \brief The Hat-Trie implementing the class name to class set
     /// mapping used to register a given classification bit set.
@@ -95,6 +104,9 @@ class Classifier {
     /// The unClassifiedSet is the complement of the union of all
     /// classSet_t(s) used by the classifyUtf8CharsAs method.
     classSet_t unClassifiedSet;
+
+    /// Allow complete access when saving or loading compiled grammars.
+    friend class CompiledGrammar;
 };
 
 
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dynUtf8Parser/compiledGrammar.h"
+
+/// \brief The magic string found at the start of every compiled
+/// grammar.
+static const char compiledGrammarMagic[8] = "dUtf8Pc";
+
+/// \brief A ByteBuffer collects the contents of one section of a
+/// compiled grammar.
+typedef struct ByteBuffer {
+  char  *data;
+  size_t size;
+  size_t capacity;
+} ByteBuffer;
+
+static void appendBytes(ByteBuffer *buffer, const void *bytes, size_t numBytes) {
+  if (buffer->capacity < buffer->size + numBytes) {
+    size_t newCapacity = 2*buffer->capacity;
+    if (newCapacity < buffer->size + numBytes) {
+      newCapacity = buffer->size + numBytes + 256;
+    }
+    char *newData = (char*)realloc(buffer->data, newCapacity);
+    if (!newData) throw ParserException("Out of memory");
+    buffer->data     = newData;
+    buffer->capacity = newCapacity;
+  }
+  memcpy(buffer->data + buffer->size, bytes, numBytes);
+  buffer->size += numBytes;
+}
+
+/// \brief Append the (NUL terminated) string, returning one more than
+/// its offset in the strings buffer (or zero for the NULL string).
+static uint64_t appendString(ByteBuffer *strings, const char *aString) {
+  if (!aString) return 0;
+  uint64_t offset = strings->size;
+  appendBytes(strings, aString, strlen(aString) + 1);
+  return offset + 1;
+}
+
+/// \brief Append a Hat-Trie key (which is not NUL terminated) as a
+/// string.
+static uint64_t appendKey(ByteBuffer *strings, const char *key, size_t keyLen) {
+  uint64_t offset = strings->size;
+  char nul = 0;
+  appendBytes(strings, key, keyLen);
+  appendBytes(strings, &nul, 1);
+  return offset + 1;
+}
+
+/// \brief Free the contents of every section of a compiled grammar.
+static void freeSections(ByteBuffer *sections, size_t numSections) {
+  for (size_t i = 0; i < numSections; i++) {
+    if (sections[i].data) free(sections[i].data);
+    sections[i].data = NULL;
+  }
+}
+
+void CompiledGrammar::save(const char *path,
+                           Classifier *classifier,
+                           NFA *nfa,
+                           DFA *dfa,
+                           Classifier::classSet_t lastClassSet) {
+  ByteBuffer sections[NumSections];
+  memset(sections, 0, NumSections*sizeof(ByteBuffer));
+  uint64_t counts[NumSections];
+  memset(counts, 0, NumSections*sizeof(uint64_t));
+  ByteBuffer *strings = sections + Strings;
+
+  // the Classifier's class names and classified UTF8 characters
+  hattrie_iter_t *iter = hattrie_iter_begin(classifier->className2classSet, true);
+  for (; !hattrie_iter_finished(iter); hattrie_iter_next(iter)) {
+    size_t keyLen = 0;
+    const char *key = hattrie_iter_key(iter, &keyLen);
+    ClassName className;
+    className.name     = appendKey(strings, key, keyLen);
+    className.classSet = *hattrie_iter_val(iter);
+    appendBytes(sections + ClassNames, &className, sizeof(ClassName));
+    counts[ClassNames]++;
+  }
+  hattrie_iter_free(iter);
+  iter = hattrie_iter_begin(classifier->utf8Char2classSet, true);
+  for (; !hattrie_iter_finished(iter); hattrie_iter_next(iter)) {
+    size_t keyLen = 0;
+    const char *key = hattrie_iter_key(iter, &keyLen);
+    utf8Char_t aChar;
+    aChar.u = 0;
+    if (sizeof(utf8Char_t) <= keyLen) continue; // not a UTF8 character
+    memcpy(aChar.c, key, keyLen);
+    ClassifiedChar classifiedChar;
+    classifiedChar.utf8Char = aChar.u;
+    classifiedChar.classSet = *hattrie_iter_val(iter);
+    appendBytes(sections + ClassifiedChars, &classifiedChar,
+                sizeof(ClassifiedChar));
+    counts[ClassifiedChars]++;
+  }
+  hattrie_iter_free(iter);
+
+  // the NFA::States (in id order)
+  for (size_t i = 0; i < nfa->getNumberStates(); i++) {
+    NFA::State *nfaState = nfa->getState(i);
+    NFAState savedState;
+    savedState.matchType = nfaState->matchType;
+    savedState.reserved  = 0;
+    memcpy(&savedState.matchData, &nfaState->matchData, sizeof(uint64_t));
+    savedState.out     = nfaState->out  ? nfaState->out->id  + 1 : 0;
+    savedState.out1    = nfaState->out1 ? nfaState->out1->id + 1 : 0;
+    savedState.message = appendString(strings, nfaState->message);
+    appendBytes(sections + NFAStates, &savedState, sizeof(NFAState));
+    counts[NFAStates]++;
+  }
+
+  // the NFA start states (in NFA::StartStateId order)
+  size_t numStartStates = nfa->getNumberStartStates();
+  StartState *startStates =
+    (StartState*)calloc(numStartStates + 1, sizeof(StartState));
+  if (!startStates) {
+    freeSections(sections, NumSections);
+    throw ParserException("Out of memory");
+  }
+  iter = hattrie_iter_begin(nfa->startStateIds, true);
+  for (; !hattrie_iter_finished(iter); hattrie_iter_next(iter)) {
+    size_t keyLen = 0;
+    const char *key = hattrie_iter_key(iter, &keyLen);
+    // internally startStateIds are 1-relative
+    NFA::StartStateId startStateId = *hattrie_iter_val(iter) - 1;
+    if (numStartStates <= startStateId) continue;
+    startStates[startStateId].name = appendKey(strings, key, keyLen);
+  }
+  hattrie_iter_free(iter);
+  for (size_t i = 0; i < numStartStates; i++) {
+    NFA::State *nfaStartState = nfa->getStartState((NFA::StartStateId)i);
+    if (nfaStartState) startStates[i].nfaState = nfaStartState->id + 1;
+    if (dfa->startState[i]) startStates[i].dfaState = dfa->startState[i]->id + 1;
+  }
+  appendBytes(sections + StartStates, startStates,
+              numStartStates*sizeof(StartState));
+  counts[StartStates] = numStartStates;
+  free(startStates);
+
+  // the DFA character classes
+  CharacterClassMapping *characterClasses = dfa->getCharacterClasses();
+  size_t numClasses = characterClasses->getNumCharacterClasses();
+  for (size_t i = 0; i < numClasses; i++) {
+    CharacterClass characterClass;
+    characterClass.representativeChar =
+      characterClasses->getRepresentativeChar(i).u;
+    characterClass.representativeClassSet =
+      characterClasses->getRepresentativeClassSet(i);
+    appendBytes(sections + CharacterClasses, &characterClass,
+                sizeof(CharacterClass));
+    counts[CharacterClasses]++;
+  }
+
+  // the learned DFA::States and their transitions
+  NextStateMapping *nextStateMapping = dfa->nextStateMapping;
+  size_t stateSize = dfa->getStateAllocator()->getStateSize();
+  for (size_t i = 0; i < nextStateMapping->getNumStateRecords(); i++) {
+    StateRecord *stateRecord = nextStateMapping->getStateRecord(i);
+    DFAState savedState;
+    savedState.pinned = stateRecord->pinned;
+    appendBytes(sections + DFAStates, &savedState, sizeof(DFAState));
+    appendBytes(sections + DFABitSets, stateRecord->state, stateSize);
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      StateRecord *nextRecord =
+        nextStateMapping->getNextState(stateRecord, charClass);
+      uint64_t next = nextRecord ? nextRecord->id + 1 : 0;
+      appendBytes(sections + DFATransitions, &next, sizeof(uint64_t));
+    }
+    counts[DFAStates]++;
+    counts[DFABitSets]++;
+  }
+  counts[DFATransitions] = counts[DFAStates]*numClasses;
+  counts[Strings]        = strings->size;
+
+  // now lay out the header and the (8 byte aligned) sections
+  Header header;
+  memset(&header, 0, sizeof(Header));
+  memcpy(header.magic, compiledGrammarMagic, sizeof(header.magic));
+  header.version             = version;
+  header.byteOrder           = byteOrder;
+  header.unClassifiedSet     = classifier->unClassifiedSet;
+  header.lastClassSet        = lastClassSet;
+  header.stateSize           = stateSize;
+  header.numCharacterClasses = numClasses;
+  uint64_t offset = sizeof(Header);
+  for (size_t i = 0; i < NumSections; i++) {
+    header.sections[i].offset = offset;
+    header.sections[i].count  = counts[i];
+    offset += (sections[i].size + 7) & ~((uint64_t)7);
+  }
+  header.fileSize = offset;
+
+  FILE *outFile = fopen(path, "wb");
+  if (!outFile) {
+    freeSections(sections, NumSections);
+    throw ParserException("Could not open compiled grammar for writing");
+  }
+  bool ok = (fwrite(&header, sizeof(Header), 1, outFile) == 1);
+  char padding[8];
+  memset(padding, 0, sizeof(padding));
+  for (size_t i = 0; i < NumSections; i++) {
+    size_t paddedSize = (sections[i].size + 7) & ~((size_t)7);
+    if (sections[i].size) {
+      ok = ok && (fwrite(sections[i].data, sections[i].size, 1, outFile) == 1);
+    }
+    if (paddedSize != sections[i].size) {
+      ok = ok && (fwrite(padding, paddedSize - sections[i].size, 1, outFile) == 1);
+    }
+  }
+  freeSections(sections, NumSections);
+  ok = (fclose(outFile) == 0) && ok;
+  if (!ok) throw ParserException("Could not write compiled grammar");
+}
+
+/// \brief Return the string at one less than the stringRef in the
+/// strings section, or NULL if the stringRef is not valid.
+static const char *getString(const char *strings,
+                             uint64_t numBytes,
+                             uint64_t stringRef) {
+  if (!stringRef || (numBytes < stringRef)) return NULL;
+  const char *aString = strings + stringRef - 1;
+  if (!memchr(aString, 0, numBytes - (stringRef - 1))) return NULL;
+  return aString;
+}
+
+/// \brief Check that a compiled grammar is well formed, returning an
+/// explanation of the first problem found (or NULL if there are none).
+static const char *checkCompiledGrammar(const char *base, uint64_t fileSize) {
+  typedef CompiledGrammar CG;
+  if (fileSize < sizeof(CG::Header)) return "Compiled grammar is truncated";
+  const CG::Header *header = (const CG::Header*)base;
+  if (memcmp(header->magic, compiledGrammarMagic, sizeof(header->magic)))
+    return "Not a compiled grammar";
+  if (header->byteOrder != CG::byteOrder)
+    return "Compiled grammar has the wrong byte order";
+  if (header->version != CG::version)
+    return "Compiled grammar has the wrong version";
+  if (header->fileSize != fileSize) return "Compiled grammar is truncated";
+
+  static const size_t entrySizes[CG::NumSections] = {
+    1, sizeof(CG::ClassName), sizeof(CG::ClassifiedChar),
+    sizeof(CG::NFAState), sizeof(CG::StartState), sizeof(CG::CharacterClass),
+    sizeof(CG::DFAState), 0, sizeof(uint64_t)
+  };
+  for (size_t i = 0; i < CG::NumSections; i++) {
+    const CG::Section *section = header->sections + i;
+    uint64_t entrySize = entrySizes[i];
+    if (i == CG::DFABitSets) entrySize = header->stateSize;
+    if (section->offset % 8) return "Compiled grammar section is misaligned";
+    if ((fileSize < section->offset) ||
+        (entrySize && ((fileSize - section->offset)/entrySize < section->count)))
+      return "Compiled grammar section is truncated";
+  }
+  uint64_t numDFAStates = header->sections[CG::DFAStates].count;
+  if ((header->sections[CG::DFABitSets].count != numDFAStates) ||
+      (header->sections[CG::DFATransitions].count !=
+       numDFAStates*header->numCharacterClasses) ||
+      (header->sections[CG::CharacterClasses].count !=
+       header->numCharacterClasses))
+    return "Compiled grammar DFA is inconsistent";
+
+  const char *strings  = base + header->sections[CG::Strings].offset;
+  uint64_t stringBytes = header->sections[CG::Strings].count;
+  const CG::ClassName *classNames =
+    (const CG::ClassName*)(base + header->sections[CG::ClassNames].offset);
+  for (size_t i = 0; i < header->sections[CG::ClassNames].count; i++) {
+    if (!getString(strings, stringBytes, classNames[i].name))
+      return "Compiled grammar class name is corrupt";
+  }
+  uint64_t numNFAStates = header->sections[CG::NFAStates].count;
+  const CG::NFAState *nfaStates =
+    (const CG::NFAState*)(base + header->sections[CG::NFAStates].offset);
+  for (size_t i = 0; i < numNFAStates; i++) {
+    if ((numNFAStates < nfaStates[i].out) || (numNFAStates < nfaStates[i].out1) ||
+        (NFA::Token < nfaStates[i].matchType) ||
+        (nfaStates[i].message &&
+         !getString(strings, stringBytes, nfaStates[i].message)))
+      return "Compiled grammar NFA::State is corrupt";
+  }
+  const CG::StartState *startStates =
+    (const CG::StartState*)(base + header->sections[CG::StartStates].offset);
+  for (size_t i = 0; i < header->sections[CG::StartStates].count; i++) {
+    if (!getString(strings, stringBytes, startStates[i].name) ||
+        (numNFAStates < startStates[i].nfaState) ||
+        (numDFAStates < startStates[i].dfaState))
+      return "Compiled grammar start state is corrupt";
+  }
+  // no DFA::State may contain an NFA::State beyond the saved NFA
+  const unsigned char *bitSets =
+    (const unsigned char*)(base + header->sections[CG::DFABitSets].offset);
+  for (size_t i = 0; i < numDFAStates; i++) {
+    const unsigned char *bitSet = bitSets + i*header->stateSize;
+    for (uint64_t byte = numNFAStates/8; byte < header->stateSize; byte++) {
+      unsigned char validBits = 0;
+      if (byte*8 < numNFAStates) validBits = (1 << (numNFAStates - byte*8)) - 1;
+      if (bitSet[byte] & ~validBits)
+        return "Compiled grammar DFA::State is corrupt";
+    }
+  }
+  const uint64_t *transitions =
+    (const uint64_t*)(base + header->sections[CG::DFATransitions].offset);
+  for (size_t i = 0; i < header->sections[CG::DFATransitions].count; i++) {
+    if (numDFAStates < transitions[i])
+      return "Compiled grammar DFA transition is corrupt";
+  }
+  return NULL;
+}
+
+DFA *CompiledGrammar::load(const char *path,
+                           Classifier *classifier,
+                           NFA *nfa,
+                           Classifier::classSet_t *lastClassSet) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) throw ParserException("Could not open compiled grammar");
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) || (fileStat.st_size <= 0)) {
+    close(fd);
+    throw ParserException("Could not read compiled grammar");
+  }
+  uint64_t fileSize = fileStat.st_size;
+  void *mapping = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) throw ParserException("Could not map compiled grammar");
+  const char *base = (const char*)mapping;
+  const char *problem = checkCompiledGrammar(base, fileSize);
+  if (problem) {
+    munmap(mapping, fileSize);
+    throw ParserException(problem);
+  }
+  const Header *header = (const Header*)base;
+  const char *strings  = base + header->sections[Strings].offset;
+  uint64_t stringBytes = header->sections[Strings].count;
+
+  // the Classifier
+  const ClassName *classNames =
+    (const ClassName*)(base + header->sections[ClassNames].offset);
+  for (size_t i = 0; i < header->sections[ClassNames].count; i++) {
+    classifier->registerClassSet(getString(strings, stringBytes,
+                                           classNames[i].name),
+                                 classNames[i].classSet);
+  }
+  const ClassifiedChar *classifiedChars =
+    (const ClassifiedChar*)(base + header->sections[ClassifiedChars].offset);
+  for (size_t i = 0; i < header->sections[ClassifiedChars].count; i++) {
+    utf8Char_t aChar;
+    aChar.u = classifiedChars[i].utf8Char;
+    value_t *classSetPtr = hattrie_get(classifier->utf8Char2classSet,
+                                       aChar.c, strnlen(aChar.c, sizeof(aChar)));
+    if (!classSetPtr) {
+      munmap(mapping, fileSize);
+      throw ParserException("Hat-Trie failure");
+    }
+    *classSetPtr = classifiedChars[i].classSet;
+  }
+  classifier->unClassifiedSet = header->unClassifiedSet;
+  *lastClassSet = header->lastClassSet;
+
+  // the NFA::States (first the states, then their out pointers)
+  uint64_t numNFAStates = header->sections[NFAStates].count;
+  const NFAState *nfaStates =
+    (const NFAState*)(base + header->sections[NFAStates].offset);
+  for (size_t i = 0; i < numNFAStates; i++) {
+    NFA::MatchData matchData;
+    memcpy(&matchData, &nfaStates[i].matchData, sizeof(uint64_t));
+    const char *message =
+      getString(strings, stringBytes, nfaStates[i].message);
+    nfa->addState((NFA::MatchType)nfaStates[i].matchType, matchData,
+                  NULL, NULL, message ? message : "");
+  }
+  for (size_t i = 0; i < numNFAStates; i++) {
+    NFA::State *nfaState = nfa->getState(i);
+    if (nfaStates[i].out)  nfaState->out  = nfa->getState(nfaStates[i].out  - 1);
+    if (nfaStates[i].out1) nfaState->out1 = nfa->getState(nfaStates[i].out1 - 1);
+  }
+  const StartState *startStates =
+    (const StartState*)(base + header->sections[StartStates].offset);
+  uint64_t numStartStates = header->sections[StartStates].count;
+  for (size_t i = 0; i < numStartStates; i++) {
+    nfa->registerStartState(getString(strings, stringBytes, startStates[i].name));
+    if (startStates[i].nfaState) {
+      nfa->startState.setItem(i, nfa->getState(startStates[i].nfaState - 1));
+    }
+  }
+
+  // the DFA (whose character classes must agree with the saved ones)
+  DFA *dfa = new DFA(nfa);
+  CharacterClassMapping *characterClasses = dfa->getCharacterClasses();
+  uint64_t numClasses = header->numCharacterClasses;
+  if ((dfa->getStateAllocator()->getStateSize() != header->stateSize) ||
+      (characterClasses->getNumCharacterClasses() != numClasses)) {
+    delete dfa;
+    munmap(mapping, fileSize);
+    throw ParserException("Compiled grammar DFA does not match its NFA");
+  }
+  const CharacterClass *savedClasses =
+    (const CharacterClass*)(base + header->sections[CharacterClasses].offset);
+  size_t *classMap = (size_t*)calloc(numClasses + 1, sizeof(size_t));
+  if (!classMap) {
+    delete dfa;
+    munmap(mapping, fileSize);
+    throw ParserException("Out of memory");
+  }
+  for (size_t i = 0; i < numClasses; i++) {
+    utf8Char_t representativeChar;
+    representativeChar.u = savedClasses[i].representativeChar;
+    if (representativeChar.u) {
+      classMap[i] = characterClasses->getCharacterClass(representativeChar);
+    } else {
+      classMap[i] = characterClasses->findClassSetClass(
+        savedClasses[i].representativeClassSet);
+    }
+  }
+
+  uint64_t numDFAStates = header->sections[DFAStates].count;
+  const DFAState *dfaStates =
+    (const DFAState*)(base + header->sections[DFAStates].offset);
+  const char *bitSets = base + header->sections[DFABitSets].offset;
+  const uint64_t *transitions =
+    (const uint64_t*)(base + header->sections[DFATransitions].offset);
+  StateAllocator *allocator = dfa->getStateAllocator();
+  NextStateMapping *nextStateMapping = dfa->nextStateMapping;
+  StateRecord **records =
+    (StateRecord**)calloc(numDFAStates + 1, sizeof(StateRecord*));
+  if (!records) {
+    free(classMap);
+    delete dfa;
+    munmap(mapping, fileSize);
+    throw ParserException("Out of memory");
+  }
+  for (size_t i = 0; i < numDFAStates; i++) {
+    State *newState = allocator->allocateANewState();
+    memcpy(newState, bitSets + i*header->stateSize, header->stateSize);
+    records[i] = dfa->registerState(newState);
+    if (dfaStates[i].pinned) nextStateMapping->pinState(records[i]);
+  }
+  for (size_t i = 0; i < numDFAStates; i++) {
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      uint64_t next = transitions[i*numClasses + charClass];
+      if (!next) continue;
+      nextStateMapping->setNextState(records[i], classMap[charClass],
+                                     records[next - 1]);
+    }
+  }
+  for (size_t i = 0; i < numStartStates; i++) {
+    if (!startStates[i].dfaState) continue;
+    dfa->startState[i] = records[startStates[i].dfaState - 1];
+    nextStateMapping->pinState(dfa->startState[i]);
+  }
+  free(records);
+  free(classMap);
+  munmap(mapping, fileSize);
+  return dfa;
+}
@@ -0,0 +1,159 @@
+#ifndef COMPILED_GRAMMAR_H
+#define COMPILED_GRAMMAR_H
+
+#include <stdint.h>
+
+#include "dynUtf8Parser/dfa/dfa.h"
+
+using namespace DeterministicFiniteAutomaton;
+
+/// \brief The CompiledGrammar class saves and loads compiled grammars,
+/// that is the Classifier tables, the NFA and any DFA::States already
+/// learned by the DFA, using a versioned binary format.
+///
+/// The format is position independent (every reference is either an
+/// index or a byte offset) so that it can be mmap-ed read-only. A
+/// compiled grammar file consists of a CompiledGrammar::Header
+/// followed by the sections described by the Header's
+/// CompiledGrammar::Section table. Every section is aligned on an 8
+/// byte boundary. Strings are stored, NUL terminated, in the Strings
+/// section and are referenced by one *more* than their byte offset
+/// (so that zero denotes a NULL string). Similarly, NFA::States and
+/// DFA StateRecords are referenced by one *more* than their index.
+///
+/// Loading a compiled grammar rebuilds the Classifier, NFA and DFA
+/// directly from the mapped tables, without recompiling any regular
+/// expressions or relearning any DFA::States.
+class CompiledGrammar {
+  public:
+
+    /// \brief The version of the compiled grammar format written by
+    /// save.
+    static const uint32_t version = 1;
+
+    /// \brief The byteOrder marker, used to reject compiled grammars
+    /// written on machines with a different byte order.
+    static const uint32_t byteOrder = 0x01020304;
+
+    /// \brief The sections of a compiled grammar.
+    enum SectionId {
+      Strings          = 0, ///< NUL terminated strings (count in bytes)
+      ClassNames       = 1, ///< ClassName entries
+      ClassifiedChars  = 2, ///< ClassifiedChar entries
+      NFAStates        = 3, ///< NFAState entries (indexed by NFA::State id)
+      StartStates      = 4, ///< StartState entries (indexed by NFA::StartStateId)
+      CharacterClasses = 5, ///< CharacterClass entries
+      DFAStates        = 6, ///< DFAState entries (indexed by StateRecord id)
+      DFABitSets       = 7, ///< the DFA::State bit sets (stateSize bytes each)
+      DFATransitions   = 8, ///< numCharacterClasses uint64_t per DFA::State
+      NumSections      = 9
+    };
+
+    /// \brief The location of one section of a compiled grammar.
+    typedef struct Section {
+      /// \brief The byte offset of the section from the start of the
+      /// file.
+      uint64_t offset;
+
+      /// \brief The number of entries in the section.
+      uint64_t count;
+    } Section;
+
+    /// \brief The Header found at the start of every compiled grammar.
+    typedef struct Header {
+      /// \brief The magic string "dUtf8Pc" (NUL terminated).
+      char     magic[8];
+
+      /// \brief The version of the compiled grammar format.
+      uint32_t version;
+
+      /// \brief The byteOrder marker as written.
+      uint32_t byteOrder;
+
+      /// \brief The total size in bytes of the compiled grammar.
+      uint64_t fileSize;
+
+      /// \brief The Classifier's class set of unclassified characters.
+      uint64_t unClassifiedSet;
+
+      /// \brief The Parser's last assigned class set.
+      uint64_t lastClassSet;
+
+      /// \brief The size in bytes of each DFA::State bit set.
+      uint64_t stateSize;
+
+      /// \brief The number of DFA character classes.
+      uint64_t numCharacterClasses;
+
+      /// \brief The location of each section.
+      Section  sections[NumSections];
+    } Header;
+
+    /// \brief A ClassName entry records a registered Classifier class
+    /// name.
+    typedef struct ClassName {
+      uint64_t name;     ///< one more than the name's string offset
+      uint64_t classSet; ///< the class set of this class name
+    } ClassName;
+
+    /// \brief A ClassifiedChar entry records a classified UTF8
+    /// character.
+    typedef struct ClassifiedChar {
+      uint64_t utf8Char; ///< the utf8Char_t (as a uint64_t)
+      uint64_t classSet; ///< the class set of this UTF8 character
+    } ClassifiedChar;
+
+    /// \brief An NFAState entry records an NFA::State.
+    typedef struct NFAState {
+      uint32_t matchType; ///< the NFA::MatchType
+      uint32_t reserved;  ///< (zero)
+      uint64_t matchData; ///< the NFA::MatchData (as a uint64_t)
+      uint64_t out;       ///< one more than the out NFA::State's id
+      uint64_t out1;      ///< one more than the out1 NFA::State's id
+      uint64_t message;   ///< one more than the message's string offset
+    } NFAState;
+
+    /// \brief A StartState entry records a named NFA start state.
+    typedef struct StartState {
+      uint64_t name;     ///< one more than the name's string offset
+      uint64_t nfaState; ///< one more than the start NFA::State's id
+      uint64_t dfaState; ///< one more than the start StateRecord's id
+    } StartState;
+
+    /// \brief A CharacterClass entry records the representatives of
+    /// a DFA character class.
+    typedef struct CharacterClass {
+      uint64_t representativeChar;     ///< the utf8Char_t (as a uint64_t)
+      uint64_t representativeClassSet; ///< the class set
+    } CharacterClass;
+
+    /// \brief A DFAState entry records a learned DFA StateRecord.
+    typedef struct DFAState {
+      uint64_t pinned; ///< non-zero if the StateRecord is pinned
+    } DFAState;
+
+    /// \brief Save the compiled grammar consisting of the Classifier,
+    /// NFA and DFA (together with the Parser's lastClassSet) to the
+    /// file at path.
+    ///
+    /// Throws a ParserException if the file can not be written.
+    static void save(const char *path,
+                     Classifier *classifier,
+                     NFA *nfa,
+                     DFA *dfa,
+                     Classifier::classSet_t lastClassSet);
+
+    /// \brief Load the compiled grammar in the file at path into the
+    /// (empty) Classifier and NFA provided, returning a new DFA
+    /// which already knows the saved DFA::States.
+    ///
+    /// The file is mmap-ed read-only while it is being loaded. Throws
+    /// a ParserException if the file can not be read, or is not a
+    /// valid compiled grammar of this version.
+    static DFA *load(const char *path,
+                     Classifier *classifier,
+                     NFA *nfa,
+                     Classifier::classSet_t *lastClassSet);
+};
+
+#endif
@@ -6,6 +6,14 @@
 namespace DeterministicFiniteAutomaton {
 
   /// \brief The PushDownMachine's state.
+  ///
+  /// An AutomataState owns no heap objects. The DFA::State is the
+  /// registered StateRecord's (shared) bit set, the stream is the
+  /// (shared) Utf8Chars being parsed, and the child tokens of the
+  /// token being recognized are kept, from tokenStart onwards, in the
+  /// PushDownMachine's token builder. This means the whole of an
+  /// AutomataState can be saved on (and restored from) the
+  /// PushDownMachine's stack as a fixed size (POD) Frame.
   class AutomataState {
     public:
 
@@ -17,6 +25,34 @@ namespace DeterministicFiniteAutomaton {
         ASRestart=3
       };
 
+      /// \brief A Frame is the fixed size (POD) image of an
+      /// AutomataState saved on the PushDownMachine's stack.
+      typedef struct Frame {
+        /// \brief The registered DFA StateRecord of the saved state.
+        StateRecord                *stateRecord;
+
+        /// \brief The index of the next of the stateRecord's ReStart
+        /// NFA::States to be tried.
+        size_t                      nextReStart;
+
+        /// \brief The position in the stream.
+        Utf8Chars::Cursor           cursor;
+
+        /// \brief The index, in the token builder, of the first child
+        /// token of the token being recognized.
+        size_t                      tokenStart;
+
+        /// \brief The number of tokens in the token builder when this
+        /// Frame was saved (a backtrack discards any later tokens).
+        size_t                      numTokens;
+
+        /// \brief The (original) start state id.
+        NFA::StartStateId           startStateId;
+
+        /// \brief The type of the saved AutomataState.
+        AutomataStateType           frameType;
+      } Frame;
+
       /// \brief An invariant which should ALWAYS be true for any
       /// instance of a AutomataState class.
       ///
@@ -28,19 +64,19 @@ namespace DeterministicFiniteAutomaton {
             throw AssertionFailure("allocator not NULL when dfa is NULL");
         }
         if (allocator  == NULL) {
-          if (dState   != NULL) throw AssertionFailure("dstate not NULL");
-          if (iterator != NULL) throw AssertionFailure("iterator not NULL");
+          if (stateRecord != NULL)
+            throw AssertionFailure("stateRecord not NULL");
         }
-        if (dState != NULL) {
-          if (iterator == NULL)
-            throw AssertionFailure("iterator should not be NULL");
-          if (iterator->origDState != dState)
-            throw AssertionFailure("iterator on wrong dState");
+        if (stateRecord != NULL) {
+          if (!stateRecord->hasMetadata)
+            throw AssertionFailure("stateRecord has no metadata");
+          if (stateRecord->numReStarts < nextReStart)
+            throw AssertionFailure("nextReStart out of range");
         }
         if ((stream  != NULL) && (!stream->invariant()))
           throw AssertionFailure("stream failed invariant");
-        if ((token   != NULL) && (!token->invariant()))
-          throw AssertionFailure("token failed invariant");
+        if ((stream  != NULL) && (!stream->validCursor(&cursor)))
+          throw AssertionFailure("cursor not inside stream");
         return true;
       }
 
@@ -48,30 +84,35 @@ namespace DeterministicFiniteAutomaton {
       AutomataState(void) {
         automataStateType = ASInvalid;
         startStateId      = 0;
+        dfa               = NULL;
         allocator         = NULL;
-        iterator          = NULL;
         stream            = NULL;
-        dState            = NULL;
-        token             = NULL;
+        cursor.start      = 0;
+        cursor.next       = 0;
+        stateRecord       = NULL;
+        nextReStart       = 0;
+        tokenStart        = 0;
         ASSERT(invariant());
       }
 
       /// \brief Initialize an existing AutomataState to the start
       /// state, aStartStateId, over the DFA, aDFA, running over the
       /// stream, aStream, of UTF8 characters.
+      ///
+      /// The stream is shared (not owned) and must outlive this
+      /// AutomataState.
       void initialize(DFA               *aDFA,
                       Utf8Chars         *aStream,
                       NFA::StartStateId  aStartStateId) {
-        // TODO: should any old state be deleted?
         dfa = aDFA;
         ASSERT(dfa);
         allocator = dfa->getStateAllocator();
         ASSERT(allocator);
         setStartStateId(aStartStateId);
         ASSERT(aStream);
-        stream   = aStream->clone();
-        token    = new Token();
-        //printf("token: %p new token (initialize)\n", token);
+        stream     = aStream;
+        cursor     = aStream->getCursor();
+        tokenStart = 0;
         automataStateType = ASRestart;
         ASSERT(invariant());
       }
@@ -84,118 +125,176 @@ namespace DeterministicFiniteAutomaton {
         ASSERT(invariant());
       }
 
-      /// \brief Set the AutomataState to the the DFA State provided,
-      /// clearing the old state if clearOldState is true.
-      void setDState(State *aDState, bool clearOldState = false) {
-        ASSERT(allocator);
-        if (clearOldState && dState)  allocator->unallocateState(dState);
-        dState   = allocator->clone(aDState);
-
-        if (clearOldState && iterator) delete iterator;
-        if (dState) iterator = allocator->getNewIteratorOn(dState);
+      /// \brief Set the AutomataState to the the (registered) DFA
+      /// State provided, starting again at its first ReStart
+      /// NFA::State.
+      void setDState(StateRecord *aDState) {
+        ASSERT(dfa);
+        ASSERT(aDState);
+        dfa->ensureStateMetadata(aDState);
+        stateRecord = aDState;
+        nextReStart = 0;
         ASSERT(invariant());
       }
 
-      /// \brief Clone the stream. If subStream is true then the cloned
-      /// stream will only read from the parent stream's current position.
-      void cloneSubStream(bool subStream) {
-        if (stream) {
-          stream   = stream->clone(subStream);
-          ASSERT(stream->invariant());
-        }
+      /// \brief Start a sub stream which only reads from the stream's
+      /// current position.
+      ///
+      /// Only the (value type) cursor changes, so no heap allocation
+      /// is required.
+      void startSubStream(void) {
+        cursor.start = cursor.next;
         ASSERT(invariant());
       }
 
-      /// \brief Clone the token. Simply create a new token if
-      /// shouldCLoneToken is false.
-      void cloneToken(bool shouldCloneToken) {
-        if (shouldCloneToken) {
-          if (token) {
-            token = token->clone();
-            //printf("token: %p new token (cloneToken-A)\n", token);
-          } else {
-            token = new Token();
-            //printf("token: %p new token (cloneToken-B)\n", token);
-          }
-        } else {
-          token = new Token();
-          //printf("token: %p new token (cloneToken-C)\n", token);
-        }
+      /// \brief Start a new token whose child tokens will be found in
+      /// the token builder from aTokenStart onwards.
+      void startToken(size_t aTokenStart) {
+        tokenStart = aTokenStart;
+      }
+
+      /// \brief Return the index, in the token builder, of the first
+      /// child token of the token being recognized.
+      size_t getTokenStart(void) {
+        return tokenStart;
+      }
+
+      /// \brief Save this AutomataState into the frame provided,
+      /// recording the number of tokens, numTokens, currently in the
+      /// token builder.
+      void saveFrame(Frame *frame, size_t numTokens) const {
         ASSERT(invariant());
+        ASSERT(frame);
+        frame->stateRecord  = stateRecord;
+        frame->nextReStart  = nextReStart;
+        frame->cursor       = cursor;
+        frame->tokenStart   = tokenStart;
+        frame->numTokens    = numTokens;
+        frame->startStateId = startStateId;
+        frame->frameType    = automataStateType;
       }
 
-      /// \brief Copy the current AutomataState's state from the other
-      /// AutomataState's state.
+      /// \brief Restore this AutomataState from the frame provided.
       ///
       /// The current AutomataState's stream position will kept if
-      /// keepStreamPosition is true.
-      void copyFrom(const AutomataState &other,
-                    bool keepStreamPosition = false) {
-        ASSERT(invariant());
-        ASSERT(other.invariant());
-
-        automataStateType = other.automataStateType;
-        startStateId      = other.startStateId;
-
-        ASSERT(dfa       || other.dfa);
-        if (!dfa) dfa = other.dfa;
-
-        ASSERT(allocator || other.allocator);
-        if (!allocator) allocator = other.allocator;
-
-        if (keepStreamPosition && other.stream) {
-          other.stream->updatePositionFrom(stream);
-        }
-        if (stream) delete stream;
-        stream   = other.stream;
-
-        if (iterator) delete iterator;
-        iterator = other.iterator;
-
-        if (dState) allocator->unallocateState(dState);
-        dState   = other.dState;
-
-        if (token) {
-          //printf("token: %p deleting token (copyFrom)\n", token);
-          delete token;
+      /// keepStreamPosition is true (and the current position is
+      /// inside the frame's sub stream).
+      void restoreFrame(const Frame &frame,
+                        bool keepStreamPosition = false) {
+        ASSERT(allocator);
+        ASSERT(frame.stateRecord);
+        automataStateType = frame.frameType;
+        startStateId      = frame.startStateId;
+        stateRecord       = frame.stateRecord;
+        nextReStart       = frame.nextReStart;
+        size_t next = frame.cursor.next;
+        if (keepStreamPosition && (frame.cursor.start <= cursor.next)) {
+          next = cursor.next;
         }
-        token = other.token;
-
+        cursor            = frame.cursor;
+        cursor.next       = next;
+        tokenStart        = frame.tokenStart;
         ASSERT(invariant());
       }
 
       /// \brief Clear the AutomataState's state.
       void clear(void) {
-        //printf("CLEARING AUTOMATA STATE\n");
         ASSERT(invariant());
-        if (iterator) delete iterator;
-        iterator  = NULL;
-        if (stream)   delete stream;
-        stream    = NULL;
-        if (dState && allocator) allocator->unallocateState(dState);
-        dState    = NULL;
-        if (token) {
-          //printf("token: %p deleting token (clear)\n", token);
-          delete token;
-        }
-        token     = NULL;
-        allocator = NULL; // we do not own the allocator
-        dfa       = NULL; // we do not own the DFA
+        nextReStart  = 0;
+        stream       = NULL;
+        cursor.start = 0;
+        cursor.next  = 0;
+        stateRecord  = NULL;
+        tokenStart   = 0;
+        allocator    = NULL; // we do not own the allocator
+        dfa          = NULL; // we do not own the DFA
         ASSERT(invariant());
       }
 
-      /// \brief Get DFA state iterator associated with this AutomataState.
-      NFAStateIterator *getIterator(void) {
-        ASSERT(invariant());
-        return iterator;
+      /// \brief Return the next of the current DFA State's (cached)
+      /// ReStart NFA::States to be tried, or NULL if all of them have
+      /// been tried.
+      ///
+      /// Only the first ReStart NFA::State for each start state id is
+      /// returned (see DFA::ensureStateMetadata).
+      NFA::State *nextReStartState(void) {
+        ASSERT(stateRecord);
+        if (stateRecord->numReStarts <= nextReStart) return NULL;
+        return stateRecord->reStarts[nextReStart++];
       }
 
-      /// \brief Get the stream associated with this AutomataState.
+      /// \brief Get the (shared) stream associated with this
+      /// AutomataState.
       Utf8Chars *getStream(void) {
         ASSERT(invariant());
         return stream;
       }
 
+      /// \brief Replace the (shared) stream associated with this
+      /// AutomataState by one whose Cursors are measured in the same
+      /// way (for example the next window of a PushStream), keeping
+      /// the current cursor.
+      void setStream(Utf8Chars *aStream) {
+        ASSERT(aStream);
+        stream = aStream;
+        ASSERT(invariant());
+      }
+
+      /// \brief Get this AutomataState's cursor into its stream.
+      Utf8Chars::Cursor *getCursor(void) {
+        ASSERT(invariant());
+        return &cursor;
+      }
+
+      /// \brief Return the next UTF8 character in this
+      /// AutomataState's stream, advancing its cursor.
+      utf8Char_t nextUtf8Char(void) {
+        ASSERT(stream);
+        return stream->nextUtf8Char(&cursor);
+      }
+
+      /// \brief Move this AutomataState's cursor to the (earlier
+      /// recognized) offset provided.
+      void skipTo(size_t offset) {
+        cursor.next = offset;
+        ASSERT(invariant());
+      }
+
+      /// \brief Return the next UTF8 character in this
+      /// AutomataState's stream, WITHOUT advancing its cursor.
+      utf8Char_t peekUtf8Char(void) {
+        ASSERT(stream);
+        Utf8Chars::Cursor peekCursor = cursor;
+        return stream->nextUtf8Char(&peekCursor);
+      }
+
+      /// \brief Backup this AutomataState's cursor ONE UTF8 character.
+      void backup(void) {
+        ASSERT(stream);
+        stream->backup(&cursor);
+      }
+
+      /// \brief Returns true if this AutomataState's cursor has read
+      /// all of its stream.
+      bool atEnd(void) {
+        ASSERT(stream);
+        return stream->atEnd(&cursor);
+      }
+
+      /// \brief Return the start of the text read in this
+      /// AutomataState's sub stream.
+      const char *getTextStart(void) {
+        ASSERT(stream);
+        return stream->getStart(&cursor);
+      }
+
+      /// \brief Return the length of the text read in this
+      /// AutomataState's sub stream.
+      size_t getTextLength(void) {
+        ASSERT(stream);
+        return stream->getNumberOfBytesRead(&cursor);
+      }
+
       /// \brief Explicitly set the AutomataState's state type.
       void setStateType(AutomataStateType stateType) {
         automataStateType = stateType;
@@ -227,111 +326,52 @@ namespace DeterministicFiniteAutomaton {
         return getStateTypeMessage(automataStateType);
       }
 
-      /// \brief Get the textural name/description of this
-      /// AutomataState's start state.
-      const char *getStartStateMessage(void) {
+      /// \brief Return this AutomataState's (original) start state id.
+      NFA::StartStateId getStartStateId(void) {
+        return startStateId;
+      }
+
+      /// \brief Get the textural name/description of the start state,
+      /// aStartStateId.
+      const char *getStartStateMessage(NFA::StartStateId aStartStateId) {
         ASSERT(dfa);
         NFA *nfa = dfa->getNFA();
         ASSERT(nfa);
-        NFA::State *nfaState = nfa->getStartState(startStateId);
+        NFA::State *nfaState = nfa->getStartState(aStartStateId);
         ASSERT(nfaState);
         return nfaState->message;
       }
 
+      /// \brief Get the textural name/description of this
+      /// AutomataState's start state.
+      const char *getStartStateMessage(void) {
+        return getStartStateMessage(startStateId);
+      }
+
       /// \brief Ge the DFA State associated with this AutomataState.
       State *getDState(void) {
         ASSERT(invariant());
-        return dState;
+        if (!stateRecord) return NULL;
+        return stateRecord->state;
       }
 
-      /// \brief Clear the NFA state out of this AutomataState's DFA
-      /// State.
-      void clearNFAState(NFA::State *nfaState) {
-        ASSERT(allocator);
-        ASSERT(nfaState);
-        ASSERT(dState);
-        allocator->clearNFAState(dState, nfaState);
+      /// \brief Get the registered DFA StateRecord of this
+      /// AutomataState's DFA State.
+      StateRecord *getStateRecord(void) {
         ASSERT(invariant());
+        return stateRecord;
       }
 
-      /// \brief Clear all NFA states which have the same ReStart
-      /// stateStateId out of this AutomataState's DFA State.
-      void clearNFAStatesWithSameRestartState(NFA::StartStateId aStartStateId) {
-        NFAStateIterator iterator = allocator->newIteratorOn(dState);
-        while (NFA::State *nfaState = iterator.nextState()) {
-          if ((nfaState->matchType == NFA::ReStart) &&
-              (nfaState->matchData.r == aStartStateId)) {
-            clearNFAState(nfaState);
-          }
-        }
-      }
-
-      /// \brief Return the first NFA::State which matches the
-      /// tokenStates provided.
-      NFA::State *stateMatchesToken(State *tokenStates) {
-        ASSERT(allocator);
-        ASSERT(tokenStates);
-        ASSERT(dState);
-        ASSERT(invariant());
-        return allocator->stateMatchesToken(dState, tokenStates);
-      }
-
-      /// \brief Explicitly set the TokenId of this AutomataState's
+      /// \brief Return the (cached) accepting NFA::Token NFA::State
+      /// of the current DFA State, or NULL if it does not accept a
       /// token.
-      void setTokenId(Token::TokenId tokenId) {
-        ASSERT(token);
-        token->setId(tokenId);
-        ASSERT(invariant());
-      }
-
-      /// \brief Explicitly set the text of this AutomataState's token.
-      void setTokenText(void) {
-        ASSERT(token);
-        ASSERT(stream);
-        token->setText(stream->getStart(), stream->getNumberOfBytesRead());
-        char *text = stream->getCopyOfTextRead();
-        //printf("token: %p setTokenText [%s]\n", token, text);
-        free(text);
-        ASSERT(invariant());
-      }
-
-      /// \brief Add a child token to this AutomataState's token.
-      void addChildToken(Token *childToken) {
-        ASSERT(childToken->invariant());
-        ASSERT(token);
-        ASSERT(token->invariant());
-        token->addChildToken(childToken);
-        ASSERT(invariant());
-      }
-
-      /// \brief Remove and return this AutomataState's token.
-      ///
-      /// On return this AutomataState will have a new token instance.
-      Token *releaseToken(void) {
-        ASSERT(invariant());
-        Token *oldToken = token;
-        token = new Token();
-        //printf("token: %p new token (releaseToken)\n", token);
-        ASSERT(invariant());
-        return oldToken;
+      NFA::State *getTokenState(void) {
+        ASSERT(stateRecord);
+        return stateRecord->tokenState;
       }
 
     protected:
 
-      /// \brief Copy the other AutomataState to this one.
-      void operator=(const AutomataState &other) {
-        ASSERT(other.invariant());
-        automataStateType = other.automataStateType;
-        startStateId      = other.startStateId;
-        dfa               = other.dfa;
-        allocator         = other.allocator;
-        dState            = other.dState;
-        iterator          = other.iterator;
-        stream            = other.stream;
-        token             = other.token;
-        ASSERT(invariant());
-      }
-
       /// \brief The type of AutomataState.
       AutomataStateType automataStateType;
 
@@ -344,30 +384,33 @@ namespace DeterministicFiniteAutomaton {
       /// \brief The allocator associated with this AutomataState.
       StateAllocator *allocator;
 
-      /// \brief A copy of the current DFA::State.
-      ///
-      /// As each reStart NFA::State alternatives are tried,
-      /// the corresponding NFA::State bits in this DFA::State
-      /// are cleared, so that if no reStart NFA::State(s)
-      /// succeed we can try to compute the next DFA:State
-      /// using the non-reStart NFA::States.
-      State *dState;
-
-      /// \brief An iterator over a copy of the current DFA::State.
+      /// \brief The registered DFA StateRecord of the current
+      /// DFA::State.
+      StateRecord *stateRecord;
+
+      /// \brief The index of the next of the stateRecord's ReStart
+      /// NFA::States to be tried.
       ///
-      /// When automata states are poped, the iterator is used
-      /// to continue searching for viable alternative paths.
-      NFAStateIterator *iterator;
+      /// When automata states are poped, the remaining ReStart
+      /// NFA::States are tried as viable alternative paths.
+      size_t nextReStart;
 
-      /// \brief The stream of UTF8 characters which have not yet
-      /// been recognized.
+      /// \brief The (shared) stream of UTF8 characters being
+      /// recognized.
+      ///
+      /// The stream is not owned by any AutomataState, each
+      /// AutomataState simply keeps its own cursor into it.
       Utf8Chars *stream;
 
-      /// \brief A copy of the currently partially constructed token
-      Token *token;
+      /// \brief The position of this AutomataState in the stream of
+      /// UTF8 characters which have not yet been recognized.
+      Utf8Chars::Cursor cursor;
+
+      /// \brief The index, in the PushDownMachine's token builder, of
+      /// the first child token of the token being recognized.
+      size_t tokenStart;
 
       friend class PDMTracer;
-      friend class VarArray<AutomataState>;
 
   }; // class AutomataState
 };  // namespace DeterministicFiniteAutomaton
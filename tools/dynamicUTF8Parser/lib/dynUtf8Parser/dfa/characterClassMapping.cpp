@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dynUtf8Parser/dfa/characterClassMapping.h"
+
+using namespace DeterministicFiniteAutomaton;
+
+CharacterClassMapping::CharacterClassMapping(NFA *anNFA) {
+  classifier          = anNFA->getClassifier();
+  utf8Char2class      = hattrie_create();
+  numCharacterClasses = 0;
+
+  // the NFA::Character literals each have their own character class
+  collectMatchData(anNFA);
+
+  // group the class sets of all other UTF8 characters
+  VarArray<Classifier::classSet_t> classSets;
+  classifier->collectClassSets(&classSets);
+  for (size_t i = 0; i < classSets.getNumItems(); i++) {
+    findClassSetClass(classSets.getItem(i, 0));
+  }
+
+  // fill in the ASCII lookup table
+  utf8Char_t asciiChar;
+  for (size_t i = 0; i < numAsciiChars; i++) {
+    asciiChar.u    = 0;
+    asciiChar.c[0] = (char)i;
+    value_t *charClass = NULL;
+    if (i) charClass = hattrie_tryget(utf8Char2class, asciiChar.c, 1);
+    if (charClass && *charClass) asciiClasses[i] = *charClass - 1;
+    else asciiClasses[i] =
+      findClassSetClass(classifier->getClassSet(asciiChar));
+  }
+}
+
+CharacterClassMapping::~CharacterClassMapping(void) {
+  if (utf8Char2class) hattrie_free(utf8Char2class);
+  utf8Char2class      = NULL;
+  classifier          = NULL;
+  numCharacterClasses = 0;
+}
+
+void CharacterClassMapping::collectMatchData(NFA *anNFA) {
+  bool *visited = (bool*)calloc(anNFA->getNumberStates() + 1, sizeof(bool));
+  if (!visited) throw ParserException("Out of memory");
+  VarArray<NFA::State*> toVisit;
+  for (size_t i = 0; i < anNFA->getNumberStartStates(); i++) {
+    toVisit.pushItem(anNFA->getStartState((NFA::StartStateId)i));
+  }
+  while (toVisit.getNumItems()) {
+    NFA::State *nfaState = toVisit.popItem();
+    if (!nfaState) continue;
+    if (visited[nfaState->id]) continue;
+    visited[nfaState->id] = true;
+
+    switch (nfaState->matchType) {
+      case NFA::Character: {
+        utf8Char_t c = nfaState->matchData.c;
+        value_t *charClass = hattrie_get(utf8Char2class, c.c, strlen(c.c));
+        if (!charClass) throw ParserException("Hat-Trie failure");
+        if (!*charClass) {
+          *charClass = addCharacterClass(c, classifier->getClassSet(c)) + 1;
+        }
+        break;
+      }
+      case NFA::ClassSet: {
+        Classifier::classSet_t classSet = nfaState->matchData.s;
+        bool known = false;
+        for (size_t i = 0; i < nfaClassSets.getNumItems(); i++) {
+          if (nfaClassSets.getItem(i, 0) == classSet) known = true;
+        }
+        if (!known) nfaClassSets.pushItem(classSet);
+        break;
+      }
+      default:
+        break;
+    }
+    toVisit.pushItem(nfaState->out);
+    if (nfaState->matchType == NFA::Split) toVisit.pushItem(nfaState->out1);
+  }
+  free(visited);
+}
+
+bool CharacterClassMapping::sameClassSetBehaviour(
+  Classifier::classSet_t aClassSet,
+  Classifier::classSet_t otherClassSet) {
+  for (size_t i = 0; i < nfaClassSets.getNumItems(); i++) {
+    Classifier::classSet_t nfaClassSet = nfaClassSets.getItem(i, 0);
+    if (((aClassSet & nfaClassSet) != 0) !=
+        ((otherClassSet & nfaClassSet) != 0)) return false;
+  }
+  return true;
+}
+
+size_t CharacterClassMapping::findClassSetClass(
+  Classifier::classSet_t aClassSet) {
+  for (size_t i = 0; i < classSetClasses.getNumItems(); i++) {
+    size_t charClass = classSetClasses.getItem(i, 0);
+    if (sameClassSetBehaviour(aClassSet,
+                              representativeClassSets.getItem(charClass, 0))) {
+      return charClass;
+    }
+  }
+  // the NUL character never matches an NFA::Character literal
+  utf8Char_t nulChar;
+  nulChar.u = 0;
+  size_t charClass = addCharacterClass(nulChar, aClassSet);
+  classSetClasses.pushItem(charClass);
+  return charClass;
+}
+
+size_t CharacterClassMapping::addCharacterClass(utf8Char_t aChar,
+  Classifier::classSet_t aClassSet) {
+  representativeChars.pushItem(aChar.u);
+  representativeClassSets.pushItem(aClassSet);
+  return numCharacterClasses++;
+}
+
+size_t CharacterClassMapping::findCharacterClass(utf8Char_t c) {
+  value_t *charClass = hattrie_get(utf8Char2class, c.c, strlen(c.c));
+  if (!charClass) throw ParserException("Hat-Trie failure");
+  if (!*charClass) {
+    *charClass = findClassSetClass(classifier->getClassSet(c)) + 1;
+  }
+  return *charClass - 1;
+}
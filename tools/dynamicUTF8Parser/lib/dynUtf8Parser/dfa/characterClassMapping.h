@@ -0,0 +1,137 @@
+#ifndef DFA_CHARACTER_CLASS_MAPPING_H
+#define DFA_CHARACTER_CLASS_MAPPING_H
+
+#include "dynUtf8Parser/dfa/nfaStateMapping.h"
+
+class CompiledGrammar;
+
+namespace DeterministicFiniteAutomaton {
+
+  /// \brief The CharacterClassMapping class maps UTF8 characters to
+  /// the small dense character class numbers used to index the
+  /// transition slots of each StateRecord.
+  ///
+  /// An NFA can only distinguish UTF8 characters using its
+  /// NFA::Character literals and the Classifier::classSet_t(s) of its
+  /// NFA::ClassSet states. Two UTF8 characters belong to the same
+  /// character class (alphabet equivalence class) if no NFA::State
+  /// can tell them apart. Each NFA::Character literal is its own
+  /// character class, while all other UTF8 characters are grouped by
+  /// which of the NFA's NFA::ClassSet states their class set
+  /// matches.
+  ///
+  /// The character classes are computed when the mapping is created
+  /// (when the Parser is compiled). ASCII characters are then mapped
+  /// using a direct lookup table, all other UTF8 characters are
+  /// mapped (and cached) using the [Hat-Trie
+  /// library](https://github.com/dcjones/hat-trie).
+  class CharacterClassMapping {
+    public:
+
+      /// \brief Create the CharacterClassMapping for the (already
+      /// built) NFA.
+      CharacterClassMapping(NFA *anNFA);
+
+      /// \brief Destroy the CharacterClassMapping.
+      ~CharacterClassMapping(void);
+
+      /// \brief Return the character class of the UTF8 character c.
+      size_t getCharacterClass(utf8Char_t c) {
+        if ((c.c[1] == 0) && ((uint8_t)c.c[0] < numAsciiChars)) {
+          return asciiClasses[(uint8_t)c.c[0]];
+        }
+        return findCharacterClass(c);
+      }
+
+      /// \brief Return the number of character classes.
+      size_t getNumCharacterClasses(void) {
+        return numCharacterClasses;
+      }
+
+      /// \brief Return a UTF8 character which is a member of the
+      /// character class.
+      ///
+      /// The representative character of a class which contains no
+      /// NFA::Character literal is the NUL character, which never
+      /// matches any NFA::Character literal.
+      utf8Char_t getRepresentativeChar(size_t charClass) {
+        utf8Char_t result;
+        result.u = representativeChars.getItem(charClass, 0);
+        return result;
+      }
+
+      /// \brief Return the class set of a UTF8 character which is a
+      /// member of the character class.
+      Classifier::classSet_t getRepresentativeClassSet(size_t charClass) {
+        return representativeClassSets.getItem(charClass, 0);
+      }
+
+    protected:
+
+      /// \brief The number of (single byte) ASCII characters mapped
+      /// by the asciiClasses lookup table.
+      static const size_t numAsciiChars = 128;
+
+      /// \brief Walk every NFA::State reachable from the NFA's start
+      /// states, collecting the NFA::ClassSet class sets and
+      /// assigning a character class to each NFA::Character literal.
+      void collectMatchData(NFA *anNFA);
+
+      /// \brief Return true if no NFA::ClassSet state can distinguish
+      /// between the two class sets.
+      bool sameClassSetBehaviour(Classifier::classSet_t aClassSet,
+                                 Classifier::classSet_t otherClassSet);
+
+      /// \brief Find (or assign) the character class of all non
+      /// literal UTF8 characters with the class set aClassSet.
+      size_t findClassSetClass(Classifier::classSet_t aClassSet);
+
+      /// \brief Assign a new character class with the given
+      /// representative character and class set.
+      size_t addCharacterClass(utf8Char_t aChar,
+                               Classifier::classSet_t aClassSet);
+
+      /// \brief Find (and cache) the character class of the non-ASCII
+      /// UTF8 character c.
+      size_t findCharacterClass(utf8Char_t c);
+
+      /// \brief The Classifier used by the NFA.
+      Classifier *classifier;
+
+      /// \brief The direct lookup table for ASCII characters.
+      size_t asciiClasses[numAsciiChars];
+
+      /// \brief The Hat-Trie based mapping of all other UTF8
+      /// characters to one *more* than their character class.
+      ///
+      /// This mapping is seeded with the NFA::Character literals, all
+      /// other UTF8 characters are added the first time they are
+      /// seen.
+      hattrie_t *utf8Char2class;
+
+      /// \brief The distinct class sets used by the NFA's
+      /// NFA::ClassSet states.
+      VarArray<Classifier::classSet_t> nfaClassSets;
+
+      /// \brief The character classes which contain no NFA::Character
+      /// literal.
+      VarArray<size_t> classSetClasses;
+
+      /// \brief The representative UTF8 character (as a uint64_t) of
+      /// each character class.
+      VarArray<uint64_t> representativeChars;
+
+      /// \brief The representative class set of each character
+      /// class.
+      VarArray<Classifier::classSet_t> representativeClassSets;
+
+      /// \brief The number of character classes assigned so far.
+      size_t numCharacterClasses;
+
+      /// Allow complete access when saving or loading compiled grammars.
+      friend class ::CompiledGrammar;
+
+  }; // class CharacterClassMapping
+};  // namespace DeterministicFiniteAutomaton
+
+#endif
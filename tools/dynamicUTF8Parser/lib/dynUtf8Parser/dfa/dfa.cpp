@@ -14,78 +14,309 @@ using namespace DeterministicFiniteAutomaton;
 DFA::DFA(NFA *anNFA) {
   nfa = anNFA;
   allocator = new StateAllocator(nfa);
-  nextStateMapping = new NextStateMapping(allocator);
+  characterClasses = new CharacterClassMapping(nfa);
+  nextStateMapping =
+    new NextStateMapping(allocator,
+                         characterClasses->getNumCharacterClasses());
+
+  nfaStateBuffer =
+    (NFA::State**)calloc(nfa->getNumberStates() + 1, sizeof(NFA::State*));
 
   numStartStates = nfa->getNumberStartStates();
-  startState = (State**)calloc(numStartStates, sizeof(State*));
+  startState = (StateRecord**)calloc(numStartStates, sizeof(StateRecord*));
   tokensState =  allocator->allocateANewState(); // get space for the tokensDState
+
+  size_t numNFAStates = nfa->getNumberStates();
+  closureWords     = NULL;
+  numClosureWords  = 0;
+  closureWordsSize = 0;
+  closureStart = (size_t*)calloc(numNFAStates + 1, sizeof(size_t));
+  closureEnd   = (size_t*)calloc(numNFAStates + 1, sizeof(size_t));
+  closureState = allocator->allocateANewState();
+  for (size_t i = 0; i < numNFAStates; i++) {
+    NFA::State *nfaState = nfa->getState(i);
+    switch (nfaState->matchType) {
+      case NFA::Token:
+        allocator->setNFAState(tokensState, nfaState);
+        break;
+      case NFA::Character:
+      case NFA::ClassSet:
+      case NFA::ReStart:
+        // precompute the epsilon closures of every transition's target
+        if (nfaState->out && !closureEnd[nfaState->out->id]) {
+          computeEpsilonClosure(nfaState->out);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  for (size_t i = 0; i < numStartStates; i++) {
+    NFA::State *nfaStartState = nfa->getStartState((NFA::StartStateId)i);
+    if (nfaStartState && !closureEnd[nfaStartState->id]) {
+      computeEpsilonClosure(nfaStartState);
+    }
+  }
+  // the empty DFA::State is the deadState
+  deadState   =  nextStateMapping->registerState(allocator->allocateANewState());
+  nextStateMapping->pinState(deadState);
+  computeFirstSets();
+  cacheBudget   = 0;
+  cacheFlushes  = 0;
+  evictedStates = 0;
+  cacheHits   = 0;
+  cacheMisses = 0;
 };
 
 DFA::~DFA(void) {
   nfa        = NULL;  // we do NOT own the NFA.
   if (nextStateMapping) delete nextStateMapping;
   nextStateMapping = NULL;
+  if (characterClasses) delete characterClasses;
+  characterClasses = NULL;
+
+  if (nfaStateBuffer) free(nfaStateBuffer);
+  nfaStateBuffer = NULL;
+
+  if (closureWords) free(closureWords);
+  closureWords     = NULL;
+  numClosureWords  = 0;
+  closureWordsSize = 0;
+  if (closureStart) free(closureStart);
+  closureStart = NULL;
+  if (closureEnd) free(closureEnd);
+  closureEnd   = NULL;
+  closureState = NULL;
 
   if (startState) free(startState);
   startState     = NULL;
+  if (firstSets) free(firstSets);
+  firstSets        = NULL;
+  numFirstSetWords = 0;
+  if (nullableStartStates) free(nullableStartStates);
+  nullableStartStates = NULL;
   numStartStates = 0;
   tokensState    = NULL;
+  deadState      = NULL;
+  cacheHits      = 0;
+  cacheMisses    = 0;
 
   if (allocator) delete allocator;
   allocator       = NULL;
 }
 
-void DFA::addNFAStateToDFAState(State *dfaState, NFA::State *nfaState) {
-  if (nfaState == NULL) return;
-  allocator->setNFAState(dfaState, nfaState);
-  switch (nfaState->matchType) {
-    case NFA::Token:
-      allocator->setNFAState(tokensState, nfaState);
-      break;
-    case  NFA::Split:
+void DFA::computeEpsilonClosure(NFA::State *nfaState) {
+  // collect the epsilon closure in the (empty) closureState
+  VarArray<NFA::State*> toVisit;
+  toVisit.pushItem(nfaState);
+  while (toVisit.getNumItems()) {
+    NFA::State *curState = toVisit.popItem();
+    if (!curState) continue;
+    if (allocator->hasNFAState(closureState, curState)) continue;
+    allocator->setNFAState(closureState, curState);
+    if (curState->matchType == NFA::Split) {
       /* follow unlabeled arrows */
-      addNFAStateToDFAState(dfaState, nfaState->out);
-      addNFAStateToDFAState(dfaState, nfaState->out1);
-      break;
-    default:
-      break;
+      toVisit.pushItem(curState->out1);
+      toVisit.pushItem(curState->out);
+    }
   }
+
+  // now record the non-zero words of the closureState
+  uint64_t *closureStateWords = (uint64_t*)closureState;
+  size_t numStateWords = allocator->getStateSize() / sizeof(uint64_t);
+  closureStart[nfaState->id] = numClosureWords;
+  for (size_t i = 0; i < numStateWords; i++) {
+    if (!closureStateWords[i]) continue;
+    if (closureWordsSize <= numClosureWords) {
+      size_t newSize = 2*closureWordsSize;
+      if (newSize < numStateWords) newSize = numStateWords;
+      ClosureWord *newWords =
+        (ClosureWord*)realloc(closureWords, newSize*sizeof(ClosureWord));
+      if (!newWords) throw ParserException("Out of memory");
+      closureWords     = newWords;
+      closureWordsSize = newSize;
+    }
+    closureWords[numClosureWords].word = i;
+    closureWords[numClosureWords].bits = closureStateWords[i];
+    numClosureWords++;
+    closureStateWords[i] = 0;
+  }
+  closureEnd[nfaState->id] = numClosureWords;
 }
 
-State *DFA::getDFAStartState(NFA::StartStateId startStateId) {
+StateRecord *DFA::getDFAStartState(NFA::StartStateId startStateId) {
   if (numStartStates <= startStateId) return NULL;
   if (!startState[startStateId]) {
     // we have not previously computed this startState... so compute it now
-    startState[startStateId] = allocator->allocateANewState();
-    addNFAStateToDFAState(startState[startStateId],
-                          nfa->getStartState(startStateId));
-    nextStateMapping->registerState(startState[startStateId]);
+    State *newStartState = allocator->allocateANewState();
+    addNFAStateToDFAState(newStartState, nfa->getStartState(startStateId));
+    startState[startStateId] = registerState(newStartState);
+    nextStateMapping->pinState(startState[startStateId]);
   }
   return startState[startStateId];
 }
 
-State *DFA::computeNextDFAState(State *curDFAState,
-                                utf8Char_t c,
-                                Classifier::classSet_t classificationSet) {
-  NFA::State *nfaState;
+StateRecord *DFA::getDFAStateFromNFAState(NFA::State *nfaState) {
+  State *dfaState = allocator->allocateANewState();
+  addNFAStateToDFAState(dfaState, nfaState->out);
+  addNFAStateToDFAState(dfaState, nfaState->out1);
+  return registerState(dfaState);
+}
 
-  State *nextGenericDFAState;
-  nextGenericDFAState = allocator->allocateANewState();
+void DFA::computeStateMetadata(StateRecord *stateRecord) {
+  VarArray<NFA::State*> reStarts;
+  bool hasCharTransitions = false;
+  NFAStateIterator iterator = allocator->newIteratorOn(stateRecord->state);
+  while (NFA::State *nfaState = iterator.nextState()) {
+    if ((nfaState->matchType == NFA::Character) ||
+        (nfaState->matchType == NFA::ClassSet)) hasCharTransitions = true;
+    if (nfaState->matchType != NFA::ReStart) continue;
+    // only the first ReStart NFA::State for each start state id is
+    // ever tried by the PushDownMachine
+    bool alreadyFound = false;
+    for (size_t i = 0; i < reStarts.getNumItems(); i++) {
+      if (reStarts.getItem(i, NULL)->matchData.r == nfaState->matchData.r) {
+        alreadyFound = true;
+        break;
+      }
+    }
+    if (!alreadyFound) reStarts.pushItem(nfaState);
+  }
+  NFA::State *tokenState =
+    allocator->stateMatchesToken(stateRecord->state, tokensState);
+  if (tokenState && (tokenState->matchType != NFA::Token)) tokenState = NULL;
+  nextStateMapping->setStateMetadata(stateRecord, &reStarts, tokenState,
+                                     hasCharTransitions);
+}
 
-  State *nextSpecificDFAState;
-  nextSpecificDFAState = allocator->allocateANewState();
+void DFA::computeFirstSets(void) {
+  numFirstSetWords = (characterClasses->getNumCharacterClasses() + 63) / 64;
+  firstSets = (uint64_t*)calloc(numStartStates*numFirstSetWords + 1,
+                                sizeof(uint64_t));
+  nullableStartStates = (bool*)calloc(numStartStates + 1, sizeof(bool));
+  if (!firstSets || !nullableStartStates) {
+    throw ParserException("Out of memory");
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t i = 0; i < numStartStates; i++) {
+      if (addFirstSetOf((NFA::StartStateId)i)) changed = true;
+    }
+  }
+}
 
-  NFAStateIterator nfaStateIter = allocator->newIteratorOn(curDFAState);
-  while (NFA::State *nfaState = nfaStateIter.nextState()) {
+bool DFA::addFirstSetOf(NFA::StartStateId startStateId) {
+  NFA::State *nfaStartState = nfa->getStartState(startStateId);
+  if (!nfaStartState) return false;
+  size_t numClasses = characterClasses->getNumCharacterClasses();
+  uint64_t *firstSet = firstSets + startStateId*numFirstSetWords;
+  bool nullable = nullableStartStates[startStateId];
+  bool changed  = false;
+
+  // walk the NFA::States which could consume the first character
+  // (using the, empty, closureState to record the visited NFA::States)
+  State *visited = closureState;
+  VarArray<NFA::State*> toVisit;
+  toVisit.pushItem(nfaStartState);
+  while (toVisit.getNumItems()) {
+    NFA::State *curState = toVisit.popItem();
+    if (!curState) continue;
+    if (allocator->hasNFAState(visited, curState)) continue;
+    allocator->setNFAState(visited, curState);
+    switch (curState->matchType) {
+      case NFA::Split:
+        toVisit.pushItem(curState->out1);
+        toVisit.pushItem(curState->out);
+        break;
+      case NFA::Character: {
+        size_t charClass =
+          characterClasses->getCharacterClass(curState->matchData.c);
+        uint64_t bit = ((uint64_t)1) << (charClass % 64);
+        if (!(firstSet[charClass / 64] & bit)) {
+          firstSet[charClass / 64] |= bit;
+          changed = true;
+        }
+        break;
+      }
+      case NFA::ClassSet:
+        for (size_t charClass = 0; charClass < numClasses; charClass++) {
+          if (!(curState->matchData.s &
+                characterClasses->getRepresentativeClassSet(charClass))) {
+            continue;
+          }
+          uint64_t bit = ((uint64_t)1) << (charClass % 64);
+          if (!(firstSet[charClass / 64] & bit)) {
+            firstSet[charClass / 64] |= bit;
+            changed = true;
+          }
+        }
+        break;
+      case NFA::ReStart: {
+        NFA::StartStateId reStartId = curState->matchData.r;
+        if (numStartStates <= reStartId) break;
+        uint64_t *reStartSet = firstSets + reStartId*numFirstSetWords;
+        for (size_t i = 0; i < numFirstSetWords; i++) {
+          if (reStartSet[i] & ~firstSet[i]) {
+            firstSet[i] |= reStartSet[i];
+            changed = true;
+          }
+        }
+        // a nullable rule may be followed by its continuation's
+        // first character
+        if (nullableStartStates[reStartId]) {
+          toVisit.pushItem(curState->out1);
+          toVisit.pushItem(curState->out);
+        }
+        break;
+      }
+      case NFA::Token:
+        nullable = true;
+        break;
+      default:
+        break;
+    }
+  }
+  allocator->emptyState(visited);
+
+  if (nullable != nullableStartStates[startStateId]) {
+    nullableStartStates[startStateId] = nullable;
+    changed = true;
+  }
+  return changed;
+}
+
+StateRecord *DFA::registerState(State *newState) {
+  StateRecord *stateRecord = nextStateMapping->registerState(newState);
+  if (stateRecord->state != newState) {
+    // This DFA::State is a copy of an already registered DFA::State
+    // so it is no longer needed
+    allocator->unallocateState(newState);
+  }
+  return stateRecord;
+}
+
+StateRecord *DFA::computeNextDFAState(StateRecord *curState,
+                                      size_t charClass) {
+  utf8Char_t c = characterClasses->getRepresentativeChar(charClass);
+  Classifier::classSet_t classificationSet =
+    characterClasses->getRepresentativeClassSet(charClass);
+  State *nextDFAState = allocator->allocateANewState();
+
+  NFAStateIterator nfaStateIter = allocator->newIteratorOn(curState->state);
+  size_t numNFAStates =
+    nfaStateIter.nextStates(nfaStateBuffer, nfa->getNumberStates());
+  for (size_t i = 0; i < numNFAStates; i++) {
+    NFA::State *nfaState = nfaStateBuffer[i];
     switch (nfaState->matchType) {
       case NFA::Character:
         if (nfaState->matchData.c.u == c.u) {
-          addNFAStateToDFAState(nextSpecificDFAState, nfaState->out);
+          addNFAStateToDFAState(nextDFAState, nfaState->out);
         }
         break;
       case NFA::ClassSet:
         if (nfaState->matchData.s & classificationSet) {
-          addNFAStateToDFAState(nextGenericDFAState, nfaState->out);
+          addNFAStateToDFAState(nextDFAState, nfaState->out);
         }
         break;
       default:
@@ -94,69 +325,305 @@ State *DFA::computeNextDFAState(State *curDFAState,
     }
   }
 
-  State **specificNextState = NULL;
-  State **genericNextState = NULL;
-  // now check if we need to store the specific nextDFAState
-  if (allocator->isSubStateOf(nextSpecificDFAState, nextGenericDFAState) ||
-      allocator->isStateEmpty(nextSpecificDFAState)) {
-    // since the specific DFA::State is a subState of the generic
-    // and since we will register the generic DFA::State we do not
-    // need to do anything more this specific DFA::State is no longer
-    // needed
-    allocator->unallocateState(nextSpecificDFAState);
-  } else {
-    // the specific DFA::State is NOT a substate of the generic
-    // DFA::State so we want to store the specific state as well and
-    // return it
-    specificNextState =
-      nextStateMapping->getNextStateByCharacter(curDFAState, c);
-    ASSERT(specificNextState); // Hat-Trie error
-    // merge the generic states into the specific...
-    allocator->mergeStateWith(nextSpecificDFAState, nextGenericDFAState);
-    // ensure we use the registered DFA::State if any...
-    *specificNextState =
-      nextStateMapping->registerState(nextSpecificDFAState);
-    if (*specificNextState != nextSpecificDFAState) {
-      // This specific DFA::State is a copy of the already registered
-      // DFA::State so it is no longer needed
-      allocator->unallocateState(nextSpecificDFAState);
-    }
-  }
-  if (allocator->isStateEmpty(nextGenericDFAState)) {
-    // the generic state is empty so we do not store it
-    allocator->unallocateState(nextGenericDFAState);
-  } else {
-    // there is a next generic DFA::State...
-    // SO ...
-    // always store the generic (classification based) nextGenericDFAState
-    genericNextState =
-      nextStateMapping->getNextStateByClass(curDFAState, classificationSet);
-    ASSERT(genericNextState); // Hat-Trie error
-    // ensure we use the registered DFA::State if any...
-    *genericNextState =
-      nextStateMapping->registerState(nextGenericDFAState);
-    if (*genericNextState != nextGenericDFAState) {
-      // This generic DFA::State is a copy of the already registered
-      // DFA::Sstate so it is no longer needed
-      allocator->unallocateState(nextGenericDFAState);
-      // ensure nextGenericDFAState is a valid DFA::State
-      // and the one used in the map
-      nextGenericDFAState = *genericNextState;
-    }
-  }
-  if (specificNextState && *specificNextState) return *specificNextState;
-  if (genericNextState  && *genericNextState)  return *genericNextState;
-  return NULL;
+  // ensure we use the registered DFA::State if any...
+  // (an empty nextDFAState registers as the deadState)
+  StateRecord *nextState = registerState(nextDFAState);
+
+  // now record this transition so that we never need to compute it again
+  nextStateMapping->setNextState(curState, charClass, nextState);
+
+  if (nextState == deadState) return NULL;
+  return nextState;
+}
+
+size_t DFA::flushCache(VarArray<StateRecord*> *liveRecords) {
+  size_t numEvicted = nextStateMapping->evictStates(liveRecords);
+  cacheFlushes++;
+  evictedStates += numEvicted;
+  return numEvicted;
+}
+
+bool DFA::stateContainsReStart(State *dfaState) {
+  NFAStateIterator nfaStateIter = allocator->newIteratorOn(dfaState);
+  while (NFA::State *nfaState = nfaStateIter.nextState()) {
+    if (nfaState->matchType == NFA::ReStart) return true;
+  }
+  return false;
+}
+
+void DFA::compileEagerly(void) {
+  if (eagerCompileReports.getNumItems()) return; // already compiled
+  for (size_t i = 0; i < numStartStates; i++) {
+    eagerCompileReports.pushItem(
+      compileStartStateEagerly((NFA::StartStateId)i));
+  }
 }
 
-/* Run DFA to determine whether it matches s. */
-State *DFA::getNextDFAState(State *curDFAState,
-                            utf8Char_t curChar) {
-  State *nextDFAState = NULL;
-  // try to find an already computed nextDFAState using the more general
-  // character classification.
-  Classifier::classSet_t classificationSet =
-    nfa->getClassifier()->getClassSet(curChar);
-  // now explicitly compute a new nextDFAState
-  return computeNextDFAState(curDFAState, curChar, classificationSet);
+void DFA::printEagerCompileReportsOn(FILE *outFile) {
+  fprintf(outFile, "DFA eager compilation (%zu start states)\n",
+          eagerCompileReports.getNumItems());
+  for (size_t i = 0; i < eagerCompileReports.getNumItems(); i++) {
+    EagerCompileReport report = getEagerCompileReport((NFA::StartStateId)i);
+    if (report.compiled) {
+      fprintf(outFile, "  start state %zu: %zu states minimized to %zu\n",
+              (size_t)report.startStateId,
+              report.numStates, report.numMinimizedStates);
+    } else {
+      fprintf(outFile, "  start state %zu: lazy (contains ReStart states)\n",
+              (size_t)report.startStateId);
+    }
+  }
+}
+
+EagerCompileReport DFA::compileStartStateEagerly(NFA::StartStateId startStateId) {
+  EagerCompileReport report;
+  report.startStateId       = startStateId;
+  report.compiled           = false;
+  report.numStates          = 0;
+  report.numMinimizedStates = 0;
+
+  StateRecord *startRecord = getDFAStartState(startStateId);
+  if (!startRecord || stateContainsReStart(startRecord->state)) return report;
+  report.compiled = true;
+  size_t numClasses = characterClasses->getNumCharacterClasses();
+
+  // (1) subset construction of all StateRecords reachable from the
+  // startRecord. The localIndex (indexed by StateRecord id) is one
+  // *more* than each reachable StateRecord's index in records.
+  VarArray<StateRecord*> records;
+  size_t localIndexSize = nextStateMapping->getNumStateRecords() + 1;
+  size_t *localIndex = (size_t*)calloc(localIndexSize, sizeof(size_t));
+  if (!localIndex) throw ParserException("Out of memory");
+  records.pushItem(startRecord);
+  localIndex[startRecord->id] = records.getNumItems();
+  if (!localIndex[deadState->id]) {
+    records.pushItem(deadState);
+    localIndex[deadState->id] = records.getNumItems();
+  }
+  for (size_t i = 0; i < records.getNumItems(); i++) {
+    StateRecord *curRecord = records.getItem(i, NULL);
+    if (curRecord == deadState) continue;
+    if (stateContainsReStart(curRecord->state)) continue; // remains lazy
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      StateRecord *nextRecord =
+        nextStateMapping->getNextState(curRecord, charClass);
+      if (!nextRecord) {
+        computeNextDFAState(curRecord, charClass);
+        nextRecord = nextStateMapping->getNextState(curRecord, charClass);
+      }
+      if (localIndexSize <= nextRecord->id) {
+        size_t newSize = 2*localIndexSize;
+        if (newSize <= nextRecord->id) newSize = nextRecord->id + 1;
+        size_t *newIndex = (size_t*)realloc(localIndex, newSize*sizeof(size_t));
+        if (!newIndex) {
+          free(localIndex);
+          throw ParserException("Out of memory");
+        }
+        memset(newIndex + localIndexSize, 0,
+               (newSize - localIndexSize)*sizeof(size_t));
+        localIndex     = newIndex;
+        localIndexSize = newSize;
+      }
+      if (!localIndex[nextRecord->id]) {
+        records.pushItem(nextRecord);
+        localIndex[nextRecord->id] = records.getNumItems();
+      }
+    }
+  }
+  size_t numRecords = records.getNumItems();
+  report.numStates  = numRecords;
+
+  // (2) collect the (local) transitions of every expanded StateRecord
+  // together with the (inverse) predecessors of each StateRecord
+  // indexed by (charClass, StateRecord)
+  bool   *expanded    = (bool*)calloc(numRecords, sizeof(bool));
+  size_t *successors  = (size_t*)calloc(numRecords*numClasses, sizeof(size_t));
+  size_t *predStart   = (size_t*)calloc(numRecords*numClasses + 1, sizeof(size_t));
+  size_t *predecessors= (size_t*)calloc(numRecords*numClasses + 1, sizeof(size_t));
+  // the partition of the StateRecords into blocks
+  size_t *elements    = (size_t*)calloc(numRecords, sizeof(size_t));
+  size_t *position    = (size_t*)calloc(numRecords, sizeof(size_t));
+  size_t *blockOf     = (size_t*)calloc(numRecords, sizeof(size_t));
+  size_t *blockStart  = (size_t*)calloc(numRecords, sizeof(size_t));
+  size_t *blockEnd    = (size_t*)calloc(numRecords, sizeof(size_t));
+  size_t *blockMarked = (size_t*)calloc(numRecords, sizeof(size_t));
+  bool   *inWorkList  = (bool*)calloc(numRecords*numClasses, sizeof(bool));
+  StateRecord **blockRecord =
+    (StateRecord**)calloc(numRecords, sizeof(StateRecord*));
+  // (the localIndex and every one of these arrays are freed together)
+  void *workArrays[] = {
+    localIndex, expanded, successors, predStart, predecessors,
+    elements, position, blockOf, blockStart, blockEnd,
+    blockMarked, inWorkList, blockRecord
+  };
+  size_t numWorkArrays = sizeof(workArrays)/sizeof(void*);
+  for (size_t i = 0; i < numWorkArrays; i++) {
+    if (workArrays[i]) continue;
+    for (size_t j = 0; j < numWorkArrays; j++) {
+      if (workArrays[j]) free(workArrays[j]);
+    }
+    throw ParserException("Out of memory");
+  }
+
+  for (size_t i = 0; i < numRecords; i++) {
+    StateRecord *curRecord = records.getItem(i, NULL);
+    if (curRecord == deadState) continue;
+    if (stateContainsReStart(curRecord->state)) continue;
+    expanded[i] = true;
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      size_t nextIndex =
+        localIndex[nextStateMapping->getNextState(curRecord, charClass)->id] - 1;
+      successors[i*numClasses + charClass] = nextIndex;
+      predStart[charClass*numRecords + nextIndex + 1]++;
+    }
+  }
+  for (size_t i = 0; i < numRecords*numClasses; i++) {
+    predStart[i+1] += predStart[i];
+  }
+  // fill in the predecessors advancing each predStart as we go
+  for (size_t i = 0; i < numRecords; i++) {
+    if (!expanded[i]) continue;
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      size_t predIndex =
+        charClass*numRecords + successors[i*numClasses + charClass];
+      predecessors[predStart[predIndex]++] = i;
+    }
+  }
+  // each predStart has now been advanced to its successor's start
+  for (size_t i = numRecords*numClasses; 0 < i; i--) {
+    predStart[i] = predStart[i-1];
+  }
+  predStart[0] = 0;
+
+  // (3) the initial partition groups the expanded StateRecords (and
+  // the deadState) by the NFA::Token they recognize, every other
+  // StateRecord is placed in its own block.
+  VarArray<NFA::State*> groupTokens;
+  VarArray<size_t>      groupBlocks;
+  size_t numBlocks = 0;
+  for (size_t i = 0; i < numRecords; i++) {
+    StateRecord *curRecord = records.getItem(i, NULL);
+    if (!expanded[i] && (curRecord != deadState)) {
+      blockOf[i] = numBlocks++;
+      continue;
+    }
+    NFA::State *tokenState =
+      allocator->stateMatchesToken(curRecord->state, tokensState);
+    size_t group = 0;
+    for (; group < groupTokens.getNumItems(); group++) {
+      if (groupTokens.getItem(group, NULL) == tokenState) break;
+    }
+    if (group == groupTokens.getNumItems()) {
+      groupTokens.pushItem(tokenState);
+      groupBlocks.pushItem(numBlocks++);
+    }
+    blockOf[i] = groupBlocks.getItem(group, 0);
+  }
+  // lay out the blocks (in order) in the elements array
+  for (size_t i = 0; i < numRecords; i++) blockEnd[blockOf[i]]++;
+  for (size_t block = 0, start = 0; block < numBlocks; block++) {
+    blockStart[block] = start;
+    start += blockEnd[block];
+    blockEnd[block] = blockStart[block];
+  }
+  for (size_t i = 0; i < numRecords; i++) {
+    size_t block = blockOf[i];
+    position[i] = blockEnd[block]++;
+    elements[position[i]] = i;
+  }
+
+  // (4) Hopcroft's partition refinement using (block, charClass)
+  // splitters
+  VarArray<size_t> workList;
+  for (size_t block = 0; block < numBlocks; block++) {
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      workList.pushItem(block*numClasses + charClass);
+      inWorkList[block*numClasses + charClass] = true;
+    }
+  }
+  VarArray<size_t> splitterPreds;
+  VarArray<size_t> touchedBlocks;
+  while (workList.getNumItems()) {
+    size_t splitter = workList.popItem();
+    inWorkList[splitter] = false;
+    size_t splitterBlock = splitter / numClasses;
+    size_t charClass     = splitter % numClasses;
+
+    // collect the predecessors of the splitter block
+    while (splitterPreds.getNumItems()) splitterPreds.popItem();
+    for (size_t p = blockStart[splitterBlock]; p < blockEnd[splitterBlock]; p++) {
+      size_t predIndex = charClass*numRecords + elements[p];
+      for (size_t e = predStart[predIndex]; e < predStart[predIndex+1]; e++) {
+        splitterPreds.pushItem(predecessors[e]);
+      }
+    }
+
+    // mark the predecessors by moving them to the front of their block
+    for (size_t j = 0; j < splitterPreds.getNumItems(); j++) {
+      size_t pred  = splitterPreds.getItem(j, 0);
+      size_t block = blockOf[pred];
+      size_t firstUnmarked = blockStart[block] + blockMarked[block];
+      if (position[pred] < firstUnmarked) continue; // already marked
+      size_t other = elements[firstUnmarked];
+      elements[position[pred]] = other;
+      position[other]          = position[pred];
+      elements[firstUnmarked]  = pred;
+      position[pred]           = firstUnmarked;
+      if (!blockMarked[block]++) touchedBlocks.pushItem(block);
+    }
+
+    // split each touched block into its marked and unmarked parts
+    while (touchedBlocks.getNumItems()) {
+      size_t block     = touchedBlocks.popItem();
+      size_t numMarked = blockMarked[block];
+      blockMarked[block] = 0;
+      if (numMarked == blockEnd[block] - blockStart[block]) continue;
+      size_t newBlock = numBlocks++;
+      blockStart[newBlock] = blockStart[block];
+      blockEnd[newBlock]   = blockStart[block] + numMarked;
+      blockStart[block]    = blockEnd[newBlock];
+      for (size_t p = blockStart[newBlock]; p < blockEnd[newBlock]; p++) {
+        blockOf[elements[p]] = newBlock;
+      }
+      size_t smallerBlock = newBlock;
+      if ((blockEnd[block] - blockStart[block]) < numMarked) {
+        smallerBlock = block;
+      }
+      for (size_t cc = 0; cc < numClasses; cc++) {
+        size_t addBlock = smallerBlock;
+        if (inWorkList[block*numClasses + cc]) addBlock = newBlock;
+        if (inWorkList[addBlock*numClasses + cc]) continue;
+        workList.pushItem(addBlock*numClasses + cc);
+        inWorkList[addBlock*numClasses + cc] = true;
+      }
+    }
+  }
+  report.numMinimizedStates = numBlocks;
+
+  // (eagerly compiled StateRecords are never evicted)
+  for (size_t i = 0; i < numRecords; i++) {
+    nextStateMapping->pinState(records.getItem(i, NULL));
+  }
+
+  // (5) choose the representative StateRecord of each block, the
+  // deadState (so that dead transitions remain dead) and then the
+  // startRecord taking precedence over the earliest reached
+  // StateRecord.
+  blockRecord[blockOf[localIndex[deadState->id] - 1]] = deadState;
+  if (!blockRecord[blockOf[0]]) blockRecord[blockOf[0]] = startRecord;
+  for (size_t i = 0; i < numRecords; i++) {
+    if (!blockRecord[blockOf[i]]) blockRecord[blockOf[i]] = records.getItem(i, NULL);
+  }
+  // and redirect every expanded transition to its representative
+  for (size_t i = 0; i < numRecords; i++) {
+    if (!expanded[i]) continue;
+    StateRecord *curRecord = records.getItem(i, NULL);
+    for (size_t charClass = 0; charClass < numClasses; charClass++) {
+      nextStateMapping->setNextState(curRecord, charClass,
+        blockRecord[blockOf[successors[i*numClasses + charClass]]]);
+    }
+  }
+
+  for (size_t i = 0; i < numWorkArrays; i++) free(workArrays[i]);
+  return report;
 }
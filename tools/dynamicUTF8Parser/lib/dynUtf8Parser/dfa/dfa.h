@@ -3,10 +3,45 @@
 
 #include "dynUtf8Parser/dfa/nextStateMapping.h"
 
+class CompiledGrammar;
+
 /// \brief The DFA namespace collects the various parts of the DFA
 /// interpreter into one logical collection.
 namespace DeterministicFiniteAutomaton {
 
+  /// \brief A ClosureWord is one non-zero 64 bit word of the
+  /// (precomputed) epsilon closure bit set of an NFA::State.
+  ///
+  /// The bits are stored in DFA::State memory order, so a closure is
+  /// added to a DFA::State by OR-ing each ClosureWord's bits into the
+  /// DFA::State's word at the given index.
+  typedef struct ClosureWord {
+    /// \brief The index of the 64 bit word in the DFA::State bit set.
+    size_t word;
+
+    /// \brief The bits of the epsilon closure in this word.
+    uint64_t bits;
+  } ClosureWord;
+
+  /// \brief An EagerCompileReport records the outcome of eagerly
+  /// compiling (and minimizing) the DFA for one NFA start state.
+  typedef struct EagerCompileReport {
+    /// \brief The NFA::StartStateId of the start state.
+    NFA::StartStateId startStateId;
+
+    /// \brief True if the start state was eagerly compiled, false if
+    /// it contains NFA::ReStart states (and so remains lazy).
+    bool compiled;
+
+    /// \brief The number of StateRecords (including the deadState)
+    /// reachable from the start state before minimization.
+    size_t numStates;
+
+    /// \brief The number of distinguishable StateRecords which
+    /// remain after minimization.
+    size_t numMinimizedStates;
+  } EagerCompileReport;
+
   /// \brief The DFA class is used to interpret a given NFA.
   ///
   /// Directly inrepreting a given NFA typically requires backtracking
@@ -41,69 +76,255 @@ namespace DeterministicFiniteAutomaton {
 
       /// \brief Add the NFA::State to the DFA::State bit set by
       /// following unlabeled (NFA::Split) transitions.
-      void addNFAStateToDFAState(State *dfaState, NFA::State *nfaState);
+      ///
+      /// The epsilon closure of the NFA::State is computed (at most)
+      /// once, and is then added using word-wide ORs.
+      void addNFAStateToDFAState(State *dfaState, NFA::State *nfaState) {
+        if (nfaState == NULL) return;
+        if (!closureEnd[nfaState->id]) computeEpsilonClosure(nfaState);
+        uint64_t *dfaWords = (uint64_t*)dfaState;
+        ClosureWord *closureWord    = closureWords + closureStart[nfaState->id];
+        ClosureWord *closureWordEnd = closureWords + closureEnd[nfaState->id];
+        for (; closureWord < closureWordEnd; closureWord++) {
+          dfaWords[closureWord->word] |= closureWord->bits;
+        }
+      }
 
-      /// \brief Compute the initial DFA::State bit set for the NFA
-      /// start state associated with the given startStateName.
+      /// \brief Compute the initial DFA::State for the NFA start state
+      /// associated with the given startStateName.
       ///
       /// The DFA::State start state is the bit set of all NFA::State(s)
       /// reachable from the give NFA StartState by following unlabeled
       /// (NFA::Split) transitions.
-      State *getDFAStartState(const char *startStateName) {
+      StateRecord *getDFAStartState(const char *startStateName) {
         return getDFAStartState(nfa->findStartStateId(startStateName));
       }
 
-      /// \brief Compute the initial DFA::State bit set for the NFA
-      /// start state.
+      /// \brief Compute the initial DFA::State for the NFA start
+      /// state.
       ///
       /// The DFA::State start state is the bit set of all NFA::State(s)
       /// reachable from the give NFA StartState by following unlabeled
       /// (NFA::Split) transitions.
-      State *getDFAStartState(NFA::State *startStatePtr) {
+      StateRecord *getDFAStartState(NFA::State *startStatePtr) {
         return getDFAStartState(nfa->findStartStateId(startStatePtr));
       }
 
-      /// \brief Compute the initial DFA::State bit set for the NFA
-      /// start state NFA::StartStateId, startStateId.
+      /// \brief Compute the initial DFA::State for the NFA start
+      /// state NFA::StartStateId, startStateId.
       ///
       /// The DFA::State start state is the bit set of all NFA::State(s)
       /// reachable from the give NFA StartState by following unlabeled
       /// (NFA::Split) transitions.
-      State *getDFAStartState(NFA::StartStateId startStateId);
-
-      /// \brief Return the DFA::State which represents the single
-      /// NFA::State provided.
-      State *getDFAStateFromNFAState(NFA::State *nfaState) {
-        State *dfaState = allocator->allocateANewState();
-        addNFAStateToDFAState(dfaState, nfaState->out);
-        addNFAStateToDFAState(dfaState, nfaState->out1);
-        return dfaState;
-      }
-
-      /// \brief Find or compute the next DFA::State given a
-      /// utf8Char_t character or a Classifier::classSet_t.
-      ///
-      /// Start by trying to use the nextDFAStateMap to find the next
-      /// DFA::State corresponding to either a specific
-      /// DFA::State/utf8Char_t or generic
-      /// DFA::State/Classifier::classSet_t combination.
-      ///
-      /// If no such (pre-compiled) next DFA::State can be found in the
-      /// existing mapping, step the NFA from the states in the
-      /// DFA::State, oldState, bit set using the transitions across
-      /// either the UTF8 character, c, or the Classifier::classSet_t,
-      /// classifiactionSet, creating and registering a new DFA::State
-      /// bit set.
-      State *computeNextDFAState(State *oldState,
-                                  utf8Char_t c,
-                                  Classifier::classSet_t classificationSet);
+      StateRecord *getDFAStartState(NFA::StartStateId startStateId);
+
+      /// \brief Return the (registered) DFA::State which represents
+      /// the successors of the single NFA::State provided.
+      StateRecord *getDFAStateFromNFAState(NFA::State *nfaState);
+
+      /// \brief Compute the next DFA::State given a character class.
+      ///
+      /// Step the NFA from the states in the DFA::State, curState, bit
+      /// set using the transitions across the UTF8 characters in the
+      /// CharacterClassMapping's character class, charClass, creating
+      /// and registering a new DFA::State bit set. Since no NFA::State
+      /// can distinguish between the members of a character class, the
+      /// class's representative character and class set are used.
+      ///
+      /// The resulting transition is recorded in the curState's
+      /// transition slot for charClass, so that getNextDFAState need
+      /// never compute it again. Missing transitions are recorded
+      /// using the deadState.
+      ///
+      /// Returns NULL is there is no viable next state.
+      StateRecord *computeNextDFAState(StateRecord *curState,
+                                       size_t charClass);
+
+      /// \brief Ensure the PushDownMachine's metadata (the ordered
+      /// ReStart NFA::States and the accepting token) of the
+      /// StateRecord has been computed.
+      ///
+      /// The metadata is computed (at most) once per registered
+      /// DFA::State, so the PushDownMachine never needs to rescan the
+      /// DFA::State bit set.
+      void ensureStateMetadata(StateRecord *stateRecord) {
+        if (!stateRecord->hasMetadata) computeStateMetadata(stateRecord);
+      }
 
       /// \brief Return the next DFA::State (if any) given the current
       /// character.
       ///
+      /// Start by looking in the curState's transition slot for the
+      /// character class of curChar. Only if this transition has not
+      /// yet been computed, use computeNextDFAState.
+      ///
       /// Returns NULL is there is no viable next state.
-      State *getNextDFAState(State *curState,
-                            utf8Char_t curChar);
+      StateRecord *getNextDFAState(StateRecord *curState,
+                                   utf8Char_t curChar) {
+        size_t charClass = characterClasses->getCharacterClass(curChar);
+        StateRecord *nextState =
+          nextStateMapping->getNextState(curState, charClass);
+        if (nextState) {
+          cacheHits++;
+          if (nextState == deadState) return NULL;
+          return nextState;
+        }
+        cacheMisses++;
+        return computeNextDFAState(curState, charClass);
+      }
+
+      /// \brief Eagerly compile the DFA for every NFA start state which
+      /// contains no NFA::ReStart states, recording an
+      /// EagerCompileReport for every start state.
+      ///
+      /// See compileStartStateEagerly. Start states containing
+      /// NFA::ReStart states continue to be compiled lazily.
+      void compileEagerly(void);
+
+      /// \brief Eagerly compile (using subset construction) every
+      /// DFA::State reachable from the start state, and then minimize
+      /// the resulting transitions (using Hopcroft's algorithm).
+      ///
+      /// Minimization redirects every transition to a single
+      /// representative StateRecord of each set of indistinguishable
+      /// StateRecords. StateRecords are indistinguishable if they
+      /// recognize the same NFA::Token and make indistinguishable
+      /// transitions on every character class. DFA::States which
+      /// contain NFA::ReStart states are neither expanded nor merged,
+      /// since the PushDownMachine must inspect them.
+      ///
+      /// Nothing is compiled if the start state itself contains
+      /// NFA::ReStart states.
+      EagerCompileReport compileStartStateEagerly(NFA::StartStateId startStateId);
+
+      /// \brief Return the number of EagerCompileReports recorded by
+      /// compileEagerly.
+      size_t getNumEagerCompileReports(void) {
+        return eagerCompileReports.getNumItems();
+      }
+
+      /// \brief Return the EagerCompileReport recorded by
+      /// compileEagerly for the given NFA::StartStateId.
+      EagerCompileReport getEagerCompileReport(NFA::StartStateId startStateId) {
+        EagerCompileReport noReport;
+        memset(&noReport, 0, sizeof(EagerCompileReport));
+        noReport.startStateId = startStateId;
+        return eagerCompileReports.getItem(startStateId, noReport);
+      }
+
+      /// \brief Print the EagerCompileReports on the FILE provided.
+      void printEagerCompileReportsOn(FILE *outFile);
+
+      /// \brief Return true if the DFA::State contains any NFA::ReStart
+      /// states.
+      bool stateContainsReStart(State *dfaState);
+
+      /// \brief Return true if the rule of the start state,
+      /// startStateId, could match a stream whose next character is
+      /// nextChar (a NULL nextChar marks the end of the stream).
+      ///
+      /// This is true if the rule is nullable, or if the character
+      /// class of nextChar is in the rule's FIRST set. The
+      /// PushDownMachine uses this to avoid trying ReStart NFA::States
+      /// which must fail on their first character.
+      bool mayStartWith(NFA::StartStateId startStateId, utf8Char_t nextChar) {
+        if (numStartStates <= startStateId) return true;
+        if (nullableStartStates[startStateId]) return true;
+        if (!nextChar.c[0]) return false;
+        return firstSetContains(startStateId,
+                                characterClasses->getCharacterClass(nextChar));
+      }
+
+      /// \brief Return true if the character class, charClass, is in
+      /// the FIRST set of the start state, startStateId.
+      bool firstSetContains(NFA::StartStateId startStateId, size_t charClass) {
+        ASSERT(startStateId < numStartStates);
+        ASSERT(charClass < characterClasses->getNumCharacterClasses());
+        uint64_t word =
+          firstSets[startStateId*numFirstSetWords + (charClass / 64)];
+        return (word >> (charClass % 64)) & 1;
+      }
+
+      /// \brief Return true if the rule of the start state,
+      /// startStateId, can match the empty string.
+      bool isNullable(NFA::StartStateId startStateId) {
+        ASSERT(startStateId < numStartStates);
+        return nullableStartStates[startStateId];
+      }
+
+      /// \brief Return the CharacterClassMapping used to index the
+      /// transition slots of this DFA's StateRecords.
+      CharacterClassMapping *getCharacterClasses(void) {
+        return characterClasses;
+      }
+
+      /// \brief Return the number of calls to getNextDFAState which
+      /// were answered from the nextStateMapping.
+      size_t getNumCacheHits(void) {
+        return cacheHits;
+      }
+
+      /// \brief Return the number of calls to getNextDFAState which
+      /// required a call to computeNextDFAState.
+      size_t getNumCacheMisses(void) {
+        return cacheMisses;
+      }
+
+      /// \brief Reset the cache hit, miss, flush and eviction
+      /// counters to zero.
+      void resetCacheStatistics(void) {
+        cacheHits      = 0;
+        cacheMisses    = 0;
+        cacheFlushes   = 0;
+        evictedStates  = 0;
+      }
+
+      /// \brief Limit the (approximate) number of bytes used by the
+      /// registered DFA::States and their transitions to maxBytes.
+      ///
+      /// A zero maxBytes (the default) places no limit on the size of
+      /// the DFA cache. Once the limit has been exceeded, the owner of
+      /// the DFA (typically a PushDownMachine) should call flushCache
+      /// at the next convenient point.
+      void setCacheBudget(size_t maxBytes) {
+        cacheBudget = maxBytes;
+      }
+
+      /// \brief Return the cache budget (zero if unlimited).
+      size_t getCacheBudget(void) {
+        return cacheBudget;
+      }
+
+      /// \brief Return the (approximate) number of bytes used by the
+      /// registered DFA::States and their transitions.
+      size_t getCacheBytes(void) {
+        return nextStateMapping->getCacheBytes();
+      }
+
+      /// \brief Return true if the DFA cache has exceeded its budget.
+      bool isCacheOverBudget(void) {
+        return cacheBudget && (cacheBudget < nextStateMapping->getCacheBytes());
+      }
+
+      /// \brief Flush the DFA cache, evicting every registered
+      /// DFA::State other than the (pinned) start states, deadState
+      /// and eagerly compiled DFA::States, and the liveRecords still
+      /// in use by the caller.
+      ///
+      /// Returns the number of DFA::States evicted. Evicted DFA::States
+      /// are recomputed (on the fly) if they are needed again.
+      size_t flushCache(VarArray<StateRecord*> *liveRecords);
+
+      /// \brief Return the number of calls to flushCache.
+      size_t getNumCacheFlushes(void) {
+        return cacheFlushes;
+      }
+
+      /// \brief Return the total number of DFA::States evicted by
+      /// flushCache.
+      size_t getNumEvictedStates(void) {
+        return evictedStates;
+      }
 
 
       /// \brief Returns a DFA::State which represents the currently
@@ -123,6 +344,40 @@ namespace DeterministicFiniteAutomaton {
       }
 
     protected:
+
+      /// \brief Compute (and record) the epsilon closure of the
+      /// NFA::State, that is the NFA::State itself together with all
+      /// of the NFA::States reachable from it by following unlabeled
+      /// (NFA::Split) transitions.
+      ///
+      /// Cycles of NFA::Split states are followed only once.
+      void computeEpsilonClosure(NFA::State *nfaState);
+
+      /// \brief Register the newly allocated DFA::State, newState,
+      /// returning its StateRecord.
+      ///
+      /// If newState duplicates an already registered DFA::State, it
+      /// is returned to the allocator.
+      StateRecord *registerState(State *newState);
+
+      /// \brief Compute the PushDownMachine's metadata of the
+      /// StateRecord (see ensureStateMetadata).
+      void computeStateMetadata(StateRecord *stateRecord);
+
+      /// \brief Compute the FIRST set (of character classes) and the
+      /// nullability of every start state.
+      ///
+      /// A ReStart NFA::State contributes the FIRST set of its rule,
+      /// and (if that rule is nullable) the FIRST set of whatever
+      /// follows it. Since rules may be (mutually) recursive, the
+      /// sets are recomputed until none of them change.
+      void computeFirstSets(void);
+
+      /// \brief Add the character classes which could start a match
+      /// of the start state, startStateId, to its FIRST set, returning
+      /// true if its FIRST set (or nullability) changed.
+      bool addFirstSetOf(NFA::StartStateId startStateId);
+
       /// \brief The NFA associated to this DFA.
       NFA *nfa;
 
@@ -132,20 +387,96 @@ namespace DeterministicFiniteAutomaton {
       /// \brief The DFA::NextStateMapping for this DFA interpretor.
       NextStateMapping *nextStateMapping;
 
-      /// \brief The bit set of all known NFA::State(s) which are
-      /// NFA::token recognizing states.
+      /// \brief The CharacterClassMapping used to index the
+      /// transition slots of this DFA interpretor's StateRecords.
+      CharacterClassMapping *characterClasses;
+
+      /// \brief The bit set of all NFA::State(s) which are NFA::token
+      /// recognizing states.
       ///
-      /// This bit set is used to determine if/when a token has been
-      /// recognized.
+      /// This bit set is computed when the DFA is created, and is used
+      /// to determine if/when a token has been recognized.
       State *tokensState;
 
+      /// \brief The (empty) DFA::State used as scratch space while
+      /// computing an epsilon closure or a FIRST set.
+      State *closureState;
+
+      /// \brief The ClosureWords of all of the epsilon closures
+      /// computed so far.
+      ClosureWord *closureWords;
+
+      /// \brief The number of ClosureWords in use.
+      size_t numClosureWords;
+
+      /// \brief The number of ClosureWords allocated.
+      size_t closureWordsSize;
+
+      /// \brief The index of the first ClosureWord of each NFA::State's
+      /// epsilon closure, indexed by NFA::State id.
+      size_t *closureStart;
+
+      /// \brief One past the index of the last ClosureWord of each
+      /// NFA::State's epsilon closure, indexed by NFA::State id.
+      ///
+      /// A zero closureEnd marks an epsilon closure which has not yet
+      /// been computed (every epsilon closure contains at least its
+      /// own NFA::State).
+      size_t *closureEnd;
+
+      /// \brief A buffer large enough to hold every NFA::State, used
+      /// by computeNextDFAState to collect the NFA::States of the
+      /// current DFA::State.
+      NFA::State **nfaStateBuffer;
+
       /// \brief The array of DFA::State(s) corresponding to the
       /// NFA startStates indexed by the NFA::StartStateId.
-      State **startState;
+      StateRecord **startState;
 
       /// \brief The total number of start states.
       size_t numStartStates;
 
+      /// \brief The FIRST sets (bit sets of character classes) of the
+      /// start states, numFirstSetWords 64 bit words per start state,
+      /// indexed by NFA::StartStateId.
+      uint64_t *firstSets;
+
+      /// \brief The number of 64 bit words in each FIRST set.
+      size_t numFirstSetWords;
+
+      /// \brief Whether or not the rule of each start state can match
+      /// the empty string, indexed by NFA::StartStateId.
+      bool *nullableStartStates;
+
+      /// \brief The (registered) empty DFA::State which records that
+      /// a given transition has no viable next state.
+      StateRecord *deadState;
+
+      /// \brief The EagerCompileReports (indexed by
+      /// NFA::StartStateId) recorded by compileEagerly.
+      VarArray<EagerCompileReport> eagerCompileReports;
+
+      /// \brief The number of getNextDFAState calls answered from the
+      /// nextStateMapping.
+      size_t cacheHits;
+
+      /// \brief The number of getNextDFAState calls which required a
+      /// call to computeNextDFAState.
+      size_t cacheMisses;
+
+      /// \brief The maximum (approximate) number of bytes of the DFA
+      /// cache, or zero if unlimited.
+      size_t cacheBudget;
+
+      /// \brief The number of calls to flushCache.
+      size_t cacheFlushes;
+
+      /// \brief The total number of DFA::States evicted by flushCache.
+      size_t evictedStates;
+
+      /// Allow complete access when saving or loading compiled grammars.
+      friend class ::CompiledGrammar;
+
   }; // class DFA
 };  // namespace DeterministicFiniteAutomaton
 
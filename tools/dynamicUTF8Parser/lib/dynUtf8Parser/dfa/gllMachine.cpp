@@ -0,0 +1,572 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dynUtf8Parser/dfa/gllMachine.h"
+
+using namespace DeterministicFiniteAutomaton;
+
+GLLMachine::KeyTable::Slot *GLLMachine::KeyTable::findSlot(size_t a,
+                                                           size_t b,
+                                                           size_t c) {
+  uint64_t hash = ((uint64_t)a * 0x9E3779B97F4A7C15ULL) ^
+    ((uint64_t)b * 0xC2B2AE3D27D4EB4FULL) ^
+    ((uint64_t)c * 0x165667B19E3779F9ULL);
+  size_t mask = numSlots - 1;
+  size_t i = (size_t)(hash ^ (hash >> 29)) & mask;
+  while (slots[i].used &&
+         ((slots[i].a != a) || (slots[i].b != b) || (slots[i].c != c))) {
+    i = (i + 1) & mask;
+  }
+  return slots + i;
+}
+
+size_t *GLLMachine::KeyTable::find(size_t a, size_t b, size_t c) {
+  if (!numKeys) return NULL;
+  Slot *slot = findSlot(a, b, c);
+  if (!slot->used) return NULL;
+  return &slot->value;
+}
+
+size_t *GLLMachine::KeyTable::findOrInsert(size_t a, size_t b, size_t c,
+                                           bool *isNew) {
+  // keep the table at most half full
+  if (numSlots <= 2*(numKeys + 1)) {
+    Slot  *oldSlots    = slots;
+    size_t oldNumSlots = numSlots;
+    numSlots = (numSlots ? 2*numSlots : initialNumSlots);
+    slots    = (Slot*)calloc(numSlots, sizeof(Slot));
+    if (!slots) throw ParserException("Out of memory");
+    for (size_t i = 0; i < oldNumSlots; i++) {
+      if (oldSlots[i].used) {
+        *findSlot(oldSlots[i].a, oldSlots[i].b, oldSlots[i].c) = oldSlots[i];
+      }
+    }
+    if (oldSlots) free(oldSlots);
+  }
+  Slot *slot = findSlot(a, b, c);
+  *isNew = !slot->used;
+  if (*isNew) {
+    slot->a     = a;
+    slot->b     = b;
+    slot->c     = c;
+    slot->value = 0;
+    slot->used  = true;
+    numKeys++;
+  }
+  return &slot->value;
+}
+
+GLLMachine::GLLMachine(DFA *aDFA) {
+  dfa              = aDFA;
+  ASSERT(dfa);
+  nfa              = dfa->getNFA();
+  characterClasses = dfa->getCharacterClasses();
+  stream           = NULL;
+  streamCursor.start = 0;
+  streamCursor.next  = 0;
+  numItems         = 0;
+  topNode          = noIndex;
+}
+
+void GLLMachine::clear(void) {
+  while (nodes.getNumItems())        nodes.popItem();
+  while (edges.getNumItems())        edges.popItem();
+  while (ends.getNumItems())         ends.popItem();
+  while (currentItems.getNumItems()) currentItems.popItem();
+  while (nextItems.getNumItems())    nextItems.popItem();
+  while (ancestors.getNumItems())    ancestors.popItem();
+  nodeTable.clear();
+  itemTable.clear();
+  stream   = NULL;
+  numItems = 0;
+  topNode  = noIndex;
+}
+
+size_t GLLMachine::findOrCreateNode(NFA::StartStateId startStateId,
+                                    size_t offset, bool *isNew) {
+  size_t *nodeIndex = nodeTable.findOrInsert(startStateId, offset, 0, isNew);
+  if (*isNew) {
+    *nodeIndex = nodes.getNumItems();
+    Node node;
+    node.startStateId = startStateId;
+    node.offset       = offset;
+    node.firstEdge    = noIndex;
+    node.firstEnd     = noIndex;
+    nodes.pushItem(node);
+  }
+  return *nodeIndex;
+}
+
+void GLLMachine::addItem(VarArray<Item> *items, NFA::State *aState,
+                         size_t node, size_t offset) {
+  if (!aState) return;
+  bool isNew;
+  itemTable.findOrInsert(aState->id, node, offset, &isNew);
+  if (!isNew) return;
+  Item item;
+  item.nfaState = aState;
+  item.node     = node;
+  items->pushItem(item);
+  numItems++;
+}
+
+bool GLLMachine::hasEnd(size_t node, size_t offset) {
+  Node noNode;
+  memset(&noNode, 0, sizeof(Node));
+  noNode.firstEnd = noIndex;
+  End noEnd;
+  noEnd.offset  = 0;
+  noEnd.nextEnd = noIndex;
+  size_t endIndex = nodes.getItem(node, noNode).firstEnd;
+  // the Ends are recorded (and so listed) from the longest
+  while (endIndex != noIndex) {
+    End end = ends.getItem(endIndex, noEnd);
+    if (end.offset == offset) return true;
+    if (end.offset < offset) return false;
+    endIndex = end.nextEnd;
+  }
+  return false;
+}
+
+utf8Char_t GLLMachine::charAt(size_t offset, size_t *nextOffset,
+                              Classifier::classSet_t *classSet) {
+  Utf8Chars::Cursor cursor = streamCursor;
+  cursor.next = offset;
+  utf8Char_t c = stream->nextUtf8Char(&cursor);
+  *nextOffset = cursor.next;
+  *classSet   = 0;
+  if (c.c[0]) {
+    *classSet = characterClasses->getRepresentativeClassSet(
+      characterClasses->getCharacterClass(c));
+  }
+  return c;
+}
+
+size_t GLLMachine::recognize(NFA::StartStateId startStateId,
+                             Utf8Chars *charStream) {
+  clear();
+  ASSERT(charStream);
+  stream       = charStream;
+  streamCursor = charStream->getCursor();
+  NFA::State *startState = nfa->getStartState(startStateId);
+  if (!startState) return noIndex;
+
+  size_t offset = streamCursor.next;
+  bool isNew;
+  topNode = findOrCreateNode(startStateId, offset, &isNew);
+  addItem(&currentItems, startState, topNode, offset);
+
+  Node noNode;
+  memset(&noNode, 0, sizeof(Node));
+  Edge noEdge;
+  memset(&noEdge, 0, sizeof(Edge));
+  noEdge.nextEdge = noIndex;
+  Item noItem;
+  memset(&noItem, 0, sizeof(Item));
+  while (true) {
+    size_t nextOffset;
+    Classifier::classSet_t classSet;
+    utf8Char_t c = charAt(offset, &nextOffset, &classSet);
+
+    // the current Items may grow as they are processed
+    for (size_t i = 0; i < currentItems.getNumItems(); i++) {
+      Item item = currentItems.getItem(i, noItem);
+      NFA::State *aState = item.nfaState;
+      switch (aState->matchType) {
+        case NFA::Split:
+          addItem(&currentItems, aState->out,  item.node, offset);
+          addItem(&currentItems, aState->out1, item.node, offset);
+          break;
+        case NFA::Character:
+        case NFA::ClassSet:
+          if (matchesChar(aState, c, classSet)) {
+            addItem(&nextItems, aState->out, item.node, nextOffset);
+          }
+          break;
+        case NFA::ReStart: {
+          NFA::StartStateId reStartId = aState->matchData.r;
+          NFA::State *reStartState = nfa->getStartState(reStartId);
+          if (!reStartState) break;
+          size_t callee = findOrCreateNode(reStartId, offset, &isNew);
+          if (isNew) addItem(&currentItems, reStartState, callee, offset);
+          // wait for the callee to match...
+          Node node = nodes.getItem(callee, noNode);
+          Edge edge;
+          edge.reStartState = aState;
+          edge.caller       = item.node;
+          edge.nextEdge     = node.firstEdge;
+          node.firstEdge    = edges.getNumItems();
+          edges.pushItem(edge);
+          nodes.setItem(callee, node);
+          // ... unless it has already matched the empty string
+          if (hasEnd(callee, offset)) {
+            addItem(&currentItems, aState->out, item.node, offset);
+          }
+          break;
+        }
+        case NFA::Token: {
+          Node node = nodes.getItem(item.node, noNode);
+          if (!hasEnd(item.node, offset)) {
+            End end;
+            end.offset    = offset;
+            end.nextEnd   = node.firstEnd;
+            node.firstEnd = ends.getNumItems();
+            ends.pushItem(end);
+            nodes.setItem(item.node, node);
+          }
+          // continue every caller waiting for this rule
+          size_t edgeIndex = node.firstEdge;
+          while (edgeIndex != noIndex) {
+            Edge edge = edges.getItem(edgeIndex, noEdge);
+            addItem(&currentItems, edge.reStartState->out,
+                    edge.caller, offset);
+            edgeIndex = edge.nextEdge;
+          }
+          break;
+        }
+        default:
+          break;
+      }
+    }
+    if (!c.c[0] || !nextItems.getNumItems()) break;
+
+    // move on to the next offset
+    while (currentItems.getNumItems()) currentItems.popItem();
+    itemTable.clear();
+    for (size_t i = 0; i < nextItems.getNumItems(); i++) {
+      Item item = nextItems.getItem(i, noItem);
+      itemTable.findOrInsert(item.nfaState->id, item.node, nextOffset, &isNew);
+      currentItems.pushItem(item);
+    }
+    while (nextItems.getNumItems()) nextItems.popItem();
+    offset = nextOffset;
+  }
+  return topNode;
+}
+
+bool GLLMachine::findPaths(PathSearch *search, NFA::State *aState,
+                           size_t offset) {
+  bool found = false;
+  if (!enterPathFrame(search, aState, offset, &found)) return found;
+  while (search->frames.getNumItems()) {
+    NFA::State *nextState = NULL;
+    size_t nextOffset = 0;
+    if (nextPathStep(search, &search->frames.getTop(),
+                     &nextState, &nextOffset)) {
+      bool childFound = false;
+      if (!enterPathFrame(search, nextState, nextOffset, &childFound)) {
+        if (childFound) search->frames.getTop().found = true;
+      }
+      continue;
+    }
+    found = leavePathFrame(search);
+    if (found && search->frames.getNumItems()) {
+      search->frames.getTop().found = true;
+    }
+  }
+  return found;
+}
+
+bool GLLMachine::enterPathFrame(PathSearch *search, NFA::State *aState,
+                                size_t offset, bool *found) {
+  *found = false;
+  if (!aState) return false;
+  bool isNew;
+  size_t *status = search->status.findOrInsert(aState->id, offset, 0, &isNew);
+  if (*status == InProgress) {
+    search->cycleCut = true;
+    return false;
+  }
+  if (*status == Failed) return false;
+  *status = InProgress;
+
+  PathFrame frame;
+  frame.nfaState      = aState;
+  frame.offset        = offset;
+  frame.next          = 0;
+  frame.span.node     = noIndex;
+  frame.span.end      = 0;
+  frame.spanPushed    = false;
+  frame.found         = false;
+  frame.outerCycleCut = search->cycleCut;
+  if (aState->matchType == NFA::ReStart) {
+    // try the longest match of the callee first
+    frame.next = noIndex;
+    size_t *calleeIndex = nodeTable.find(aState->matchData.r, offset, 0);
+    if (calleeIndex) {
+      Node noNode;
+      memset(&noNode, 0, sizeof(Node));
+      noNode.firstEnd = noIndex;
+      frame.span.node = *calleeIndex;
+      frame.next      = nodes.getItem(frame.span.node, noNode).firstEnd;
+    }
+  }
+  search->cycleCut = false;
+  search->frames.pushItem(frame);
+  return true;
+}
+
+bool GLLMachine::nextPathStep(PathSearch *search, PathFrame *frame,
+                              NFA::State **nextState, size_t *nextOffset) {
+  NFA::State *aState = frame->nfaState;
+  switch (aState->matchType) {
+    case NFA::Split:
+      if (frame->next == 0) {
+        frame->next = 1;
+        *nextState  = aState->out;
+        *nextOffset = frame->offset;
+        return true;
+      }
+      if ((frame->next == 1) &&
+          (search->pathTokens.getNumItems() < search->maxPaths)) {
+        frame->next = 2;
+        *nextState  = aState->out1;
+        *nextOffset = frame->offset;
+        return true;
+      }
+      return false;
+    case NFA::Character:
+    case NFA::ClassSet: {
+      if (frame->next) return false;
+      frame->next = 1;
+      if (search->end <= frame->offset) return false;
+      Classifier::classSet_t classSet;
+      utf8Char_t c = charAt(frame->offset, nextOffset, &classSet);
+      if (!matchesChar(aState, c, classSet) || (search->end < *nextOffset)) {
+        return false;
+      }
+      *nextState = aState->out;
+      return true;
+    }
+    case NFA::ReStart: {
+      if (frame->spanPushed) {
+        search->spans.popItem();
+        frame->spanPushed = false;
+      }
+      End noEnd;
+      noEnd.offset  = 0;
+      noEnd.nextEnd = noIndex;
+      while (frame->next != noIndex) {
+        if (search->maxPaths <= search->pathTokens.getNumItems()) break;
+        End end = ends.getItem(frame->next, noEnd);
+        frame->next     = end.nextEnd;
+        frame->span.end = end.offset;
+        if (search->end < frame->span.end) continue;
+        // a Span can not (eventually) be its own child
+        bool isAncestor = false;
+        for (size_t i = 0; i < ancestors.getNumItems(); i++) {
+          Span ancestor = ancestors.getItem(i, frame->span);
+          if ((ancestor.node == frame->span.node) &&
+              (ancestor.end  == frame->span.end)) {
+            isAncestor = true;
+            break;
+          }
+        }
+        if (isAncestor) continue;
+        search->spans.pushItem(frame->span);
+        frame->spanPushed = true;
+        *nextState  = aState->out;
+        *nextOffset = frame->span.end;
+        return true;
+      }
+      return false;
+    }
+    case NFA::Token:
+      if (frame->offset != search->end) return false;
+      search->pathStarts.pushItem(search->pathSpans.getNumItems());
+      search->pathLengths.pushItem(search->spans.getNumItems());
+      for (size_t i = 0; i < search->spans.getNumItems(); i++) {
+        search->pathSpans.pushItem(search->spans.getItem(i, Span()));
+      }
+      search->pathTokens.pushItem(aState);
+      frame->found = true;
+      return false;
+    default:
+      return false;
+  }
+}
+
+bool GLLMachine::leavePathFrame(PathSearch *search) {
+  PathFrame frame = search->frames.popItem();
+  size_t *status = search->status.find(frame.nfaState->id, frame.offset, 0);
+  ASSERT(status);
+  // only a failure which did not depend upon a cycle is final, and a
+  // success may be searched again for further paths
+  *status = ((frame.found || search->cycleCut) ? Unknown : Failed);
+  search->cycleCut = search->cycleCut || frame.outerCycleCut;
+  return frame.found;
+}
+
+size_t GLLMachine::buildTokens(Span span, VarArray<Token*> *tokens,
+                               size_t maxTokens, bool asChild) {
+  VarArray<BuildFrame> frames;
+  if (!pushBuildFrame(&frames, span, tokens, maxTokens, asChild)) return 0;
+  size_t numTokens = 0;
+  while (frames.getNumItems()) {
+    BuildFrame frame = frames.popItem();
+    PathSearch *search = frame.search;
+    size_t pathStart  = search->pathStarts.getItem(frame.path, 0);
+    size_t pathLength = search->pathLengths.getItem(frame.path, 0);
+    if (frame.childPending) {
+      // combine the child Span's trees with the partial trees
+      frame.childPending = false;
+      adoptChildTokens(frame.partials, frame.children,
+                       frame.maxTokens - frame.numTokens);
+      if (!frame.partials->getNumItems()) frame.child = pathLength;
+    }
+    if (frame.inPath && (frame.child < pathLength)) {
+      // build the trees of the path's next child Span (into children)
+      Span childSpan =
+        search->pathSpans.getItem(pathStart + frame.child, Span());
+      frame.child++;
+      frame.childPending = true;
+      frames.pushItem(frame);
+      pushBuildFrame(&frames, childSpan, frame.children,
+                     frame.maxTokens - frame.numTokens, true);
+      continue;
+    }
+    if (frame.inPath) {
+      // the path's trees are complete
+      for (size_t j = 0; j < frame.partials->getNumItems(); j++) {
+        frame.tokens->pushItem(frame.partials->getItem(j, NULL));
+        frame.numTokens++;
+      }
+      while (frame.partials->getNumItems()) frame.partials->popItem();
+      frame.inPath = false;
+      frame.path++;
+    }
+    if ((frame.maxTokens <= frame.numTokens) ||
+        (search->pathTokens.getNumItems() <= frame.path)) {
+      // every path of the Span has been built
+      ancestors.popItem();
+      delete frame.children;
+      delete frame.partials;
+      delete frame.search;
+      numTokens = frame.numTokens;
+      continue;
+    }
+    NFA::State *tokenState = search->pathTokens.getItem(frame.path, NULL);
+    if (frame.asChild && Token::ignoreToken(tokenState->matchData.t)) {
+      frame.tokens->pushItem(NULL);
+      frame.numTokens++;
+      frame.path++;
+      frames.pushItem(frame);
+      continue;
+    }
+    // build the (at most maxTokens) combinations of the child trees
+    Utf8Chars::Cursor textCursor = streamCursor;
+    Node noNode;
+    memset(&noNode, 0, sizeof(Node));
+    textCursor.start = nodes.getItem(frame.span.node, noNode).offset;
+    textCursor.next  = frame.span.end;
+    Token *token = new Token();
+    token->setId(Token::unWrapTokenId(tokenState->matchData.t));
+    token->setText(stream->getStart(&textCursor),
+                   stream->getNumberOfBytesRead(&textCursor));
+    frame.partials->pushItem(token);
+    frame.inPath = true;
+    frame.child  = 0;
+    frames.pushItem(frame);
+  }
+  return numTokens;
+}
+
+bool GLLMachine::pushBuildFrame(VarArray<BuildFrame> *frames, Span span,
+                                VarArray<Token*> *tokens, size_t maxTokens,
+                                bool asChild) {
+  Node noNode;
+  memset(&noNode, 0, sizeof(Node));
+  Node node = nodes.getItem(span.node, noNode);
+  NFA::State *startState = nfa->getStartState(node.startStateId);
+  if (!startState || !maxTokens) return false;
+
+  BuildFrame frame;
+  frame.span         = span;
+  frame.tokens       = tokens;
+  frame.maxTokens    = maxTokens;
+  frame.asChild      = asChild;
+  frame.numTokens    = 0;
+  frame.search       = new PathSearch();
+  frame.path         = 0;
+  frame.child        = 0;
+  frame.inPath       = false;
+  frame.childPending = false;
+  frame.partials     = new VarArray<Token*>();
+  frame.children     = new VarArray<Token*>();
+  frame.search->end      = span.end;
+  frame.search->maxPaths = maxTokens;
+  frame.search->cycleCut = false;
+  ancestors.pushItem(span);
+  findPaths(frame.search, startState, node.offset);
+  frames->pushItem(frame);
+  return true;
+}
+
+void GLLMachine::adoptChildTokens(VarArray<Token*> *partials,
+                                  VarArray<Token*> *children,
+                                  size_t maxPartials) {
+  VarArray<Token*> newPartials;
+  for (size_t j = 0; j < partials->getNumItems(); j++) {
+    Token *partial = partials->getItem(j, NULL);
+    for (size_t k = 0; k < children->getNumItems(); k++) {
+      if (maxPartials <= newPartials.getNumItems()) break;
+      Token *child = children->getItem(k, NULL);
+      Token *newPartial = partial;
+      if ((children->getNumItems() != 1) || (partials->getNumItems() != 1)) {
+        newPartial = partial->clone();
+        if (child) child = child->clone();
+      } else {
+        children->setItem(k, NULL); // adopted without copying
+      }
+      if (child) newPartial->adoptChildToken(child);
+      newPartials.pushItem(newPartial);
+    }
+    if (newPartials.getItem(0, NULL) != partial) delete partial;
+  }
+  while (children->getNumItems()) {
+    Token *child = children->popItem();
+    if (child) delete child;
+  }
+  while (partials->getNumItems()) partials->popItem();
+  for (size_t j = 0; j < newPartials.getNumItems(); j++) {
+    partials->pushItem(newPartials.getItem(j, NULL));
+  }
+}
+
+Token *GLLMachine::runFromUsing(NFA::StartStateId startStateId,
+                                Utf8Chars *charStream,
+                                bool partialOk) {
+  VarArray<Token*> parses;
+  allParsesFromUsing(startStateId, charStream, &parses, 1, partialOk);
+  return parses.getItem(0, NULL);
+}
+
+size_t GLLMachine::allParsesFromUsing(NFA::StartStateId startStateId,
+                                      Utf8Chars *charStream,
+                                      VarArray<Token*> *parses,
+                                      size_t maxParses,
+                                      bool partialOk) {
+  ASSERT(parses);
+  size_t node = recognize(startStateId, charStream);
+  if (node == noIndex) return 0;
+  Node noNode;
+  memset(&noNode, 0, sizeof(Node));
+  noNode.firstEnd = noIndex;
+  End noEnd;
+  noEnd.offset  = 0;
+  noEnd.nextEnd = noIndex;
+  size_t endIndex = nodes.getItem(node, noNode).firstEnd;
+  if (endIndex == noIndex) return 0;
+  Span span;
+  span.node = node;
+  span.end  = ends.getItem(endIndex, noEnd).offset;
+  if (!partialOk) {
+    // the whole stream must have been matched
+    Utf8Chars::Cursor endCursor = streamCursor;
+    endCursor.next = span.end;
+    if (!stream->atEnd(&endCursor)) return 0;
+  }
+  return buildTokens(span, parses, maxParses, false);
+}
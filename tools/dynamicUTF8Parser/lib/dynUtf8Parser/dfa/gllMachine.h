@@ -0,0 +1,487 @@
+#ifndef DFA_GLL_MACHINE_H
+#define DFA_GLL_MACHINE_H
+
+#include "dynUtf8Parser/dfa/dfa.h"
+
+namespace DeterministicFiniteAutomaton {
+
+  /// \brief A GLLMachine object is used to run an NFA (and its
+  /// NFA::ReStart states) breadth first.
+  ///
+  /// Where the PushDownMachine explores the alternatives of a grammar
+  /// depth first, backtracking on failure, the GLLMachine follows
+  /// every live alternative in lock-step over the stream, one UTF8
+  /// character at a time (in the style of Earley and GLL parsers).
+  ///
+  /// Each rule started (by an NFA::ReStart state) at a given offset
+  /// is recorded once as a Node of a graph structured stack, whose
+  /// Edges record the NFA::ReStart states waiting for the rule to
+  /// match, and whose Ends record the offsets at which the rule has
+  /// matched. Since there are at most (number of rules) x (number of
+  /// offsets) Nodes, the recognition of a stream takes (at worst)
+  /// polynomial time, even for ambiguous grammars.
+  ///
+  /// The parse tree(s) are then recovered from the Nodes and their
+  /// Ends, preferring the longest match of each rule (as the greedy
+  /// PushDownMachine does), and the out before the out1 alternative
+  /// of each NFA::Split state.
+  class GLLMachine {
+    public:
+
+      /// \brief The index used to mark the end of an Edge or End list.
+      static const size_t noIndex = (size_t)-1;
+
+      /// \brief An Item is an NFA::State reached (at the current
+      /// offset) by the rule of a given Node.
+      typedef struct Item {
+        /// \brief The NFA::State reached.
+        NFA::State *nfaState;
+
+        /// \brief The index of the Node of the rule being recognized.
+        size_t node;
+      } Item;
+
+      /// \brief A Node records the rule of a start state started at a
+      /// given offset.
+      typedef struct Node {
+        /// \brief The start state of the rule.
+        NFA::StartStateId startStateId;
+
+        /// \brief The offset (in the stream) at which the rule started.
+        size_t offset;
+
+        /// \brief The index of the first of this Node's Edges.
+        size_t firstEdge;
+
+        /// \brief The index of the first (and longest) of this Node's
+        /// Ends.
+        size_t firstEnd;
+      } Node;
+
+      /// \brief An Edge records an NFA::ReStart state (of the rule of
+      /// the caller Node) waiting for the rule of a Node to match.
+      typedef struct Edge {
+        /// \brief The waiting NFA::ReStart state.
+        NFA::State *reStartState;
+
+        /// \brief The index of the caller's Node.
+        size_t caller;
+
+        /// \brief The index of the next Edge of the same Node.
+        size_t nextEdge;
+      } Edge;
+
+      /// \brief An End records an offset at which the rule of a Node
+      /// has matched.
+      typedef struct End {
+        /// \brief The offset (in the stream) at which the match ended.
+        size_t offset;
+
+        /// \brief The index of the next (shorter) End of the same Node.
+        size_t nextEnd;
+      } End;
+
+      /// \brief A Span is the match of the rule of a Node which ended
+      /// at a given offset.
+      typedef struct Span {
+        /// \brief The index of the Node of the rule.
+        size_t node;
+
+        /// \brief The offset (in the stream) at which the match ended.
+        size_t end;
+      } Span;
+
+      /// \brief A KeyTable is a (linearly probed) hash table mapping
+      /// a key of three size_t values to a size_t value.
+      class KeyTable {
+        public:
+
+          /// \brief The number of slots initially allocated.
+          static const size_t initialNumSlots = 64;
+
+          /// \brief Create an (empty) KeyTable.
+          KeyTable(void) {
+            slots    = NULL;
+            numSlots = 0;
+            numKeys  = 0;
+          }
+
+          /// \brief Destroy the KeyTable.
+          ~KeyTable(void) {
+            if (slots) free(slots);
+            slots    = NULL;
+            numSlots = 0;
+            numKeys  = 0;
+          }
+
+          /// \brief Return the (zero initialized, if isNew is set)
+          /// value of the key (a, b, c).
+          size_t *findOrInsert(size_t a, size_t b, size_t c, bool *isNew);
+
+          /// \brief Return the value of the key (a, b, c), or NULL if
+          /// it is not in the table.
+          size_t *find(size_t a, size_t b, size_t c);
+
+          /// \brief Remove every key from the table.
+          void clear(void) {
+            if (numKeys) memset(slots, 0, numSlots*sizeof(Slot));
+            numKeys = 0;
+          }
+
+          /// \brief Return the number of keys in the table.
+          size_t getNumKeys(void) {
+            return numKeys;
+          }
+
+        protected:
+
+          /// \brief A Slot in the hash table.
+          typedef struct Slot {
+            size_t a;
+            size_t b;
+            size_t c;
+            size_t value;
+            bool   used;
+          } Slot;
+
+          /// \brief Return the Slot of the key (a, b, c), or the
+          /// (unused) Slot where it should be stored.
+          Slot *findSlot(size_t a, size_t b, size_t c);
+
+          /// \brief The (power of two sized) array of Slots.
+          Slot *slots;
+
+          /// \brief The number of Slots allocated.
+          size_t numSlots;
+
+          /// \brief The number of Slots in use.
+          size_t numKeys;
+      };
+
+      /// \brief Create a new GLLMachine running the NFA of the DFA
+      /// provided.
+      ///
+      /// The DFA's CharacterClassMapping is used to classify each
+      /// UTF8 character only once.
+      GLLMachine(DFA *aDFA);
+
+      /// \brief Destroy the GLLMachine.
+      ~GLLMachine(void) {
+        clear();
+      }
+
+      /// \brief Run the GLLMachine from the named start state using
+      /// the Utf8Chars stream provided, returning the (preferred)
+      /// parse tree or NULL if the stream does not match.
+      ///
+      /// If partialOk is true then the longest match of a prefix of
+      /// the stream is returned.
+      Token *runFromUsing(const char *startStateName,
+                          Utf8Chars *charStream,
+                          bool partialOk = false) {
+        return runFromUsing(nfa->findStartStateId(startStateName),
+                            charStream, partialOk);
+      }
+
+      /// \brief Run the GLLMachine from the start state using the
+      /// Utf8Chars stream provided, returning the (preferred) parse
+      /// tree or NULL if the stream does not match.
+      ///
+      /// If partialOk is true then the longest match of a prefix of
+      /// the stream is returned.
+      Token *runFromUsing(NFA::StartStateId startStateId,
+                          Utf8Chars *charStream,
+                          bool partialOk = false);
+
+      /// \brief Run the GLLMachine from the start state using the
+      /// Utf8Chars stream provided, adding (at most maxParses of) the
+      /// distinct parse trees of the stream to parses.
+      ///
+      /// The preferred parse tree (see runFromUsing) is added first.
+      /// Returns the number of parse trees added.
+      size_t allParsesFromUsing(NFA::StartStateId startStateId,
+                                Utf8Chars *charStream,
+                                VarArray<Token*> *parses,
+                                size_t maxParses,
+                                bool partialOk = false);
+
+      /// \brief Return the number of Items created by the last run.
+      size_t getNumItems(void) {
+        return numItems;
+      }
+
+      /// \brief Return the number of Nodes (rules started at a given
+      /// offset) created by the last run.
+      size_t getNumNodes(void) {
+        return nodes.getNumItems();
+      }
+
+      /// \brief Return the number of Edges (waiting NFA::ReStart
+      /// states) created by the last run.
+      size_t getNumEdges(void) {
+        return edges.getNumItems();
+      }
+
+    protected:
+
+      /// \brief A PathFrame records an NFA::State (at a given offset)
+      /// whose paths are being searched (see findPaths).
+      typedef struct PathFrame {
+        /// \brief The NFA::State being searched.
+        NFA::State *nfaState;
+
+        /// \brief The offset at which the NFA::State is searched.
+        size_t offset;
+
+        /// \brief The next alternative to search: the out (0) or out1
+        /// (1) of an NFA::Split state, or the index of the next End
+        /// (of the callee Node) of an NFA::ReStart state.
+        size_t next;
+
+        /// \brief The Span (of an NFA::ReStart state) being searched.
+        Span span;
+
+        /// \brief True if span has been pushed onto the current path.
+        bool spanPushed;
+
+        /// \brief True if a path has been found from the NFA::State.
+        bool found;
+
+        /// \brief The PathSearch's cycleCut on entry.
+        bool outerCycleCut;
+      } PathFrame;
+
+      /// \brief The state of the search for the derivations (paths
+      /// through the NFA of a rule) of a given Span.
+      typedef struct PathSearch {
+        /// \brief The offset at which every path must end.
+        size_t end;
+
+        /// \brief The maximum number of paths to find.
+        size_t maxPaths;
+
+        /// \brief The status (see SearchStatus) of each NFA::State at
+        /// each offset.
+        KeyTable status;
+
+        /// \brief The Spans (of the NFA::ReStart states) of the
+        /// current path.
+        VarArray<Span> spans;
+
+        /// \brief The Spans of every path found.
+        VarArray<Span> pathSpans;
+
+        /// \brief The index (in pathSpans) of the first Span of each
+        /// path found.
+        VarArray<size_t> pathStarts;
+
+        /// \brief The number of Spans of each path found.
+        VarArray<size_t> pathLengths;
+
+        /// \brief The NFA::Token state which ends each path found.
+        VarArray<NFA::State*> pathTokens;
+
+        /// \brief True if the search reached an NFA::State which was
+        /// still being searched (so a failure can not be recorded).
+        bool cycleCut;
+
+        /// \brief The (explicit) stack of the NFA::States being
+        /// searched.
+        VarArray<PathFrame> frames;
+      } PathSearch;
+
+      /// \brief A BuildFrame records a Span whose parse trees are
+      /// being built (see buildTokens).
+      typedef struct BuildFrame {
+        /// \brief The Span whose parse trees are being built.
+        Span span;
+
+        /// \brief The array to which the parse trees are added.
+        VarArray<Token*> *tokens;
+
+        /// \brief The maximum number of parse trees to add.
+        size_t maxTokens;
+
+        /// \brief True if the (NULL) tree of an ignored token is
+        /// also added.
+        bool asChild;
+
+        /// \brief The number of parse trees added.
+        size_t numTokens;
+
+        /// \brief The (owned) search for the paths of the Span.
+        PathSearch *search;
+
+        /// \brief The path whose parse trees are being built.
+        size_t path;
+
+        /// \brief The next child Span (of the path) to be built.
+        size_t child;
+
+        /// \brief True once the path's parse trees have been started.
+        bool inPath;
+
+        /// \brief True while the trees of the path's (last) child
+        /// Span are being built (into children).
+        bool childPending;
+
+        /// \brief The (owned) partial parse trees of the path.
+        VarArray<Token*> *partials;
+
+        /// \brief The (owned) parse trees of the child Span being
+        /// built.
+        VarArray<Token*> *children;
+      } BuildFrame;
+
+      /// \brief The status of an NFA::State, at a given offset, in a
+      /// PathSearch.
+      enum SearchStatus {
+        Unknown    = 0,
+        InProgress = 1,
+        Failed     = 2
+      };
+
+      /// \brief Discard the Items, Nodes, Edges and Ends of the last
+      /// run.
+      void clear(void);
+
+      /// \brief Recognize the stream from the start state, returning
+      /// the Node of the start state's rule (or noIndex).
+      ///
+      /// The longest match is the first of the Node's Ends.
+      size_t recognize(NFA::StartStateId startStateId,
+                       Utf8Chars *charStream);
+
+      /// \brief Return the index of the Node of the rule of
+      /// startStateId started at offset, creating it if required.
+      size_t findOrCreateNode(NFA::StartStateId startStateId,
+                              size_t offset, bool *isNew);
+
+      /// \brief Add the Item (aState, node) to the items provided,
+      /// unless it has already been added at the offset.
+      void addItem(VarArray<Item> *items, NFA::State *aState,
+                   size_t node, size_t offset);
+
+      /// \brief Return true if the rule of the Node has matched up to
+      /// the offset.
+      bool hasEnd(size_t node, size_t offset);
+
+      /// \brief Return the next character (and so its class set) at
+      /// the offset, setting nextOffset to the offset following it.
+      utf8Char_t charAt(size_t offset, size_t *nextOffset,
+                        Classifier::classSet_t *classSet);
+
+      /// \brief Return true if the NFA::Character or NFA::ClassSet
+      /// state matches the character c (of class set classSet).
+      bool matchesChar(NFA::State *aState, utf8Char_t c,
+                       Classifier::classSet_t classSet) {
+        if (!c.c[0]) return false;
+        if (aState->matchType == NFA::Character) {
+          return aState->matchData.c.u == c.u;
+        }
+        if (aState->matchType == NFA::ClassSet) {
+          return (aState->matchData.s & classSet) != 0;
+        }
+        return false;
+      }
+
+      /// \brief Find (at most search->maxPaths of) the paths through
+      /// the NFA from aState at offset to an NFA::Token state at
+      /// search->end, returning true if a path was found.
+      ///
+      /// The NFA::States being searched are kept on the search's
+      /// (explicit) stack of PathFrames, so very long inputs can not
+      /// overflow the (C) stack.
+      bool findPaths(PathSearch *search, NFA::State *aState, size_t offset);
+
+      /// \brief Start searching aState at offset, returning true if a
+      /// PathFrame has been pushed (otherwise found is set).
+      bool enterPathFrame(PathSearch *search, NFA::State *aState,
+                          size_t offset, bool *found);
+
+      /// \brief Move the (top) PathFrame on to its next alternative,
+      /// returning true (and the NFA::State and offset to search) if
+      /// there is one.
+      bool nextPathStep(PathSearch *search, PathFrame *frame,
+                        NFA::State **nextState, size_t *nextOffset);
+
+      /// \brief Finish searching the (top) PathFrame, returning true
+      /// if a path was found.
+      bool leavePathFrame(PathSearch *search);
+
+      /// \brief Add (at most maxTokens of) the parse trees of the
+      /// Span to tokens, returning the number added.
+      ///
+      /// If asChild is true, the (NULL) tree of an ignored token is
+      /// also added.
+      ///
+      /// The Spans being built are kept on an (explicit) stack of
+      /// BuildFrames, so deeply nested parse trees can not overflow
+      /// the (C) stack.
+      size_t buildTokens(Span span, VarArray<Token*> *tokens,
+                         size_t maxTokens, bool asChild);
+
+      /// \brief Push a BuildFrame for the Span (searching its paths),
+      /// returning false if it has no parse trees to build.
+      bool pushBuildFrame(VarArray<BuildFrame> *frames, Span span,
+                          VarArray<Token*> *tokens, size_t maxTokens,
+                          bool asChild);
+
+      /// \brief Add every combination (at most maxPartials) of the
+      /// partial parse trees and the child parse trees to partials,
+      /// deleting any unused trees.
+      void adoptChildTokens(VarArray<Token*> *partials,
+                            VarArray<Token*> *children,
+                            size_t maxPartials);
+
+      /// \brief The DFA whose NFA is run.
+      DFA *dfa;
+
+      /// \brief The NFA run by this GLLMachine.
+      NFA *nfa;
+
+      /// \brief The CharacterClassMapping used to classify each
+      /// character.
+      CharacterClassMapping *characterClasses;
+
+      /// \brief The stream being recognized.
+      Utf8Chars *stream;
+
+      /// \brief The cursor (at the start) of the stream.
+      Utf8Chars::Cursor streamCursor;
+
+      /// \brief The Nodes of the graph structured stack.
+      VarArray<Node> nodes;
+
+      /// \brief The Edges of the graph structured stack.
+      VarArray<Edge> edges;
+
+      /// \brief The Ends of the Nodes of the graph structured stack.
+      VarArray<End> ends;
+
+      /// \brief The Node index of each (startStateId, offset) pair.
+      KeyTable nodeTable;
+
+      /// \brief The Items already added at the current and next
+      /// offsets.
+      KeyTable itemTable;
+
+      /// \brief The Items at the current offset.
+      VarArray<Item> currentItems;
+
+      /// \brief The Items at the next offset.
+      VarArray<Item> nextItems;
+
+      /// \brief The total number of Items created.
+      size_t numItems;
+
+      /// \brief The Node of the start state's rule.
+      size_t topNode;
+
+      /// \brief The Spans whose parse trees are being built.
+      VarArray<Span> ancestors;
+  };
+
+}; // namespace DeterministicFiniteAutomaton
+
+#endif
@@ -11,48 +11,177 @@ using namespace DeterministicFiniteAutomaton;
 #define NUM_DFA_STATES_PER_BLOCK 20
 #endif
 
-NextStateMapping::NextStateMapping(StateAllocator *anAllocator) {
+NextStateMapping::NextStateMapping(StateAllocator *anAllocator,
+                                   size_t aNumCharacterClasses) {
   allocator = anAllocator;
-  dfaStateProbeSize = allocator->getStateSize() + sizeof(utf8Char_t);
-  dfaStateProbe = (char*)calloc(dfaStateProbeSize, sizeof(uint8_t));
+  numCharacterClasses = aNumCharacterClasses;
   nextDFAStateMap   = hattrie_create();
+  cacheBytes        = 0;
+  recordAllocator   =
+    new BlockAllocator(NUM_DFA_STATES_PER_BLOCK*sizeof(StateRecord));
 };
 
 NextStateMapping::~NextStateMapping(void) {
   allocator = NULL;
-  dfaStateProbeSize = 0;
-  if (dfaStateProbe) free(dfaStateProbe);
-  dfaStateProbe = NULL;
+  while (stateRecords.getNumItems()) {
+    StateRecord *stateRecord = stateRecords.popItem();
+    if (stateRecord->next) free(stateRecord->next);
+    stateRecord->next    = NULL;
+    stateRecord->numNext = 0;
+    clearStateMetadata(stateRecord);
+  }
+  while (freeRecords.getNumItems()) freeRecords.popItem();
+  cacheBytes = 0;
+  if (recordAllocator) delete recordAllocator;
+  recordAllocator = NULL;
   if (nextDFAStateMap) hattrie_free(nextDFAStateMap);
   nextDFAStateMap = NULL;
 }
 
-void NextStateMapping::assembleStateCharacterProbe(State *state,
-                                                      utf8Char_t curChar) {
-  assembleStateProbe(state);
-  size_t stateSize = allocator->getStateSize();
-  for (size_t j = 0; j < sizeof(utf8Char_t); j++) {
-    dfaStateProbe[stateSize+j] = curChar.c[j];
+StateRecord *NextStateMapping::registerState(State *state) {
+  StateRecord **registeredRecord =
+    (StateRecord**)hattrie_get(nextDFAStateMap,
+                               state,
+                               allocator->getStateSize());
+  if (!registeredRecord) throw ParserException("Hat-Trie failure");
+  if (!*registeredRecord) {
+    StateRecord *newRecord = NULL;
+    if (freeRecords.getNumItems()) newRecord = freeRecords.popItem();
+    else newRecord =
+      (StateRecord*)recordAllocator->allocateNewStructure(sizeof(StateRecord));
+    newRecord->id      = stateRecords.getNumItems();
+    newRecord->state   = state;
+    newRecord->next    = NULL;
+    newRecord->numNext = 0;
+    newRecord->pinned  = false;
+    newRecord->hasMetadata = false;
+    newRecord->reStarts    = NULL;
+    clearStateMetadata(newRecord);
+    stateRecords.pushItem(newRecord);
+    cacheBytes += getRecordBytes();
+    *registeredRecord = newRecord;
+  }
+  return *registeredRecord;
+}
+
+void NextStateMapping::setNextState(StateRecord *curState,
+                                    size_t charClass,
+                                    StateRecord *nextState) {
+  if (curState->numNext <= charClass) {
+    // allocate slots for every character class, growing them
+    // (geometrically) if charClass is out of range
+    size_t newNumNext = 2*curState->numNext;
+    if (newNumNext < numCharacterClasses) newNumNext = numCharacterClasses;
+    if (newNumNext <= charClass) newNumNext = charClass + 1;
+    StateRecord **newNext =
+      (StateRecord**)calloc(newNumNext, sizeof(StateRecord*));
+    if (!newNext) throw ParserException("Out of memory");
+    if (curState->next) {
+      memcpy(newNext, curState->next,
+             curState->numNext*sizeof(StateRecord*));
+      free(curState->next);
+    }
+    cacheBytes += (newNumNext - curState->numNext)*sizeof(StateRecord*);
+    curState->next    = newNext;
+    curState->numNext = newNumNext;
   }
+  curState->next[charClass] = nextState;
 }
 
-void NextStateMapping::assembleStateClassificationProbe(State *state,
-  Classifier::classSet_t classification) {
-  assembleStateProbe(state);
-  size_t stateSize = allocator->getStateSize();
-  for (size_t j = 0; j < sizeof(Classifier::classSet_t); j++) {
-    dfaStateProbe[stateSize+j] = ((uint8_t*)(&classification))[j];
+void NextStateMapping::setStateMetadata(StateRecord *stateRecord,
+                                        VarArray<NFA::State*> *reStarts,
+                                        NFA::State *tokenState,
+                                        bool hasCharTransitions) {
+  cacheBytes -= stateRecord->numReStarts*sizeof(NFA::State*);
+  clearStateMetadata(stateRecord);
+  size_t numReStarts = (reStarts ? reStarts->getNumItems() : 0);
+  if (numReStarts) {
+    stateRecord->reStarts =
+      (NFA::State**)calloc(numReStarts, sizeof(NFA::State*));
+    if (!stateRecord->reStarts) throw ParserException("Out of memory");
+    for (size_t i = 0; i < numReStarts; i++) {
+      stateRecord->reStarts[i] = reStarts->getItem(i, NULL);
+    }
+    stateRecord->numReStarts = numReStarts;
+    cacheBytes += numReStarts*sizeof(NFA::State*);
+  }
+  stateRecord->tokenState         = tokenState;
+  stateRecord->hasCharTransitions = hasCharTransitions;
+  if (tokenState) {
+    stateRecord->tokenId     = Token::unWrapTokenId(tokenState->matchData.t);
+    stateRecord->ignoreToken = Token::ignoreToken(tokenState->matchData.t);
   }
+  stateRecord->hasMetadata = true;
 }
 
-State *NextStateMapping::registerState(State *state) {
-  assembleStateProbe(state);
-  size_t stateSize = allocator->getStateSize();
-  State **registeredValue = (State**)hattrie_get(nextDFAStateMap,
-                                                 dfaStateProbe,
-                                                 stateSize);
-  if (!registeredValue) throw ParserException("Hat-Trie failure");
-  if (!*registeredValue) *registeredValue = state;
-  return *registeredValue;
+void NextStateMapping::clearStateMetadata(StateRecord *stateRecord) {
+  if (stateRecord->reStarts) free(stateRecord->reStarts);
+  stateRecord->hasMetadata = false;
+  stateRecord->ignoreToken = false;
+  stateRecord->numReStarts = 0;
+  stateRecord->reStarts    = NULL;
+  stateRecord->tokenState  = NULL;
+  stateRecord->tokenId     = 0;
+  stateRecord->hasCharTransitions = true;
 }
 
+size_t NextStateMapping::evictStates(VarArray<StateRecord*> *liveRecords) {
+  size_t numRecords = stateRecords.getNumItems();
+  bool *keep = (bool*)calloc(numRecords + 1, sizeof(bool));
+  if (!keep) throw ParserException("Out of memory");
+  for (size_t i = 0; i < numRecords; i++) {
+    keep[i] = stateRecords.getItem(i, NULL)->pinned;
+  }
+  for (size_t i = 0; liveRecords && (i < liveRecords->getNumItems()); i++) {
+    StateRecord *liveRecord = liveRecords->getItem(i, NULL);
+    if (liveRecord) keep[liveRecord->id] = true;
+  }
+
+  // clear the transition slots of the kept StateRecords which refer
+  // to evicted StateRecords
+  for (size_t i = 0; i < numRecords; i++) {
+    if (!keep[i]) continue;
+    StateRecord *stateRecord = stateRecords.getItem(i, NULL);
+    for (size_t j = 0; j < stateRecord->numNext; j++) {
+      if (stateRecord->next[j] && !keep[stateRecord->next[j]->id]) {
+        stateRecord->next[j] = NULL;
+      }
+    }
+  }
+
+  // rebuild the registry from the kept StateRecords, recycling the
+  // evicted StateRecords
+  VarArray<StateRecord*> oldRecords;
+  while (stateRecords.getNumItems()) oldRecords.pushItem(stateRecords.popItem());
+  hattrie_free(nextDFAStateMap);
+  nextDFAStateMap = hattrie_create();
+  cacheBytes      = 0;
+  size_t numEvicted = 0;
+  while (oldRecords.getNumItems()) {
+    // (oldRecords is in reverse id order)
+    StateRecord *stateRecord = oldRecords.popItem();
+    if (!keep[stateRecord->id]) {
+      if (stateRecord->next) free(stateRecord->next);
+      stateRecord->next    = NULL;
+      stateRecord->numNext = 0;
+      clearStateMetadata(stateRecord);
+      allocator->unallocateState(stateRecord->state);
+      stateRecord->state   = NULL;
+      freeRecords.pushItem(stateRecord);
+      numEvicted++;
+      continue;
+    }
+    StateRecord **registeredRecord =
+      (StateRecord**)hattrie_get(nextDFAStateMap,
+                                 stateRecord->state,
+                                 allocator->getStateSize());
+    if (!registeredRecord) throw ParserException("Hat-Trie failure");
+    *registeredRecord = stateRecord;
+    stateRecord->id = stateRecords.getNumItems();
+    stateRecords.pushItem(stateRecord);
+    cacheBytes += getRecordBytes() + stateRecord->numNext*sizeof(StateRecord*);
+    cacheBytes += stateRecord->numReStarts*sizeof(NFA::State*);
+  }
+  free(keep);
+  return numEvicted;
+}
@@ -2,116 +2,208 @@
 #define DFA_NEXT_STATE_MAPPING_H
 
 #include "dynUtf8Parser/dfa/stateAllocator.h"
+#include "dynUtf8Parser/dfa/characterClassMapping.h"
 
 namespace DeterministicFiniteAutomaton {
 
+  /// \brief A StateRecord is the registered (and hence unique)
+  /// representation of a DFA::State bit set.
+  ///
+  /// Each StateRecord has a compact integer id and owns the
+  /// transition slots to its successor StateRecords, indexed by the
+  /// CharacterClassMapping's character class. Once computed, a
+  /// transition is a single array load.
+  typedef struct StateRecord {
+    /// \brief The dense integer id of this StateRecord.
+    size_t id;
+
+    /// \brief The registered DFA::State bit set.
+    State *state;
+
+    /// \brief The successor StateRecords indexed by character class.
+    ///
+    /// A NULL slot denotes a transition which has not yet been
+    /// computed.
+    struct StateRecord **next;
+
+    /// \brief The number of slots in the next array.
+    size_t numNext;
+
+    /// \brief True if this StateRecord must never be evicted from
+    /// the NextStateMapping (see NextStateMapping::evictStates).
+    bool pinned;
+
+    /// \brief True once the PushDownMachine's metadata (below) has
+    /// been computed (see DFA::ensureStateMetadata).
+    bool hasMetadata;
+
+    /// \brief True if the tokenState's token should be ignored.
+    bool ignoreToken;
+
+    /// \brief The number of ReStart NFA::States in reStarts.
+    size_t numReStarts;
+
+    /// \brief The ReStart NFA::States of the DFA::State, in
+    /// NFA::State order, keeping only the first ReStart NFA::State
+    /// for each start state id.
+    NFA::State **reStarts;
+
+    /// \brief The accepting (NFA::Token) NFA::State of the
+    /// DFA::State, or NULL if the DFA::State does not accept a token.
+    NFA::State *tokenState;
+
+    /// \brief The (unwrapped) token id of the tokenState.
+    Token::TokenId tokenId;
+
+    /// \brief True if the DFA::State contains a Character or ClassSet
+    /// NFA::State (and so may move on to a next DFA::State).
+    bool hasCharTransitions;
+  } StateRecord;
+
   /// \brief The NextStateMapping class is used to implement the next state
   /// mapping which is the heart of the DFA interpreter for a given NFA.
   ///
   /// The NextStateMapping class ues the [Hat-Trie
-  /// library](https://github.com/dcjones/hat-trie).
+  /// library](https://github.com/dcjones/hat-trie) to register the
+  /// known DFA::State bit sets.
   class NextStateMapping {
     public:
 
       /// \brief Create a NextStateMapping object corresponding to a
       /// given collection of DFA::States for an NFA.
       ///
-      /// The StateAllocator, is associated to a specific NFA.
-      NextStateMapping(StateAllocator *anAllocator);
+      /// The StateAllocator, is associated to a specific NFA. The
+      /// transition slots of each StateRecord are allocated for
+      /// aNumCharacterClasses character classes.
+      NextStateMapping(StateAllocator *anAllocator,
+                       size_t aNumCharacterClasses);
 
       /// \brief Destroy the NextStateMapping object.
       ~NextStateMapping(void);
 
       /// \brief Register the DFA::State to ensure all DFA::State bit
-      /// sets use the *same* in memory object.
+      /// sets use the *same* StateRecord.
+      ///
+      /// If the DFA::State bit set has not previously been registered,
+      /// a new StateRecord (which takes ownership of the state) is
+      /// created, otherwise the existing StateRecord is returned (and
+      /// the caller retains ownership of the state).
       ///
       /// This registration process makes use of the nextDFAStateMap.
-      State *registerState(State *state);
-
-      /// \brief Using the current DFA::State and character, get the
-      /// next DFA::State (if known) from the nextDFAStateMap. If no
-      /// next DFA::State exits, register it with the nextDFAStateMap.
-      State **getNextStateByCharacter(State *curState, utf8Char_t c) {
-        assembleStateCharacterProbe(curState, c);
-        return (State**)hattrie_get(nextDFAStateMap,
-                                    dfaStateProbe,
-                                    dfaStateProbeSize);
+      StateRecord *registerState(State *state);
+
+      /// \brief Return the StateRecord (if any) previously registered
+      /// for the DFA::State bit set.
+      StateRecord *findState(State *state) {
+        StateRecord **registeredRecord =
+          (StateRecord**)hattrie_tryget(nextDFAStateMap,
+                                        state,
+                                        allocator->getStateSize());
+        if (!registeredRecord) return NULL;
+        return *registeredRecord;
       }
 
-      /// \brief Using the current DFA::State and character, get the
-      /// next DFA::State (if known) from the nextDFAStateMap. If no
-      /// next DFA::State exists, *do* *not* register it with the
-      /// nextDFAStateMap.
-      State **tryGetNextStateByCharacter(State *curState, utf8Char_t c) {
-        assembleStateCharacterProbe(curState, c);
-        return (State**)hattrie_tryget(nextDFAStateMap,
-                                       dfaStateProbe,
-                                       dfaStateProbeSize);
+      /// \brief Return the StateRecord with the given id.
+      StateRecord *getStateRecord(size_t stateId) {
+        return stateRecords.getItem(stateId, NULL);
       }
 
-      /// \brief Using the current DFA::State and classification, get
-      /// the next DFA::State (if known) from the nextDFAStateMap. If
-      /// no next DFA::State exits, register it with the
-      /// nextDFAStateMap.
-      State **getNextStateByClass(State *curState,
-                                  Classifier::classSet_t classSet) {
-        assembleStateClassificationProbe(curState, classSet);
-        return (State**)hattrie_get(nextDFAStateMap,
-                                    dfaStateProbe,
-                                    dfaStateProbeSize);
+      /// \brief Return the number of registered StateRecords.
+      size_t getNumStateRecords(void) {
+        return stateRecords.getNumItems();
       }
 
-      /// \brief Using the current DFA::State and classification, get
-      /// the next DFA::State (if known) from the nextDFAStateMap. If
-      /// no next DFA::State exists, *do* *not* register it with the
-      /// nextDFAStateMap.
-      State **tryGetNextStateByClass(State *curState,
-                                  Classifier::classSet_t classSet) {
-        assembleStateClassificationProbe(curState, classSet);
-        return (State**)hattrie_tryget(nextDFAStateMap,
-                                       dfaStateProbe,
-                                       dfaStateProbeSize);
+      /// \brief Return the (approximate) number of bytes used by the
+      /// registered StateRecords, their DFA::State bit sets (including
+      /// the Hat-Trie's copy of each bit set) and their transition
+      /// slots.
+      size_t getCacheBytes(void) {
+        return cacheBytes;
       }
 
-    protected:
+      /// \brief Set the PushDownMachine's metadata of the StateRecord
+      /// to the (ordered) ReStart NFA::States, the accepting
+      /// tokenState and the hasCharTransitions flag provided.
+      void setStateMetadata(StateRecord *stateRecord,
+                            VarArray<NFA::State*> *reStarts,
+                            NFA::State *tokenState,
+                            bool hasCharTransitions);
+
+      /// \brief Pin the StateRecord so that it is never evicted.
+      void pinState(StateRecord *stateRecord) {
+        stateRecord->pinned = true;
+      }
 
-      /// \brief Copy the DFA::DState bytes into the dfaStateProbe array.
-      void assembleStateProbe(State *state) {
-        allocator->copyStateIntoBuffer(state, dfaStateProbe, dfaStateProbeSize);
+      /// \brief Evict every registered StateRecord which is neither
+      /// pinned nor one of the liveRecords, returning
+      /// the number of StateRecords evicted.
+      ///
+      /// The evicted StateRecords (and their DFA::State bit sets) are
+      /// recycled by later registrations. Every transition slot which
+      /// refers to an evicted StateRecord is cleared, and the
+      /// remaining StateRecords are given new (dense) ids. Any
+      /// evicted StateRecord pointer held by the caller is no longer
+      /// valid.
+      size_t evictStates(VarArray<StateRecord*> *liveRecords);
+
+      /// \brief Return the (already computed) successor of the
+      /// StateRecord for the given character class, or NULL if this
+      /// transition has not yet been computed.
+      StateRecord *getNextState(StateRecord *curState, size_t charClass) {
+        if (curState->numNext <= charClass) return NULL;
+        return curState->next[charClass];
       }
 
-      /// \brief Copy the DFA::DState bytes followed by the bytes in
-      /// the utf8Char_t structure into the dfaStateProbe array.
-      void assembleStateCharacterProbe(State *dfaState,
-                                          utf8Char_t curChar);
+      /// \brief Record the successor of the StateRecord for the given
+      /// character class.
+      ///
+      /// The transition slots are allocated (for all character
+      /// classes) on the first call for a given StateRecord.
+      void setNextState(StateRecord *curState,
+                        size_t charClass,
+                        StateRecord *nextState);
 
-      /// \brief Copy the DFA::DState bytes followed by the bytes in
-      /// the Classifier::classSet_t structure into the dfaStateProbe
-      /// array.
-      void assembleStateClassificationProbe(State *dfaState,
-        Classifier::classSet_t classification);
+    protected:
 
       /// \brief The DFA::StateAllocator for this NextStateMapping.
       ///
-      /// This NextStateMapping maps DFA::State/character/classSet_t
-      /// patterns to their associated *next* DFA::states.  All such
-      /// DFA::States are allocated by this DFA::StateAllocator.
+      /// This NextStateMapping maps DFA::State bit sets to their
+      /// associated StateRecords. All such DFA::States are allocated
+      /// by this DFA::StateAllocator.
       StateAllocator *allocator;
 
-      /// \brief The Hat-Trie based next DFA::State mapping.
+      /// \brief The Hat-Trie based DFA::State registry.
       ///
-      /// This mapping is used both to register the known DFA::State(s),
-      /// as well as record any successor DFA::State(s) for a given
-      /// DFA::State + {character | classSet_t} combination.
+      /// This mapping is used to register the known DFA::State(s),
+      /// by mapping each DFA::State bit set to its StateRecord.
       hattrie_t   *nextDFAStateMap;
 
-      /// \brief The maximum size of a probe into the nextDFAStateMap
-      /// mapping.
-      size_t dfaStateProbeSize;
+      /// \brief The number of character classes used to index the
+      /// transition slots of each StateRecord.
+      size_t numCharacterClasses;
 
-      /// \brief Some (central-per-DFA) storage for probing the
-      /// nextDFAStateMap.
-      char  *dfaStateProbe;
+      /// \brief A BlockAllocator which allocates new StateRecords.
+      BlockAllocator *recordAllocator;
+
+      /// \brief All registered StateRecords indexed by their id.
+      VarArray<StateRecord*> stateRecords;
+
+      /// \brief The evicted StateRecords available for reuse.
+      VarArray<StateRecord*> freeRecords;
+
+      /// \brief The (approximate) number of bytes used by the
+      /// registered StateRecords.
+      size_t cacheBytes;
+
+      /// \brief Clear (and free) the PushDownMachine's metadata of the
+      /// StateRecord (the caller is responsible for the cacheBytes).
+      void clearStateMetadata(StateRecord *stateRecord);
+
+      /// \brief The (approximate) number of bytes used by each
+      /// registered StateRecord excluding its transition slots.
+      size_t getRecordBytes(void) {
+        return sizeof(StateRecord) + 2*allocator->getStateSize();
+      }
 
   }; // class NextStateMapping
 };  // namespace DeterministicFiniteAutomaton
@@ -5,40 +5,88 @@
 
 namespace DeterministicFiniteAutomaton {
 
+  /// \brief Return the 64 bit word of a DFA::State bit set whose bit
+  /// i (counting from the least significant bit) represents the
+  /// NFA::State numbered 64*wordNumber + i.
+  ///
+  /// The bytes of a DFA::State bit set are numbered in memory order,
+  /// so on big endian platforms the bytes of each word are swapped.
+  inline uint64_t getBitSetWord(const uint64_t *word) {
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    return __builtin_bswap64(*word);
+#else
+    return *word;
+#endif
+  }
+
   /// \brief The NFAStateIterator class encapsulates the state required
   /// to iterate over the NFA states in a DFA::State bit set.
+  ///
+  /// The DFA::State bit set is scanned a 64 bit word at a time, and
+  /// each set bit is found using count-trailing-zeros, so the cost of
+  /// an iteration is proportional to the number of words plus the
+  /// number of set bits.
   class NFAStateIterator {
 
     public:
 
+      /// \brief Create an empty NFAStateIterator (over no DFA::State).
+      NFAStateIterator(void) {
+        origDState = NULL;
+        curWord = NULL;
+        endWord = NULL;
+        curBits = 0;
+        curNFAStateNum = 0;
+        nfaStateMapping = NULL;
+      }
+
       /// \brief Destroy an NFAStateIterator object.
       ~NFAStateIterator(void) {
-        curByte = NULL;
-        endByte = NULL;
-        curBit  = 0;
+        curWord = NULL;
+        endWord = NULL;
+        curBits = 0;
         curNFAStateNum = 0;
         nfaStateMapping = NULL;
       };
 
       /// \brief Return the next NFA::State in the DFA::State bit set.
       NFA::State *nextState(void) {
-        while (curByte < endByte) {
-          while (curBit < 256) {
-            if (*curByte & curBit) {
-              NFA::State *nfaState =
-                nfaStateMapping->getNFAStateFor(curNFAStateNum);
-              curBit <<= 1;
-              curNFAStateNum++;
-              return nfaState;
-            } else {
-              curBit <<= 1;
-              curNFAStateNum++;
-            }
-          }
-          curBit = 1;
-          curByte++;
+        while (!curBits) {
+          if (endWord <= curWord) return NULL;
+          curNFAStateNum = (curWord - (uint64_t*)origDState)*64;
+          curBits = getBitSetWord(curWord);
+          curWord++;
+        }
+        size_t bit = __builtin_ctzll(curBits);
+        curBits &= curBits - 1; // clear the lowest set bit
+        return nfaStateMapping->getNFAStateFor(curNFAStateNum + bit);
+      }
+
+      /// \brief Collect (at most maxStates of) the remaining
+      /// NFA::States in the DFA::State bit set into the nfaStates
+      /// array, returning the number collected.
+      ///
+      /// This bulk method visits all of the set states in one tight
+      /// (inlined) loop, so callers can then process the NFA::States
+      /// without interleaving the bit set scan.
+      size_t nextStates(NFA::State **nfaStates, size_t maxStates) {
+        size_t numStates = 0;
+        while (numStates < maxStates) {
+          NFA::State *nfaState = nextState();
+          if (!nfaState) break;
+          nfaStates[numStates++] = nfaState;
+        }
+        return numStates;
+      }
+
+      /// \brief Return the number of NFA::States remaining in the
+      /// DFA::State bit set.
+      size_t numRemainingStates(void) {
+        size_t numStates = __builtin_popcountll(curBits);
+        for (uint64_t *word = curWord; word < endWord; word++) {
+          numStates += __builtin_popcountll(*word);
         }
-        return NULL;
+        return numStates;
       }
 
     protected:
@@ -52,14 +100,16 @@ namespace DeterministicFiniteAutomaton {
       ///
       /// This method can only be invoked by a StateAllocator, which is
       /// the only object which has all of the information to
-      /// successfully create an NFAStateIterator.
+      /// successfully create an NFAStateIterator. The DFA::State must
+      /// be (at least) 64 bit aligned and stateSize must be a
+      /// multiple of 8 bytes.
       NFAStateIterator(NFAStateMapping *aMapping,
                        size_t stateSize,
                        State *state) {
         origDState = state;
-        curByte = state;
-        endByte = curByte + stateSize;
-        curBit  = 1;
+        curWord = (uint64_t*)state;
+        endWord = curWord + (stateSize / sizeof(uint64_t));
+        curBits = 0;
         curNFAStateNum = 0;
         nfaStateMapping = aMapping;
       }
@@ -70,20 +120,20 @@ namespace DeterministicFiniteAutomaton {
       NFAStateMapping *nfaStateMapping;
 
       /// \brief The index into NFAStateMapping's int2nfaStatePtr
-      /// mapping for the current bit in the DFA::State bit set.
+      /// mapping for bit zero of the word held in curBits.
       size_t   curNFAStateNum;
 
-      /// \brief A pointer to the current byte in the DFA::State bit
-      /// set (which is an array of bytes).
-      char    *curByte;
+      /// \brief A pointer to the next (unscanned) word in the
+      /// DFA::State bit set.
+      uint64_t *curWord;
 
-      /// \brief A pointer to the end of the DFA::State bit sets array
-      /// of bytes.
-      char    *endByte;
+      /// \brief A pointer to the end of the DFA::State bit set's array
+      /// of words.
+      uint64_t *endWord;
 
-      /// \brief The current bit in the current byte in the DFA::State
-      /// bit set.
-      size_t  curBit;
+      /// \brief The bits of the current word which have not yet been
+      /// returned.
+      uint64_t curBits;
 
       /// \brief The original DFA State on which this iterator was
       /// created.
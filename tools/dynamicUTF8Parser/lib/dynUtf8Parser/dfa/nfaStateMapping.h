@@ -17,8 +17,8 @@ namespace DeterministicFiniteAutomaton {
   /// mapping from the NFA::State(s) of a given NFA to the DFAState(s)
   /// of a DFA which is interpreting the NFA.
   ///
-  /// The NFAStateMapping class uses the [Hat-Trie
-  /// library](https://github.com/dcjones/hat-trie).
+  /// Each NFA::State is represented by the bit whose number is the
+  /// NFA::State's (dense) id.
   class NFAStateMapping {
     public:
 
@@ -47,9 +47,22 @@ namespace DeterministicFiniteAutomaton {
       /// NFA::State.
       ///
       /// This method is the inverse to the getNFAStateFor method.
-      /// This method uses the nfaStatePtr2int mapping.
+      /// The bit number is the NFA::State's dense id, assigned by
+      /// NFA::addState, so no lookup is required.
       NFAStateNumber getNFAStateNumber(NFA::State *nfaState)
-        throw (ParserException);
+        throw (ParserException) {
+        NFAStateNumber nfaStateNumber;
+        nfaStateNumber.stateByte = 0;
+        nfaStateNumber.stateBit  = 0;
+        if (!nfaState) return nfaStateNumber;
+        if ((int2nfaStatePtrSize <= nfaState->id) ||
+            (int2nfaStatePtr[nfaState->id] != nfaState)) {
+          throw ParserException("unknown NFA state used in NFAStateMapping");
+        }
+        nfaStateNumber.stateByte = nfaState->id / 8;
+        nfaStateNumber.stateBit  = 1 << (nfaState->id % 8);
+        return nfaStateNumber;
+      }
 
       /// \brief Return the NFA::State represented by a given
       /// NFAStateNumber.
@@ -57,7 +70,7 @@ namespace DeterministicFiniteAutomaton {
       /// This method is the inverse to the getNFAStateNumber method.
       /// This method used the int2nfaStatePtr mapping.
       NFA::State *getNFAStateFor(size_t nfaStateNumber) {
-        if (numKnownNFAStates <= nfaStateNumber) {
+        if (int2nfaStatePtrSize <= nfaStateNumber) {
           throw ParserException("invalid NFA state requested in NFAStateMapping");
         }
         return int2nfaStatePtr[nfaStateNumber];
@@ -72,30 +85,18 @@ namespace DeterministicFiniteAutomaton {
       /// DFA::StateAllocator.
       StateAllocator *allocator;
 
-      /// \brief A vector of known NFA::States.
+      /// \brief A vector of known NFA::States indexed by their id.
       ///
       /// This vector provides an integer to NFA::State mapping.
       ///
       /// Note that for a given NFA, the number of NFA::States is fixed,
-      /// so the length of this vector if fixed when the
-      /// DFA::NFAStateMapping is created.
+      /// so this vector is filled when the DFA::NFAStateMapping is
+      /// created.
       NFA::State **int2nfaStatePtr;
 
       /// \brief The size of the int2nfaStatePtr vector.
       size_t int2nfaStatePtrSize;
 
-      /// \brief The number of *currently* "known" NFA::State(s).
-      ///
-      /// The "known" NFA::State(s) are those that have been reached,
-      /// while compiling the DFA on the fly, from one or more of the
-      /// NFA start states.
-      size_t numKnownNFAStates;
-
-      /// \brief The Hat-Trie based nfaStatePtr to integer mapping.
-      ///
-      /// This is the inverse mapping to the int2nfaStatePtr mapping.
-      hattrie_t   *nfaStatePtr2int;
-
   }; // class StateMapping
 };  // namespace DeterministicFiniteAutomaton
 
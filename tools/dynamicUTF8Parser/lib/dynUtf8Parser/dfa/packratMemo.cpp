@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dynUtf8Parser/dfa/packratMemo.h"
+
+using namespace DeterministicFiniteAutomaton;
+
+PackratMemo::PackratMemo(void) {
+  entries     = NULL;
+  entriesSize = 0;
+  numEntries  = 0;
+  tokenBytes  = 0;
+  budget      = 0;
+  lookups     = 0;
+  hits        = 0;
+  flushes     = 0;
+}
+
+PackratMemo::~PackratMemo(void) {
+  clear();
+  if (entries) free(entries);
+  entries     = NULL;
+  entriesSize = 0;
+}
+
+void PackratMemo::clear(void) {
+  if (numEntries) {
+    for (size_t i = 0; i < entriesSize; i++) {
+      if (entries[i].ownsToken) delete entries[i].token;
+    }
+    memset(entries, 0, entriesSize*sizeof(Entry));
+  }
+  numEntries = 0;
+  tokenBytes = 0;
+}
+
+PackratMemo::Entry *PackratMemo::newEntry(NFA::StartStateId startStateId,
+                                          size_t offset,
+                                          size_t extraBytes) {
+  if (!budget) return NULL;
+  // keep the table at most half full
+  size_t newSize = entriesSize;
+  if (!newSize) newSize = initialNumEntries;
+  if (newSize <= 2*(numEntries + 1)) newSize *= 2;
+  if (budget < newSize*sizeof(Entry) + tokenBytes + extraBytes) {
+    // over budget... so start again with the current table
+    if (numEntries) flushes++;
+    clear();
+    if (entriesSize) newSize = entriesSize;
+    if (budget < newSize*sizeof(Entry) + extraBytes) return NULL;
+  }
+  if (entriesSize < newSize) {
+    Entry *oldEntries = entries;
+    size_t oldSize    = entriesSize;
+    entries = (Entry*)calloc(newSize, sizeof(Entry));
+    if (!entries) throw ParserException("Out of memory");
+    entriesSize = newSize;
+    for (size_t i = 0; i < oldSize; i++) {
+      if (!oldEntries[i].used) continue;
+      *findEntry(oldEntries[i].startStateId, oldEntries[i].offset) =
+        oldEntries[i];
+    }
+    if (oldEntries) free(oldEntries);
+  }
+  Entry *entry = findEntry(startStateId, offset);
+  ASSERT(!entry->used);
+  entry->startStateId = startStateId;
+  entry->offset       = offset;
+  entry->endOffset    = offset;
+  entry->token        = NULL;
+  entry->ownsToken    = false;
+  entry->used         = true;
+  entry->matched      = false;
+  numEntries++;
+  tokenBytes += extraBytes;
+  return entry;
+}
+
+void PackratMemo::recordMatch(NFA::StartStateId startStateId,
+                              size_t offset,
+                              size_t endOffset,
+                              Token *token,
+                              bool shareToken) {
+  if (numEntries && findEntry(startStateId, offset)->used) return;
+  size_t extraBytes = 0;
+  if (token && !shareToken) extraBytes = token->countTokens()*sizeof(Token);
+  Entry *entry = newEntry(startStateId, offset, extraBytes);
+  if (!entry) return;
+  entry->endOffset = endOffset;
+  entry->matched   = true;
+  if (!token) return;
+  entry->token     = (shareToken ? token : token->clone());
+  entry->ownsToken = !shareToken;
+}
+
+void PackratMemo::recordFailure(NFA::StartStateId startStateId,
+                                size_t offset) {
+  if (numEntries && findEntry(startStateId, offset)->used) return;
+  newEntry(startStateId, offset, 0);
+}
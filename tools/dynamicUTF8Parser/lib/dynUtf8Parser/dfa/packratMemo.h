@@ -0,0 +1,195 @@
+#ifndef DFA_PACKRAT_MEMO_H
+#define DFA_PACKRAT_MEMO_H
+
+#include "dynUtf8Parser/nfa.h"
+
+namespace DeterministicFiniteAutomaton {
+
+  /// \brief The PackratMemo class records the outcome of running the
+  /// rule of a given start state from a given offset in the stream.
+  ///
+  /// The PushDownMachine's first successful match of a rule at a
+  /// given offset is the only match it will ever use, so (as in a
+  /// packrat parser) the outcome of a rule at an offset never
+  /// changes. Once recorded, a backtracking PushDownMachine need
+  /// never run that rule at that offset again.
+  ///
+  /// The PackratMemo is a (linearly probed) hash table keyed by the
+  /// (startStateId, offset) pair. Its (approximate) size is bounded
+  /// by a budget, once exceeded the whole table is flushed.
+  class PackratMemo {
+    public:
+
+      /// \brief An Entry records the outcome of the rule of
+      /// startStateId started at offset.
+      typedef struct Entry {
+        /// \brief The start state of the rule.
+        NFA::StartStateId startStateId;
+
+        /// \brief The offset (in the stream) at which the rule started.
+        size_t offset;
+
+        /// \brief The offset (in the stream) at which a match ended.
+        size_t endOffset;
+
+        /// \brief The token recognized by a match, or NULL if the
+        /// rule failed or its token is ignored.
+        Token *token;
+
+        /// \brief True if this Entry owns (and so deletes) its token.
+        bool ownsToken;
+
+        /// \brief True if this Entry is in use.
+        bool used;
+
+        /// \brief True if the rule matched, false if it failed.
+        bool matched;
+      } Entry;
+
+      /// \brief The number of Entries initially allocated.
+      static const size_t initialNumEntries = 256;
+
+      /// \brief Create an (empty and disabled) PackratMemo.
+      PackratMemo(void);
+
+      /// \brief Destroy the PackratMemo (and its tokens).
+      ~PackratMemo(void);
+
+      /// \brief Limit the (approximate) number of bytes used by the
+      /// PackratMemo to maxBytes.
+      ///
+      /// A zero maxBytes (the default) disables the PackratMemo.
+      void setBudget(size_t maxBytes) {
+        budget = maxBytes;
+        if (!budget) clear();
+      }
+
+      /// \brief Return the PackratMemo's budget (zero if disabled).
+      size_t getBudget(void) {
+        return budget;
+      }
+
+      /// \brief Return true if the PackratMemo is in use.
+      bool isEnabled(void) {
+        return budget != 0;
+      }
+
+      /// \brief Return the Entry recording the outcome of the rule of
+      /// startStateId started at offset, or NULL if it is unknown.
+      const Entry *lookup(NFA::StartStateId startStateId, size_t offset) {
+        lookups++;
+        if (!numEntries) return NULL;
+        Entry *entry = findEntry(startStateId, offset);
+        if (!entry->used) return NULL;
+        hits++;
+        return entry;
+      }
+
+      /// \brief Record that the rule of startStateId, started at
+      /// offset, matched up to endOffset recognizing the token
+      /// provided (NULL if its token is ignored).
+      ///
+      /// Unless shareToken is true, the token is cloned, so remains
+      /// owned by the caller. A shared token (for example one owned by
+      /// a TokenArena) is neither copied nor deleted, so must outlive
+      /// the PackratMemo's next clear.
+      void recordMatch(NFA::StartStateId startStateId, size_t offset,
+                       size_t endOffset, Token *token,
+                       bool shareToken = false);
+
+      /// \brief Record that the rule of startStateId, started at
+      /// offset, failed.
+      void recordFailure(NFA::StartStateId startStateId, size_t offset);
+
+      /// \brief Remove (and delete the owned tokens of) every Entry.
+      void clear(void);
+
+      /// \brief Return the number of Entries in use.
+      size_t getNumEntries(void) {
+        return numEntries;
+      }
+
+      /// \brief Return the (approximate) number of bytes used by the
+      /// PackratMemo.
+      size_t getNumBytes(void) {
+        return entriesSize*sizeof(Entry) + tokenBytes;
+      }
+
+      /// \brief Return the number of calls to lookup.
+      size_t getNumLookups(void) {
+        return lookups;
+      }
+
+      /// \brief Return the number of calls to lookup which found an
+      /// Entry.
+      size_t getNumHits(void) {
+        return hits;
+      }
+
+      /// \brief Return the number of times the PackratMemo has been
+      /// flushed because it exceeded its budget.
+      size_t getNumFlushes(void) {
+        return flushes;
+      }
+
+      /// \brief Reset the lookup, hit and flush counters to zero.
+      void resetStatistics(void) {
+        lookups = 0;
+        hits    = 0;
+        flushes = 0;
+      }
+
+    protected:
+
+      /// \brief Return the Entry for the (startStateId, offset) key,
+      /// or the (unused) Entry where it should be stored.
+      Entry *findEntry(NFA::StartStateId startStateId, size_t offset) {
+        uint64_t hash = ((uint64_t)startStateId * 0x9E3779B97F4A7C15ULL) ^
+          ((uint64_t)offset * 0xC2B2AE3D27D4EB4FULL);
+        size_t mask = entriesSize - 1;
+        size_t i = (size_t)(hash ^ (hash >> 29)) & mask;
+        while (entries[i].used &&
+               ((entries[i].startStateId != startStateId) ||
+                (entries[i].offset != offset))) {
+          i = (i + 1) & mask;
+        }
+        return entries + i;
+      }
+
+      /// \brief Return a new (unused) Entry for the (startStateId,
+      /// offset) key, growing or (if over budget) flushing the table
+      /// to make room for extraBytes more, or NULL if the Entry can
+      /// not fit within the budget.
+      Entry *newEntry(NFA::StartStateId startStateId, size_t offset,
+                      size_t extraBytes);
+
+      /// \brief The (power of two sized) hash table of Entries.
+      Entry *entries;
+
+      /// \brief The number of Entries allocated.
+      size_t entriesSize;
+
+      /// \brief The number of Entries in use.
+      size_t numEntries;
+
+      /// \brief The (approximate) number of bytes used by the tokens
+      /// of the Entries.
+      size_t tokenBytes;
+
+      /// \brief The maximum (approximate) number of bytes of the
+      /// PackratMemo, or zero if disabled.
+      size_t budget;
+
+      /// \brief The number of calls to lookup.
+      size_t lookups;
+
+      /// \brief The number of calls to lookup which found an Entry.
+      size_t hits;
+
+      /// \brief The number of times the PackratMemo has been flushed.
+      size_t flushes;
+  };
+
+}; // namespace DeterministicFiniteAutomaton
+
+#endif
@@ -24,7 +24,7 @@ void PDMTracer::reportNFAState(NFA::State *nfaState,
 void PDMTracer::reportDFAState(size_t indent) {
   if (!traceFile || !trace(DFAState)) return;
    NFAStateIterator iterator =
-    pdm->allocator->newIteratorOn(pdm->curState.dState);
+    pdm->allocator->newIteratorOn(pdm->curState.getDState());
   fprintf(traceFile, "%sCurrent state: %s(%s)\n", indents[indent],
           pdm->curState.getStateTypeMessage(),
           pdm->curState.getStartStateMessage());
@@ -41,10 +41,11 @@ void PDMTracer::reportAutomataStack(size_t indent) {
   fprintf(traceFile, "%sAutomataStack (%zu):\n", indents[indent],
           pdm->stack.getNumItems());
   for (size_t i = 0; i < pdm->stack.getNumItems(); i++) {
+    AutomataState::Frame &frame = pdm->stack.getFrame(i);
     fprintf(traceFile, "%s%zu: %s(%s)\n",
       indents[indent+1], i,
-      pdm->stack.getItem(i, AutomataState()).getStateTypeMessage(),
-      pdm->stack.getItem(i, AutomataState()).getStartStateMessage());
+      AutomataState::getStateTypeMessage(frame.frameType),
+      pdm->curState.getStartStateMessage(frame.startStateId));
   }
   fprintf(traceFile, "-------------------------------------\n");
 }
@@ -58,19 +59,20 @@ void PDMTracer::reportState(size_t indent) {
   fprintf(traceFile, "\n");
   reportTokens(indent);
   reportDFAState(indent);
-  ASSERT(pdm->curState.dState == pdm->curState.iterator->origDState);
 }
 
 void PDMTracer::reportStreamPrefix(void) {
   if (!traceFile) return;
-  char *prefix = pdm->curState.stream->getCopyOfTextRead();
+  char *prefix =
+    pdm->curState.stream->getCopyOfTextRead(&pdm->curState.cursor);
   fprintf(traceFile, "[%s]", prefix);
   free(prefix);
 }
 
 void PDMTracer::reportStreamPostfix(void) {
   if (!traceFile) return;
-  char *postfix = pdm->curState.stream->getCopyOfTextToRead(30);
+  char *postfix =
+    pdm->curState.stream->getCopyOfTextToRead(&pdm->curState.cursor, 30);
   fprintf(traceFile, "[%s]", postfix);
   free(postfix);
 }
@@ -88,7 +90,10 @@ void PDMTracer::reportChar(utf8Char_t curChar, size_t indent) {
 void PDMTracer::reportTokens(size_t indent) {
   if (!traceFile || !trace(PDMTokens)) return;
   fprintf(traceFile, "----------tokens---------------------\n");
-    pdm->curState.token->printOn(traceFile, indent+1);
+  for (size_t i = pdm->curState.getTokenStart();
+       i < pdm->tokenBuilder.getNumItems(); i++) {
+    pdm->tokenBuilder.getItem(i, NULL)->printOn(traceFile, indent+1);
+  }
   fprintf(traceFile, "-------------------------------------\n");
 }
 
@@ -104,10 +109,10 @@ void PDMTracer::pop(const char *message0, const char *message1, size_t indent) {
   if (!traceFile || !trace(StackPops)) return;
   const char *stateTypeMessage = "unknown";
   if (pdm->stack.getNumItems()) stateTypeMessage =
-    pdm->stack.getTop().getStateTypeMessage();
+    AutomataState::getStateTypeMessage(pdm->stack.getTop().frameType);
   const char *startStateMessage = "stack empty";
   if (pdm->stack.getNumItems()) startStateMessage =
-    pdm->stack.getTop().getStartStateMessage();
+    pdm->curState.getStartStateMessage(pdm->stack.getTop().startStateId);
   fprintf(traceFile, "%spop::%s(%s) (%s%s)\n", indents[indent],
           stateTypeMessage, startStateMessage,
           message0, message1);
@@ -135,13 +140,15 @@ void PDMTracer::restart(size_t indent) {
 
 void PDMTracer::match(NFA::State *nfaState, size_t indent) {
   if (!traceFile || !trace(PDMMatch)) return;
-  size_t textSize = pdm->curState.stream->getNumberOfBytesRead()+10;
+  Utf8Chars *stream = pdm->curState.stream;
+  Utf8Chars::Cursor *cursor = &pdm->curState.cursor;
+  size_t textSize = stream->getNumberOfBytesRead(cursor)+10;
   char text[textSize];
   memset(text, 0, textSize);
-  strncpy(text, pdm->curState.stream->getStart(),
-          pdm->curState.stream->getNumberOfBytesRead());
+  strncpy(text, stream->getStart(cursor),
+          stream->getNumberOfBytesRead(cursor));
   fprintf(traceFile, "%s [%s](%zu)\n",
-          nfaState->message, text, pdm->curState.stream->getNumberOfBytesRead());
+          nfaState->message, text, stream->getNumberOfBytesRead(cursor));
 }
 
 
@@ -11,101 +11,200 @@ Token *PushDownMachine::runFromUsing(NFA::StartStateId startStateId,
                                      Utf8Chars *charStream,
                                      PDMTracer *pdmTracer,
                                      bool       partialOK) {
+  startRun(startStateId, charStream, pdmTracer);
+  return continueRun(pdmTracer, partialOK);
+}
+
+PushDownMachine::PushStatus PushDownMachine::feed(const char *someBytes,
+                                                  size_t numBytes) {
+  if (pushStatus != PushSuspended) return pushStatus;
+  pushStream->append(someBytes, numBytes);
+  return resumePushing();
+}
+
+PushDownMachine::PushStatus PushDownMachine::finish(void) {
+  if (pushStatus != PushSuspended) return pushStatus;
+  if (pushStream->endsMidCharacter()) {
+    // the document ends part way through a UTF8 character
+    curState.clear();
+    stack.clear();
+    discardTokensFrom(0);
+    return stopPushing(PushFailed);
+  }
+  pushStream->finish();
+  return resumePushing();
+}
+
+PushDownMachine::PushStatus PushDownMachine::resumePushing(void) {
+  curState.setStream(pushStream->getStream());
+  continueRun(NULL, false);
+  if (suspended) {
+    // keep only the bytes which may still be read
+    pushStream->discardBefore(getFirstLiveOffset());
+    curState.setStream(pushStream->getStream());
+    return PushSuspended;
+  }
+  return stopPushing(matched ? PushMatched : PushFailed);
+}
+
+void PushDownMachine::startRun(NFA::StartStateId startStateId,
+                               Utf8Chars *charStream,
+                               PDMTracer *pdmTracer) {
 
   if (pdmTracer) pdmTracer->setPDM(this);
 
+  stack.clear();
+  discardTokensFrom(0);
+  memo.clear();
+  matched    = false;
+  pushStatus = PushIdle;
   curState.initialize(dfa, charStream, startStateId);
+  enterToken();
+}
+
+Token *PushDownMachine::continueRun(PDMTracer *pdmTracer,
+                                    bool       partialOK) {
+  suspended = false;
 
   restart:
   while(true) {
+    // a push mode run is suspended (until the next chunk is fed)
+    // once it has read every complete UTF8 character fed so far
+    if ((pushStatus == PushSuspended) && curState.atEnd() &&
+        !pushStream->isFinished()) {
+      suspended = true;
+      return NULL;
+    }
     ASSERT(stack.invariant());
     ASSERT(curState.invariant());
     if (pdmTracer) pdmTracer->reportState();
 
-    // scan current dfa state for ReStart NFA states
+    // try the current dfa state's next (cached) ReStart NFA state
     if (pdmTracer) pdmTracer->checkForRestart();
-    while(NFA::State *nfaState = curState.getIterator()->nextState()) {
-      if (nfaState->matchType == NFA::ReStart) {
-        // we need to try this path
-        //
-        // setup the backtrack state...
+    NFA::State *nfaState = curState.nextReStartState();
+    if (nfaState) {
+      // skip any ReStart NFA states whose rules can not start with
+      // the next character (they would fail on their first character)
+      utf8Char_t upcomingChar = curState.peekUtf8Char();
+      while (nfaState &&
+             !dfa->mayStartWith(nfaState->matchData.r, upcomingChar)) {
+        numPrunedReStarts++;
+        nfaState = curState.nextReStartState();
+      }
+    }
+    if (nfaState && memo.isEnabled()) {
+      const PackratMemo::Entry *entry =
+        memo.lookup(nfaState->matchData.r, curState.getCursor()->next);
+      if (entry) {
+        // we already know the outcome of this path...
+        // ... a failure is simply skipped
+        if (!entry->matched) goto restart;
+        // ... a match continues (as if the rule had been run)
+        // from the end of the match
         curState.setStateType(AutomataState::ASBackTrack);
-        // clear this NFA::State out of the backTrack DFA state
-        curState.clearNFAStatesWithSameRestartState(nfaState->matchData.r);
         if (pdmTracer) pdmTracer->push("TODO");
-        stack.pushItem(curState);
-
-        // setup the call continue state...
+        pushCurState();
         curState.setStateType(AutomataState::ASContinue);
         curState.setDState(dfa->getDFAStateFromNFAState(nfaState));
-        curState.cloneSubStream(false);
-        curState.cloneToken(true);
-        if (pdmTracer) pdmTracer->push("TODO");
-        stack.pushItem(curState);
-
-        // now set up the subDFA state
-        curState.setStateType(AutomataState::ASRestart);
-        curState.setStartStateId(nfaState->matchData.r);
-        curState.cloneSubStream(true);
-        curState.cloneToken(false);
-        if (pdmTracer) pdmTracer->restart();
+        curState.skipTo(entry->endOffset);
+        // (the TokenArena's tokens are shared rather than copied)
+        if (entry->token) {
+          tokenBuilder.pushItem(tokenArena ? entry->token
+                                           : entry->token->clone());
+        }
         goto restart;
       }
     }
-    // we have scanned the dfa state for any ReStart NFA states
-    // and none remain.... so we now transition to the next DFA state
-    utf8Char_t nextChar = curState.getStream()->nextUtf8Char();
+    if (nfaState) {
+      // we need to try this path
+      //
+      // setup the backtrack state...
+      // (which continues with the next ReStart NFA::State)
+      curState.setStateType(AutomataState::ASBackTrack);
+      if (pdmTracer) pdmTracer->push("TODO");
+      pushCurState();
+
+      // setup the call continue state...
+      // (which continues to build the same token)
+      curState.setStateType(AutomataState::ASContinue);
+      curState.setDState(dfa->getDFAStateFromNFAState(nfaState));
+      if (pdmTracer) pdmTracer->push("TODO");
+      pushCurState();
+
+      // now set up the subDFA state
+      // (whose child tokens start at the top of the token builder)
+      curState.setStateType(AutomataState::ASRestart);
+      curState.setStartStateId(nfaState->matchData.r);
+      curState.startSubStream();
+      curState.startToken(getNumBuiltTokens());
+      enterToken();
+      if (pdmTracer) pdmTracer->restart();
+      goto restart;
+    }
+    // we have tried all of the dfa state's ReStart NFA states
+    // .... so we now transition to the next DFA state
+    utf8Char_t nextChar = curState.nextUtf8Char();
     if (pdmTracer) pdmTracer->reportChar(nextChar);
-    State *nextDFAState =
-      dfa->getNextDFAState(curState.getDState(), nextChar);
+    // keep the DFA's cache within its budget
+    if (dfa->isCacheOverBudget()) flushDFACache();
+    StateRecord *nextDFAState =
+      dfa->getNextDFAState(curState.getStateRecord(), nextChar);
 
     if (nextDFAState) {
       // we have a suitable nextDFAState...
       // so we greedily restart with the new nextDFAState
       if (pdmTracer) pdmTracer->nextDFAState();
-      curState.setDState(nextDFAState, true);
+      curState.setDState(nextDFAState);
       goto restart;
     }
 
     // there is no suitable nextDFAState given the current character
     // so push that character back (unless the nextChar is NULL).
-    if (nextChar.c[0]) curState.getStream()->backup();
+    if (nextChar.c[0]) curState.backup();
 
     // does the current DFAState contain a token(match) NFA::State?
-    NFA::State *tokenNFAState =
-        curState.stateMatchesToken(dfa->getTokensState());
-    if (tokenNFAState && (tokenNFAState->matchType == NFA::Token)) {
-      if (pdmTracer) pdmTracer->match(tokenNFAState);
+    StateRecord *tokenRecord = curState.getStateRecord();
+    if (tokenRecord->tokenState) {
+      if (pdmTracer) pdmTracer->match(tokenRecord->tokenState);
       // we have a match... wrap up this token
-      curState.setTokenId(Token::unWrapTokenId(tokenNFAState->matchData.t));
-      curState.setTokenText();
-      Token *token = curState.releaseToken();
-
       // we have found a match...
       // so pop the stack until we reach a continue state
+      NFA::StartStateId matchStartStateId = curState.getStartStateId();
+      Utf8Chars::Cursor matchCursor = *curState.getCursor();
       popUntil(AutomataState::ASContinue, pdmTracer);
 
+      // an ignored token is never built
+      // (unless it is the whole match)
+      bool ignoreToken =
+        tokenRecord->ignoreToken && (0 < stack.getNumItems());
+      Token *token = buildToken(tokenRecord->tokenId, ignoreToken);
+
       if (0 < stack.getNumItems()) {
         // we have reached a continue state
         // so pop the stack keeping the current stream and restart
         popKeepStreamPosition(pdmTracer); // use the continue state
         if (pdmTracer) pdmTracer->reportDFAState();
-        if (Token::ignoreToken(tokenNFAState->matchData.t)) {
-          delete token;
-          goto restart;
+        if (memo.isEnabled() && buildsTokens()) {
+          memo.recordMatch(matchStartStateId, matchCursor.start,
+                           matchCursor.next, token, tokenArena != NULL);
         }
-        curState.addChildToken(token);
-        delete token; // addChildToken takes a clone
+        commitEvents();
+        if (ignoreToken) goto restart;
+        // the token is now a child of the continue state's token
+        pushBuiltToken(token);
         goto restart;
       }
 
-      if (partialOK || curState.getStream()->atEnd()) {
+      if (partialOK || curState.atEnd()) {
         // we have a match, the stack is empty and ...
         // we are at the end of the stream
         // (or we are happy with a partial match)...
         // so return this token and we are done!
         if (pdmTracer) pdmTracer->done();
         curState.clear();
+        if (flatTree) flatTree->setRoot(builtNode);
+        matched = true;
+        commitEvents();
         return token;
       }
 
@@ -114,10 +213,8 @@ Token *PushDownMachine::runFromUsing(NFA::StartStateId startStateId,
       // so return the NULL token we have FAILED.
       if (pdmTracer) pdmTracer->failedWithStream();
       curState.clear();
-      if (token) {
-        //printf("token: %p deleting token (runFromUsing)\n", token);
-        delete token;
-      }
+      discardTokensFrom(0);
+      releaseToken(token);
       return NULL;
     }
 
@@ -125,6 +222,7 @@ Token *PushDownMachine::runFromUsing(NFA::StartStateId startStateId,
     // AND the current DFAState does not contain a suitable token(match)
     // so we need to backtrack and try the next possible path
     if (pdmTracer) pdmTracer->backtrack();
+    if (memo.isEnabled()) memoizeFailedRules();
     popUntil(AutomataState::ASBackTrack, pdmTracer);
 
     if (!stack.getNumItems()) {
@@ -132,6 +230,7 @@ Token *PushDownMachine::runFromUsing(NFA::StartStateId startStateId,
       // ... so we give up by returning the NULL token.
       if (pdmTracer) pdmTracer->failedBacktrack();
       curState.clear();
+      discardTokensFrom(0);
       return NULL;
     }
 
@@ -141,5 +240,8 @@ Token *PushDownMachine::runFromUsing(NFA::StartStateId startStateId,
   // if we have reached this point we have failed!
   if (pdmTracer) pdmTracer->errorReturn();
   curState.clear();
+  stack.clear();
+  discardTokensFrom(0);
+  memo.clear();
   return NULL;
 }
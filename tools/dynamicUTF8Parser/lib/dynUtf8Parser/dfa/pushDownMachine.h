@@ -2,6 +2,11 @@
 #define PUSH_DOWN_MACHINE_H
 
 #include "dynUtf8Parser/dfa/automataState.h"
+#include "dynUtf8Parser/dfa/packratMemo.h"
+#include "dynUtf8Parser/tokenArena.h"
+#include "dynUtf8Parser/flatTokenTree.h"
+#include "dynUtf8Parser/pushStream.h"
+#include "dynUtf8Parser/dfa/tokenVisitor.h"
 
 namespace DeterministicFiniteAutomaton {
 
@@ -13,12 +18,31 @@ namespace DeterministicFiniteAutomaton {
 
     public:
 
+      /// \brief The PushStatus of a push mode run (see startPushing).
+      enum PushStatus {
+        /// \brief No push mode run has been started.
+        PushIdle,
+
+        /// \brief The run has read every (complete) UTF8 character fed
+        /// so far, and waits for the next chunk (or finish).
+        PushSuspended,
+
+        /// \brief The run has finished and the document matched.
+        PushMatched,
+
+        /// \brief The run has finished and the document did not
+        /// match.
+        PushFailed
+      };
+
       /// \brief An invariant which should ALWAYS be true for any
       /// instance of a PushDownMachine class.
       ///
       /// Throws an AssertionFailure with a brief description of any
       /// inconsistencies discovered.
       bool invariant(void) const {
+        if (!stack.invariant())
+          throw AssertionFailure("AutomataStack failed invariant");
         return curState.invariant();
       }
 
@@ -27,6 +51,17 @@ namespace DeterministicFiniteAutomaton {
         dfa        = aDFA;
         nfa        = dfa->getNFA();
         allocator  = dfa->getStateAllocator();
+        tokenArena = NULL;
+        flatTree   = NULL;
+        builtNode  = FlatTokenTree::noNode;
+        visitor    = NULL;
+        numEvents  = 0;
+        numCommittedEvents = 0;
+        matched    = false;
+        suspended  = false;
+        pushStream = NULL;
+        pushStatus = PushIdle;
+        numPrunedReStarts = 0;
         ASSERT(invariant());
       }
 
@@ -59,42 +94,448 @@ namespace DeterministicFiniteAutomaton {
                           PDMTracer *pdmTracer = NULL,
                           bool       partialOk = false);
 
+      /// \brief Run the PushDownAutomata from the given start state
+      /// using the Utf8Chars stream provided, building the parse tree
+      /// directly into the (cleared) FlatTokenTree provided.
+      ///
+      /// No Token is allocated. Returns true if the stream matched
+      /// (in which case the flatTree's root is the last Node).
+      ///
+      /// Since no Token is built, only the failures of rules are
+      /// memoized (see setMemoBudget).
+      bool runFromUsingInto(NFA::StartStateId startStateId,
+                            Utf8Chars *charStream,
+                            FlatTokenTree *aFlatTree,
+                            PDMTracer *pdmTracer = NULL,
+                            bool       partialOk = false) {
+        ASSERT(aFlatTree);
+        discardTokensFrom(0);
+        flatTree = aFlatTree;
+        flatTree->clear();
+        runFromUsing(startStateId, charStream, pdmTracer, partialOk);
+        flatTree = NULL;
+        while (flatBuilder.getNumItems()) flatBuilder.popItem();
+        return aFlatTree->getRoot() != FlatTokenTree::noNode;
+      }
+
+      /// \brief Run the PushDownAutomata from the given start state
+      /// using the Utf8Chars stream provided, reporting each token to
+      /// the TokenVisitor as it is recognized (see TokenVisitor).
+      ///
+      /// No Token is allocated, and only the push down stack grows
+      /// with the nesting of the tokens. Returns true if the stream
+      /// matched.
+      ///
+      /// Since no Token is built, only the failures of rules are
+      /// memoized (see setMemoBudget).
+      bool runFromUsingVisiting(NFA::StartStateId startStateId,
+                                Utf8Chars *charStream,
+                                TokenVisitor *aVisitor,
+                                PDMTracer *pdmTracer = NULL,
+                                bool       partialOk = false) {
+        ASSERT(aVisitor);
+        discardTokensFrom(0);
+        visitor   = aVisitor;
+        numEvents = 0;
+        numCommittedEvents = 0;
+        runFromUsing(startStateId, charStream, pdmTracer, partialOk);
+        visitor   = NULL;
+        numEvents = 0;
+        numCommittedEvents = 0;
+        return matched;
+      }
+
+      /// \brief Start a push mode run from the given start state,
+      /// reporting each token to the TokenVisitor (see
+      /// runFromUsingVisiting) as the document is fed (in chunks) to
+      /// this PushDownMachine.
+      ///
+      /// The run suspends whenever it has read every (complete) UTF8
+      /// character fed so far, and resumes, with its stack intact,
+      /// when the next chunk is fed. Only the bytes from the earliest
+      /// stream position of a live frame onwards are kept, so the
+      /// token offsets reported to the TokenVisitor (measured from the
+      /// start of the whole document) can not be used to recover the
+      /// (discarded) text of the tokens from the PushStream.
+      void startPushing(NFA::StartStateId startStateId,
+                        TokenVisitor *aVisitor) {
+        ASSERT(aVisitor);
+        discardTokensFrom(0);
+        if (!pushStream) pushStream = new PushStream();
+        pushStream->clear();
+        visitor   = aVisitor;
+        numEvents = 0;
+        numCommittedEvents = 0;
+        startRun(startStateId, pushStream->getStream(), NULL);
+        pushStatus = PushSuspended;
+      }
+
+      /// \brief Feed the next chunk (of numBytes) of the document to
+      /// the push mode run, returning its PushStatus.
+      ///
+      /// The chunk may end part way through a UTF8 character. A run
+      /// may fail (but never match) before the document is finished.
+      PushStatus feed(const char *someBytes, size_t numBytes);
+
+      /// \brief Mark the end of the document fed to the push mode
+      /// run, returning its (final) PushStatus.
+      PushStatus finish(void);
+
+      /// \brief Return the PushStatus of the (last) push mode run.
+      PushStatus getPushStatus(void) {
+        return pushStatus;
+      }
+
+      /// \brief Return the PushStream (if any) holding the bytes fed
+      /// to the push mode run.
+      PushStream *getPushStream(void) {
+        return pushStream;
+      }
+
+      /// \brief Return the number of ReStart NFA::States which were
+      /// not tried because their rules could not start with the next
+      /// character (see DFA::mayStartWith).
+      size_t getNumPrunedReStarts(void) {
+        return numPrunedReStarts;
+      }
+
+      /// \brief Reset the number of pruned ReStart NFA::States to
+      /// zero.
+      void resetPrunedReStarts(void) {
+        numPrunedReStarts = 0;
+      }
+
+      /// \brief Limit the (approximate) number of bytes used to
+      /// memoize the outcome of each rule at each stream offset to
+      /// maxBytes.
+      ///
+      /// A zero maxBytes (the default) disables memoization. See
+      /// PackratMemo.
+      void setMemoBudget(size_t maxBytes) {
+        memo.setBudget(maxBytes);
+      }
+
+      /// \brief Return the PackratMemo (and so its statistics) used
+      /// by this PushDownMachine.
+      PackratMemo *getMemo(void) {
+        return &memo;
+      }
+
+      /// \brief Allocate all of the tokens of each run in the
+      /// TokenArena provided (or, if NULL, on the heap).
+      ///
+      /// The tokens returned by runFromUsing are then owned by the
+      /// TokenArena, and so must NOT be deleted. They are released
+      /// all at once by TokenArena::reset.
+      void setTokenArena(TokenArena *aTokenArena) {
+        discardTokensFrom(0);
+        memo.clear();
+        tokenArena = aTokenArena;
+      }
+
+      /// \brief Return the TokenArena (if any) used by this
+      /// PushDownMachine.
+      TokenArena *getTokenArena(void) {
+        return tokenArena;
+      }
+
+      /// \brief Destroy this PushDownMachine, deleting any tokens
+      /// left in the token builder.
+      ~PushDownMachine(void) {
+        discardTokensFrom(0);
+        if (pushStream) delete pushStream;
+        pushStream = NULL;
+      }
+
     protected:
 
+      /// \brief Start a run from the given start state using the
+      /// Utf8Chars stream provided (see continueRun).
+      void startRun(NFA::StartStateId startStateId,
+                    Utf8Chars *charStream,
+                    PDMTracer *pdmTracer);
+
+      /// \brief Continue the (started) run until it matches, fails or
+      /// (in a push mode run) is suspended.
+      ///
+      /// Returns the resulting token (NULL if the run failed, was
+      /// suspended, or is not building Tokens).
+      Token *continueRun(PDMTracer *pdmTracer, bool partialOK);
+
+      /// \brief Continue the suspended push mode run over the bytes
+      /// fed so far, returning its PushStatus.
+      PushStatus resumePushing(void);
+
+      /// \brief End the push mode run with the PushStatus provided.
+      PushStatus stopPushing(PushStatus aPushStatus) {
+        visitor    = NULL;
+        numEvents  = 0;
+        numCommittedEvents = 0;
+        pushStatus = aPushStatus;
+        return pushStatus;
+      }
+
+      /// \brief Return the earliest stream position which the current
+      /// state (or a frame on the stack) may still read.
+      size_t getFirstLiveOffset(void) {
+        size_t offset = curState.getCursor()->next;
+        for (size_t i = 0; i < stack.getNumItems(); i++) {
+          const AutomataState::Frame &frame = stack.getFrame(i);
+          if (frame.cursor.next < offset) offset = frame.cursor.next;
+        }
+        return offset;
+      }
+
+      /// \brief Push the current automata state onto the push down
+      /// automata's state stack.
+      void pushCurState(void) {
+        curState.saveFrame(stack.pushFrame(), getNumBuiltTokens());
+      }
+
       /// \brief Pop the current automata state off the top of the
       /// push down automata's state stack, *keeping* the current
       /// stream location.
       void popKeepStreamPosition(PDMTracer *pdmTracer) {
-        // keepStreamState = true
-        // clearOldState   = true
         if (pdmTracer) pdmTracer->pop("keep stream position");
-        curState.copyFrom(stack.popItem(), true);
+        curState.restoreFrame(stack.popFrame(), true);
       }
 
       /// \brief Pop the current automata state off the top of the
       /// push down automata's state stack, *resetting* the current
-      /// stream location.
+      /// stream location (and discarding any tokens recognized since
+      /// it was pushed).
       void popResetStreamPosition(PDMTracer *pdmTracer) {
-        // keepStreamState = false
-        // clearOldState   = true
         if (pdmTracer) pdmTracer->pop("pop stream position");
-        curState.copyFrom(stack.popItem(), false);
+        const AutomataState::Frame &frame = stack.popFrame();
+        discardTokensFrom(frame.numTokens);
+        curState.restoreFrame(frame, false);
       }
 
       /// \brief Pop the current automata state off the top of the
       /// push down automata's state stack *until* the state type is
       /// the required state type.
-      void popUntil(AutomataState::AutomataStateType requiredStateType, 
+      void popUntil(AutomataState::AutomataStateType requiredStateType,
                     PDMTracer *pdmTracer) {
-        // TODO: how do we clean up unused state?
-        //
         // continue poping until we reach the required state type
         while(stack.getNumItems() &&
-              stack.getTop().getStateType() != requiredStateType) {
+              stack.getTop().frameType != requiredStateType) {
           if (pdmTracer) pdmTracer->pop("IGNORE looking for ",
             AutomataState::getStateTypeMessage(requiredStateType));
-          stack.popItem().clear();
+          stack.popFrame();
+        }
+      }
+
+      /// \brief Record (in the memo) the failure of every rule whose
+      /// continue state will be poped by a backtrack.
+      ///
+      /// Each rule started (at its sub stream's start) by a restart
+      /// whose continue state lies above the top backtrack state has
+      /// no further alternatives, and so has failed.
+      void memoizeFailedRules(void) {
+        NFA::StartStateId startStateId = curState.getStartStateId();
+        size_t offset = curState.getCursor()->start;
+        for (size_t i = stack.getNumItems(); 0 < i; i--) {
+          const AutomataState::Frame &frame = stack.getFrame(i-1);
+          if (frame.frameType == AutomataState::ASBackTrack) break;
+          if (frame.frameType != AutomataState::ASContinue) continue;
+          memo.recordFailure(startStateId, offset);
+          startStateId = frame.startStateId;
+          offset       = frame.cursor.start;
+        }
+      }
+
+      /// \brief Return true if the PushDownMachine is building Tokens
+      /// (rather than a FlatTokenTree or events for a TokenVisitor).
+      bool buildsTokens(void) {
+        return !flatTree && !visitor;
+      }
+
+      /// \brief Return true if resuming the (backtrack) Frame could
+      /// never succeed: its DFA state has no untried ReStart NFA
+      /// states, accepts no token and has no character transitions.
+      ///
+      /// Backtracking into such a Frame simply backtracks again, so
+      /// it can never retract events to its own numTokens.
+      bool isExhausted(const AutomataState::Frame &frame) {
+        StateRecord *stateRecord = frame.stateRecord;
+        if (!stateRecord || !stateRecord->hasMetadata) return false;
+        return (stateRecord->numReStarts <= frame.nextReStart) &&
+          !stateRecord->tokenState && !stateRecord->hasCharTransitions;
+      }
+
+      /// \brief Return the number of events which can no longer be
+      /// retracted (unless the whole run fails).
+      ///
+      /// Events may be retracted by backtracking (to the numTokens of
+      /// any backtrack Frame which is not exhausted), or by an ignored
+      /// token (to the tokenStart of any rule called by the outermost
+      /// rule, which is itself never ignored). A called rule's
+      /// tokenStart is the numTokens of its caller's continue Frame.
+      /// Since the Frames' numTokens only grow up the stack, the
+      /// first Frame (from the bottom) which is not exhausted bounds
+      /// every retraction.
+      size_t getNumCommittableEvents(void) {
+        for (size_t i = 0; i < stack.getNumItems(); i++) {
+          const AutomataState::Frame &frame = stack.getFrame(i);
+          if ((frame.frameType == AutomataState::ASBackTrack) &&
+              isExhausted(frame)) continue;
+          if (frame.numTokens < numEvents) return frame.numTokens;
+          break;
         }
+        return numEvents;
+      }
+
+      /// \brief Report any newly committed events to the TokenVisitor
+      /// (if any).
+      void commitEvents(void) {
+        if (!visitor) return;
+        size_t numCommittable = getNumCommittableEvents();
+        if (numCommittable <= numCommittedEvents) return;
+        numCommittedEvents = numCommittable;
+        visitor->commitEvents(numCommittedEvents);
+      }
+
+      /// \brief Report the start of the current state's token to the
+      /// TokenVisitor (if any).
+      void enterToken(void) {
+        if (!visitor) return;
+        visitor->enterToken(curState.getStartStateId(),
+                            curState.getCursor()->start);
+        numEvents++;
+      }
+
+      /// \brief Build the token, with the tokenId provided, recognized
+      /// by the current automata state.
+      ///
+      /// The token adopts (without copying) the child tokens found in
+      /// the token builder from the current state's tokenStart.
+      ///
+      /// An ignored token is never built, its child tokens (or Nodes,
+      /// or events) are simply discarded and NULL is returned.
+      ///
+      /// When reporting to a TokenVisitor, the token is closed and
+      /// NULL is returned.
+      Token *buildToken(Token::TokenId tokenId, bool ignoreToken) {
+        size_t tokenStart = curState.getTokenStart();
+        if (ignoreToken) {
+          discardTokensFrom(tokenStart);
+          return NULL;
+        }
+        if (visitor) {
+          size_t start = curState.getCursor()->start;
+          size_t end   = start + curState.getTextLength();
+          // (the token's own enterToken event follows tokenStart)
+          if (numEvents == tokenStart + 1) {
+            visitor->leafToken(tokenId, start, end);
+          } else {
+            visitor->leaveToken(tokenId, start, end);
+          }
+          numEvents++;
+          return NULL;
+        }
+        if (flatTree) {
+          // the Node's children are the Nodes in the flat builder
+          Utf8Chars::Cursor *cursor = curState.getCursor();
+          flatTree->setText(curState.getTextStart() - cursor->start);
+          builtNode =
+            flatTree->addNode(tokenId, cursor->start,
+                              cursor->start + curState.getTextLength(),
+                              &flatBuilder, tokenStart);
+          while (tokenStart < flatBuilder.getNumItems()) {
+            flatBuilder.popItem();
+          }
+          return NULL;
+        }
+        size_t numTokens  = tokenBuilder.getNumItems();
+        Token *token = NULL;
+        if (tokenArena) {
+          token = tokenArena->newToken(tokenId, curState.getTextStart(),
+                                       curState.getTextLength(),
+                                       &tokenBuilder, tokenStart);
+        } else {
+          token = new Token();
+          token->setId(tokenId);
+          token->setText(curState.getTextStart(), curState.getTextLength());
+          token->adoptChildTokens(&tokenBuilder, tokenStart);
+        }
+        for (size_t i = tokenStart; i < numTokens; i++) {
+          tokenBuilder.popItem();
+        }
+        return token;
+      }
+
+      /// \brief Delete the tokens in the token builder from the
+      /// numTokens-th token onwards.
+      void discardTokensFrom(size_t numTokens) {
+        if (visitor) {
+          if (numTokens < numEvents) {
+            visitor->retractEvents(numTokens);
+            numEvents = numTokens;
+          }
+          // (only the failure of the whole run retracts committed events)
+          if (numTokens < numCommittedEvents) numCommittedEvents = numTokens;
+          return;
+        }
+        if (flatTree) {
+          while (numTokens < flatBuilder.getNumItems()) {
+            flatBuilder.popItem();
+          }
+          flatTree->truncate(getNumKeptNodes());
+          return;
+        }
+        while (numTokens < tokenBuilder.getNumItems()) {
+          releaseToken(tokenBuilder.popItem());
+        }
+      }
+
+      /// \brief Delete the token, unless it is owned by the
+      /// TokenArena (which releases it on reset).
+      ///
+      /// When building a FlatTokenTree, the last Node built (and its
+      /// descendants) are removed instead.
+      void releaseToken(Token *token) {
+        if (visitor) return;
+        if (flatTree) {
+          flatTree->truncate(getNumKeptNodes());
+          return;
+        }
+        if (token && !tokenArena) delete token;
+      }
+
+      /// \brief Add the token (or, when building a FlatTokenTree, the
+      /// last Node built) to the token builder.
+      void pushBuiltToken(Token *token) {
+        if (visitor) return;
+        if (flatTree) flatBuilder.pushItem(builtNode);
+        else tokenBuilder.pushItem(token);
+      }
+
+      /// \brief Return the number of tokens (or Nodes) in the token
+      /// builder (or, when reporting to a TokenVisitor, the number of
+      /// events reported).
+      size_t getNumBuiltTokens(void) {
+        if (visitor) return numEvents;
+        if (flatTree) return flatBuilder.getNumItems();
+        return tokenBuilder.getNumItems();
+      }
+
+      /// \brief Return the number of FlatTokenTree Nodes used by the
+      /// Nodes in the flat builder.
+      ///
+      /// Nodes are built in postorder, so every Node built after the
+      /// last one in the flat builder has been discarded.
+      size_t getNumKeptNodes(void) {
+        if (!flatBuilder.getNumItems()) return 0;
+        return flatBuilder.getTop() + 1;
+      }
+
+      /// \brief Flush the DFA's cache, keeping the DFA StateRecords
+      /// in use by the current state and the push down stack.
+      void flushDFACache(void) {
+        VarArray<StateRecord*> liveRecords;
+        liveRecords.pushItem(curState.getStateRecord());
+        stack.collectStateRecords(&liveRecords);
+        dfa->flushCache(&liveRecords);
       }
 
       /// \brief The DFA integrated by this PushDownAutomata.
@@ -110,34 +551,179 @@ namespace DeterministicFiniteAutomaton {
       /// \brief The current state of this PushDownAutomata.
       AutomataState curState;
 
-      /// \brief AutomataStack class provides the VarArray
-      /// implementation of the PushDownMachine's AutoamataState stack.
+      /// \brief The AutomataStack class provides the push down
+      /// automata's stack of (fixed size, POD) AutomataState::Frames.
       ///
-      /// It primary purpose is to provide explicit invariant checking.
-      class AutomataStack : public VarArray<AutomataState> {
+      /// The frames are kept in one preallocated array which grows
+      /// geometrically, so pushing and poping a frame never touches
+      /// the heap once the stack has reached its deepest nesting.
+      class AutomataStack {
 
         public:
 
+          /// \brief The number of frames initially allocated.
+          static const size_t initialNumFrames = 64;
+
           /// \brief An invariant which should ALWAYS be true for any
           /// instance of a AutomataStack class.
           ///
           /// Throws an AssertionFailure with a brief description of any
           /// inconsistencies discovered.
           bool invariant(void) const {
-            if (!VarArray<AutomataState>::invariant())
-              throw AssertionFailure("AutomataState varArray failed invariant");
-
-            for (size_t i = 0; i < numItems; i++) {
-              if (!itemArray[i].invariant())
-                throw AssertionFailure("AutomataState entry failed invariant");
+            if (!frames)
+              throw AssertionFailure("AutomataStack frames not allocated");
+            if (framesSize < numFrames)
+              throw AssertionFailure("AutomataStack has too many frames");
+            for (size_t i = 0; i < numFrames; i++) {
+              if (!frames[i].stateRecord)
+                throw AssertionFailure("AutomataStack frame has no stateRecord");
             }
             return true;
           }
+
+          /// \brief Create an (empty) AutomataStack.
+          AutomataStack(void) {
+            framesSize = initialNumFrames;
+            frames     = (AutomataState::Frame*)
+              calloc(framesSize, sizeof(AutomataState::Frame));
+            numFrames  = 0;
+            ASSERT(invariant());
+          }
+
+          /// \brief Destroy the AutomataStack.
+          ~AutomataStack(void) {
+            if (frames) free(frames);
+            frames     = NULL;
+            framesSize = 0;
+            numFrames  = 0;
+          }
+
+          /// \brief Return the number of frames on this stack.
+          size_t getNumItems(void) const {
+            return numFrames;
+          }
+
+          /// \brief Return the frame on the top of this stack.
+          AutomataState::Frame &getTop(void) {
+            ASSERT(numFrames);
+            return frames[numFrames-1];
+          }
+
+          /// \brief Return the i-th frame (from the bottom) of this
+          /// stack.
+          AutomataState::Frame &getFrame(size_t i) {
+            ASSERT(i < numFrames);
+            return frames[i];
+          }
+
+          /// \brief Push a new frame onto this stack, returning the
+          /// frame to be filled in.
+          ///
+          /// The frames array is doubled in size whenever it is full.
+          AutomataState::Frame *pushFrame(void) {
+            if (framesSize <= numFrames) {
+              size_t newFramesSize = 2*framesSize;
+              AutomataState::Frame *newFrames = (AutomataState::Frame*)
+                realloc(frames, newFramesSize*sizeof(AutomataState::Frame));
+              ASSERT(newFrames);
+              frames     = newFrames;
+              framesSize = newFramesSize;
+            }
+            return frames + numFrames++;
+          }
+
+          /// \brief Pop the top frame off this stack.
+          ///
+          /// The frame returned remains valid until the next push.
+          const AutomataState::Frame &popFrame(void) {
+            ASSERT(numFrames);
+            return frames[--numFrames];
+          }
+
+          /// \brief Pop all frames off this stack.
+          void clear(void) {
+            numFrames = 0;
+          }
+
+          /// \brief Add the DFA StateRecord of every frame on this
+          /// stack to the stateRecords provided.
+          void collectStateRecords(VarArray<StateRecord*> *stateRecords) {
+            for (size_t i = 0; i < numFrames; i++) {
+              stateRecords->pushItem(frames[i].stateRecord);
+            }
+          }
+
+        protected:
+
+          /// \brief The (geometrically growing) array of frames.
+          AutomataState::Frame *frames;
+
+          /// \brief The number of frames allocated.
+          size_t framesSize;
+
+          /// \brief The number of frames in use.
+          size_t numFrames;
       };
 
       /// \brief The push down stack for this PushDownAutomata.
       AutomataStack stack;
 
+      /// \brief The token builder holds the (completed) child tokens
+      /// of every token still being recognized.
+      ///
+      /// The child tokens of the token being recognized by an
+      /// AutomataState are those from its tokenStart onwards (up to
+      /// the tokenStart of the next state being recognized).
+      VarArray<Token*> tokenBuilder;
+
+      /// \brief The (optional) memo of the outcome of each rule at
+      /// each stream offset.
+      PackratMemo memo;
+
+      /// \brief The (optional) TokenArena in which every token is
+      /// allocated.
+      TokenArena *tokenArena;
+
+      /// \brief The FlatTokenTree being built (or NULL when building
+      /// Tokens).
+      FlatTokenTree *flatTree;
+
+      /// \brief The (root) Nodes of the completed child tokens of the
+      /// tokens being built into the FlatTokenTree.
+      VarArray<size_t> flatBuilder;
+
+      /// \brief The last Node built into the FlatTokenTree.
+      size_t builtNode;
+
+      /// \brief The TokenVisitor to which tokens are reported (or
+      /// NULL when building Tokens).
+      TokenVisitor *visitor;
+
+      /// \brief The number of events reported to the TokenVisitor
+      /// (and not retracted).
+      size_t numEvents;
+
+      /// \brief The number of events reported to the TokenVisitor as
+      /// committed (see TokenVisitor::commitEvents).
+      size_t numCommittedEvents;
+
+      /// \brief True if the last run matched the stream.
+      bool matched;
+
+      /// \brief True if the last (push mode) run was suspended.
+      bool suspended;
+
+      /// \brief The (owned) PushStream of the push mode runs (created
+      /// on first use).
+      PushStream *pushStream;
+
+      /// \brief The PushStatus of the (last) push mode run.
+      PushStatus pushStatus;
+
+      /// \brief The number of ReStart NFA::States which were not tried
+      /// because their rules could not start with the next character.
+      size_t numPrunedReStarts;
+
       /// Allow complete access from the associated tracer.
       friend class PDMTracer;
 
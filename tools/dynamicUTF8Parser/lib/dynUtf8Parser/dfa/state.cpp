@@ -5,67 +5,237 @@
 
 #include "dynUtf8Parser/dfa/stateAllocator.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DFA_X86_BIT_SET_KERNELS
+#include <immintrin.h>
+#endif
+
 using namespace DeterministicFiniteAutomaton;
 
 #ifndef NUM_DFA_STATES_PER_BLOCK
 #define NUM_DFA_STATES_PER_BLOCK 20
 #endif
 
+// The bit set kernels.
+//
+// Every DFA::State is stateAlignment aligned and a whole multiple of
+// stateAlignment bytes long, so every kernel works on whole words (or
+// vectors) with no tails.
+
+static bool anyBitsWords(const uint64_t *words, size_t numWords) {
+  uint64_t bits = 0;
+  for (size_t i = 0; i < numWords; i++) bits |= words[i];
+  return bits != 0;
+}
+
+static bool anyBitsNotInWords(const uint64_t *words,
+                              const uint64_t *otherWords,
+                              size_t numWords) {
+  for (size_t i = 0; i < numWords; i++) {
+    if (words[i] & ~otherWords[i]) return true;
+  }
+  return false;
+}
+
+static void mergeWords(uint64_t *words,
+                       const uint64_t *otherWords,
+                       size_t numWords) {
+  for (size_t i = 0; i < numWords; i++) words[i] |= otherWords[i];
+}
+
+static size_t firstCommonWordWords(const uint64_t *words,
+                                   const uint64_t *otherWords,
+                                   size_t numWords) {
+  for (size_t i = 0; i < numWords; i++) {
+    if (words[i] & otherWords[i]) return i;
+  }
+  return numWords;
+}
+
+#ifdef DFA_X86_BIT_SET_KERNELS
+
+__attribute__((target("sse2")))
+static bool anyBitsSSE2(const uint64_t *words, size_t numWords) {
+  const __m128i *vecs = (const __m128i*)words;
+  __m128i bits = _mm_setzero_si128();
+  for (size_t i = 0; i < numWords/2; i++) {
+    bits = _mm_or_si128(bits, _mm_load_si128(vecs + i));
+  }
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128()))
+    != 0xFFFF;
+}
+
+__attribute__((target("sse2")))
+static bool anyBitsNotInSSE2(const uint64_t *words,
+                             const uint64_t *otherWords,
+                             size_t numWords) {
+  const __m128i *vecs      = (const __m128i*)words;
+  const __m128i *otherVecs = (const __m128i*)otherWords;
+  for (size_t i = 0; i < numWords/2; i++) {
+    __m128i bits = _mm_andnot_si128(_mm_load_si128(otherVecs + i),
+                                    _mm_load_si128(vecs + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128()))
+        != 0xFFFF) return true;
+  }
+  return false;
+}
+
+__attribute__((target("sse2")))
+static void mergeSSE2(uint64_t *words,
+                      const uint64_t *otherWords,
+                      size_t numWords) {
+  __m128i *vecs            = (__m128i*)words;
+  const __m128i *otherVecs = (const __m128i*)otherWords;
+  for (size_t i = 0; i < numWords/2; i++) {
+    _mm_store_si128(vecs + i, _mm_or_si128(_mm_load_si128(vecs + i),
+                                           _mm_load_si128(otherVecs + i)));
+  }
+}
+
+__attribute__((target("sse2")))
+static size_t firstCommonWordSSE2(const uint64_t *words,
+                                  const uint64_t *otherWords,
+                                  size_t numWords) {
+  const __m128i *vecs      = (const __m128i*)words;
+  const __m128i *otherVecs = (const __m128i*)otherWords;
+  for (size_t i = 0; i < numWords/2; i++) {
+    __m128i bits = _mm_and_si128(_mm_load_si128(vecs + i),
+                                 _mm_load_si128(otherVecs + i));
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(bits, _mm_setzero_si128()))
+        != 0xFFFF) {
+      return firstCommonWordWords(words + 2*i, otherWords + 2*i, 2) + 2*i;
+    }
+  }
+  return numWords;
+}
+
+__attribute__((target("avx2")))
+static bool anyBitsAVX2(const uint64_t *words, size_t numWords) {
+  const __m256i *vecs = (const __m256i*)words;
+  __m256i bits = _mm256_setzero_si256();
+  for (size_t i = 0; i < numWords/4; i++) {
+    bits = _mm256_or_si256(bits, _mm256_load_si256(vecs + i));
+  }
+  return !_mm256_testz_si256(bits, bits);
+}
+
+__attribute__((target("avx2")))
+static bool anyBitsNotInAVX2(const uint64_t *words,
+                             const uint64_t *otherWords,
+                             size_t numWords) {
+  const __m256i *vecs      = (const __m256i*)words;
+  const __m256i *otherVecs = (const __m256i*)otherWords;
+  for (size_t i = 0; i < numWords/4; i++) {
+    // testc is true when every bit of vecs[i] is also in otherVecs[i]
+    if (!_mm256_testc_si256(_mm256_load_si256(otherVecs + i),
+                            _mm256_load_si256(vecs + i))) return true;
+  }
+  return false;
+}
+
+__attribute__((target("avx2")))
+static void mergeAVX2(uint64_t *words,
+                      const uint64_t *otherWords,
+                      size_t numWords) {
+  __m256i *vecs            = (__m256i*)words;
+  const __m256i *otherVecs = (const __m256i*)otherWords;
+  for (size_t i = 0; i < numWords/4; i++) {
+    _mm256_store_si256(vecs + i,
+                       _mm256_or_si256(_mm256_load_si256(vecs + i),
+                                       _mm256_load_si256(otherVecs + i)));
+  }
+}
+
+__attribute__((target("avx2")))
+static size_t firstCommonWordAVX2(const uint64_t *words,
+                                  const uint64_t *otherWords,
+                                  size_t numWords) {
+  const __m256i *vecs      = (const __m256i*)words;
+  const __m256i *otherVecs = (const __m256i*)otherWords;
+  for (size_t i = 0; i < numWords/4; i++) {
+    if (!_mm256_testz_si256(_mm256_load_si256(vecs + i),
+                            _mm256_load_si256(otherVecs + i))) {
+      return firstCommonWordWords(words + 4*i, otherWords + 4*i, 4) + 4*i;
+    }
+  }
+  return numWords;
+}
+
+#endif
+
+bool StateAllocator::supportsBitSetKernels(BitSetKernels someKernels) {
+  switch (someKernels) {
+    case WordKernels:
+      return true;
+#ifdef DFA_X86_BIT_SET_KERNELS
+    case SSE2Kernels:
+      return __builtin_cpu_supports("sse2");
+    case AVX2Kernels:
+      return __builtin_cpu_supports("avx2");
+#endif
+    default:
+      return false;
+  }
+}
+
+bool StateAllocator::useBitSetKernels(BitSetKernels someKernels) {
+  if (!supportsBitSetKernels(someKernels)) return false;
+  switch (someKernels) {
+#ifdef DFA_X86_BIT_SET_KERNELS
+    case SSE2Kernels:
+      anyBitsKernel         = anyBitsSSE2;
+      anyBitsNotInKernel    = anyBitsNotInSSE2;
+      mergeKernel           = mergeSSE2;
+      firstCommonWordKernel = firstCommonWordSSE2;
+      break;
+    case AVX2Kernels:
+      anyBitsKernel         = anyBitsAVX2;
+      anyBitsNotInKernel    = anyBitsNotInAVX2;
+      mergeKernel           = mergeAVX2;
+      firstCommonWordKernel = firstCommonWordAVX2;
+      break;
+#endif
+    default:
+      anyBitsKernel         = anyBitsWords;
+      anyBitsNotInKernel    = anyBitsNotInWords;
+      mergeKernel           = mergeWords;
+      firstCommonWordKernel = firstCommonWordWords;
+      break;
+  }
+  bitSetKernels = someKernels;
+  return true;
+}
+
 State *StateAllocator::clone(State *oldState) {
   State *newState = allocateANewState();
   if (!oldState) return newState;
-  char *curByte = newState;
-  char *oldByte = oldState;
-  char *stateEnd = curByte + stateSize;
-  for (; curByte < stateEnd; curByte++, oldByte++) {
-    *curByte = *oldByte;
-  }
+  memcpy(newState, oldState, stateSize);
   return newState;
 }
 
 void StateAllocator::emptyState(State *state) {
   if (!state) return;
-  char *curByte = state;
-  char *stateEnd = curByte + stateSize;
-  for (; curByte < stateEnd; curByte++) {
-    *curByte = 0;
-  }
+  memset(state, 0, stateSize);
 }
 
 bool StateAllocator::isStateEmpty(State *state) {
   if (!state) return true;
-  char *curByte = state;
-  char *stateEnd = curByte + stateSize;
-  for (; curByte < stateEnd; curByte++) {
-    if (*curByte != 0) return false;
-  }
-  return true;
+  return !anyBitsKernel((const uint64_t*)state, stateWords);
 }
 
 bool StateAllocator::isSubStateOf(State *state, State *other) {
   // return true if this is a subset of other
   if (!other) return false;
   if (!state) return true;
-  char *curByte1 = state;
-  char *curByte2 = other;
-  char *stateEnd1 = curByte1 + stateSize;
-  for (; curByte1 < stateEnd1; curByte1++, curByte2++) {
-    if (*curByte1 & ~*curByte2) {
-      return false; // curByte1 contains a bit outside of curByte2
-    }
-  }
-  return true;
+  return !anyBitsNotInKernel((const uint64_t*)state,
+                             (const uint64_t*)other,
+                             stateWords);
 }
 
 void StateAllocator::mergeStateWith(State *state, State *other) {
   if (!state) return;
   if (!other) return;
-  char *curByte1 = state;
-  char *curByte2 = other;
-  char *stateEnd = curByte1 + stateSize;
-  for (; curByte1 < stateEnd; curByte1++, curByte2++) {
-    *curByte1 |= *curByte2;
-  }
+  mergeKernel((uint64_t*)state, (const uint64_t*)other, stateWords);
 }
 
 void StateAllocator::printStateOnWithMessage(FILE *filePtr,
@@ -80,7 +250,13 @@ void StateAllocator::printStateOnWithMessage(FILE *filePtr,
 
 /* Check whether state list contains a match. */
 NFA::State *StateAllocator::stateMatchesToken(State *state, State *tokensState) {
-  for (size_t i = 0; i < stateSize; i++) {
+  size_t word = firstCommonWordKernel((const uint64_t*)state,
+                                      (const uint64_t*)tokensState,
+                                      stateWords);
+  if (stateWords <= word) return NULL;
+  // search the bytes of this word in bit set order
+  size_t endByte = (word + 1)*sizeof(uint64_t);
+  for (size_t i = word*sizeof(uint64_t); i < endByte; i++) {
     if (state[i] & tokensState[i]) {
       for (size_t j = 0; j < 8; j++) {
         if (state[i] & tokensState[i] & (1<<j)) {
@@ -96,9 +272,5 @@ void StateAllocator::copyStateIntoBuffer(State *state,
                                     char *buffer, size_t bufferSize) {
   size_t copySize = stateSize;
   if (bufferSize < stateSize) copySize = bufferSize;
-  char *curByte = state;
-  char *bufferEnd = buffer + copySize;
-  for (; buffer < bufferEnd; buffer++, curByte++) {
-    *buffer = *curByte;
-  }
+  memcpy(buffer, state, copySize);
 }
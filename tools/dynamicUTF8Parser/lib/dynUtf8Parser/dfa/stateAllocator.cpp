@@ -35,7 +35,14 @@ StateAllocator::StateAllocator(NFA *anNFA) {
   nfa = anNFA;
   nfaStateMapping = new NFAStateMapping(this);
   stateSize = (nfa->getNumberStates() / 8) + 1;
-  stateAllocator = new BlockAllocator(NUM_DFA_STATES_PER_BLOCK*stateSize);
+  // pad the DFA::State bit sets to whole stateAlignment sized chunks
+  stateSize = ((stateSize + stateAlignment - 1) / stateAlignment) *
+    stateAlignment;
+  stateWords = stateSize / sizeof(uint64_t);
+  nextFreeState   = NULL;
+  endOfStateBlock = NULL;
+  if (!useBitSetKernels(AVX2Kernels) &&
+      !useBitSetKernels(SSE2Kernels)) useBitSetKernels(WordKernels);
 };
 
 StateAllocator::~StateAllocator(void) {
@@ -44,9 +51,13 @@ StateAllocator::~StateAllocator(void) {
   if (nfaStateMapping) delete nfaStateMapping;
   nfaStateMapping = NULL;
 
-  stateSize = 0;
-  if (stateAllocator) delete stateAllocator;
-  stateAllocator    = NULL;
+  stateSize  = 0;
+  stateWords = 0;
+  while (stateBlocks.getNumItems()) {
+    free(stateBlocks.popItem());
+  }
+  nextFreeState   = NULL;
+  endOfStateBlock = NULL;
 }
 
 State *StateAllocator::allocateANewState(void) {
@@ -60,7 +71,19 @@ State *StateAllocator::allocateANewState(void) {
   }
 
   // We have no allocated but unused DStates....
-  newState = (State*)stateAllocator->allocateNewStructure(stateSize);
+  if (endOfStateBlock <= nextFreeState) {
+    // ... nor any room in the current block, so allocate a new block
+    void *newBlock = NULL;
+    if (posix_memalign(&newBlock, stateAlignment,
+                       NUM_DFA_STATES_PER_BLOCK*stateSize)) {
+      throw ParserException("Out of memory");
+    }
+    stateBlocks.pushItem((State*)newBlock);
+    nextFreeState   = (State*)newBlock;
+    endOfStateBlock = nextFreeState + NUM_DFA_STATES_PER_BLOCK*stateSize;
+  }
+  newState = nextFreeState;
+  nextFreeState += stateSize;
   emptyState(newState);
   return newState;
 }
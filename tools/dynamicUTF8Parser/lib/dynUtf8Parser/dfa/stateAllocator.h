@@ -8,9 +8,27 @@ namespace DeterministicFiniteAutomaton {
   /// \brief The DFA::StateAllocator class allocates DFA::State(s) over
   /// a given NFA. It also implements simple methods on the light
   /// weight DFA::State(s) which have been allocated by this allocator.
+  ///
+  /// Every DFA::State bit set is padded to a multiple of
+  /// stateAlignment bytes and is allocated on a stateAlignment byte
+  /// boundary, so that the bit set methods can work on whole 64 bit
+  /// words, or (when the CPU supports them) on SSE2 or AVX2 vectors,
+  /// without any partial word tails.
   class StateAllocator {
     public:
 
+      /// \brief The alignment (and size granularity) in bytes of every
+      /// DFA::State bit set allocated by a StateAllocator.
+      static const size_t stateAlignment = 32;
+
+      /// \brief The BitSetKernels enumeration names the different
+      /// implementations of the DFA::State bit set methods.
+      enum BitSetKernels {
+        WordKernels = 0, ///< portable 64 bit word loops
+        SSE2Kernels = 1, ///< 128 bit SSE2 vector loops
+        AVX2Kernels = 2  ///< 256 bit AVX2 vector loops
+      };
+
       /// \brief Create a DFA::StateAllocator object corresponding to a
       /// given NFA.
       StateAllocator(NFA *anNFA);
@@ -70,6 +88,14 @@ namespace DeterministicFiniteAutomaton {
         state[nfaStateNumber.stateByte] |= nfaStateNumber.stateBit;
       };
 
+      /// \brief Return true if the bit corresponding the the NFA::State
+      /// nfaState is set in the DFA::State state's bit set.
+      bool hasNFAState(State *state, NFA::State *nfaState) {
+        NFAStateMapping::NFAStateNumber nfaStateNumber =
+          nfaStateMapping->getNFAStateNumber(nfaState);
+        return (state[nfaStateNumber.stateByte] & nfaStateNumber.stateBit) != 0;
+      };
+
       /// \brief Clear the bit corresponding the the NFA::State nfaState
       /// in the DFA::State state's bit set.
       void clearNFAState(State *state, NFA::State *nfaState) {
@@ -84,6 +110,25 @@ namespace DeterministicFiniteAutomaton {
         return stateSize;
       }
 
+      /// \brief Return the BitSetKernels currently used by the bit set
+      /// methods.
+      BitSetKernels getBitSetKernels(void) {
+        return bitSetKernels;
+      }
+
+      /// \brief Use the given BitSetKernels for the bit set methods.
+      ///
+      /// Returns false (and leaves the current BitSetKernels
+      /// unchanged) if the CPU does not support someKernels.
+      ///
+      /// When a StateAllocator is created, the fastest BitSetKernels
+      /// the CPU supports is chosen.
+      bool useBitSetKernels(BitSetKernels someKernels);
+
+      /// \brief Return true if the CPU supports the given
+      /// BitSetKernels.
+      static bool supportsBitSetKernels(BitSetKernels someKernels);
+
       /// \brief Return the NFA associated to this allocator.
       NFA *getNFA(void) {
         return nfa;
@@ -111,11 +156,46 @@ namespace DeterministicFiniteAutomaton {
       /// \brief The number of bytes in a DFA::State.
       ///
       /// For a given NFA, this is a fixed number, computed when
-      /// the DFA::StateAllocator is created.
+      /// the DFA::StateAllocator is created. It is always a multiple
+      /// of stateAlignment.
       size_t stateSize;
 
-      /// \brief A BlockAllocator which allocates new DFA::States.
-      BlockAllocator *stateAllocator;
+      /// \brief The number of 64 bit words in a DFA::State.
+      size_t stateWords;
+
+      /// \brief The (stateAlignment aligned) blocks of
+      /// NUM_DFA_STATES_PER_BLOCK DFA::States allocated so far.
+      VarArray<State*> stateBlocks;
+
+      /// \brief The next unallocated DFA::State in the current block.
+      State *nextFreeState;
+
+      /// \brief The end of the current block of DFA::States.
+      State *endOfStateBlock;
+
+      /// \brief The BitSetKernels used by the bit set methods.
+      BitSetKernels bitSetKernels;
+
+      /// \brief Return true if any word of the bit set is non-zero.
+      bool (*anyBitsKernel)(const uint64_t *words, size_t numWords);
+
+      /// \brief Return true if any bit of the first bit set is not
+      /// in the second bit set.
+      bool (*anyBitsNotInKernel)(const uint64_t *words,
+                                 const uint64_t *otherWords,
+                                 size_t numWords);
+
+      /// \brief Merge the second bit set into the first bit set.
+      void (*mergeKernel)(uint64_t *words,
+                          const uint64_t *otherWords,
+                          size_t numWords);
+
+      /// \brief Return the index of the first word for which the two
+      /// bit sets have a bit in common (or numWords if there is no
+      /// such word).
+      size_t (*firstCommonWordKernel)(const uint64_t *words,
+                                      const uint64_t *otherWords,
+                                      size_t numWords);
 
       /// \brief One of three allocated but currently unused DFA::State(s).
       ///
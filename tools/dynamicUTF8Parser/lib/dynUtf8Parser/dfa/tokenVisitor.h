@@ -0,0 +1,67 @@
+#ifndef TOKEN_VISITOR_H
+#define TOKEN_VISITOR_H
+
+#include "dynUtf8Parser/nfa.h"
+
+namespace DeterministicFiniteAutomaton {
+
+  /// \brief A TokenVisitor is told about each token as it is
+  /// recognized by a PushDownMachine (see
+  /// PushDownMachine::runFromUsingVisiting), so that no tree of
+  /// Tokens need ever be built.
+  ///
+  /// Each (non-ignored) token is reported by an enterToken event, when
+  /// its rule starts, and closed by exactly one leafToken (if it has no
+  /// child tokens) or leaveToken event, when its rule matches. The
+  /// events of its child tokens lie in between. All offsets are byte
+  /// offsets in the original UTF8 character stream.
+  ///
+  /// Since the PushDownMachine backtracks, any event may later be
+  /// invalidated. A retractEvents event invalidates every event after
+  /// the first numEvents (counting from the start of the run). The
+  /// events which remain once the run has returned are final.
+  ///
+  /// A commitEvents event promises that the first numEvents will
+  /// never be retracted (unless the whole run fails), so a consumer
+  /// may act upon (and release) them part way through a long run.
+  class TokenVisitor {
+    public:
+
+      /// \brief Destroy the TokenVisitor.
+      virtual ~TokenVisitor(void) { }
+
+      /// \brief The rule of the start state has started (at the
+      /// start offset) to recognize a token.
+      virtual void enterToken(NFA::StartStateId startStateId,
+                              size_t start) = 0;
+
+      /// \brief The token (entered by the last unclosed enterToken
+      /// event) has been recognized, with no child tokens, between
+      /// the start and end offsets.
+      virtual void leafToken(Token::TokenId tokenId,
+                             size_t start, size_t end) = 0;
+
+      /// \brief The token (entered by the last unclosed enterToken
+      /// event) has been recognized, with child tokens, between the
+      /// start and end offsets.
+      virtual void leaveToken(Token::TokenId tokenId,
+                              size_t start, size_t end) = 0;
+
+      /// \brief Every event after the first numEvents has been
+      /// invalidated (by backtracking, or because its token was
+      /// ignored).
+      virtual void retractEvents(size_t numEvents) = 0;
+
+      /// \brief The first numEvents can no longer be invalidated by
+      /// backtracking (or by an ignored token), only by the failure
+      /// of the whole run (a retractEvents(0) event).
+      ///
+      /// Reported whenever the number of committed events grows, so
+      /// each commitEvents event covers more events than the last.
+      /// Once the run has matched, every remaining event is committed.
+      virtual void commitEvents(size_t numEvents) { }
+  };
+
+}; // namespace DeterministicFiniteAutomaton
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynUtf8Parser/nfa.h"
+#include "dynUtf8Parser/flatTokenTree.h"
+
+FlatTokenTree::FlatTokenTree(void) {
+  nodes     = NULL;
+  nodesSize = 0;
+  numNodes  = 0;
+  root      = noNode;
+  text      = NULL;
+}
+
+FlatTokenTree::~FlatTokenTree(void) {
+  if (nodes) free(nodes);
+  nodes     = NULL;
+  nodesSize = 0;
+  clear();
+}
+
+size_t FlatTokenTree::addNode(Token::TokenId aTokenId,
+                              size_t aStart, size_t anEnd,
+                              VarArray<size_t> *someNodes,
+                              size_t firstNode) {
+  if (nodesSize <= numNodes) {
+    size_t newSize = (nodesSize ? 2*nodesSize : initialNumNodes);
+    Node *newNodes = (Node*)realloc(nodes, newSize*sizeof(Node));
+    if (!newNodes) throw ParserException("Out of memory");
+    nodes     = newNodes;
+    nodesSize = newSize;
+  }
+  size_t index = numNodes++;
+  Node *node = nodes + index;
+  node->tokenId     = aTokenId;
+  node->start       = aStart;
+  node->end         = anEnd;
+  node->firstChild  = noNode;
+  node->nextSibling = noNode;
+  // link the children (from the last to the first)
+  size_t numChildren = 0;
+  if (someNodes) numChildren = someNodes->getNumItems();
+  for (size_t i = numChildren; firstNode < i; i--) {
+    size_t child = someNodes->getItem(i-1, noNode);
+    ASSERT(child < index);
+    nodes[child].nextSibling = node->firstChild;
+    node->firstChild = child;
+  }
+  return index;
+}
+
+size_t FlatTokenTree::getNumChildren(size_t index) {
+  if (numNodes <= index) return 0;
+  size_t numChildren = 0;
+  for (size_t child = nodes[index].firstChild;
+       child != noNode;
+       child = nodes[child].nextSibling) {
+    numChildren++;
+  }
+  return numChildren;
+}
@@ -0,0 +1,139 @@
+#ifndef FLAT_TOKEN_TREE_H
+#define FLAT_TOKEN_TREE_H
+
+#include "dynUtf8Parser/tokens.h"
+
+/// \brief A FlatTokenTree holds a whole parse tree in one contiguous
+/// array of fixed size Nodes.
+///
+/// Each Node records its token id, the start and end byte offsets
+/// (in the original UTF8 character stream) of its text, and the
+/// indices of its first child and its next sibling. The Nodes are
+/// stored in postorder (every child precedes its parent), so the
+/// root is the last Node, and the tree may be walked linearly (or
+/// written out as is) without chasing pointers.
+class FlatTokenTree {
+  public:
+
+    /// \brief The index used to mark a missing child or sibling (or
+    /// an empty tree's root).
+    static const size_t noNode = (size_t)-1;
+
+    /// \brief The number of Nodes initially allocated.
+    static const size_t initialNumNodes = 256;
+
+    /// \brief A Node is one token of a FlatTokenTree.
+    typedef struct Node {
+      /// \brief The token id of the token.
+      Token::TokenId tokenId;
+
+      /// \brief The byte offset of the start of the token's text.
+      size_t start;
+
+      /// \brief The byte offset just beyond the end of the token's
+      /// text.
+      size_t end;
+
+      /// \brief The index of the token's first child (or noNode).
+      size_t firstChild;
+
+      /// \brief The index of the token's next sibling (or noNode).
+      size_t nextSibling;
+    } Node;
+
+    /// \brief Create an empty FlatTokenTree.
+    FlatTokenTree(void);
+
+    /// \brief Destroy the FlatTokenTree.
+    ~FlatTokenTree(void);
+
+    /// \brief Remove every Node, keeping the array for reuse.
+    void clear(void) {
+      numNodes = 0;
+      root     = noNode;
+      text     = NULL;
+    }
+
+    /// \brief Add a new Node whose children are the Nodes whose
+    /// indices are in someNodes from firstNode onwards, returning its
+    /// index.
+    size_t addNode(Token::TokenId aTokenId, size_t aStart, size_t anEnd,
+                   VarArray<size_t> *someNodes, size_t firstNode);
+
+    /// \brief Remove every Node from the numNodes-th Node onwards.
+    void truncate(size_t newNumNodes) {
+      ASSERT(newNumNodes <= numNodes);
+      numNodes = newNumNodes;
+      if ((root != noNode) && (numNodes <= root)) root = noNode;
+    }
+
+    /// \brief Return the number of Nodes.
+    size_t getNumNodes(void) {
+      return numNodes;
+    }
+
+    /// \brief Return the index of the root Node (or noNode if the
+    /// tree is empty).
+    size_t getRoot(void) {
+      return root;
+    }
+
+    /// \brief Set the index of the root Node.
+    void setRoot(size_t aRoot) {
+      ASSERT((aRoot == noNode) || (aRoot < numNodes));
+      root = aRoot;
+    }
+
+    /// \brief Return the Node at the index provided (or NULL).
+    const Node *getNode(size_t index) {
+      if (numNodes <= index) return NULL;
+      return nodes + index;
+    }
+
+    /// \brief Return the (contiguous) array of Nodes, for example to
+    /// write it out.
+    const Node *getNodes(void) {
+      return nodes;
+    }
+
+    /// \brief Return the number of children of the Node.
+    size_t getNumChildren(size_t index);
+
+    /// \brief Set the start of the original UTF8 character stream
+    /// from which the Nodes' offsets are measured.
+    void setText(const char *someText) {
+      text = someText;
+    }
+
+    /// \brief Return the start of the text of the Node (or NULL if
+    /// the tree's text is unknown).
+    const char *getTextStart(size_t index) {
+      if (!text || (numNodes <= index)) return NULL;
+      return text + nodes[index].start;
+    }
+
+    /// \brief Return the length (in bytes) of the text of the Node.
+    size_t getTextLength(size_t index) {
+      if (numNodes <= index) return 0;
+      return nodes[index].end - nodes[index].start;
+    }
+
+  protected:
+
+    /// \brief The (growable) array of Nodes.
+    Node *nodes;
+
+    /// \brief The number of Nodes allocated.
+    size_t nodesSize;
+
+    /// \brief The number of Nodes in use.
+    size_t numNodes;
+
+    /// \brief The index of the root Node.
+    size_t root;
+
+    /// \brief The start of the original UTF8 character stream.
+    const char *text;
+};
+
+#endif
@@ -17,8 +17,11 @@ NFA::NFA(Classifier *aUTF8Classifier) {
 }
 
 NFA::~NFA(void) {
-  for (size_t i = 0; i < startState.getNumItems(); i++) {
-    deleteState(startState.getItem(i, NULL));
+  // every state (reachable or not) is registered in states
+  for (size_t i = 0; i < states.getNumItems(); i++) {
+    State *aState = states.getItem(i, NULL);
+    if (aState && aState->message) free((void*)(aState->message));
+    if (aState) aState->message = NULL;
   }
   if (stateAllocator) delete stateAllocator;
   stateAllocator = NULL;
@@ -35,6 +38,8 @@ NFA::State *NFA::addState(NFA::MatchType aMatchType,
                           const char *aMessage) {
   State *newState =
     (State*)stateAllocator->allocateNewStructure(sizeof(State));
+  newState->id = numKnownStates;
+  states.pushItem(newState);
   numKnownStates++;
   newState->matchType = aMatchType;
   newState->matchData = someMatchData;
@@ -84,6 +89,294 @@ void NFA::appendNFAToStartState(const char *startStateName,
   }
 }
 
+size_t NFA::inlineIgnoredReStarts(void) {
+  size_t numInlined = 0;
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    size_t numStartStates = startState.getNumItems();
+    bool *inlinable = (bool*)calloc(numStartStates + 1, sizeof(bool));
+    if (!inlinable) throw ParserException("Out of memory");
+    for (size_t i = 0; i < numStartStates; i++) {
+      inlinable[i] = isInlinable((StartStateId)i);
+    }
+    size_t numStates = numKnownStates;
+    bool *contended = (bool*)calloc(numStates + 1, sizeof(bool));
+    if (!contended) {
+      free(inlinable);
+      throw ParserException("Out of memory");
+    }
+    markContendedReStarts(contended);
+    VarArray<Classifier::classSet_t> classSets;
+    if (utf8Classifier) utf8Classifier->collectClassSets(&classSets);
+    for (size_t i = 0; i < numStates; i++) {
+      State *aState = getState(i);
+      if (aState->matchType != ReStart) continue;
+      if (contended[i]) continue;
+      if (numStartStates <= aState->matchData.r) continue;
+      if (!inlinable[aState->matchData.r]) continue;
+      if (extendsIntoSuccessor(aState, &classSets)) continue;
+      inlineReStart(aState);
+      numInlined++;
+      changed = true;
+    }
+    free(contended);
+    free(inlinable);
+  }
+  return numInlined;
+}
+
+bool NFA::isInlinable(StartStateId startStateId) {
+  State *baseState = getStartState(startStateId);
+  if (!baseState) return false;
+  bool *visited = (bool*)calloc(numKnownStates + 1, sizeof(bool));
+  if (!visited) throw ParserException("Out of memory");
+  bool inlinable = true;
+  VarArray<State*> toVisit;
+  toVisit.pushItem(baseState);
+  while (inlinable && toVisit.getNumItems()) {
+    State *curState = toVisit.popItem();
+    if (!curState || visited[curState->id]) continue;
+    visited[curState->id] = true;
+    if (curState->matchType == ReStart) inlinable = false;
+    if ((curState->matchType == Token) &&
+        !Token::ignoreToken(curState->matchData.t)) inlinable = false;
+    toVisit.pushItem(curState->out1);
+    toVisit.pushItem(curState->out);
+  }
+  free(visited);
+  return inlinable;
+}
+
+void NFA::summarizeClosureReStarts(size_t *firstReStart,
+                                   bool *manyReStarts) {
+  size_t numStates = numKnownStates;
+  // the (epsilon) predecessors of each state are the Split states
+  // which lead to it, kept in predecessors from predStart[id]
+  size_t *predStart = (size_t*)calloc(numStates + 2, sizeof(size_t));
+  size_t *predecessors = (size_t*)calloc(2*numStates + 1, sizeof(size_t));
+  if (!predStart || !predecessors) {
+    if (predStart) free(predStart);
+    if (predecessors) free(predecessors);
+    throw ParserException("Out of memory");
+  }
+  for (size_t i = 0; i < numStates; i++) {
+    State *aState = getState(i);
+    if (aState->matchType != Split) continue;
+    if (aState->out)  predStart[aState->out->id + 2]++;
+    if (aState->out1) predStart[aState->out1->id + 2]++;
+  }
+  for (size_t i = 2; i < numStates + 2; i++) predStart[i] += predStart[i-1];
+  for (size_t i = 0; i < numStates; i++) {
+    State *aState = getState(i);
+    if (aState->matchType != Split) continue;
+    if (aState->out)  predecessors[predStart[aState->out->id + 1]++]  = i;
+    if (aState->out1) predecessors[predStart[aState->out1->id + 1]++] = i;
+  }
+  // each ReStart state's closure is itself, the summaries then flow
+  // (backwards) to the predecessors, changing at most twice each
+  VarArray<size_t> toUpdate;
+  for (size_t i = 0; i < numStates; i++) {
+    firstReStart[i] = numStates;
+    manyReStarts[i] = false;
+    if (getState(i)->matchType != ReStart) continue;
+    firstReStart[i] = i;
+    toUpdate.pushItem(i);
+  }
+  while (toUpdate.getNumItems()) {
+    size_t curId = toUpdate.popItem();
+    for (size_t j = predStart[curId]; j < predStart[curId+1]; j++) {
+      size_t predId = predecessors[j];
+      if (manyReStarts[predId]) continue;
+      if (manyReStarts[curId] ||
+          ((firstReStart[predId] != numStates) &&
+           (firstReStart[predId] != firstReStart[curId]))) {
+        manyReStarts[predId] = true;
+      } else if (firstReStart[predId] == numStates) {
+        firstReStart[predId] = firstReStart[curId];
+      } else {
+        continue;
+      }
+      toUpdate.pushItem(predId);
+    }
+  }
+  free(predecessors);
+  free(predStart);
+}
+
+void NFA::markContendedReStarts(bool *contended) {
+  size_t numStates = numKnownStates;
+  memset(contended, 0, (numStates + 1)*sizeof(bool));
+  size_t *firstReStart = (size_t*)calloc(numStates + 1, sizeof(size_t));
+  bool *manyReStarts   = (bool*)calloc(numStates + 1, sizeof(bool));
+  bool *visited        = (bool*)calloc(numStates + 1, sizeof(bool));
+  if (!firstReStart || !manyReStarts || !visited) {
+    if (firstReStart) free(firstReStart);
+    if (manyReStarts) free(manyReStarts);
+    if (visited) free(visited);
+    throw ParserException("Out of memory");
+  }
+  summarizeClosureReStarts(firstReStart, manyReStarts);
+  // the epsilon closures are those of the start states and of the
+  // successors of every (non-epsilon) transition... every ReStart
+  // state in a closure containing at least two is contended
+  VarArray<State*> toVisit;
+  for (size_t i = 0; i < startState.getNumItems(); i++) {
+    State *rootState = startState.getItem(i, NULL);
+    if (rootState && manyReStarts[rootState->id]) toVisit.pushItem(rootState);
+  }
+  for (size_t i = 0; i < numStates; i++) {
+    State *aState = getState(i);
+    switch (aState->matchType) {
+      case Character:
+      case ClassSet:
+      case ReStart:
+        if (aState->out && manyReStarts[aState->out->id]) {
+          toVisit.pushItem(aState->out);
+        }
+        break;
+      default:
+        break;
+    }
+  }
+  while (toVisit.getNumItems()) {
+    State *curState = toVisit.popItem();
+    if (!curState || visited[curState->id]) continue;
+    visited[curState->id] = true;
+    if (curState->matchType == ReStart) contended[curState->id] = true;
+    if (curState->matchType == Split) {
+      toVisit.pushItem(curState->out1);
+      toVisit.pushItem(curState->out);
+    }
+  }
+  // ... as is every ReStart state whose successor's closure contains
+  // a ReStart state
+  for (size_t i = 0; i < numStates; i++) {
+    State *aState = getState(i);
+    if ((aState->matchType != ReStart) || !aState->out) continue;
+    if (firstReStart[aState->out->id] != numStates) contended[i] = true;
+  }
+  free(visited);
+  free(manyReStarts);
+  free(firstReStart);
+}
+
+void NFA::collectTransitions(State *baseState,
+                             bool epsilonOnly,
+                             VarArray<State*> *transitions) {
+  bool *visited = (bool*)calloc(numKnownStates + 1, sizeof(bool));
+  if (!visited) throw ParserException("Out of memory");
+  VarArray<State*> toVisit;
+  toVisit.pushItem(baseState);
+  while (toVisit.getNumItems()) {
+    State *curState = toVisit.popItem();
+    if (!curState || visited[curState->id]) continue;
+    visited[curState->id] = true;
+    switch (curState->matchType) {
+      case Split:
+        toVisit.pushItem(curState->out1);
+        toVisit.pushItem(curState->out);
+        break;
+      case Character:
+      case ClassSet:
+        transitions->pushItem(curState);
+        if (!epsilonOnly) toVisit.pushItem(curState->out);
+        break;
+      default:
+        break;
+    }
+  }
+  free(visited);
+}
+
+bool NFA::transitionsOverlap(State *aState,
+                             State *otherState,
+                             VarArray<Classifier::classSet_t> *classSets) {
+  if (aState->matchType == Character) {
+    if (otherState->matchType == Character) {
+      return aState->matchData.c.u == otherState->matchData.c.u;
+    }
+    if (!utf8Classifier) return true;
+    return (utf8Classifier->getClassSet(aState->matchData.c) &
+            otherState->matchData.s) != 0;
+  }
+  if (otherState->matchType == Character) {
+    return transitionsOverlap(otherState, aState, classSets);
+  }
+  // two class sets overlap if any character's class set matches both
+  if (!utf8Classifier) return true;
+  for (size_t i = 0; i < classSets->getNumItems(); i++) {
+    Classifier::classSet_t classSet = classSets->getItem(i, 0);
+    if ((classSet & aState->matchData.s) &&
+        (classSet & otherState->matchData.s)) return true;
+  }
+  return false;
+}
+
+bool NFA::extendsIntoSuccessor(State *reStartState,
+                               VarArray<Classifier::classSet_t> *classSets) {
+  ASSERT(reStartState->matchType == ReStart);
+  VarArray<State*> ruleTransitions;
+  collectTransitions(getStartState(reStartState->matchData.r),
+                     false, &ruleTransitions);
+  VarArray<State*> firstTransitions;
+  collectTransitions(reStartState->out, true, &firstTransitions);
+  for (size_t i = 0; i < ruleTransitions.getNumItems(); i++) {
+    State *ruleState = ruleTransitions.getItem(i, NULL);
+    for (size_t j = 0; j < firstTransitions.getNumItems(); j++) {
+      State *firstState = firstTransitions.getItem(j, NULL);
+      if (transitionsOverlap(ruleState, firstState, classSets)) return true;
+    }
+  }
+  return false;
+}
+
+void NFA::inlineReStart(State *reStartState) {
+  ASSERT(reStartState->matchType == ReStart);
+  State *baseState    = getStartState(reStartState->matchData.r);
+  State *continuation = reStartState->out;
+  MatchData nulMatchData;
+  nulMatchData.c.u = 0;
+
+  // copy every NFA::State of the (sub)NFA...
+  size_t numStates = numKnownStates;
+  State **copies = (State**)calloc(numStates + 1, sizeof(State*));
+  if (!copies) throw ParserException("Out of memory");
+  VarArray<State*> toCopy;
+  toCopy.pushItem(baseState);
+  while (toCopy.getNumItems()) {
+    State *curState = toCopy.popItem();
+    if (!curState || copies[curState->id]) continue;
+    if (curState->matchType == Token) {
+      // ... whose (ignored) tokens continue after the ReStart state
+      copies[curState->id] =
+        addState(Split, nulMatchData, continuation, NULL, curState->message);
+      continue;
+    }
+    copies[curState->id] =
+      addState(curState->matchType, curState->matchData,
+               NULL, NULL, curState->message);
+    toCopy.pushItem(curState->out1);
+    toCopy.pushItem(curState->out);
+  }
+
+  // ... then link the copies together
+  for (size_t i = 0; i < numStates; i++) {
+    State *aCopy = copies[i];
+    if (!aCopy) continue;
+    State *origState = getState(i);
+    if (origState->matchType == Token) continue;
+    if (origState->out)  aCopy->out  = copies[origState->out->id];
+    if (origState->out1) aCopy->out1 = copies[origState->out1->id];
+  }
+
+  reStartState->matchType = Split;
+  reStartState->matchData = nulMatchData;
+  reStartState->out       = copies[baseState->id];
+  reStartState->out1      = NULL;
+  free(copies);
+}
+
 void NFA::printStateOnWithMessage(FILE *filePtr,
                                   const char *message,
                                   NFA::State *state) {
@@ -125,6 +125,13 @@ class NFA {
       State *out1;
 
       const char *message;
+
+      /// \brief The dense index of this NFA::State, assigned (in
+      /// order of creation) by NFA::addState.
+      ///
+      /// The DFA uses this index as the NFA::State's bit number in
+      /// every DFA::State bit set.
+      size_t id;
     } State;
 
     /// \brief Get the Classifier associated with this NFA.
@@ -212,6 +219,13 @@ class NFA {
     /// \brief Clean out the given state and all of its substates.
     void deleteState(State *aState);
 
+    /// \brief Get the NFA::State with the given (dense) index.
+    ///
+    /// Returns NULL if there is no such NFA::State.
+    State *getState(size_t stateId) {
+      return states.getItem(stateId, NULL);
+    }
+
     /// \brief Get the current number of NFA::States.
     size_t getNumberStates(void) {
       return numKnownStates;
@@ -222,6 +236,36 @@ class NFA {
       return startState.getNumItems();
     }
 
+    /// \brief Inline every NFA::ReStart state whose start state's
+    /// (sub)NFA contains no NFA::ReStart states and whose tokens are
+    /// all ignored, returning the number of NFA::ReStart states
+    /// inlined.
+    ///
+    /// Such rules recognize a plain regular language and add no
+    /// tokens to the parse tree, so a copy of their (sub)NFA, whose
+    /// NFA::Token states continue with the NFA::ReStart state's
+    /// successor, can replace the NFA::ReStart state. The DFA can
+    /// then absorb them, leaving the push down stack for the rules
+    /// which need it. Since inlining one rule may leave its caller
+    /// free of NFA::ReStart states, this is repeated until no more
+    /// rules can be inlined.
+    ///
+    /// The PushDownMachine tries NFA::ReStart states before reading
+    /// the next character, so an NFA::ReStart state is only inlined
+    /// if no other NFA::ReStart state shares an epsilon closure with
+    /// it or with its successor. This ensures the inlined rule still
+    /// consumes the same characters before the remaining NFA::ReStart
+    /// states are tried.
+    ///
+    /// The match of an NFA::ReStart state is also final: the
+    /// PushDownMachine takes the rule's longest match and never
+    /// returns characters the rule has consumed to its caller. So an
+    /// NFA::ReStart state is not inlined if any character the rule
+    /// can match could also start its successor (see
+    /// extendsIntoSuccessor), since the caller's DFA would then be
+    /// free to accept inputs the rule would have swallowed.
+    size_t inlineIgnoredReStarts(void);
+
     /// \brief Print the NFA::State state on the FILE
     /// filePtr together with the message message.
     void printStateOnWithMessage(FILE *filePtr,
@@ -230,6 +274,50 @@ class NFA {
 
   protected:
 
+    /// \brief Return true if the (sub)NFA of the start state,
+    /// startStateId, contains no NFA::ReStart states and only
+    /// ignored NFA::Token states.
+    bool isInlinable(StartStateId startStateId);
+
+    /// \brief Summarize (in the arrays provided, indexed by NFA::State
+    /// id) the NFA::ReStart states in the epsilon closure of every
+    /// NFA::State: firstReStart is the id of one of them (or
+    /// numKnownStates if there are none), and manyReStarts is true if
+    /// there are at least two.
+    void summarizeClosureReStarts(size_t *firstReStart, bool *manyReStarts);
+
+    /// \brief Mark (in the contended array, indexed by NFA::State id)
+    /// every NFA::ReStart state which shares an epsilon closure with
+    /// another NFA::ReStart state, or whose successor's epsilon
+    /// closure contains an NFA::ReStart state.
+    void markContendedReStarts(bool *contended);
+
+    /// \brief Collect the NFA::Character and NFA::ClassSet states
+    /// reachable from baseState, either through NFA::Split states
+    /// only (epsilonOnly) or through any transition, stopping at
+    /// NFA::Token and NFA::ReStart states.
+    void collectTransitions(State *baseState,
+                            bool epsilonOnly,
+                            VarArray<State*> *transitions);
+
+    /// \brief Return true if some character could be matched by both
+    /// the NFA::Character or NFA::ClassSet states, aState and
+    /// otherState, given the distinct class sets, classSets, which
+    /// the utf8Classifier can return.
+    bool transitionsOverlap(State *aState,
+                            State *otherState,
+                            VarArray<Classifier::classSet_t> *classSets);
+
+    /// \brief Return true if a character which the rule of the
+    /// NFA::ReStart state, reStartState, can match could also be the
+    /// first character matched by the NFA::ReStart state's successor.
+    bool extendsIntoSuccessor(State *reStartState,
+                              VarArray<Classifier::classSet_t> *classSets);
+
+    /// \brief Replace the NFA::ReStart state, reStartState, with a
+    /// copy of its start state's (sub)NFA (see inlineIgnoredReStarts).
+    void inlineReStart(State *reStartState);
+
     /// \brief A BlockAllocator which allocates new NFA::States.
     BlockAllocator *stateAllocator;
 
@@ -242,8 +330,15 @@ class NFA {
     /// \brief The number of NFA::States added to this NFA.
     size_t numKnownStates;
 
+    /// \brief All of the NFA::States added to this NFA, indexed by
+    /// their id.
+    VarArray<State*> states;
+
     /// \brief The Classifier used by this NFA to classify UTF8 characters.
     Classifier *utf8Classifier;
+
+    /// Allow complete access when saving or loading compiled grammars.
+    friend class CompiledGrammar;
 };
 
 
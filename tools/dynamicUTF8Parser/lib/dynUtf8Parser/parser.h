@@ -28,6 +28,8 @@ framework](https://github.com/joakimkarlsson/bandit).
 
 #include "dynUtf8Parser/nfaBuilder.h"
 #include "dynUtf8Parser/dfa/pushDownMachine.h"
+#include "dynUtf8Parser/dfa/gllMachine.h"
+#include "dynUtf8Parser/compiledGrammar.h"
 
 using namespace DeterministicFiniteAutomaton;
 
@@ -39,17 +41,38 @@ class Parser {
     /// \brief A TokenId is a user assigned NFA::TokenId (Hat-Trie::value_t).
     typedef Token::TokenId TokenId;
 
+    /// \brief The CompileMode determines how much of the DFA is
+    /// built when the Parser is compiled.
+    enum CompileMode {
+      /// \brief Build every DFA::State on the fly while parsing.
+      Lazy,
+
+      /// \brief Build (and minimize) the DFA for every start state
+      /// which contains no NFA::ReStart states when compiling (see
+      /// DFA::compileEagerly), the remaining DFA::States are built on
+      /// the fly.
+      Eager
+    };
+
     /// \brief Create a Parser.
     Parser(void) {
       classifier   = new Classifier();
       nfa          = new NFA(classifier);
       nfaBuilder   = new NFABuilder(nfa);
       lastClassSet = 1;
+      cacheBudget  = 0;
+      memoBudget   = 0;
+      memoLookups  = 0;
+      memoHits     = 0;
+      tokenArena   = NULL;
+      pdm          = NULL;
       dfa          = NULL;
     }
 
     /// \brief Delete the parser.
     ~Parser(void) {
+      if (pdm) delete pdm;
+      pdm = NULL;
       if (dfa) delete dfa;
       dfa = NULL;
       delete nfaBuilder;
@@ -140,10 +163,118 @@ class Parser {
     ///
     /// After a Parser has been compiled no further classifications can
     /// be made, or Regular-Expression/TokenIds can be added.
-    void compile(void) {
+    ///
+    /// Compiling the Parser first inlines every reference to a rule
+    /// which recognizes a plain regular language whose tokens are
+    /// ignored, wherever this leaves the inputs the Parser accepts
+    /// unchanged (see NFA::inlineIgnoredReStarts).
+    ///
+    /// Compiling the Parser computes the alphabet equivalence classes
+    /// (see the DFA's CharacterClassMapping) which index the DFA's
+    /// transitions.
+    ///
+    /// In CompileMode::Eager, the DFA for every start state which
+    /// contains no NFA::ReStart states is also built and minimized,
+    /// so that the first parses need not pay the cost of building
+    /// these DFA::States. See getEagerCompileReport. A Parser which
+    /// has already been (lazily) compiled is then compiled eagerly.
+    void compile(CompileMode compileMode = Lazy) {
       if (!dfa) {
+        nfa->inlineIgnoredReStarts();
         dfa = new DFA(nfa);
+        dfa->setCacheBudget(cacheBudget);
+      }
+      if (compileMode == Eager) dfa->compileEagerly();
+    }
+
+    /// \brief Return the EagerCompileReport of the named start state.
+    ///
+    /// The report records the number of DFA::States before and after
+    /// minimization, and is all zero unless the Parser has been
+    /// compiled using CompileMode::Eager.
+    EagerCompileReport getEagerCompileReport(const char *startStateName) {
+      NFA::StartStateId startStateId = nfa->findStartStateId(startStateName);
+      if (dfa) return dfa->getEagerCompileReport(startStateId);
+      EagerCompileReport noReport;
+      memset(&noReport, 0, sizeof(EagerCompileReport));
+      noReport.startStateId = startStateId;
+      return noReport;
+    }
+
+    /// \brief Save the compiled Parser (its Classifier, NFA and all
+    /// of the DFA::States learned so far) to the file at path.
+    ///
+    /// The Parser is compiled first, if it has not already been
+    /// compiled. See CompiledGrammar for details of the file format.
+    /// Throws a ParserException if the file can not be written.
+    void saveCompiled(const char *path) {
+      compile();
+      CompiledGrammar::save(path, classifier, nfa, dfa, lastClassSet);
+    }
+
+    /// \brief Load a compiled Parser from the file at path (saved by
+    /// saveCompiled).
+    ///
+    /// The Parser must be new, that is, have no rules and not yet
+    /// have been compiled. The loaded Parser is compiled, and already
+    /// knows the saved DFA::States. Throws a ParserException if the
+    /// Parser is not new or the file is not a valid compiled grammar.
+    void loadCompiled(const char *path) {
+      if (dfa || nfa->getNumberStates() || nfa->getNumberStartStates()) {
+        throw ParserException("Can only load a compiled grammar into a new Parser");
       }
+      dfa = CompiledGrammar::load(path, classifier, nfa, &lastClassSet);
+      dfa->setCacheBudget(cacheBudget);
+    }
+
+    /// \brief Limit the (approximate) number of bytes used by the
+    /// DFA's cache of DFA::States to maxBytes (zero for no limit).
+    ///
+    /// Once over budget, the DFA cache is flushed while parsing (see
+    /// DFA::flushCache), keeping the start states, the eagerly
+    /// compiled DFA::States, and the DFA::States in use.
+    void setCacheBudget(size_t maxBytes) {
+      cacheBudget = maxBytes;
+      if (dfa) dfa->setCacheBudget(cacheBudget);
+    }
+
+    /// \brief Return the number of times the DFA cache has been
+    /// flushed.
+    size_t getNumCacheFlushes(void) {
+      if (dfa) return dfa->getNumCacheFlushes();
+      return 0;
+    }
+
+    /// \brief Limit the (approximate) number of bytes used, while
+    /// parsing, to memoize the outcome of each rule at each stream
+    /// offset to maxBytes.
+    ///
+    /// A zero maxBytes (the default) disables memoization. Memoizing
+    /// avoids re-running rules after backtracking (see PackratMemo).
+    void setMemoBudget(size_t maxBytes) {
+      memoBudget = maxBytes;
+    }
+
+    /// \brief Allocate the tokens of each parse in the TokenArena
+    /// provided (or, if NULL, on the heap).
+    ///
+    /// The parse trees returned by parseFromUsing are then owned by
+    /// the TokenArena and must NOT be deleted, instead they are all
+    /// released at once by TokenArena::reset.
+    void setTokenArena(TokenArena *aTokenArena) {
+      tokenArena = aTokenArena;
+    }
+
+    /// \brief Return the number of times, over all parses, that the
+    /// outcome of a rule at a stream offset was looked up.
+    size_t getNumMemoLookups(void) {
+      return memoLookups;
+    }
+
+    /// \brief Return the number of times, over all parses, that the
+    /// outcome of a rule at a stream offset was already known.
+    size_t getNumMemoHits(void) {
+      return memoHits;
     }
 
     /// \brief Parse the provided UTF8 character stream starting at the
@@ -152,22 +283,140 @@ class Parser {
     ///
     /// If the Parser has not yet been compiled, the NULL token is
     /// returned.
+    ///
+    /// Every parse reuses the same PushDownMachine (and so its stack,
+    /// token builder and memo). Once warmed up (by parsing a similar
+    /// document), a parse into a TokenArena (see setTokenArena), a
+    /// FlatTokenTree (see parseFromUsingInto) or a TokenVisitor (see
+    /// parseFromUsingVisiting) makes no heap allocations, provided
+    /// the DFA has already built the DFA::States needed, and neither
+    /// the DFA's cache nor the memo exceed their budgets.
     Token *parseFromUsing(const char *startStateName,
                           Utf8Chars *someChars,
                           PDMTracer *pdmTracer = NULL) {
-      if (dfa) {
-        PushDownMachine *pdm = new PushDownMachine(dfa);
-        Token *result =
-          pdm->runFromUsing(nfa->findStartStateId(startStateName),
-                            someChars, pdmTracer);
-        delete pdm;
-        return result;
+      if (!dfa) return NULL;
+      PushDownMachine *aPDM = getPDM();
+      if (aPDM->getTokenArena() != tokenArena) {
+        aPDM->setTokenArena(tokenArena);
       }
-      return NULL;
+      Token *result =
+        aPDM->runFromUsing(nfa->findStartStateId(startStateName),
+                           someChars, pdmTracer);
+      collectMemoStatistics();
+      return result;
+    }
+
+    /// \brief Parse the provided UTF8 character stream starting at the
+    /// named NFA start state, reporting each token to the
+    /// TokenVisitor provided, rather than building a parse tree (see
+    /// PushDownMachine::runFromUsingVisiting). Returns true if the
+    /// stream was parsed.
+    ///
+    /// If the Parser has not yet been compiled, false is returned.
+    bool parseFromUsingVisiting(const char *startStateName,
+                                Utf8Chars *someChars,
+                                TokenVisitor *visitor,
+                                PDMTracer *pdmTracer = NULL) {
+      if (!dfa) return false;
+      bool result =
+        getPDM()->runFromUsingVisiting(nfa->findStartStateId(startStateName),
+                                       someChars, visitor, pdmTracer);
+      collectMemoStatistics();
+      return result;
+    }
+
+    /// \brief Start a push mode parse of a document (fed in chunks
+    /// by feed and finish) from the named NFA start state, reporting
+    /// each token to the TokenVisitor provided (see
+    /// PushDownMachine::startPushing).
+    ///
+    /// Returns false (starting nothing) if the Parser has not yet
+    /// been compiled.
+    bool startPushing(const char *startStateName, TokenVisitor *visitor) {
+      if (!dfa) return false;
+      getPDM()->startPushing(nfa->findStartStateId(startStateName),
+                             visitor);
+      return true;
+    }
+
+    /// \brief Feed the next chunk (of numBytes) of the document to the
+    /// push mode parse, returning its PushStatus.
+    PushDownMachine::PushStatus feed(const char *someBytes,
+                                     size_t numBytes) {
+      if (!pdm) return PushDownMachine::PushIdle;
+      PushDownMachine::PushStatus status = pdm->feed(someBytes, numBytes);
+      collectMemoStatistics();
+      return status;
+    }
+
+    /// \brief Mark the end of the document fed to the push mode
+    /// parse, returning its (final) PushStatus.
+    PushDownMachine::PushStatus finish(void) {
+      if (!pdm) return PushDownMachine::PushIdle;
+      PushDownMachine::PushStatus status = pdm->finish();
+      collectMemoStatistics();
+      return status;
+    }
+
+    /// \brief Parse the provided UTF8 character stream starting at the
+    /// named NFA start state, building the resulting parse tree
+    /// directly into the FlatTokenTree provided (see
+    /// PushDownMachine::runFromUsingInto). Returns true if the stream
+    /// was parsed.
+    ///
+    /// If the Parser has not yet been compiled, false is returned.
+    bool parseFromUsingInto(const char *startStateName,
+                            Utf8Chars *someChars,
+                            FlatTokenTree *flatTree,
+                            PDMTracer *pdmTracer = NULL) {
+      if (!dfa) return false;
+      bool result =
+        getPDM()->runFromUsingInto(nfa->findStartStateId(startStateName),
+                                   someChars, flatTree, pdmTracer);
+      collectMemoStatistics();
+      return result;
+    }
+
+    /// \brief Parse the provided UTF8 character stream starting at the
+    /// named NFA start state, exploring every alternative breadth
+    /// first (see GLLMachine), adding (at most maxParses of) the
+    /// distinct parse trees to parses.
+    ///
+    /// Unlike parseFromUsing, ambiguous and left recursive grammars
+    /// are parsed in (at worst) polynomial time. Returns the number
+    /// of parse trees added, the preferred parse tree first.
+    size_t allParsesFromUsing(const char *startStateName,
+                              Utf8Chars *someChars,
+                              VarArray<Token*> *parses,
+                              size_t maxParses = 1) {
+      if (!dfa) return 0;
+      GLLMachine *gll = new GLLMachine(dfa);
+      size_t numParses =
+        gll->allParsesFromUsing(nfa->findStartStateId(startStateName),
+                                someChars, parses, maxParses);
+      delete gll;
+      return numParses;
     }
 
   protected:
 
+    /// \brief Return the (compiled) Parser's PushDownMachine, creating
+    /// it on first use, with the current memo budget.
+    PushDownMachine *getPDM(void) {
+      ASSERT(dfa);
+      if (!pdm) pdm = new PushDownMachine(dfa);
+      pdm->setMemoBudget(memoBudget);
+      return pdm;
+    }
+
+    /// \brief Add the PushDownMachine's memo statistics (of the last
+    /// parse) to the totals over all parses.
+    void collectMemoStatistics(void) {
+      memoLookups += pdm->getMemo()->getNumLookups();
+      memoHits    += pdm->getMemo()->getNumHits();
+      pdm->getMemo()->resetStatistics();
+    }
+
     /// \brief The Classifier used to classify UTF8 characters.
     Classifier *classifier;
 
@@ -180,6 +429,28 @@ class Parser {
     /// \brief the bit representing the last class set assigned.
     Classifier::classSet_t lastClassSet;
 
+    /// \brief The (approximate) maximum number of bytes of the DFA's
+    /// cache, or zero if unlimited.
+    size_t cacheBudget;
+
+    /// \brief The (approximate) maximum number of bytes used to
+    /// memoize rules while parsing, or zero if disabled.
+    size_t memoBudget;
+
+    /// \brief The number of memo lookups over all parses.
+    size_t memoLookups;
+
+    /// \brief The number of memo hits over all parses.
+    size_t memoHits;
+
+    /// \brief The (optional) TokenArena which owns the tokens of each
+    /// parse.
+    TokenArena *tokenArena;
+
+    /// \brief The PushDownMachine reused by every parse (created on
+    /// first use).
+    PushDownMachine *pdm;
+
     /// \brief The DFA used to scan Utf8Chars streams.
     ///
     /// The DFA is compiled from the NFA by the compile method.
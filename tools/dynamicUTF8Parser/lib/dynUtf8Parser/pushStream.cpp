@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dynUtf8Parser/nfa.h"
+#include "dynUtf8Parser/pushStream.h"
+
+PushStream::PushStream(void) {
+  bytesSize = initialNumBytes;
+  bytes     = (char*)malloc(bytesSize);
+  if (!bytes) throw ParserException("Out of memory");
+  stream    = new Utf8Chars(bytes, (size_t)0, Utf8Chars::DoNotOwn);
+  clear();
+}
+
+PushStream::~PushStream(void) {
+  if (stream) delete stream;
+  stream = NULL;
+  if (bytes) free(bytes);
+  bytes     = NULL;
+  bytesSize = 0;
+}
+
+void PushStream::clear(void) {
+  numBytes          = 0;
+  numCompleteBytes  = 0;
+  numDiscardedBytes = 0;
+  finished          = false;
+  updateStream();
+}
+
+void PushStream::append(const char *someBytes, size_t someNumBytes) {
+  ASSERT(!finished);
+  if (!someBytes || !someNumBytes) return;
+  if (bytesSize < numBytes + someNumBytes) {
+    size_t newSize = 2*bytesSize;
+    while (newSize < numBytes + someNumBytes) newSize *= 2;
+    char *newBytes = (char*)realloc(bytes, newSize);
+    if (!newBytes) throw ParserException("Out of memory");
+    bytes     = newBytes;
+    bytesSize = newSize;
+  }
+  memcpy(bytes + numBytes, someBytes, someNumBytes);
+  numBytes += someNumBytes;
+  // hold back the bytes of a trailing incomplete UTF8 character
+  // (whose start byte is at most 5 bytes from the end)
+  numCompleteBytes = numBytes;
+  for (size_t i = 1; (i <= 6) && (i <= numBytes); i++) {
+    unsigned char aByte = bytes[numBytes - i];
+    if ((aByte & 0xC0) == 0x80) continue;
+    size_t charLength = 1;
+    if      ((aByte & 0xE0) == 0xC0) charLength = 2;
+    else if ((aByte & 0xF0) == 0xE0) charLength = 3;
+    else if ((aByte & 0xF8) == 0xF0) charLength = 4;
+    else if ((aByte & 0xFC) == 0xF8) charLength = 5;
+    else if ((aByte & 0xFE) == 0xFC) charLength = 6;
+    if (i < charLength) numCompleteBytes = numBytes - i;
+    break;
+  }
+  updateStream();
+}
+
+void PushStream::discardBefore(size_t offset) {
+  if (offset <= numDiscardedBytes) return;
+  size_t numToDiscard = offset - numDiscardedBytes;
+  if (numCompleteBytes < numToDiscard) numToDiscard = numCompleteBytes;
+  if (2*numToDiscard < numBytes) return;
+  memmove(bytes, bytes + numToDiscard, numBytes - numToDiscard);
+  numBytes          -= numToDiscard;
+  numCompleteBytes  -= numToDiscard;
+  numDiscardedBytes += numToDiscard;
+  updateStream();
+}
+
+void PushStream::updateStream(void) {
+  // measure the window's Cursors from the start of the whole document
+  // (only the bytes from the window's start are ever read)
+  stream->origUtf8Chars = bytes;
+  stream->baseOffset    = numDiscardedBytes;
+  stream->utf8Chars     = bytes;
+  stream->lastByte      = bytes + numCompleteBytes;
+  stream->restart();
+  ASSERT(stream->invariant());
+}
@@ -0,0 +1,114 @@
+#ifndef PUSH_STREAM_H
+#define PUSH_STREAM_H
+
+#include "dynUtf8Parser/utf8chars.h"
+
+/// \brief A PushStream collects the chunks of a UTF8 document as they
+/// arrive, and provides a Utf8Chars window onto the (complete) UTF8
+/// characters received so far.
+///
+/// The window's Cursor offsets are always measured from the start of
+/// the whole document, even once the bytes before some offset (which
+/// will never be read again) have been discarded (see
+/// discardBefore). A chunk may end part way through a UTF8
+/// character, whose bytes are held back from the window until the
+/// rest of the character arrives.
+///
+/// Only the bytes at or after the window's getStart may be read, so
+/// text must be recovered from the (absolute) offsets before it is
+/// discarded.
+class PushStream {
+  public:
+
+    /// \brief The number of bytes initially allocated.
+    static const size_t initialNumBytes = 4096;
+
+    /// \brief Create an empty PushStream.
+    PushStream(void);
+
+    /// \brief Destroy the PushStream.
+    ~PushStream(void);
+
+    /// \brief Remove every byte (and any discarded offset), starting
+    /// a new (unfinished) document.
+    void clear(void);
+
+    /// \brief Append the numBytes of the chunk provided (which need
+    /// not end on a UTF8 character boundary) to the document.
+    void append(const char *someBytes, size_t numBytes);
+
+    /// \brief Mark the document as finished (no more chunks will be
+    /// appended).
+    void finish(void) {
+      finished = true;
+    }
+
+    /// \brief Return true if the document has been finished.
+    bool isFinished(void) {
+      return finished;
+    }
+
+    /// \brief Return true if the document so far ends part way
+    /// through a UTF8 character.
+    bool endsMidCharacter(void) {
+      return numCompleteBytes < numBytes;
+    }
+
+    /// \brief Discard the bytes before the (absolute) offset provided,
+    /// which will never be read again.
+    ///
+    /// The remaining bytes are only moved (to the front of the
+    /// buffer) once at least half of the bytes can be discarded.
+    void discardBefore(size_t offset);
+
+    /// \brief Return the Utf8Chars window onto the complete UTF8
+    /// characters received (and not discarded) so far.
+    ///
+    /// The window is owned by the PushStream, and is updated (in
+    /// place) by append and discardBefore.
+    Utf8Chars *getStream(void) {
+      return stream;
+    }
+
+    /// \brief Return the (absolute) offset of the first byte still
+    /// held.
+    size_t getNumDiscardedBytes(void) {
+      return numDiscardedBytes;
+    }
+
+    /// \brief Return the number of bytes still held (including any
+    /// incomplete UTF8 character).
+    size_t getNumBytes(void) {
+      return numBytes;
+    }
+
+  protected:
+
+    /// \brief Move the window onto the complete UTF8 characters
+    /// currently held.
+    void updateStream(void);
+
+    /// \brief The (growable) buffer of the bytes still held.
+    char *bytes;
+
+    /// \brief The number of bytes allocated.
+    size_t bytesSize;
+
+    /// \brief The number of bytes held.
+    size_t numBytes;
+
+    /// \brief The number of bytes held which form complete UTF8
+    /// characters.
+    size_t numCompleteBytes;
+
+    /// \brief The (absolute) offset of the first byte held.
+    size_t numDiscardedBytes;
+
+    /// \brief True once the document has been finished.
+    bool finished;
+
+    /// \brief The (owned) window onto the complete UTF8 characters.
+    Utf8Chars *stream;
+};
+
+#endif
@@ -37,6 +37,29 @@ class StreamRegistry {
       addStream(new Utf8Chars(someUtf8Chars, ownership));
     }
 
+    /// \brief Add the first numBytes of a byte array (which need not
+    /// be NUL terminated) as a stream to this stream registry.
+    ///
+    /// Internally a Utf8Chars instance will be created with the given
+    /// ownership model.
+    void addStream(const char *someUtf8Chars, size_t numBytes,
+                   Utf8Chars::Ownership ownership = Utf8Chars::DoNotOwn) {
+      addStream(new Utf8Chars(someUtf8Chars, numBytes, ownership));
+    }
+
+    /// \brief Add the (read only) memory mapped contents of the file
+    /// at path as a stream to this stream registry (see
+    /// Utf8Chars::fromMappedFile).
+    ///
+    /// The file is unmapped when the stream registry is destroyed.
+    /// Returns the new stream, or NULL (adding nothing) if the file
+    /// can not be mapped.
+    Utf8Chars *addMappedFile(const char *path) {
+      Utf8Chars *aStream = Utf8Chars::fromMappedFile(path);
+      if (aStream) addStream(aStream);
+      return aStream;
+    }
+
     /// \brief Add a Utf8Chars instance to this stream registry.
     ///
     /// *NOTE:* This Utf8Chars instance will be destroyed when the
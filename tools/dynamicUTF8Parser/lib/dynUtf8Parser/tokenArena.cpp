@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "dynUtf8Parser/nfa.h"
+#include "dynUtf8Parser/tokenArena.h"
+
+TokenArena::TokenArena(size_t aBlockSize) {
+  blockSize    = aBlockSize;
+  if (blockSize < sizeof(Token)) blockSize = sizeof(Token);
+  curBlock     = 0;
+  curBlockUsed = 0;
+  numTokens    = 0;
+  numBytes     = 0;
+}
+
+TokenArena::~TokenArena(void) {
+  reset();
+  while (blocks.getNumItems()) free(blocks.popItem());
+}
+
+void TokenArena::reset(void) {
+  while (largeBlocks.getNumItems()) free(largeBlocks.popItem());
+  curBlock     = 0;
+  curBlockUsed = 0;
+  numTokens    = 0;
+  numBytes     = 0;
+}
+
+void *TokenArena::allocate(size_t size) {
+  // keep every allocation pointer aligned
+  size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+  numBytes += size;
+  if (blockSize < size) {
+    char *largeBlock = (char*)calloc(1, size);
+    if (!largeBlock) throw ParserException("Out of memory");
+    largeBlocks.pushItem(largeBlock);
+    return largeBlock;
+  }
+  if (blockSize < curBlockUsed + size) {
+    curBlock++;
+    curBlockUsed = 0;
+  }
+  if (blocks.getNumItems() <= curBlock) {
+    char *newBlock = (char*)malloc(blockSize);
+    if (!newBlock) throw ParserException("Out of memory");
+    blocks.pushItem(newBlock);
+  }
+  char *result = blocks.getItem(curBlock, NULL) + curBlockUsed;
+  curBlockUsed += size;
+  memset(result, 0, size);
+  return result;
+}
+
+Token *TokenArena::newToken(Token::TokenId aTokenId,
+                            const char *aTextStart, size_t aTextLength,
+                            VarArray<Token*> *someTokens, size_t firstToken) {
+  size_t numChildren = 0;
+  if (someTokens && (firstToken < someTokens->getNumItems())) {
+    numChildren = someTokens->getNumItems() - firstToken;
+  }
+  Token *token = new (allocate(sizeof(Token))) Token();
+  numTokens++;
+  token->setId(aTokenId);
+  token->setText(aTextStart, aTextLength);
+  if (numChildren) {
+    Token **children = (Token**)allocate(numChildren*sizeof(Token*));
+    for (size_t i = 0; i < numChildren; i++) {
+      children[i] = someTokens->getItem(firstToken + i, NULL);
+    }
+    token->tokens.useArray(children, numChildren);
+  }
+  return token;
+}
+
+Token *TokenArena::cloneToken(Token *token) {
+  if (!token) return NULL;
+  VarArray<Token*> children;
+  for (size_t i = 0; i < token->tokens.getNumItems(); i++) {
+    children.pushItem(cloneToken(token->tokens.getItem(i, NULL)));
+  }
+  return newToken(token->tokenId, token->textStart, token->textLength,
+                  &children, 0);
+}
@@ -0,0 +1,95 @@
+#ifndef TOKEN_ARENA_H
+#define TOKEN_ARENA_H
+
+#include "dynUtf8Parser/tokens.h"
+
+/// \brief A TokenArena is a (bump) allocator which owns all of the
+/// Tokens (and their arrays of child tokens) of one or more parses.
+///
+/// Tokens are allocated one after another in large blocks, so a
+/// token's children sit (more or less) contiguously in memory. The
+/// Tokens of a TokenArena are NEVER deleted individually, instead
+/// all of them are released at once by TokenArena::reset, which keeps
+/// the (standard sized) blocks for reuse by the next parse.
+///
+/// *NOTE:* the Tokens of a TokenArena must not be deleted nor have
+/// further child tokens added. Use Token::clone to obtain a (heap
+/// allocated) copy which outlives the TokenArena.
+class TokenArena {
+  public:
+
+    /// \brief The default number of bytes in each block.
+    static const size_t defaultBlockSize = 64*1024;
+
+    /// \brief Create an (empty) TokenArena whose blocks are
+    /// aBlockSize bytes.
+    TokenArena(size_t aBlockSize = defaultBlockSize);
+
+    /// \brief Destroy the TokenArena, freeing all of its blocks (and
+    /// hence all of its Tokens).
+    ~TokenArena(void);
+
+    /// \brief Return a new Token with the token id and text provided
+    /// whose children are the (already allocated) tokens of
+    /// someTokens from firstToken onwards.
+    Token *newToken(Token::TokenId aTokenId,
+                    const char *aTextStart, size_t aTextLength,
+                    VarArray<Token*> *someTokens, size_t firstToken);
+
+    /// \brief Return a (deep) copy, allocated in this TokenArena, of
+    /// the token provided.
+    Token *cloneToken(Token *token);
+
+    /// \brief Release every Token of this TokenArena at once,
+    /// keeping the standard sized blocks for reuse.
+    void reset(void);
+
+    /// \brief Return the number of Tokens allocated since the last
+    /// reset.
+    size_t getNumTokens(void) {
+      return numTokens;
+    }
+
+    /// \brief Return the number of bytes allocated since the last
+    /// reset.
+    size_t getNumBytes(void) {
+      return numBytes;
+    }
+
+    /// \brief Return the number of (standard sized) blocks owned by
+    /// this TokenArena.
+    size_t getNumBlocks(void) {
+      return blocks.getNumItems();
+    }
+
+  protected:
+
+    /// \brief Return size (zeroed and pointer aligned) bytes.
+    void *allocate(size_t size);
+
+    /// \brief The number of bytes in each (standard sized) block.
+    size_t blockSize;
+
+    /// \brief The (standard sized) blocks, which are reused after a
+    /// reset.
+    VarArray<char*> blocks;
+
+    /// \brief The index of the block currently being allocated.
+    size_t curBlock;
+
+    /// \brief The number of bytes already allocated from the current
+    /// block.
+    size_t curBlockUsed;
+
+    /// \brief The (over sized) blocks used by requests larger than a
+    /// standard block, which are freed on reset.
+    VarArray<char*> largeBlocks;
+
+    /// \brief The number of Tokens allocated since the last reset.
+    size_t numTokens;
+
+    /// \brief The number of bytes allocated since the last reset.
+    size_t numBytes;
+};
+
+#endif
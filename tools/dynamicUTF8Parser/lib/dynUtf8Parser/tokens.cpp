@@ -29,14 +29,12 @@ static const char *indents[] = {
 void Token::printOn(FILE *outFile, size_t indent) {
   if (!outFile) return;
   if (20 < indent) indent = 20;
-  const char *text = strndup(textStart, textLength);
-  //printf("token: %p printOn: %s%lu(%lu) [%s]\n", this,
+  //printf("token: %p printOn: %s%lu(%lu) [%.*s]\n", this,
   //        indents[indent], tokenId,
-  //        tokens.getNumItems(), text);
-  fprintf(outFile, "%s%lu(%lu) [%s]\n",
+  //        tokens.getNumItems(), (int)textLength, textStart);
+  fprintf(outFile, "%s%lu(%lu) [%.*s]\n",
           indents[indent], tokenId,
-          tokens.getNumItems(), text);
-  free((void*)text);
+          tokens.getNumItems(), (int)textLength, textStart);
   tokens.printOn(outFile, indent);
 }
 
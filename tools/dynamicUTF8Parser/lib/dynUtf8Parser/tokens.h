@@ -6,6 +6,8 @@
 #include "cUtils/varArray.h"
 #include "dynUtf8Parser/streamRegistry.h"
 
+class TokenArena;
+
 /// \brief A Token which can contain a subTree of child tokens over a
 /// collection of UTF8 characters.
 ///
@@ -14,8 +16,8 @@
 /// StreamRegistry. To do this each backing stream should be added to the
 /// StreamRegistry instance.
 ///
-/// **TODO make TokenArray back into VarArray<Token> rather than the
-/// less cache aware (less localized) VarArray<Token*>.**
+/// *NOTE:* where locality matters, a parse tree can instead be built
+/// into a (contiguous) FlatTokenTree.
 class Token {
   public:
 
@@ -98,6 +100,27 @@ class Token {
       ASSERT(invariant());
     }
 
+    /// \brief Add a Child token, taking ownership of the child token
+    /// (rather than copying it).
+    void adoptChildToken(Token *childToken) {
+      ASSERT(childToken->invariant());
+      tokens.pushItem(childToken);
+      ASSERT(invariant());
+    }
+
+    /// \brief Add the tokens of someTokens, from firstToken onwards,
+    /// as Child tokens, taking ownership of them (rather than copying
+    /// them).
+    void adoptChildTokens(VarArray<Token*> *someTokens, size_t firstToken) {
+      size_t numTokens = someTokens->getNumItems();
+      for (size_t i = firstToken; i < numTokens; i++) {
+        Token *childToken = someTokens->getItem(i, NULL);
+        ASSERT(childToken->invariant());
+        tokens.pushItem(childToken);
+      }
+      ASSERT(invariant());
+    }
+
     /// \brief Wrap the ignoreToken flag into the TokenId provided.
     static WrappedTokenId wrapTokenId(TokenId aTokenId, bool ignoreToken) {
       return (( aTokenId << 1 ) | ( ignoreToken ? 0x1 : 0x0));
@@ -139,8 +162,22 @@ class Token {
       return true;
     }
 
+    /// \brief Return the number of tokens in this token and all of
+    /// its subtrees of child tokens.
+    size_t countTokens(void) {
+      size_t numTokens = 1;
+      for (size_t i = 0; i < tokens.getNumItems(); i++) {
+        numTokens += tokens.getItem(i, NULL)->countTokens();
+      }
+      return numTokens;
+    }
+
   protected:
 
+    /// \brief A TokenArena builds its Tokens' arrays of child tokens
+    /// in place.
+    friend class TokenArena;
+
     /// \brief Make a *deep* copy of the other token.
     void copyFrom(const Token *other) {
       ASSERT(other->invariant());
@@ -220,6 +257,18 @@ class Token {
       /// \brief Print the child tokens on the FILE* provided.
       void printOn(FILE *outFile, size_t indent);
 
+      /// \brief Use the (TokenArena allocated) array of numTokens
+      /// child tokens provided.
+      ///
+      /// Since the TokenArena owns both the array and its tokens, the
+      /// array can not grow and is never freed (see TokenArena).
+      void useArray(Token **someTokens, size_t numTokens) {
+        ASSERT(!itemArray);
+        itemArray = someTokens;
+        arraySize = numTokens;
+        numItems  = numTokens;
+      }
+
     };
 
     /// \brief The number of child tokens which make up this token.
@@ -1,5 +1,9 @@
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "dynUtf8Parser/utf8chars.h"
 
@@ -58,18 +62,83 @@ Utf8Chars::Utf8Chars(const char* someUtf8Chars,
       origUtf8Chars = strdup(someUtf8Chars);
       break;
   }
-  utf8Chars = origUtf8Chars;
+  isMapped   = false;
+  baseOffset = 0;
+  utf8Chars  = origUtf8Chars;
   lastByte  = utf8Chars+strlen(utf8Chars);
   restart();
   ASSERT(invariant());
 }
 
+Utf8Chars::Utf8Chars(const char* someUtf8Chars, size_t numBytes,
+                     Utf8Chars::Ownership ownership) {
+  switch(ownership) {
+    case DoNotOwn:
+      ownsString = false;
+      origUtf8Chars = someUtf8Chars;
+      break;
+    case TakeOwnership:
+      ownsString = true;
+      origUtf8Chars = someUtf8Chars;
+      break;
+    default: {
+      ownsString = true;
+      char *copy = (char*)malloc(numBytes + 1);
+      if (numBytes) memcpy(copy, someUtf8Chars, numBytes);
+      copy[numBytes] = 0;
+      origUtf8Chars = copy;
+      break;
+    }
+  }
+  isMapped   = false;
+  baseOffset = 0;
+  utf8Chars  = origUtf8Chars;
+  lastByte  = utf8Chars+numBytes;
+  restart();
+  ASSERT(invariant());
+}
+
+Utf8Chars *Utf8Chars::fromMappedFile(const char *path) {
+  if (!path) return NULL;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return NULL;
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) < 0) {
+    close(fd);
+    return NULL;
+  }
+  size_t numBytes = fileStat.st_size;
+  if (!numBytes) {
+    // an empty file can not be mapped
+    close(fd);
+    return new Utf8Chars("", (size_t)0, DoNotOwn);
+  }
+  void *mapping = mmap(NULL, numBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+  // (the mapping remains valid once the file is closed)
+  close(fd);
+  if (mapping == MAP_FAILED) return NULL;
+  madvise(mapping, numBytes, MADV_SEQUENTIAL);
+  Utf8Chars *result =
+    new Utf8Chars((const char*)mapping, numBytes, DoNotOwn);
+  result->ownsString = true;
+  result->isMapped   = true;
+  return result;
+}
+
 Utf8Chars::~Utf8Chars(void) {
   ASSERT_INSIDE_DELETE(invariant());
-  if (utf8Chars && ownsString) free((void*)utf8Chars);
+  if (utf8Chars && ownsString) {
+    if (isMapped) {
+      munmap((void*)origUtf8Chars, lastByte - origUtf8Chars);
+    } else {
+      free((void*)utf8Chars);
+    }
+  }
   origUtf8Chars = NULL;
+  baseOffset    = 0;
   utf8Chars     = NULL;
   ownsString    = false;
+  isMapped      = false;
   lastByte      = NULL;
   nextByte      = NULL;
 }
@@ -83,22 +152,27 @@ void Utf8Chars::restart(void) {
 //
 void Utf8Chars::backup(void) {
   ASSERT(invariant());
+  nextByte = backupFrom(utf8Chars, nextByte, lastByte);
+  ASSERT(invariant());
+}
+
+// We use the Wikipedia
+// [UTF-8::Description](http://en.wikipedia.org/wiki/UTF-8#Description)
+//
+const char *Utf8Chars::backupFrom(const char *startByte,
+                                  const char *nextByte,
+                                  const char *lastByte) {
   // In case we are beyond the end... ensure we move back to the end
   if (lastByte <= nextByte) nextByte = lastByte;
   while(true) {
     // backup one byte
     nextByte--;
     // ensure we have not backed off over the front of the string
-    if (nextByte < utf8Chars) {
-       restart();
-       ASSERT(invariant());
-       return;
-    }
+    if (nextByte < startByte) return startByte;
     // check to see if this is "start" byte
     if ((*nextByte & 0xC0) != 0x80) {
       // this is a start byte... so we are done
-      ASSERT(invariant());
-      return;
+      return nextByte;
     }
   }
 }
@@ -108,6 +182,15 @@ void Utf8Chars::backup(void) {
 //
 utf8Char_t Utf8Chars::nextUtf8Char(void) {
   ASSERT(invariant());
+  return decodeUtf8Char(&nextByte, lastByte);
+}
+
+// We use the Wikipedia
+// [UTF-8::Description](http://en.wikipedia.org/wiki/UTF-8#Description)
+//
+utf8Char_t Utf8Chars::decodeUtf8Char(const char **nextBytePtr,
+                                     const char *lastByte) {
+  const char *nextByte = *nextBytePtr;
   utf8Char_t nullChar;
   nullChar.u = 0;
 
@@ -118,6 +201,15 @@ utf8Char_t Utf8Chars::nextUtf8Char(void) {
   utf8Char_t result;
   result.u = 0;
 
+  // an embedded NUL byte is returned as the (overlong) character
+  // 0xC0 0x80 so that it is not mistaken for the end of the string
+  if (*nextByte == 0) {
+    result.c[0] = (char)0xC0;
+    result.c[1] = (char)0x80;
+    *nextBytePtr = nextByte + 1;
+    return result;
+  }
+
   // assume that this is a valid character
   // and copy over the first byte
   result.c[0] = *nextByte;
@@ -151,16 +243,23 @@ utf8Char_t Utf8Chars::nextUtf8Char(void) {
   for(int i = 1; i <= additionalBytes; i++) {
     // check to see if we are still in the string
     // if not return the null character
-    if (lastByte < nextByte) return nullChar;
+    if (lastByte <= nextByte) {
+      *nextBytePtr = nextByte;
+      return nullChar;
+    }
     // if these additional characters are not of the form 10xxxxxx
     // then this is a malformed utf8 character
     // so return the null character
-    if ((*nextByte & 0xC0) != 0x80) return nullChar;
+    if ((*nextByte & 0xC0) != 0x80) {
+      *nextBytePtr = nextByte;
+      return nullChar;
+    }
     // copy over this byte and increment the nextByte pointer
     result.c[i] = *nextByte;
     nextByte++;
   }
 
+  *nextBytePtr = nextByte;
   return result;
 }
 
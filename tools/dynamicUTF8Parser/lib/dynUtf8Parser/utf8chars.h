@@ -19,6 +19,12 @@ typedef union utf8Char_struct {
 /// \brief The Utf8Chars class encapsulates UTF8 strings. In particular
 /// the Utf8Chars class understands how to walk forwards and backwards over
 /// UTF8 characters.
+///
+/// A Utf8Chars created from a (pointer, length) pair (or from a
+/// memory mapped file) need not be NUL terminated, and may contain
+/// embedded NUL bytes. An embedded NUL byte is read as the (overlong)
+/// UTF8 character 0xC0 0x80 (as in Java's modified UTF8), so that it
+/// is not mistaken for the end of the stream.
 class Utf8Chars {
   public:
 
@@ -60,10 +66,30 @@ class Utf8Chars {
     /// someUtf8Chars with the provided OwnerShip model.
     Utf8Chars(const char* someUtf8Chars, Ownership ownership = DoNotOwn);
 
+    /// \brief Create an instance of the Utf8Chars using the first
+    /// numBytes of the byte array someUtf8Chars with the provided
+    /// OwnerShip model.
+    ///
+    /// The bytes need not be NUL terminated, and may contain embedded
+    /// NUL bytes. A Duplicate copy is NUL terminated.
+    Utf8Chars(const char* someUtf8Chars, size_t numBytes,
+              Ownership ownership = DoNotOwn);
+
+    /// \brief Create an instance of the Utf8Chars which reads the
+    /// (read only) memory mapped contents of the file at path.
+    ///
+    /// The file is never copied into memory, instead its pages are
+    /// read (sequentially) on demand, so very large files may be
+    /// parsed. The Utf8Chars owns the mapping, which is unmapped when
+    /// the Utf8Chars is destroyed (see also
+    /// StreamRegistry::addMappedFile). Returns NULL if the file can
+    /// not be opened or mapped.
+    static Utf8Chars *fromMappedFile(const char *path);
+
     /// \brief Destroy this object.
     ///
-    /// If the underlying C-String is owned by this object, the string
-    /// will be freed as well.
+    /// If the underlying C-String (or memory mapped file) is owned by
+    /// this object, the string will be freed (or unmapped) as well.
     ~Utf8Chars(void);
 
     /// \brief Create a cloned copy of this Utf8Chars starting at
@@ -73,10 +99,12 @@ class Utf8Chars {
     /// parent's nextbyte (current position).
     Utf8Chars *clone(bool subStream = false) {
       ASSERT(invariant());
-      Utf8Chars *result = new Utf8Chars(utf8Chars, DoNotOwn);
+      Utf8Chars *result =
+        new Utf8Chars(utf8Chars, lastByte - utf8Chars, DoNotOwn);
       if (subStream) result->utf8Chars = nextByte;
       result->nextByte = nextByte;
       result->origUtf8Chars = origUtf8Chars;
+      result->baseOffset = baseOffset;
       result->lastByte = lastByte;
       ASSERT(result->invariant());
       return result;
@@ -89,12 +117,116 @@ class Utf8Chars {
       if (!otherChars)                                       return;
       ASSERT(otherChars->invariant());
       if (origUtf8Chars        != otherChars->origUtf8Chars) return;
+      if (baseOffset           != otherChars->baseOffset)    return;
       if (lastByte             != otherChars->lastByte)      return;
       if (otherChars->nextByte <  utf8Chars)                 return;
       nextByte = otherChars->nextByte;
       ASSERT(invariant());
     }
 
+    /// \brief A Cursor is a (heap free) value type position within a
+    /// Utf8Chars stream.
+    ///
+    /// Any number of Cursors may read the one (shared) Utf8Chars
+    /// buffer, each behaving like a Utf8Chars clone, without
+    /// allocating a new Utf8Chars object. Both offsets are measured
+    /// in bytes from the start of the original C-string (which is
+    /// itself at the Utf8Chars baseOffset).
+    typedef struct Cursor {
+      /// \brief The offset of the start of the (sub)stream read by
+      /// this Cursor.
+      size_t start;
+
+      /// \brief The offset of the next byte to be read by this
+      /// Cursor.
+      size_t next;
+    } Cursor;
+
+    /// \brief Returns a Cursor positioned at this Utf8Chars current
+    /// location.
+    ///
+    /// If subStream is true then the Cursor "starts" at the current
+    /// location, otherwise at the start of this Utf8Chars (as per
+    /// Utf8Chars::clone).
+    Cursor getCursor(bool subStream = false) {
+      ASSERT(invariant());
+      Cursor cursor;
+      cursor.next  = cursorOffset(nextByte);
+      cursor.start = cursorOffset(subStream ? nextByte : utf8Chars);
+      return cursor;
+    }
+
+    /// \brief Returns true if the cursor is positioned inside this
+    /// Utf8Chars.
+    bool validCursor(const Cursor *cursor) const {
+      if (!cursor) return false;
+      if (cursor->next < cursor->start) return false;
+      if (cursorOffset(lastByte) < cursor->start) return false;
+      return true;
+    }
+
+    /// \brief Returns true if the cursor has read the last character
+    /// in the underlying C-String.
+    bool atEnd(const Cursor *cursor) {
+      ASSERT(validCursor(cursor));
+      return (cursorOffset(lastByte) <= cursor->next);
+    }
+
+    /// \brief Backup the cursor ONE UTF8 character.
+    void backup(Cursor *cursor) {
+      ASSERT(validCursor(cursor));
+      cursor->next = cursorOffset(backupFrom(cursorByte(cursor->start),
+                                             cursorByte(cursor->next),
+                                             lastByte));
+    }
+
+    /// \brief Return the next UTF8 character at the cursor, advancing
+    /// the cursor.
+    ///
+    /// If there are no more characters, returns the null character.
+    utf8Char_t nextUtf8Char(Cursor *cursor) {
+      ASSERT(validCursor(cursor));
+      const char *nextCursorByte = cursorByte(cursor->next);
+      utf8Char_t result = decodeUtf8Char(&nextCursorByte, lastByte);
+      cursor->next = cursorOffset(nextCursorByte);
+      return result;
+    }
+
+    /// \brief Returns the start of the cursor's (sub)stream.
+    const char *getStart(const Cursor *cursor) {
+      ASSERT(validCursor(cursor));
+      return cursorByte(cursor->start);
+    }
+
+    /// \brief Returns the number of bytes, not neccessarily the number
+    /// of UTF8 characters, read by the cursor from the start of its
+    /// (sub)stream.
+    size_t getNumberOfBytesRead(const Cursor *cursor) {
+      ASSERT(validCursor(cursor));
+      if (cursorOffset(lastByte) <= cursor->next) {
+        return cursorOffset(lastByte) - cursor->start;
+      }
+      return cursor->next - cursor->start;
+    }
+
+    /// \brief Returns a (strndup'ed) copy of the text read by the
+    /// cursor.
+    char *getCopyOfTextRead(const Cursor *cursor) {
+      return strndup(getStart(cursor), getNumberOfBytesRead(cursor));
+    }
+
+    /// \brief Returns a (strndup'ed) copy of the text which the
+    /// cursor has not yet read.
+    char *getCopyOfTextToRead(const Cursor *cursor,
+                              size_t numBytesToCopy = 30) {
+      ASSERT(validCursor(cursor));
+      if (atEnd(cursor)) return strndup(lastByte, 0);
+      const char *nextCursorByte = cursorByte(cursor->next);
+      if ((size_t)(lastByte - nextCursorByte) < numBytesToCopy)
+        numBytesToCopy = lastByte - nextCursorByte;
+      return strndup(nextCursorByte, numBytesToCopy);
+    }
+
     /// \brief Returns true if the last character was the last one
     /// in the underlying C-String.
     bool atEnd(void) {
@@ -175,6 +307,8 @@ class Utf8Chars {
     char *getCopyOfTextToRead(size_t numBytesToCopy = 30) {
       ASSERT(invariant());
       if (lastByte <= nextByte) nextByte = lastByte;
+      if ((size_t)(lastByte - nextByte) < numBytesToCopy)
+        numBytesToCopy = lastByte - nextByte;
       return strndup(nextByte, numBytesToCopy);
     }
 
@@ -208,12 +342,47 @@ class Utf8Chars {
 
   protected:
 
+    /// \brief Decode the UTF8 character at *nextByte (which must be
+    /// before lastByte), advancing *nextByte past it.
+    ///
+    /// Returns the null character if there are no more characters or
+    /// the character is malformed.
+    static utf8Char_t decodeUtf8Char(const char **nextByte,
+                                     const char *lastByte);
+
+    /// \brief Return the start of the UTF8 character before nextByte,
+    /// (but not before startByte).
+    static const char *backupFrom(const char *startByte,
+                                  const char *nextByte,
+                                  const char *lastByte);
+
     /// \brief Whether or not this C-string is owned by this object
     bool ownsString;
 
+    /// \brief Whether or not this (owned) C-string is a memory mapped
+    /// file (to be unmapped rather than freed).
+    bool isMapped;
+
     /// \brief The original C-string of UTF8 characters.
     const char* origUtf8Chars;
 
+    /// \brief The Cursor offset of the original C-string (non-zero
+    /// only for a window onto part of a larger document, see
+    /// PushStream).
+    size_t baseOffset;
+
+    /// \brief Return the Cursor offset of aByte (in the original
+    /// C-string).
+    size_t cursorOffset(const char *aByte) const {
+      return baseOffset + (aByte - origUtf8Chars);
+    }
+
+    /// \brief Return the byte (in the original C-string) at the
+    /// Cursor offset provided.
+    const char *cursorByte(size_t offset) const {
+      return origUtf8Chars + (offset - baseOffset);
+    }
+
     /// \brief The current (sub)C-string of UTF8 characters.
     const char* utf8Chars;
 
@@ -230,6 +399,10 @@ class Utf8Chars {
     /// return a null character (which could be interpreted to represent
     /// the end of the Utf8Chars character stream.
     const char* nextByte;
+
+    /// Allow a PushStream to move its window (and baseOffset) along
+    /// the whole document.
+    friend class PushStream;
 };
 
 #endif
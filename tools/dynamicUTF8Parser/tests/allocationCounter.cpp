@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <new>
+
+#include "allocationCounter.h"
+
+// The address sanitizer provides its own malloc (which must not be
+// replaced), so we only count the C allocations of an unsanitized
+// glibc build.
+#if defined(__SANITIZE_ADDRESS__)
+#define COUNT_MALLOC 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define COUNT_MALLOC 0
+#endif
+#endif
+#if !defined(COUNT_MALLOC) && defined(__GLIBC__)
+#define COUNT_MALLOC 1
+#endif
+#ifndef COUNT_MALLOC
+#define COUNT_MALLOC 0
+#endif
+
+static bool   countingAllocations = false;
+static size_t numAllocations      = 0;
+
+void startCountingAllocations(void) {
+  numAllocations      = 0;
+  countingAllocations = true;
+}
+
+size_t stopCountingAllocations(void) {
+  countingAllocations = false;
+  return numAllocations;
+}
+
+#if COUNT_MALLOC
+
+extern "C" {
+  void *__libc_malloc(size_t size);
+  void *__libc_calloc(size_t num, size_t size);
+  void *__libc_realloc(void *ptr, size_t size);
+  void *__libc_memalign(size_t alignment, size_t size);
+
+  void *malloc(size_t size) {
+    if (countingAllocations) numAllocations++;
+    return __libc_malloc(size);
+  }
+
+  void *calloc(size_t num, size_t size) {
+    if (countingAllocations) numAllocations++;
+    return __libc_calloc(num, size);
+  }
+
+  void *realloc(void *ptr, size_t size) {
+    if (countingAllocations) numAllocations++;
+    return __libc_realloc(ptr, size);
+  }
+
+  // (the DFA's StateAllocator allocates its blocks of DFA::States
+  // with posix_memalign)
+  int posix_memalign(void **ptrPtr, size_t alignment, size_t size) {
+    if (!alignment || (alignment & (alignment - 1)) ||
+        (alignment % sizeof(void*))) return EINVAL;
+    if (countingAllocations) numAllocations++;
+    void *ptr = __libc_memalign(alignment, size);
+    if (!ptr) return ENOMEM;
+    *ptrPtr = ptr;
+    return 0;
+  }
+
+  void *aligned_alloc(size_t alignment, size_t size) {
+    if (countingAllocations) numAllocations++;
+    return __libc_memalign(alignment, size);
+  }
+
+  void *memalign(size_t alignment, size_t size) {
+    if (countingAllocations) numAllocations++;
+    return __libc_memalign(alignment, size);
+  }
+};
+
+#endif
+
+void *operator new(size_t size) {
+  // (when counting malloc, this allocation is counted by malloc)
+  if (countingAllocations && !COUNT_MALLOC) numAllocations++;
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  return ptr;
+}
+
+void *operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void *ptr, size_t) noexcept {
+  free(ptr);
+}
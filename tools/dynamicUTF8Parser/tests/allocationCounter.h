@@ -0,0 +1,21 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <stdlib.h>
+
+/// \brief Start counting the heap allocations made by this (test)
+/// process.
+///
+/// Every call to operator new (and operator new[]) is counted. When
+/// linked against glibc (and not built with the address sanitizer)
+/// every call to malloc, calloc, realloc, posix_memalign,
+/// aligned_alloc and memalign is also counted, so that the growth of
+/// VarArrays (and other C arrays) and of the DFA's blocks of
+/// DFA::States is caught.
+void startCountingAllocations(void);
+
+/// \brief Stop counting heap allocations, returning the number of
+/// allocations made since startCountingAllocations.
+size_t stopCountingAllocations(void);
+
+#endif
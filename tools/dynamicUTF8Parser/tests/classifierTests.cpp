@@ -75,5 +75,24 @@ describe(Classifier) {
     delete classifier;
   } endIt();
 
+  /// Ensure that we can collect the distinct class sets used to
+  /// classify characters.
+  it("collect the distinct class sets") {
+    Classifier *classifier = new Classifier();
+    VarArray<Classifier::classSet_t> classSets;
+    classifier->collectClassSets(&classSets);
+    shouldBeEqual(classSets.getNumItems(), 1);
+    shouldBeEqual(classSets.getItem(0, 0), ~0L);
+    classifier->registerClassSet("whitespace", 1);
+    classifier->classifyUtf8CharsAs(Utf8Chars::whiteSpaceChars, "whitespace");
+    classifier->registerClassSet("digits", 2);
+    classifier->classifyUtf8CharsAs("0123456789", "digits");
+    VarArray<Classifier::classSet_t> moreClassSets;
+    classifier->collectClassSets(&moreClassSets);
+    shouldBeEqual(moreClassSets.getNumItems(), 3);
+    shouldBeEqual(moreClassSets.getItem(0, 0), ~3L);
+    delete classifier;
+  } endIt();
+
 } endDescribe(Classifier);
 
@@ -0,0 +1,199 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include <dynUtf8Parser/parser.h>
+
+enum CompiledGrammarTestTokens {
+  WhiteSpace=1,
+  NonWhiteSpace=2,
+  Text=4
+};
+
+/// \brief Setup a Parser which tokenizes white space and non white
+/// space.
+static Parser *newTestParser(void) {
+  Parser *parser = new Parser();
+  parser->classifyWhiteSpace();
+  parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+  parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+  parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+  return parser;
+}
+
+/// \brief We test the CompiledGrammar class.
+describe(CompiledGrammar) {
+
+  specSize(CompiledGrammar::Header);
+
+  it("Save and load a compiled Parser") {
+    char path[] = "/tmp/compiledGrammarTestsXXXXXX";
+    int fd = mkstemp(path);
+    shouldBeTrue(0 <= fd);
+    close(fd);
+    const char *cString ="  if A then B else C ";
+
+    Parser *parser = newTestParser();
+    shouldNotBeNULL(parser);
+    parser->compile();
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    delete aToken;
+    delete someChars;
+    parser->saveCompiled(path);
+
+    Parser *loadedParser = new Parser();
+    shouldNotBeNULL(loadedParser);
+    loadedParser->loadCompiled(path);
+    shouldNotBeNULL(loadedParser->dfa);
+    shouldBeEqual(loadedParser->lastClassSet, parser->lastClassSet);
+    shouldBeEqual(loadedParser->classifier->getClassSet(" "),
+                  parser->classifier->getClassSet(" "));
+    shouldBeEqual(loadedParser->classifier->getClassSet("a"),
+                  parser->classifier->getClassSet("a"));
+    shouldBeEqual(loadedParser->classifier->findClassSet("whiteSpace"),
+                  parser->classifier->findClassSet("whiteSpace"));
+    shouldBeEqual(loadedParser->nfa->getNumberStates(),
+                  parser->nfa->getNumberStates());
+    shouldBeEqual(loadedParser->nfa->getNumberStartStates(),
+                  parser->nfa->getNumberStartStates());
+    shouldBeEqual(loadedParser->nfa->findStartStateId("start"),
+                  parser->nfa->findStartStateId("start"));
+    for (size_t i = 0; i < parser->nfa->getNumberStates(); i++) {
+      NFA::State *nfaState       = parser->nfa->getState(i);
+      NFA::State *loadedNFAState = loadedParser->nfa->getState(i);
+      shouldBeEqual(loadedNFAState->matchType, nfaState->matchType);
+      shouldBeEqual(loadedNFAState->matchData.c.u, nfaState->matchData.c.u);
+      shouldBeEqual((loadedNFAState->out ? loadedNFAState->out->id : 0),
+                    (nfaState->out ? nfaState->out->id : 0));
+      shouldBeEqual((loadedNFAState->out1 ? loadedNFAState->out1->id : 0),
+                    (nfaState->out1 ? nfaState->out1->id : 0));
+      shouldBeZero(strcmp(loadedNFAState->message, nfaState->message));
+    }
+    shouldBeEqual(loadedParser->dfa->nextStateMapping->getNumStateRecords(),
+                  parser->dfa->nextStateMapping->getNumStateRecords());
+
+    // the loaded Parser already knows every DFA::State required
+    someChars = new Utf8Chars(cString);
+    aToken = loadedParser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokenId, 4);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    shouldBeEqual(aToken->tokens.itemArray[3]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[3]->textStart[0], ('A'));
+    shouldBeZero(loadedParser->dfa->getNumCacheMisses());
+    shouldBeEqual(loadedParser->dfa->nextStateMapping->getNumStateRecords(),
+                  parser->dfa->nextStateMapping->getNumStateRecords());
+    delete aToken;
+    delete someChars;
+
+    delete loadedParser;
+    delete parser;
+    unlink(path);
+  } endIt();
+
+  it("Refuse to load invalid compiled grammars") {
+    char path[] = "/tmp/compiledGrammarTestsXXXXXX";
+    int fd = mkstemp(path);
+    shouldBeTrue(0 <= fd);
+    close(fd);
+
+    Parser *parser = newTestParser();
+    shouldNotBeNULL(parser);
+    parser->saveCompiled(path);
+    shouldNotBeNULL(parser->dfa);
+
+    // a Parser with rules can not load a compiled grammar
+    Parser *newParser = newTestParser();
+    try {
+      newParser->loadCompiled(path);
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
+    }
+    delete newParser;
+
+    // a compiled grammar can not be saved to a missing directory
+    try {
+      parser->saveCompiled("/nonexistent/compiledGrammarTests");
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
+    }
+
+    // a DFA::State containing an NFA::State beyond the saved NFA
+    FILE *file = fopen(path, "rb");
+    shouldNotBeNULL(file);
+    fseek(file, 0, SEEK_END);
+    size_t fileSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *contents = (char*)calloc(fileSize, sizeof(char));
+    shouldNotBeNULL(contents);
+    shouldBeEqual(fread(contents, 1, fileSize, file), fileSize);
+    fclose(file);
+    CompiledGrammar::Header *header = (CompiledGrammar::Header*)contents;
+    uint64_t numNFAStates =
+      header->sections[CompiledGrammar::NFAStates].count;
+    shouldBeTrue(0 < header->sections[CompiledGrammar::DFABitSets].count);
+    shouldBeTrue(numNFAStates < 8*header->stateSize);
+    char *bitSet =
+      contents + header->sections[CompiledGrammar::DFABitSets].offset;
+    bitSet[numNFAStates/8] |= 1 << (numNFAStates % 8);
+    file = fopen(path, "wb");
+    shouldNotBeNULL(file);
+    shouldBeEqual(fwrite(contents, 1, fileSize, file), fileSize);
+    fclose(file);
+    free(contents);
+    newParser = new Parser();
+    try {
+      newParser->loadCompiled(path);
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
+    }
+    shouldBeNULL(newParser->dfa);
+    delete newParser;
+
+    // a truncated compiled grammar
+    file = fopen(path, "rb");
+    shouldNotBeNULL(file);
+    char buffer[64];
+    shouldBeEqual(fread(buffer, 1, 64, file), 64);
+    fclose(file);
+    file = fopen(path, "wb");
+    shouldNotBeNULL(file);
+    shouldBeEqual(fwrite(buffer, 1, 64, file), 64);
+    fclose(file);
+    newParser = new Parser();
+    try {
+      newParser->loadCompiled(path);
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
+    }
+    shouldBeNULL(newParser->dfa);
+    delete newParser;
+
+    // a missing compiled grammar
+    unlink(path);
+    newParser = new Parser();
+    try {
+      newParser->loadCompiled(path);
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
+    }
+    delete newParser;
+
+    delete parser;
+  } endIt();
+
+} endDescribe(CompiledGrammar);
@@ -17,14 +17,15 @@ using namespace DeterministicFiniteAutomaton;
 describe(DFA_AutomataState) {
 
   specSize(AutomataState);
+  specSize(AutomataState::Frame);
 
   it("Create a NULL AutomataState and initialize it") {
     AutomataState automataState;
-    shouldBeNULL(automataState.token);
     shouldBeNULL(automataState.stream);
-    shouldBeNULL(automataState.iterator);
-    shouldBeNULL(automataState.dState);
+    shouldBeZero(automataState.nextReStart);
+    shouldBeNULL(automataState.stateRecord);
     shouldBeNULL(automataState.allocator);
+    shouldBeZero(automataState.tokenStart);
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
     NFA *nfa = new NFA(classifier);
@@ -37,16 +38,19 @@ describe(DFA_AutomataState) {
     StateAllocator *allocator = dfa->getStateAllocator();
     Utf8Chars *someChars = new Utf8Chars("some characters");
     NFA::StartStateId startStateId = nfa->findStartStateId("start");
-    State *dState = dfa->getDFAStartState(startStateId);
+    StateRecord *dState = dfa->getDFAStartState(startStateId);
     automataState.initialize(dfa, someChars, startStateId);
     shouldBeEqual(automataState.dfa, dfa);
     shouldBeEqual(automataState.allocator, allocator);
-    shouldNotBeNULL(automataState.token);
     shouldNotBeNULL(automataState.stream);
-    shouldNotBeEqual((void*)automataState.stream, (void*)someChars);
-    shouldNotBeNULL(automataState.iterator);
-    shouldNotBeNULL(automataState.dState);
-    shouldNotBeEqual((void*)automataState.dState, (void*)dState);
+    shouldBeEqual((void*)automataState.stream, (void*)someChars);
+    shouldBeZero(automataState.cursor.start);
+    shouldBeZero(automataState.cursor.next);
+    shouldBeZero(automataState.tokenStart);
+    shouldBeZero(automataState.nextReStart);
+    shouldBeTrue(dState->hasMetadata);
+    shouldBeEqual((void*)automataState.getDState(), (void*)dState->state);
+    shouldBeEqual((void*)automataState.stateRecord, (void*)dState);
     automataState.clear();
     delete someChars;
     delete dfa;
@@ -55,56 +59,64 @@ describe(DFA_AutomataState) {
     delete classifier;
   } endIt();
 
-  it("CopyFrom an AutomataState") {
+  it("Save and restore an AutomataState Frame") {
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
     NFA *nfa = new NFA(classifier);
     shouldNotBeNULL(nfa);
     NFABuilder *nfaBuilder = new NFABuilder(nfa);
     shouldNotBeNULL(nfaBuilder);
-    nfaBuilder->compileRegularExpressionForTokenId("start", "simple", 1);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
     nfaBuilder->compileRegularExpressionForTokenId("other", "otherSimple", 1);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({a}b|{other}c)", 1);
     DFA *dfa = new DFA(nfa);
     shouldNotBeNULL(dfa);
-    StateAllocator *allocator = dfa->getStateAllocator();
     Utf8Chars *someChars = new Utf8Chars("some characters");
     NFA::StartStateId startStateId = nfa->findStartStateId("start");
-    State *dState = dfa->getDFAStartState(startStateId);
+    NFA::StartStateId otherStateId = nfa->findStartStateId("other");
+    StateRecord *dState = dfa->getDFAStartState(startStateId);
     AutomataState automataState;
     automataState.initialize(dfa, someChars, startStateId);
-    shouldBeEqual(automataState.dfa, dfa);
-    shouldBeEqual(automataState.allocator, allocator);
-    shouldNotBeNULL(automataState.token);
-    shouldNotBeNULL(automataState.stream);
-    shouldNotBeNULL(automataState.iterator);
-    shouldNotBeNULL(automataState.dState);
-    shouldNotBeEqual((void*)automataState.dState, (void*)dState);
-    shouldBeEqual(automataState.allocator, allocator);
-    AutomataState newAutomataState;
-    shouldBeNULL(newAutomataState.token);
-    shouldBeNULL(newAutomataState.stream);
-    shouldBeNULL(newAutomataState.iterator);
-    shouldBeNULL(newAutomataState.dState);
-    shouldBeNULL(newAutomataState.allocator);
-    newAutomataState.copyFrom(automataState, true);
-    shouldNotBeNULL(newAutomataState.token);
-    shouldBeEqual(newAutomataState.stream,    automataState.stream);
-    shouldBeEqual(newAutomataState.iterator,  automataState.iterator);
-    shouldBeEqual((void*)newAutomataState.dState,    (void*)automataState.dState);
-    shouldBeEqual(newAutomataState.allocator, allocator);
-    automataState.initialize(dfa, someChars, startStateId);
-    newAutomataState.copyFrom(automataState, false);
-    shouldBeEqual(newAutomataState.token,     automataState.token);
-    shouldBeEqual(newAutomataState.stream,    automataState.stream);
-    shouldBeEqual(newAutomataState.iterator,  automataState.iterator);
-    shouldBeEqual((void*)newAutomataState.dState,    (void*)automataState.dState);
-    shouldBeEqual(newAutomataState.allocator, allocator);
-    //
-    // newAutomataState is now a copy of automataState so we ONLY want to
-    // clear the last one....
-    //
-    // automataState.clear();
-    newAutomataState.clear();
+    automataState.setStateType(AutomataState::ASBackTrack);
+    NFA::State *firstNFAState = automataState.nextReStartState();
+    shouldNotBeNULL(firstNFAState);
+    shouldBeEqual(firstNFAState, dState->reStarts[0]);
+    automataState.nextUtf8Char();
+    automataState.startToken(3);
+    AutomataState::Frame frame;
+    automataState.saveFrame(&frame, 5);
+    shouldBeEqual((void*)frame.stateRecord, (void*)dState);
+    shouldBeEqual(frame.cursor.next, 1);
+    shouldBeEqual(frame.tokenStart, 3);
+    shouldBeEqual(frame.numTokens, 5);
+    shouldBeEqual(frame.startStateId, startStateId);
+    shouldBeEqual(frame.frameType, AutomataState::ASBackTrack);
+    // move the automataState somewhere else
+    automataState.setStateType(AutomataState::ASRestart);
+    automataState.setStartStateId(otherStateId);
+    automataState.startSubStream();
+    automataState.nextUtf8Char();
+    automataState.nextUtf8Char();
+    automataState.startToken(5);
+    // restoring resets the stream position
+    automataState.restoreFrame(frame, false);
+    shouldBeEqual((void*)automataState.stateRecord, (void*)dState);
+    shouldBeEqual(automataState.startStateId, startStateId);
+    shouldBeEqual(automataState.getStateType(), AutomataState::ASBackTrack);
+    shouldBeZero(automataState.cursor.start);
+    shouldBeEqual(automataState.cursor.next, 1);
+    shouldBeEqual(automataState.tokenStart, 3);
+    // the iteration continues where it left off
+    shouldBeEqual(automataState.nextReStart, 1);
+    shouldBeEqual(automataState.nextReStartState(), dState->reStarts[1]);
+    shouldBeNULL(automataState.nextReStartState());
+    // restoring can keep the stream position
+    automataState.nextUtf8Char();
+    automataState.nextUtf8Char();
+    automataState.restoreFrame(frame, true);
+    shouldBeZero(automataState.cursor.start);
+    shouldBeEqual(automataState.cursor.next, 3);
+    automataState.clear();
     delete someChars;
     delete dfa;
     delete nfaBuilder;
@@ -120,27 +132,22 @@ describe(DFA_AutomataState) {
     NFABuilder *nfaBuilder = new NFABuilder(nfa);
     shouldNotBeNULL(nfaBuilder);
     nfaBuilder->compileRegularExpressionForTokenId("start", "simple", 1);
-    nfaBuilder->compileRegularExpressionForTokenId("other", "otherSimple", 1);
     DFA *dfa = new DFA(nfa);
     shouldNotBeNULL(dfa);
     StateAllocator *allocator = dfa->getStateAllocator();
     Utf8Chars *someChars = new Utf8Chars("some characters");
     NFA::StartStateId startStateId = nfa->findStartStateId("start");
-    State *dState = dfa->getDFAStartState(startStateId);
+    StateRecord *dState = dfa->getDFAStartState(startStateId);
     AutomataState automataState;
     automataState.initialize(dfa, someChars, startStateId);
-    shouldBeEqual(automataState.dfa, dfa);
     shouldBeEqual(automataState.allocator, allocator);
-    shouldNotBeNULL(automataState.token);
     shouldNotBeNULL(automataState.stream);
-    shouldNotBeNULL(automataState.iterator);
-    shouldNotBeEqual((void*)automataState.dState, (void*)dState);
-    shouldBeEqual(automataState.allocator, allocator);
+    shouldBeEqual((void*)automataState.stateRecord, (void*)dState);
     automataState.clear();
-    shouldBeNULL(automataState.token);
     shouldBeNULL(automataState.stream);
-    shouldBeNULL(automataState.iterator);
-    shouldBeNULL(automataState.dState);
+    shouldBeZero(automataState.cursor.next);
+    shouldBeZero(automataState.nextReStart);
+    shouldBeNULL(automataState.stateRecord);
     shouldBeNULL(automataState.allocator);
     delete someChars;
     delete dfa;
@@ -149,4 +156,85 @@ describe(DFA_AutomataState) {
     delete classifier;
   } endIt();
 
+  it("Skip ReStart NFA States which have already been tried") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({a}b|{a}c)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    Utf8Chars *someChars = new Utf8Chars("ac");
+    NFA::StartStateId startStateId = nfa->findStartStateId("start");
+    AutomataState automataState;
+    automataState.initialize(dfa, someChars, startStateId);
+    size_t numReStarts = 0;
+    NFAStateIterator iterator =
+      dfa->getStateAllocator()->newIteratorOn(automataState.getDState());
+    while (NFA::State *nfaState = iterator.nextState()) {
+      if (nfaState->matchType == NFA::ReStart) numReStarts++;
+    }
+    shouldBeEqual(numReStarts, 2);
+    // only the first ReStart NFA State is ever tried
+    NFA::State *reStartState = automataState.nextReStartState();
+    shouldNotBeNULL(reStartState);
+    shouldBeEqual(reStartState->matchData.r, nfa->findStartStateId("a"));
+    shouldBeNULL(automataState.nextReStartState());
+    automataState.clear();
+    delete someChars;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Share the stream between AutomataStates using cursors") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "simple", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    Utf8Chars *someChars = new Utf8Chars("some characters");
+    NFA::StartStateId startStateId = nfa->findStartStateId("start");
+    AutomataState automataState;
+    automataState.initialize(dfa, someChars, startStateId);
+    shouldBeEqual(automataState.nextUtf8Char().c[0], 's');
+    shouldBeEqual(automataState.nextUtf8Char().c[0], 'o');
+    // the shared stream itself is never moved
+    shouldBeEqual((void*)someChars->nextByte, (void*)someChars->utf8Chars);
+    // a pushed (continue) frame keeps the current cursor
+    AutomataState::Frame continueFrame;
+    automataState.setStateType(AutomataState::ASContinue);
+    automataState.saveFrame(&continueFrame, 0);
+    automataState.startSubStream();
+    shouldBeEqual(automataState.cursor.start, 2);
+    shouldBeEqual(automataState.cursor.next, 2);
+    shouldBeEqual(automataState.nextUtf8Char().c[0], 'm');
+    shouldBeEqual(automataState.nextUtf8Char().c[0], 'e');
+    automataState.backup();
+    shouldBeEqual(automataState.cursor.next, 3);
+    shouldBeEqual(automataState.getTextStart(), someChars->utf8Chars+2);
+    shouldBeEqual(automataState.getTextLength(), 1);
+    shouldBeFalse(automataState.atEnd());
+    // poping the continue frame keeps the sub stream's position
+    automataState.restoreFrame(continueFrame, true);
+    shouldBeEqual((void*)automataState.stream, (void*)someChars);
+    shouldBeZero(automataState.cursor.start);
+    shouldBeEqual(automataState.cursor.next, 3);
+    shouldBeEqual(automataState.nextUtf8Char().c[0], 'e');
+    automataState.clear();
+    delete someChars;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
 } endDescribe(DFA_AutomataState);
@@ -0,0 +1,121 @@
+#include <string.h>
+#include <stdio.h>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include "dynUtf8Parser/nfaBuilder.h"
+#include <dynUtf8Parser/dfa/characterClassMapping.h>
+
+namespace DeterministicFiniteAutomaton {
+
+/// \brief Test the CharacterClassMapping class.
+describe(DFA_CharacterClassMapping) {
+
+  specSize(CharacterClassMapping);
+
+  it("Should have correct sizes and pointers setup") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "simple", 1);
+    CharacterClassMapping *mapping = new CharacterClassMapping(nfa);
+    shouldNotBeNULL(mapping);
+    shouldBeEqual(mapping->classifier, classifier);
+    shouldNotBeNULL(mapping->utf8Char2class);
+    shouldBeZero(mapping->nfaClassSets.getNumItems());
+    // one class for each of the literals 's', 'i', 'm', 'p', 'l', 'e'
+    // and one class for every other character
+    shouldBeEqual(mapping->getNumCharacterClasses(), 7);
+    shouldBeEqual(mapping->classSetClasses.getNumItems(), 1);
+    size_t otherClass = mapping->classSetClasses.getItem(0, 0);
+    shouldBeEqual(mapping->asciiClasses['x'], otherClass);
+    shouldBeEqual(mapping->asciiClasses[' '], otherClass);
+    shouldBeEqual(mapping->asciiClasses[0], otherClass);
+    shouldNotBeEqual(mapping->asciiClasses['s'], otherClass);
+    shouldNotBeEqual(mapping->asciiClasses['s'], mapping->asciiClasses['e']);
+    shouldBeZero(mapping->getRepresentativeChar(otherClass).u);
+    shouldBeEqual(mapping->getRepresentativeChar(mapping->asciiClasses['s']).c[0],
+                  's');
+    delete mapping;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should group characters no NFA::State can distinguish") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    classifier->registerClassSet("whitespace",1);
+    classifier->classifyUtf8CharsAs(Utf8Chars::whiteSpaceChars,"whitespace");
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|[!whitespace]bbb)", 1);
+    CharacterClassMapping *mapping = new CharacterClassMapping(nfa);
+    shouldNotBeNULL(mapping);
+    shouldBeEqual(mapping->nfaClassSets.getNumItems(), 1);
+    // 'a', 'b', the white space characters and all other characters
+    shouldBeEqual(mapping->getNumCharacterClasses(), 4);
+    utf8Char_t aChar;
+    aChar.u = 0;
+    aChar.c[0] = 'a';
+    utf8Char_t bChar;
+    bChar.u = 0;
+    bChar.c[0] = 'b';
+    utf8Char_t xChar;
+    xChar.u = 0;
+    xChar.c[0] = 'x';
+    utf8Char_t yChar;
+    yChar.u = 0;
+    yChar.c[0] = 'y';
+    utf8Char_t spaceChar;
+    spaceChar.u = 0;
+    spaceChar.c[0] = ' ';
+    utf8Char_t tabChar;
+    tabChar.u = 0;
+    tabChar.c[0] = '\t';
+    size_t aClass     = mapping->getCharacterClass(aChar);
+    size_t bClass     = mapping->getCharacterClass(bChar);
+    size_t xClass     = mapping->getCharacterClass(xChar);
+    size_t spaceClass = mapping->getCharacterClass(spaceChar);
+    shouldNotBeEqual(aClass, bClass);
+    shouldNotBeEqual(aClass, xClass);
+    shouldNotBeEqual(bClass, xClass);
+    shouldNotBeEqual(xClass, spaceClass);
+    shouldBeEqual(mapping->getCharacterClass(yChar), xClass);
+    shouldBeEqual(mapping->getCharacterClass(tabChar), spaceClass);
+    shouldBeEqual(mapping->getRepresentativeChar(aClass).u, aChar.u);
+    shouldBeEqual(mapping->getRepresentativeClassSet(aClass), ~1L);
+    shouldBeZero(mapping->getRepresentativeChar(xClass).u);
+    shouldBeEqual(mapping->getRepresentativeClassSet(xClass), ~1L);
+    shouldBeEqual(mapping->getRepresentativeClassSet(spaceClass), 1);
+    // non-ASCII characters are mapped (and cached) using the Hat-Trie
+    Utf8Chars *someChars = new Utf8Chars("\xE2\x80\x80\xC3\xA9");
+    utf8Char_t enQuad = someChars->nextUtf8Char();
+    utf8Char_t eAcute = someChars->nextUtf8Char();
+    delete someChars;
+    shouldBeNULL(hattrie_tryget(mapping->utf8Char2class,
+                                eAcute.c, strlen(eAcute.c)));
+    shouldBeEqual(mapping->getCharacterClass(enQuad), spaceClass);
+    shouldBeEqual(mapping->getCharacterClass(eAcute), xClass);
+    shouldNotBeNULL(hattrie_tryget(mapping->utf8Char2class,
+                                   eAcute.c, strlen(eAcute.c)));
+    shouldBeEqual(mapping->getCharacterClass(eAcute), xClass);
+    shouldBeEqual(mapping->getNumCharacterClasses(), 4);
+    delete mapping;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+} endDescribe(DFA_CharacterClassMapping);
+
+}; // namespace DeterministicFiniteAutomaton
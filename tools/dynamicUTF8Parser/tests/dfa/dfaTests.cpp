@@ -38,17 +38,309 @@ describe(DFA) {
     shouldBeEqual(dfa->numStartStates, 1);
     shouldBeNULL(dfa->startState[0]);
     shouldNotBeNULL(((void*)dfa->tokensState));
-    for( size_t i = 0; i < dfa->allocator->stateSize; i++) {
+    // the only NFA::Token state is token(10)
+    shouldBeZero(dfa->tokensState[0]);
+    shouldBeEqual((int)dfa->tokensState[1], 0x04);
+    for( size_t i = 2; i < dfa->allocator->stateSize; i++) {
       shouldBeZero(dfa->tokensState[i]);
     }
-    State *startState = dfa->getDFAStartState((NFA::StartStateId)0);
+    shouldNotBeNULL(dfa->deadState);
+    shouldBeTrue(dfa->allocator->isStateEmpty(dfa->deadState->state));
+    StateRecord *startState = dfa->getDFAStartState((NFA::StartStateId)0);
     shouldNotBeNULL(dfa->startState[0]);
     shouldBeEqual((void*)dfa->startState[0], (void*)startState);
-    shouldBeEqual((int)dfa->startState[0][0], 15);
-    for( size_t i = 1; i < dfa->allocator->stateSize; i++) {
-      shouldBeZero(dfa->startState[0][i]);
+    // NFA::States are numbered in order of creation:
+    //   start(0) 'a'(1) 'b'(2) 'a'(3) 'b'(4) 'a'(5) 'b'(6) 'b'(7) 'b'(8)
+    //   alternate(9) token(10)
+    // so the start state is {0, 1, 5, 9}
+    shouldBeEqual((int)dfa->startState[0]->state[0], 0x23);
+    shouldBeEqual((int)dfa->startState[0]->state[1], 0x02);
+    for( size_t i = 2; i < dfa->allocator->stateSize; i++) {
+      shouldBeZero(dfa->startState[0]->state[i]);
     }
-    shouldBeFalse(dfa->allocator->isSubStateOf(dfa->startState[0], dfa->tokensState));
+    shouldBeFalse(dfa->allocator->isSubStateOf(dfa->startState[0]->state, dfa->tokensState));
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  /// Show that the epsilon closures of the NFA::States are
+  /// precomputed as (word, bits) pairs.
+  it("Should precompute the epsilon closures of NFA::States") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    shouldBeEqual(nfa->getNumberStates(), 11);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    shouldNotBeNULL(dfa->closureStart);
+    shouldNotBeNULL(dfa->closureEnd);
+    shouldNotBeNULL(((void*)dfa->closureState));
+    for( size_t i = 0; i < dfa->allocator->stateSize; i++) {
+      shouldBeZero(dfa->closureState[i]);
+    }
+    // the start state's closure is {0, 1, 5, 9}
+    NFA::State *nfaStartState = nfa->getStartState((NFA::StartStateId)0);
+    shouldBeEqual(nfaStartState->id, 0);
+    shouldBeEqual(dfa->closureEnd[0] - dfa->closureStart[0], 1);
+    ClosureWord *closureWord = dfa->closureWords + dfa->closureStart[0];
+    shouldBeZero(closureWord->word);
+    shouldBeEqual(closureWord->bits, (uint64_t)0x0223);
+    // every transition's target closure is precomputed
+    for (size_t i = 1; i < 9; i++) {
+      NFA::State *nfaState = nfa->getState(i);
+      shouldNotBeNULL(nfaState->out);
+      shouldBeTrue(0 < dfa->closureEnd[nfaState->out->id]);
+    }
+    // the closure of a non-Split state is the state itself
+    closureWord = dfa->closureWords + dfa->closureStart[2];
+    shouldBeEqual(dfa->closureEnd[2] - dfa->closureStart[2], 1);
+    shouldBeEqual(closureWord->bits, ((uint64_t)1) << 2);
+    // adding a closure twice has no further effect
+    State *dfaState = dfa->allocator->allocateANewState();
+    dfa->addNFAStateToDFAState(dfaState, nfaStartState);
+    dfa->addNFAStateToDFAState(dfaState, nfaStartState);
+    shouldBeEqual((int)dfaState[0], 0x23);
+    shouldBeEqual((int)dfaState[1], 0x02);
+    dfa->allocator->unallocateState(dfaState);
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  /// Show that cycles of NFA::Split states are followed only once.
+  it("Should compute the epsilon closures of cyclic NFA::Split states") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFA::MatchData noMatchData;
+    noMatchData.c.u = 0;
+    nfa->registerStartState("start");
+    NFA::State *splitA = nfa->addState(NFA::Split, noMatchData, NULL, NULL, "a");
+    NFA::State *splitB = nfa->addState(NFA::Split, noMatchData, splitA, NULL, "b");
+    splitA->out = splitB;
+    splitA->out1 = splitA;
+    nfa->startState.setItem(0, splitA);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    State *dfaState = dfa->allocator->allocateANewState();
+    dfa->addNFAStateToDFAState(dfaState, splitB);
+    shouldBeEqual((int)dfaState[0], 0x03);
+    shouldBeEqual(dfa->closureEnd[splitB->id] - dfa->closureStart[splitB->id], 1);
+    dfa->allocator->unallocateState(dfaState);
+    delete dfa;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  /// Show that the DFA of a ReStart free start state can be compiled
+  /// and minimized eagerly.
+  it("Should eagerly compile and minimize ReStart free start states") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    shouldBeZero(dfa->getNumEagerCompileReports());
+    dfa->compileEagerly();
+    shouldBeEqual(dfa->getNumEagerCompileReports(), 1);
+    EagerCompileReport report = dfa->getEagerCompileReport(0);
+    shouldBeZero(report.startStateId);
+    shouldBeTrue(report.compiled);
+    // start, {2,6}, {3,7}, {4}, {8}, {10} and the deadState
+    shouldBeEqual(report.numStates, 7);
+    // {4} and {8} are indistinguishable
+    shouldBeEqual(report.numMinimizedStates, 6);
+    // every transition has been computed
+    dfa->resetCacheStatistics();
+    utf8Char_t aChar, bChar;
+    aChar.u = 0; aChar.c[0] = 'a';
+    bChar.u = 0; bChar.c[0] = 'b';
+    StateRecord *startState = dfa->getDFAStartState((NFA::StartStateId)0);
+    StateRecord *abState =
+      dfa->getNextDFAState(dfa->getNextDFAState(startState, aChar), bChar);
+    shouldNotBeNULL(abState);
+    StateRecord *abaState = dfa->getNextDFAState(abState, aChar);
+    StateRecord *abbState = dfa->getNextDFAState(abState, bChar);
+    shouldNotBeNULL(abaState);
+    shouldBeEqual((void*)abaState, (void*)abbState);
+    StateRecord *tokenState = dfa->getNextDFAState(abbState, bChar);
+    shouldNotBeNULL(tokenState);
+    shouldNotBeNULL(dfa->allocator->stateMatchesToken(tokenState->state,
+                                                      dfa->tokensState));
+    shouldBeNULL(dfa->getNextDFAState(tokenState, aChar));
+    shouldBeNULL(dfa->getNextDFAState(startState, bChar));
+    shouldBeZero(dfa->getNumCacheMisses());
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  /// Show that flushing the DFA cache keeps the pinned and live
+  /// DFA::States.
+  it("Should flush the DFA cache keeping pinned and live States") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    shouldBeZero(dfa->getCacheBudget());
+    shouldBeFalse(dfa->isCacheOverBudget());
+    utf8Char_t aChar, bChar;
+    aChar.u = 0; aChar.c[0] = 'a';
+    bChar.u = 0; bChar.c[0] = 'b';
+    StateRecord *startState = dfa->getDFAStartState((NFA::StartStateId)0);
+    shouldBeTrue(startState->pinned);
+    shouldBeTrue(dfa->deadState->pinned);
+    StateRecord *aState  = dfa->getNextDFAState(startState, aChar);
+    StateRecord *abState = dfa->getNextDFAState(aState, bChar);
+    shouldNotBeNULL(abState);
+    shouldBeNULL(dfa->getNextDFAState(startState, bChar));
+    shouldBeEqual(dfa->nextStateMapping->getNumStateRecords(), 4);
+    dfa->setCacheBudget(1);
+    shouldBeEqual(dfa->getCacheBudget(), 1);
+    shouldBeTrue(dfa->isCacheOverBudget());
+    VarArray<StateRecord*> liveRecords;
+    liveRecords.pushItem(abState);
+    shouldBeEqual(dfa->flushCache(&liveRecords), 1);
+    shouldBeEqual(dfa->getNumCacheFlushes(), 1);
+    shouldBeEqual(dfa->getNumEvictedStates(), 1);
+    shouldBeEqual(dfa->nextStateMapping->getNumStateRecords(), 3);
+    shouldBeEqual((void*)dfa->getDFAStartState((NFA::StartStateId)0),
+                  (void*)startState);
+    // the evicted transitions are recomputed
+    dfa->resetCacheStatistics();
+    shouldBeZero(dfa->getNumCacheFlushes());
+    shouldBeNULL(dfa->getNextDFAState(startState, bChar));
+    shouldBeEqual(dfa->getNumCacheHits(), 1);
+    StateRecord *newAState = dfa->getNextDFAState(startState, aChar);
+    shouldNotBeNULL(newAState);
+    shouldBeEqual(dfa->getNumCacheMisses(), 1);
+    shouldBeEqual((void*)dfa->getNextDFAState(newAState, bChar),
+                  (void*)abState);
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should cache the ReStart NFA::States and token of each State") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({b}c|{a}{b}|{a}d|e)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    StateRecord *startState = dfa->getDFAStartState("start");
+    shouldNotBeNULL(startState);
+    shouldBeFalse(startState->hasMetadata);
+    size_t cacheBytes = dfa->getCacheBytes();
+    dfa->ensureStateMetadata(startState);
+    shouldBeTrue(startState->hasMetadata);
+    shouldBeEqual(dfa->getCacheBytes(), cacheBytes + 2*sizeof(NFA::State*));
+    // one ReStart NFA::State per start state id in NFA::State order
+    shouldBeEqual(startState->numReStarts, 2);
+    shouldBeEqual(startState->reStarts[0]->matchType, NFA::ReStart);
+    shouldBeEqual(startState->reStarts[0]->matchData.r,
+                  nfa->findStartStateId("b"));
+    shouldBeEqual(startState->reStarts[1]->matchData.r,
+                  nfa->findStartStateId("a"));
+    shouldBeNULL(startState->tokenState);
+    // an accepting State caches its token
+    utf8Char_t eChar;
+    eChar.u = 0; eChar.c[0] = 'e';
+    StateRecord *eState = dfa->getNextDFAState(startState, eChar);
+    shouldNotBeNULL(eState);
+    dfa->ensureStateMetadata(eState);
+    shouldBeZero(eState->numReStarts);
+    shouldBeNULL(eState->reStarts);
+    shouldBeEqual(eState->tokenState,
+                  dfa->allocator->stateMatchesToken(eState->state,
+                                                    dfa->getTokensState()));
+    shouldBeEqual(eState->tokenId, 1);
+    shouldBeFalse(eState->ignoreToken);
+    // evicted States lose their metadata
+    dfa->flushCache(NULL);
+    shouldBeTrue(startState->hasMetadata);
+    shouldBeEqual(dfa->nextStateMapping->getNumStateRecords(), 2);
+    shouldBeEqual(dfa->getCacheBytes(),
+                  cacheBytes + 2*sizeof(NFA::State*) +
+                  startState->numNext*sizeof(StateRecord*));
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should compute the FIRST set of each start state") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("opt", "x*", 3);
+    // start refers to list before list has been defined
+    nfa->registerStartState("list");
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({opt}y|{list})", 1);
+    nfaBuilder->compileRegularExpressionForTokenId("list", "({a}{list}|b)", 4);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    CharacterClassMapping *characterClasses = dfa->getCharacterClasses();
+    utf8Char_t aChar, bChar, xChar, yChar, zChar, endChar;
+    aChar.u = 0; aChar.c[0] = 'a';
+    bChar.u = 0; bChar.c[0] = 'b';
+    xChar.u = 0; xChar.c[0] = 'x';
+    yChar.u = 0; yChar.c[0] = 'y';
+    zChar.u = 0; zChar.c[0] = 'z';
+    endChar.u = 0;
+    NFA::StartStateId optId   = nfa->findStartStateId("opt");
+    NFA::StartStateId listId  = nfa->findStartStateId("list");
+    NFA::StartStateId startId = nfa->findStartStateId("start");
+    shouldBeTrue(dfa->isNullable(optId));
+    shouldBeFalse(dfa->isNullable(listId));
+    shouldBeFalse(dfa->isNullable(startId));
+    shouldBeTrue(dfa->firstSetContains(optId,
+      characterClasses->getCharacterClass(xChar)));
+    shouldBeFalse(dfa->firstSetContains(optId,
+      characterClasses->getCharacterClass(yChar)));
+    // the recursive rule's FIRST set
+    shouldBeTrue(dfa->mayStartWith(listId, aChar));
+    shouldBeTrue(dfa->mayStartWith(listId, bChar));
+    shouldBeFalse(dfa->mayStartWith(listId, xChar));
+    shouldBeFalse(dfa->mayStartWith(listId, endChar));
+    // the nullable opt rule is followed by y
+    shouldBeTrue(dfa->mayStartWith(startId, xChar));
+    shouldBeTrue(dfa->mayStartWith(startId, yChar));
+    shouldBeTrue(dfa->mayStartWith(startId, aChar));
+    shouldBeTrue(dfa->mayStartWith(startId, bChar));
+    shouldBeFalse(dfa->mayStartWith(startId, zChar));
+    shouldBeFalse(dfa->mayStartWith(startId, endChar));
+    // a nullable rule may start with anything
+    shouldBeTrue(dfa->mayStartWith(optId, zChar));
+    shouldBeTrue(dfa->mayStartWith(optId, endChar));
     delete dfa;
     delete nfaBuilder;
     delete nfa;
@@ -113,41 +405,31 @@ describe(DFA) {
     NextStateMapping *mapping = dfa->nextStateMapping;
     shouldNotBeNULL(mapping);
     shouldBeZero(allocator->allocatedUnusedStack.getNumItems());
-    State *specificState = allocator->allocateANewState(); // this will be the specific state
-    State *genericState  = allocator->allocateANewState(); // this will be generic state
-    State *startState    = allocator->allocateANewState(); // this will be the start state
-    shouldNotBeNULL((void*)specificState);
-    shouldNotBeNULL((void*)genericState);
+    State *nextState  = allocator->allocateANewState(); // this will be the next state
+    State *startState = allocator->allocateANewState(); // this will be the start state
+    shouldNotBeNULL((void*)nextState);
     shouldNotBeNULL((void*)startState);
-    allocator->unallocateState(specificState);
-    allocator->unallocateState(genericState);
+    allocator->unallocateState(nextState);
     allocator->unallocateState(startState); // last in first out of stack
     utf8Char_t firstChar;
     firstChar.u = 0;
     firstChar.c[0] = 'a';
-    Classifier::classSet_t classificationSet = 0;
-    State *nextDFAState =
-      dfa->computeNextDFAState(dfa->getDFAStartState("start"),
-                               firstChar,
-                               classificationSet);
-    shouldNotBeNULL((void*)nextDFAState);
-    shouldBeEqual((void*)nextDFAState, (void*)specificState);
-    shouldBeTrue(allocator->isStateEmpty(genericState));
-    State **registeredGenericState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              genericState, allocator->stateSize);
-    shouldBeNULL((void**)registeredGenericState);
-
-    shouldBeFalse(allocator->isStateEmpty(specificState));
-    State **registeredSpecificState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              specificState, allocator->stateSize);
-    shouldNotBeNULL((void**)registeredSpecificState);
-    shouldBeEqual((void*)*registeredSpecificState, (void*)specificState);
-    shouldBeEqual(((int)nextDFAState[0]), (int)0x30);
+    size_t charClass = dfa->characterClasses->getCharacterClass(firstChar);
+    StateRecord *startRecord = dfa->getDFAStartState("start");
+    shouldNotBeNULL(startRecord);
+    shouldBeEqual((void*)startRecord->state, (void*)startState);
+    StateRecord *nextDFAState =
+      dfa->computeNextDFAState(startRecord, charClass);
+    shouldNotBeNULL(nextDFAState);
+    shouldBeEqual((void*)nextDFAState->state, (void*)nextState);
+    shouldBeFalse(allocator->isStateEmpty(nextState));
+    shouldBeEqual((void*)mapping->findState(nextState), (void*)nextDFAState);
+    shouldBeEqual(((int)nextState[0]), (int)0x44);
     for (size_t i = 1; i < allocator->stateSize; i++) {
-      shouldBeEqual(((int)nextDFAState[i]), (int)0x00);
+      shouldBeEqual(((int)nextState[i]), (int)0x00);
     }
+    shouldBeEqual((void*)mapping->getNextState(startRecord, charClass),
+                  (void*)nextDFAState);
     delete dfa;
     delete nfaBuilder;
     delete nfa;
@@ -178,51 +460,44 @@ describe(DFA) {
     NextStateMapping *mapping = dfa->nextStateMapping;
     shouldNotBeNULL(mapping);
     shouldBeZero(allocator->allocatedUnusedStack.getNumItems());
-    State *specificState = allocator->allocateANewState(); // this will be the specific state
-    State *genericState  = allocator->allocateANewState(); // this will be generic state
-    State *startState    = allocator->allocateANewState(); // this will be the start state
-    shouldNotBeNULL((void*)specificState);
-    shouldNotBeNULL((void*)genericState);
+    State *nextState  = allocator->allocateANewState(); // this will be the next state
+    State *startState = allocator->allocateANewState(); // this will be the start state
+    shouldNotBeNULL((void*)nextState);
     shouldNotBeNULL((void*)startState);
-    allocator->unallocateState(specificState);
-    allocator->unallocateState(genericState);
+    allocator->unallocateState(nextState);
     allocator->unallocateState(startState); // last in first out of stack
     shouldBeEqual((void*)allocator->allocatedUnusedStack.getItem(0, NULL),
-      (void*)specificState);
-    shouldBeEqual((void*)allocator->allocatedUnusedStack.getItem(1, NULL),
-      (void*)genericState);
+      (void*)nextState);
     utf8Char_t firstChar;
     firstChar.u = 0;
     firstChar.c[0] = 'a';
     Classifier::classSet_t classificationSet =
       classifier->getClassSet(firstChar);
     shouldBeEqual(classificationSet, ~1L);
-    State *nextDFAState =
+    StateRecord *nextDFAState =
       dfa->computeNextDFAState(dfa->getDFAStartState("start"),
-                               firstChar,
-                               classificationSet);
-    shouldNotBeNULL((void*)nextDFAState);
-    shouldBeEqual((void*)nextDFAState, (void*)specificState);
-    shouldBeFalse(allocator->isStateEmpty(specificState));
-    shouldBeEqual(((int)specificState[0]), (int)0x30);
+        dfa->characterClasses->getCharacterClass(firstChar));
+    shouldNotBeNULL(nextDFAState);
+    shouldBeEqual((void*)nextDFAState->state, (void*)nextState);
+    shouldBeFalse(allocator->isStateEmpty(nextState));
+    // both the specific (0x04) and generic (0x40) next states
+    shouldBeEqual(((int)nextState[0]), (int)0x44);
     for (size_t i = 1; i < dfa->allocator->stateSize; i++) {
-      shouldBeEqual(((int)specificState[i]), (int)0x00);
+      shouldBeEqual(((int)nextState[i]), (int)0x00);
     }
-    State **registeredSpecificState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              specificState, allocator->stateSize);
-    shouldNotBeNULL((void**)registeredSpecificState);
-    shouldBeEqual((void*)*registeredSpecificState, (void*)specificState);
-
-    shouldBeFalse(allocator->isStateEmpty(genericState));
-    State **registeredGenericState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              genericState, allocator->stateSize);
-    shouldNotBeNULL((void**)registeredGenericState);
-    shouldBeEqual((void*)*registeredGenericState, (void*)genericState);
-    shouldBeEqual(((int)genericState[0]), (int)0x20);
+    shouldBeEqual((void*)mapping->findState(nextState), (void*)nextDFAState);
+    // a character matching only the generic state
+    utf8Char_t otherChar;
+    otherChar.u = 0;
+    otherChar.c[0] = 'x';
+    StateRecord *genericDFAState =
+      dfa->computeNextDFAState(dfa->getDFAStartState("start"),
+        dfa->characterClasses->getCharacterClass(otherChar));
+    shouldNotBeNULL(genericDFAState);
+    shouldNotBeEqual((void*)genericDFAState, (void*)nextDFAState);
+    shouldBeEqual(((int)genericDFAState->state[0]), (int)0x40);
     for (size_t i = 1; i < dfa->allocator->stateSize; i++) {
-      shouldBeEqual(((int)genericState[i]), (int)0x00);
+      shouldBeEqual(((int)genericDFAState->state[i]), (int)0x00);
     }
     delete dfa;
     delete nfaBuilder;
@@ -254,51 +529,102 @@ describe(DFA) {
     NextStateMapping *mapping = dfa->nextStateMapping;
     shouldNotBeNULL(mapping);
     shouldBeZero(allocator->allocatedUnusedStack.getNumItems());
-    State *specificState = allocator->allocateANewState(); // this will be the specific state
-    State *genericState = allocator->allocateANewState(); // this will be generic state
-    State *startState    = allocator->allocateANewState(); // this will be the start state
-    shouldNotBeNULL((void*)specificState);
-    shouldNotBeNULL((void*)genericState);
+    State *nextState  = allocator->allocateANewState(); // this will be the next state
+    State *startState = allocator->allocateANewState(); // this will be the start state
+    shouldNotBeNULL((void*)nextState);
     shouldNotBeNULL((void*)startState);
-    allocator->unallocateState(specificState);
-    allocator->unallocateState(genericState);
+    allocator->unallocateState(nextState);
     allocator->unallocateState(startState); // last in first out stack
-    shouldBeEqual((void*)allocator->allocatedUnusedStack.getItem(0, NULL),
-      (void*)specificState);
-    shouldBeEqual((void*)allocator->allocatedUnusedStack.getItem(1, NULL),
-      (void*)genericState);
     utf8Char_t firstChar;
     firstChar.u = 0;
     firstChar.c[0] = 'a';
     Classifier::classSet_t classificationSet =
       classifier->getClassSet(firstChar);
     shouldBeEqual(classificationSet, ~1L);
-    State *nextDFAState =
+    StateRecord *nextDFAState =
       dfa->computeNextDFAState(dfa->getDFAStartState("start"),
-                               firstChar,
-                               classificationSet);
-    shouldNotBeNULL((void*)nextDFAState);
-    shouldBeEqual((void*)nextDFAState, (void*)genericState);
-    shouldBeFalse(allocator->isStateEmpty(genericState));
-    shouldBeEqual(((int)genericState[0]), (int)0x30);
+        dfa->characterClasses->getCharacterClass(firstChar));
+    shouldNotBeNULL(nextDFAState);
+    shouldBeEqual((void*)nextDFAState->state, (void*)nextState);
+    shouldBeEqual(((int)nextState[0]), (int)0x44);
     for (size_t i = 1; i < allocator->stateSize; i++) {
-      shouldBeEqual(((int)genericState[i]), (int)0x00);
+      shouldBeEqual(((int)nextState[i]), (int)0x00);
     }
-    State **registeredGenericState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              genericState, allocator->stateSize);
-    shouldNotBeNULL((void**)registeredGenericState);
-    shouldBeEqual((void*)*registeredGenericState, (void*)genericState);
+    shouldBeEqual((void*)mapping->findState(nextState), (void*)nextDFAState);
+    // a whitespace character has no viable next state
+    utf8Char_t spaceChar;
+    spaceChar.u = 0;
+    spaceChar.c[0] = ' ';
+    size_t charClass = dfa->characterClasses->getCharacterClass(spaceChar);
+    shouldBeNULL(dfa->computeNextDFAState(dfa->getDFAStartState("start"),
+                                          charClass));
+    shouldBeEqual((void*)mapping->getNextState(dfa->getDFAStartState("start"),
+                                               charClass),
+                  (void*)dfa->deadState);
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
 
-    shouldBeTrue(allocator->isStateEmpty(specificState));
-    State **registeredSpecificState =
-      (State**)hattrie_tryget(mapping->nextDFAStateMap,
-                              specificState, allocator->stateSize);
-    shouldBeNULL((void**)registeredSpecificState);
-    shouldBeEqual(((int)nextDFAState[0]), (int)0x30);
-    for (size_t i = 1; i < allocator->stateSize; i++) {
-      shouldBeEqual(((int)nextDFAState[i]), (int)0x00);
-    }
+  /// Show that DFA::getNextDFAState only computes a given transition
+  /// once, after which the transition is found in the current
+  /// StateRecord's transition slots.
+  it("getNextDFAState should use previously computed transitions") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    classifier->registerClassSet("whitespace",1);
+    classifier->classifyUtf8CharsAs(Utf8Chars::whiteSpaceChars,"whitespace");
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|[!whitespace]bbb)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    shouldBeZero(dfa->getNumCacheHits());
+    shouldBeZero(dfa->getNumCacheMisses());
+    StateRecord *startState = dfa->getDFAStartState("start");
+    shouldNotBeNULL(startState);
+    utf8Char_t aChar;
+    aChar.u = 0;
+    aChar.c[0] = 'a';
+    StateRecord *nextState = dfa->getNextDFAState(startState, aChar);
+    shouldNotBeNULL(nextState);
+    shouldBeZero(dfa->getNumCacheHits());
+    shouldBeEqual(dfa->getNumCacheMisses(), 1);
+    shouldBeEqual((void*)dfa->getNextDFAState(startState, aChar),
+                  (void*)nextState);
+    shouldBeEqual(dfa->getNumCacheHits(), 1);
+    shouldBeEqual(dfa->getNumCacheMisses(), 1);
+    utf8Char_t xChar;
+    xChar.u = 0;
+    xChar.c[0] = 'x';
+    StateRecord *otherState = dfa->getNextDFAState(startState, xChar);
+    shouldNotBeNULL(otherState);
+    shouldNotBeEqual((void*)otherState, (void*)nextState);
+    shouldBeEqual(dfa->getNumCacheHits(), 1);
+    shouldBeEqual(dfa->getNumCacheMisses(), 2);
+    // 'y' is in the same character class as 'x'
+    utf8Char_t yChar;
+    yChar.u = 0;
+    yChar.c[0] = 'y';
+    shouldBeEqual((void*)dfa->getNextDFAState(startState, yChar),
+                  (void*)otherState);
+    shouldBeEqual(dfa->getNumCacheHits(), 2);
+    shouldBeEqual(dfa->getNumCacheMisses(), 2);
+    // transitions with no viable next state are also remembered
+    utf8Char_t spaceChar;
+    spaceChar.u = 0;
+    spaceChar.c[0] = ' ';
+    shouldBeNULL(dfa->getNextDFAState(startState, spaceChar));
+    shouldBeEqual(dfa->getNumCacheMisses(), 3);
+    shouldBeNULL(dfa->getNextDFAState(startState, spaceChar));
+    shouldBeEqual(dfa->getNumCacheHits(), 3);
+    shouldBeEqual(dfa->getNumCacheMisses(), 3);
+    dfa->resetCacheStatistics();
+    shouldBeZero(dfa->getNumCacheHits());
+    shouldBeZero(dfa->getNumCacheMisses());
     delete dfa;
     delete nfaBuilder;
     delete nfa;
@@ -479,7 +805,7 @@ describe(DFA) {
     shouldNotBeNULL(allocator);
     dfa->getDFAStartState("start");
     NFA::State *nfaState =
-      allocator->stateMatchesToken(dfa->startState[0], dfa->tokensState);
+      allocator->stateMatchesToken(dfa->startState[0]->state, dfa->tokensState);
     shouldBeNULL(nfaState);
     PushDownMachine *pdm = new PushDownMachine(dfa);
     shouldNotBeNULL(pdm);
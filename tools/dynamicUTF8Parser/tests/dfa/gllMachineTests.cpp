@@ -0,0 +1,269 @@
+#include <string.h>
+#include <stdio.h>
+#include <exception>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include "dynUtf8Parser/nfaBuilder.h"
+#include "dynUtf8Parser/dfa/gllMachine.h"
+#include "dynUtf8Parser/dfa/pushDownMachine.h"
+
+using namespace DeterministicFiniteAutomaton;
+
+/// \brief We test the GLLMachine class.
+describe(DFA_GLLMachine) {
+
+  specSize(GLLMachine);
+  specSize(GLLMachine::Node);
+  specSize(GLLMachine::Edge);
+
+  it("Should create an instance") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    GLLMachine *gll = new GLLMachine(dfa);
+    shouldNotBeNULL(gll);
+    shouldBeEqual(gll->dfa, dfa);
+    shouldBeEqual(gll->nfa, nfa);
+    shouldBeNULL(gll->stream);
+    shouldBeZero(gll->getNumItems());
+    shouldBeZero(gll->getNumNodes());
+    shouldBeZero(gll->getNumEdges());
+    Utf8Chars *someChars = new Utf8Chars("abbb");
+    Token *aToken = gll->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "abbb"));
+    shouldBeEqual(gll->getNumNodes(), 1);
+    delete aToken;
+    delete someChars;
+    someChars = new Utf8Chars("abb");
+    aToken = gll->runFromUsing("start", someChars);
+    shouldBeNULL(aToken);
+    delete someChars;
+    delete gll;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should build the same nested tokens as the PushDownMachine") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 4, true);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({a}{ws}?{a}c|{b}{a})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    GLLMachine *gll = new GLLMachine(dfa);
+    shouldNotBeNULL(gll);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    const char *inputs[] = { "aac", "axxac", "ba", "aa" };
+    for (size_t i = 0; i < 4; i++) {
+      Utf8Chars *someChars = new Utf8Chars(inputs[i]);
+      Token *gllToken = gll->runFromUsing("start", someChars);
+      Token *pdmToken = pdm->runFromUsing("start", someChars);
+      if (!pdmToken) {
+        shouldBeNULL(gllToken);
+        delete someChars;
+        continue;
+      }
+      shouldNotBeNULL(gllToken);
+      shouldBeTrue(gllToken->ASSERT_EQUALS(pdmToken->tokenId,
+                                           inputs[i]));
+      shouldBeTrue(gllToken->hasChildren(2));
+      for (size_t j = 0; j < 2; j++) {
+        Token *pdmChild = pdmToken->tokens.getItem(j, NULL);
+        Token *gllChild = gllToken->tokens.getItem(j, NULL);
+        shouldNotBeNULL(gllChild);
+        shouldBeEqual(gllChild->tokenId, pdmChild->tokenId);
+        shouldBeEqual(gllChild->textLength, pdmChild->textLength);
+        shouldBeZero(strncmp(gllChild->textStart, pdmChild->textStart,
+                             pdmChild->textLength));
+      }
+      delete gllToken;
+      delete pdmToken;
+      delete someChars;
+    }
+    delete pdm;
+    delete gll;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should find every parse of an ambiguous grammar") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("ab", "ab", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("bc", "bc", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({ab}c|a{bc})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    GLLMachine *gll = new GLLMachine(dfa);
+    shouldNotBeNULL(gll);
+    Utf8Chars *someChars = new Utf8Chars("abc");
+    VarArray<Token*> parses;
+    size_t numParses =
+      gll->allParsesFromUsing(nfa->findStartStateId("start"),
+                              someChars, &parses, 10);
+    shouldBeEqual(numParses, 2);
+    shouldBeEqual(parses.getNumItems(), 2);
+    // the out alternative is preferred
+    Token *aToken = parses.getItem(0, NULL);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "abc"));
+    shouldBeTrue(aToken->hasChildren(1));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(2, "ab"));
+    delete aToken;
+    aToken = parses.getItem(1, NULL);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "abc"));
+    shouldBeTrue(aToken->hasChildren(1));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(3, "bc"));
+    delete aToken;
+    // the number of parses may be limited
+    while (parses.getNumItems()) parses.popItem();
+    numParses =
+      gll->allParsesFromUsing(nfa->findStartStateId("start"),
+                              someChars, &parses, 1);
+    shouldBeEqual(numParses, 1);
+    delete parses.getItem(0, NULL);
+    delete someChars;
+    delete gll;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should parse left recursive grammars in polynomial space") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfa->registerStartState("sum");
+    nfaBuilder->compileRegularExpressionForTokenId("sum", "({sum}\\+{sum}|a)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    GLLMachine *gll = new GLLMachine(dfa);
+    shouldNotBeNULL(gll);
+    Utf8Chars *someChars = new Utf8Chars("a+a");
+    Token *aToken = gll->runFromUsing("sum", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "a+a"));
+    shouldBeTrue(aToken->hasChildren(2));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(1, "a"));
+    shouldBeTrue(aToken->tokens.getItem(1, NULL)->ASSERT_EQUALS(1, "a"));
+    delete aToken;
+    delete someChars;
+    // "a+a+...+a" has exponentially many parses, but at most one
+    // Node per offset
+    char input[2*40];
+    size_t len = 0;
+    for (size_t i = 0; i < 40; i++) {
+      if (i) input[len++] = '+';
+      input[len++] = 'a';
+    }
+    input[len] = 0;
+    someChars = new Utf8Chars(input);
+    aToken = gll->runFromUsing("sum", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, input));
+    shouldBeTrue(gll->getNumNodes() <= len + 1);
+    delete aToken;
+    VarArray<Token*> parses;
+    shouldBeEqual(gll->allParsesFromUsing(nfa->findStartStateId("sum"),
+                                          someChars, &parses, 5), 5);
+    for (size_t i = 0; i < parses.getNumItems(); i++) {
+      aToken = parses.getItem(i, NULL);
+      shouldBeTrue(aToken->ASSERT_EQUALS(1, input));
+      delete aToken;
+    }
+    // a partial match is only accepted on request
+    delete someChars;
+    someChars = new Utf8Chars("a+a+");
+    shouldBeNULL(gll->runFromUsing("sum", someChars));
+    aToken = gll->runFromUsing("sum", someChars, true);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "a+a"));
+    delete aToken;
+    delete someChars;
+    delete gll;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should parse very long flat inputs") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("as", "a+", 1);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("bs", "{b}+", 3);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    GLLMachine *gll = new GLLMachine(dfa);
+    shouldNotBeNULL(gll);
+    // (one PathFrame per character would overflow a recursive search)
+    size_t numChars = 50000;
+    char *input = (char*)calloc(numChars + 1, sizeof(char));
+    shouldNotBeNULL(input);
+    memset(input, 'a', numChars);
+    Utf8Chars *someChars = new Utf8Chars(input);
+    Token *aToken = gll->runFromUsing("as", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokenId, 1);
+    shouldBeEqual(aToken->textLength, numChars);
+    delete aToken;
+    delete someChars;
+    // ... as would one child Span per character (fewer, since every
+    // child adopted re-checks its parent Token's invariant)
+    size_t numChildren = 5000;
+    memset(input, 0, numChars);
+    memset(input, 'b', numChildren);
+    someChars = new Utf8Chars(input);
+    aToken = gll->runFromUsing("bs", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokenId, 3);
+    shouldBeEqual(aToken->textLength, numChildren);
+    shouldBeTrue(aToken->hasChildren(numChildren));
+    Token *lastChild = aToken->tokens.getItem(numChildren - 1, NULL);
+    shouldBeTrue(lastChild->ASSERT_EQUALS(2, "b"));
+    delete aToken;
+    delete someChars;
+    free(input);
+    delete gll;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+} endDescribe(DFA_GLLMachine);
@@ -30,16 +30,12 @@ describe(DFA_NextStateMapping) {
     shouldBeEqual(nfa->getNumberStates(), 11);
     StateAllocator *allocator = new StateAllocator(nfa);
     shouldNotBeNULL(allocator);
-    NextStateMapping *mapping = new NextStateMapping(allocator);
+    NextStateMapping *mapping = new NextStateMapping(allocator, 4);
     shouldNotBeNULL(mapping);
     shouldBeEqual(mapping->allocator, allocator);
     shouldNotBeNULL(mapping->nextDFAStateMap);
-    shouldBeEqual(mapping->dfaStateProbeSize,
-               (allocator->stateSize+sizeof(utf8Char_t)));
-    shouldNotBeNULL((void*)mapping->dfaStateProbe);
-    for (size_t i = 0; i < mapping->dfaStateProbeSize; i++) {
-      shouldBeZero(mapping->dfaStateProbe[i]);
-    }
+    shouldNotBeNULL(mapping->recordAllocator);
+    shouldBeZero(mapping->getNumStateRecords());
     delete mapping;
     delete allocator;
     delete nfaBuilder;
@@ -48,7 +44,7 @@ describe(DFA_NextStateMapping) {
   } endIt();
 
   it("Should be able to register a State using",
-     "NextStateMapping::registerDState") {
+     "NextStateMapping::registerState") {
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
     NFA *nfa = new NFA(classifier);
@@ -59,29 +55,43 @@ describe(DFA_NextStateMapping) {
     shouldBeEqual(nfa->getNumberStates(), 11);
     StateAllocator *allocator = new StateAllocator(nfa);
     shouldNotBeNULL(allocator);
-    shouldBeEqual(allocator->stateSize, 2);
-    NextStateMapping *mapping = new NextStateMapping(allocator);
+    shouldBeEqual(allocator->stateSize, 32);
+    NextStateMapping *mapping = new NextStateMapping(allocator, 4);
     shouldNotBeNULL(mapping);
-    shouldBeZero(mapping->dfaStateProbe[0]);
-    shouldBeZero(mapping->dfaStateProbe[1]);
     State *testState = allocator->allocateANewState();
     testState[0] = 255;
     testState[1] = 255;
-    mapping->assembleStateProbe(testState);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[0], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[1], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[2], (uint8_t)0);
-    State **registeredTryState =
-      (State **)hattrie_tryget(mapping->nextDFAStateMap,
-                               testState, allocator->stateSize);
+    StateRecord **registeredTryState =
+      (StateRecord **)hattrie_tryget(mapping->nextDFAStateMap,
+                                     testState, allocator->stateSize);
     shouldBeNULL((void*)registeredTryState);
-    State *registeredState  = mapping->registerState(testState);
-    shouldBeEqual(registeredState, testState);
+    shouldBeNULL(mapping->findState(testState));
+    StateRecord *registeredState  = mapping->registerState(testState);
+    shouldNotBeNULL(registeredState);
+    shouldBeEqual(registeredState->state, testState);
+    shouldBeZero(registeredState->id);
+    shouldBeNULL((void*)registeredState->next);
+    shouldBeZero(registeredState->numNext);
+    shouldBeEqual(mapping->getNumStateRecords(), 1);
+    shouldBeEqual((void*)mapping->getStateRecord(0), (void*)registeredState);
     registeredTryState =
-      (State **)hattrie_tryget(mapping->nextDFAStateMap,
-                               testState, allocator->stateSize);
+      (StateRecord **)hattrie_tryget(mapping->nextDFAStateMap,
+                                     testState, allocator->stateSize);
     shouldNotBeNULL((void*)registeredTryState);
-    shouldBeEqual((void*)*registeredTryState, (void*)testState);
+    shouldBeEqual((void*)*registeredTryState, (void*)registeredState);
+    shouldBeEqual((void*)mapping->findState(testState), (void*)registeredState);
+    // a copy of the same DFA::State bit set uses the same StateRecord
+    State *copyState = allocator->clone(testState);
+    shouldNotBeEqual((void*)copyState, (void*)testState);
+    shouldBeEqual((void*)mapping->registerState(copyState),
+                  (void*)registeredState);
+    shouldBeEqual(mapping->getNumStateRecords(), 1);
+    // a different DFA::State bit set has the next id
+    copyState[0] = 1;
+    StateRecord *otherState = mapping->registerState(copyState);
+    shouldNotBeEqual((void*)otherState, (void*)registeredState);
+    shouldBeEqual(otherState->id, 1);
+    shouldBeEqual(mapping->getNumStateRecords(), 2);
     delete mapping;
     delete allocator;
     delete nfaBuilder;
@@ -89,8 +99,8 @@ describe(DFA_NextStateMapping) {
     delete classifier;
   } endIt();
 
-  it("Should be able to register a State/character using",
-     "NextStateMapping::getNextStateByCharacter") {
+  it("Should be able to record transitions using",
+     "NextStateMapping::setNextState") {
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
     NFA *nfa = new NFA(classifier);
@@ -101,33 +111,30 @@ describe(DFA_NextStateMapping) {
     shouldBeEqual(nfa->getNumberStates(), 11);
     StateAllocator *allocator = new StateAllocator(nfa);
     shouldNotBeNULL(allocator);
-    shouldBeEqual(allocator->stateSize, 2);
-    NextStateMapping *mapping = new NextStateMapping(allocator);
+    NextStateMapping *mapping = new NextStateMapping(allocator, 4);
     shouldNotBeNULL(mapping);
-    shouldBeZero(mapping->dfaStateProbe[0]);
-    shouldBeZero(mapping->dfaStateProbe[1]);
-    shouldBeZero(mapping->dfaStateProbe[2]);
-    shouldBeZero(mapping->dfaStateProbe[3]);
     State *testState = allocator->allocateANewState();
     testState[0] = 255;
-    testState[1] = 255;
-    utf8Char_t aChar;
-    aChar.u = 0;
-    aChar.c[0] = 'a';
-    mapping->assembleStateCharacterProbe(testState, aChar);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[0], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[1], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[2], (uint8_t)'a');
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[3], (uint8_t)0);
-    State **nextState =
-      (State **)hattrie_tryget(mapping->nextDFAStateMap,
-                               mapping->dfaStateProbe,
-                               mapping->dfaStateProbeSize);
-    shouldBeNULL((void*)nextState);
-    nextState = mapping->tryGetNextStateByCharacter(testState, aChar);
-    shouldBeNULL((void**)nextState);
-    nextState = mapping->getNextStateByCharacter(testState, aChar);
-    shouldNotBeNULL((void*)nextState);
+    StateRecord *curState = mapping->registerState(testState);
+    State *otherState = allocator->allocateANewState();
+    otherState[0] = 1;
+    StateRecord *nextState = mapping->registerState(otherState);
+    shouldBeNULL(mapping->getNextState(curState, 0));
+    shouldBeNULL(mapping->getNextState(curState, 5));
+    mapping->setNextState(curState, 5, nextState);
+    shouldNotBeNULL((void*)curState->next);
+    shouldBeEqual(curState->numNext, 6);
+    shouldBeEqual((void*)mapping->getNextState(curState, 5), (void*)nextState);
+    shouldBeNULL(mapping->getNextState(curState, 0));
+    shouldBeNULL(mapping->getNextState(curState, 6));
+    mapping->setNextState(curState, 6, curState);
+    shouldBeEqual(curState->numNext, 12);
+    shouldBeEqual((void*)mapping->getNextState(curState, 5), (void*)nextState);
+    shouldBeEqual((void*)mapping->getNextState(curState, 6), (void*)curState);
+    mapping->setNextState(nextState, 0, curState);
+    shouldBeEqual(nextState->numNext, 4);
+    shouldBeEqual((void*)mapping->getNextState(nextState, 0), (void*)curState);
+    shouldBeNULL(mapping->getNextState(nextState, 3));
     delete mapping;
     delete allocator;
     delete nfaBuilder;
@@ -135,8 +142,8 @@ describe(DFA_NextStateMapping) {
     delete classifier;
   } endIt();
 
-  it("Should be able to register a State/class using",
-     "NextStateMapping::getNextStateByClass") {
+  it("Should be able to evict unpinned States using",
+     "NextStateMapping::evictStates") {
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
     NFA *nfa = new NFA(classifier);
@@ -144,35 +151,53 @@ describe(DFA_NextStateMapping) {
     NFABuilder *nfaBuilder = new NFABuilder(nfa);
     shouldNotBeNULL(nfaBuilder);
     nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
-    shouldBeEqual(nfa->getNumberStates(), 11);
     StateAllocator *allocator = new StateAllocator(nfa);
     shouldNotBeNULL(allocator);
-    shouldBeEqual(allocator->stateSize, 2);
-    NextStateMapping *mapping = new NextStateMapping(allocator);
+    NextStateMapping *mapping = new NextStateMapping(allocator, 4);
     shouldNotBeNULL(mapping);
-    shouldBeZero(mapping->dfaStateProbe[0]);
-    shouldBeZero(mapping->dfaStateProbe[1]);
-    shouldBeZero(mapping->dfaStateProbe[2]);
-    shouldBeZero(mapping->dfaStateProbe[3]);
-    State *testState = allocator->allocateANewState();
-    testState[0] = 255;
-    testState[1] = 255;
-    Classifier::classSet_t aClass;
-    aClass = 10;
-    mapping->assembleStateClassificationProbe(testState, aClass);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[0], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[1], (uint8_t)255);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[2], (uint8_t)10);
-    shouldBeEqual((uint8_t)mapping->dfaStateProbe[3], (uint8_t)0);
-    State **nextState =
-      (State **)hattrie_tryget(mapping->nextDFAStateMap,
-                               mapping->dfaStateProbe,
-                               mapping->dfaStateProbeSize);
-    shouldBeNULL((void*)nextState);
-    nextState = mapping->tryGetNextStateByClass(testState, aClass);
-    shouldBeNULL((void**)nextState);
-    nextState = mapping->getNextStateByClass(testState, aClass);
-    shouldNotBeNULL((void*)nextState);
+    shouldBeZero(mapping->getCacheBytes());
+    StateRecord *records[4];
+    for (size_t i = 0; i < 4; i++) {
+      State *aState = allocator->allocateANewState();
+      aState[0] = i + 1;
+      records[i] = mapping->registerState(aState);
+      shouldBeFalse(records[i]->pinned);
+    }
+    size_t recordBytes = sizeof(StateRecord) + 2*allocator->stateSize;
+    shouldBeEqual(mapping->getCacheBytes(), 4*recordBytes);
+    mapping->setNextState(records[0], 0, records[1]);
+    mapping->setNextState(records[0], 1, records[2]);
+    mapping->setNextState(records[2], 0, records[0]);
+    shouldBeEqual(mapping->getCacheBytes(),
+                  4*recordBytes + 8*sizeof(StateRecord*));
+    // pin records[0] and keep records[2] live
+    mapping->pinState(records[0]);
+    shouldBeTrue(records[0]->pinned);
+    VarArray<StateRecord*> liveRecords;
+    liveRecords.pushItem(records[2]);
+    shouldBeEqual(mapping->evictStates(&liveRecords), 2);
+    shouldBeEqual(mapping->getNumStateRecords(), 2);
+    shouldBeEqual(mapping->getCacheBytes(),
+                  2*recordBytes + 8*sizeof(StateRecord*));
+    shouldBeEqual((void*)mapping->getStateRecord(0), (void*)records[0]);
+    shouldBeEqual((void*)mapping->getStateRecord(1), (void*)records[2]);
+    shouldBeZero(records[0]->id);
+    shouldBeEqual(records[2]->id, 1);
+    // transitions to evicted States are cleared
+    shouldBeNULL(mapping->getNextState(records[0], 0));
+    shouldBeEqual((void*)mapping->getNextState(records[0], 1), (void*)records[2]);
+    shouldBeEqual((void*)mapping->getNextState(records[2], 0), (void*)records[0]);
+    // the kept States are still registered, the evicted ones are not
+    State *aState = allocator->allocateANewState();
+    aState[0] = 3;
+    shouldBeEqual((void*)mapping->findState(aState), (void*)records[2]);
+    aState[0] = 2;
+    shouldBeNULL(mapping->findState(aState));
+    // evicted StateRecords are recycled
+    StateRecord *newRecord = mapping->registerState(aState);
+    shouldBeEqual(newRecord->id, 2);
+    shouldBeTrue((newRecord == records[1]) || (newRecord == records[3]));
+    shouldBeFalse(newRecord->pinned);
     delete mapping;
     delete allocator;
     delete nfaBuilder;
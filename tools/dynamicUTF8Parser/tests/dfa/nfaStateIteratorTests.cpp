@@ -36,9 +36,10 @@ describe(DFA_NFAStateIterator) {
     shouldNotBeNULL((void*)state);
     NFAStateIterator iterator = allocator->newIteratorOn(state);
     shouldBeZero(iterator.curNFAStateNum);
-    shouldBeEqual((void*)iterator.curByte, (void*)state);
-    shouldBeEqual((void*)iterator.endByte, (void*)(state+allocator->stateSize));
-    shouldBeEqual(iterator.curBit, 1);
+    shouldBeEqual((void*)iterator.curWord, (void*)state);
+    shouldBeEqual((void*)iterator.endWord, (void*)(state+allocator->stateSize));
+    shouldBeZero(iterator.curBits);
+    shouldBeNULL(iterator.nextState());
     // mapping is owned by allocator
     delete allocator;
     delete nfaBuilder;
@@ -57,7 +58,7 @@ describe(DFA_NFAStateIterator) {
     shouldBeEqual(nfa->getNumberStates(), 19);
     StateAllocator *allocator = new StateAllocator(nfa);
     shouldNotBeNULL(allocator);
-    shouldBeEqual(allocator->stateSize, 3);
+    shouldBeEqual(allocator->stateSize, 32);
     NFAStateMapping *mapping = allocator->nfaStateMapping;
     shouldNotBeNULL(mapping);
     State *state = allocator->allocateANewState();
@@ -224,6 +225,23 @@ describe(DFA_NFAStateIterator) {
     for (size_t i = 10; i < 19; i++) {
       shouldBeEqual(iterator.nextState(), baseState+i);
     }
+    shouldBeNULL(iterator.nextState());
+    // collect the remaining NFA::States in bulk
+    iterator = allocator->newIteratorOn(state);
+    shouldBeEqual(iterator.numRemainingStates(), 9);
+    shouldBeEqual(iterator.nextState(), baseState+10);
+    shouldBeEqual(iterator.numRemainingStates(), 8);
+    NFA::State *nfaStates[19];
+    shouldBeEqual(iterator.nextStates(nfaStates, 3), 3);
+    for (size_t i = 0; i < 3; i++) {
+      shouldBeEqual(nfaStates[i], baseState+11+i);
+    }
+    shouldBeEqual(iterator.nextStates(nfaStates, 19), 5);
+    for (size_t i = 0; i < 5; i++) {
+      shouldBeEqual(nfaStates[i], baseState+14+i);
+    }
+    shouldBeZero(iterator.nextStates(nfaStates, 19));
+    shouldBeZero(iterator.numRemainingStates());
     // mapping is owned by allocator
     delete allocator;
     delete nfaBuilder;
@@ -231,6 +249,36 @@ describe(DFA_NFAStateIterator) {
     delete classifier;
   } endIt();
 
+  it("Show that NFAStateIterator can cross 64 bit word boundaries") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    char longRegExp[301];
+    memset(longRegExp, 'a', 300);
+    longRegExp[300] = 0;
+    nfaBuilder->compileRegularExpressionForTokenId("start", longRegExp, 1);
+    StateAllocator *allocator = new StateAllocator(nfa);
+    shouldNotBeNULL(allocator);
+    State *state = allocator->allocateANewState();
+    size_t setStates[] = { 0, 63, 64, 127, 128, 200, 255, 259 };
+    for (size_t i = 0; i < 8; i++) {
+      allocator->setNFAState(state, nfa->getState(setStates[i]));
+    }
+    NFAStateIterator iterator = allocator->newIteratorOn(state);
+    shouldBeEqual(iterator.numRemainingStates(), 8);
+    for (size_t i = 0; i < 8; i++) {
+      shouldBeEqual(iterator.nextState(), nfa->getState(setStates[i]));
+    }
+    shouldBeNULL(iterator.nextState());
+    delete allocator;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
 } endDescribe(DFA_NFAStateIterator);
 
 }; // namespace DeterministicFiniteAutomaton
@@ -34,9 +34,12 @@ describe(DFA_NFAStateMapping) {
     NFAStateMapping *stateMapping = allocator->nfaStateMapping;
     shouldNotBeNULL(stateMapping);
     shouldBeEqual(stateMapping->allocator, allocator);
-    shouldNotBeNULL(stateMapping->nfaStatePtr2int);
     shouldNotBeNULL(stateMapping->int2nfaStatePtr);
-    shouldBeZero(stateMapping->numKnownNFAStates);
+    shouldBeEqual(stateMapping->int2nfaStatePtrSize, 11);
+    for (size_t i = 0; i < 11; i++) {
+      shouldBeEqual(stateMapping->int2nfaStatePtr[i], nfa->getState(i));
+      shouldBeEqual(stateMapping->int2nfaStatePtr[i]->id, i);
+    }
     // stateMapper is owned by allocator
     delete allocator;
     delete nfaBuilder;
@@ -62,53 +65,26 @@ describe(DFA_NFAStateMapping) {
     shouldNotBeNULL(allocator);
     NFAStateMapping *mapping = allocator->nfaStateMapping;
     shouldNotBeNULL(mapping);
-    shouldBeZero(mapping->numKnownNFAStates);
     NFA::State *nfaStartState = nfa->getStartState("start");
     shouldNotBeNULL(nfaStartState);
-    mapping->getNFAStateNumber(nfaStartState);
-    shouldBeEqual(mapping->int2nfaStatePtr[0], nfaStartState);
-    long long tmpNFAState = (long long)nfaStartState;
-    char nfaStatePtr[sizeof(NFA::State*)];
-    for (size_t i = 0; i < sizeof(NFA::State*); i++) {
-      nfaStatePtr[i] = tmpNFAState & 0xFF;
-      tmpNFAState >>=8;
+    // the NFA::State's bit number is its (creation ordered) id
+    NFA::State *nextState = nfaStartState;
+    while (nextState) {
+      NFAStateMapping::NFAStateNumber aStateNum =
+        mapping->getNFAStateNumber(nextState);
+      shouldBeEqual(aStateNum.stateByte, nextState->id / 8);
+      shouldBeEqual((int)aStateNum.stateBit, 1 << (nextState->id % 8));
+      shouldBeEqual(mapping->getNFAStateFor(nextState->id), nextState);
+      nextState = nextState->out;
     }
-    shouldBeEqual(*hattrie_get(mapping->nfaStatePtr2int,
-                               nfaStatePtr, sizeof(NFA::State*)), 1);
-    shouldNotBeNULL(nfaStartState->out);
-    mapping->getNFAStateNumber(nfaStartState->out);
-    shouldBeEqual(mapping->int2nfaStatePtr[1], nfaStartState->out);
-    tmpNFAState = (long long)(nfaStartState->out);
-    for (size_t i = 0; i < sizeof(NFA::State*); i++) {
-      nfaStatePtr[i] = tmpNFAState & 0xFF;
-      tmpNFAState >>=8;
+    // NFA::States which do not belong to this NFA are rejected
+    NFA::State foreignState = *nfaStartState;
+    try {
+      mapping->getNFAStateNumber(&foreignState);
+      shouldNotReachThisPoint("should have thrown ParserException");
+    } catch (ParserException& e) {
+      shouldReachThisPoint();
     }
-    shouldBeEqual(*hattrie_get(mapping->nfaStatePtr2int,
-                               nfaStatePtr, sizeof(NFA::State*)), 2);
-
-    shouldBeNULL(mapping->int2nfaStatePtr[2]);
-    shouldBeEqual(mapping->numKnownNFAStates, 2);
-    NFAStateMapping::NFAStateNumber aStateNum =
-      mapping->getNFAStateNumber(nfaStartState);
-    shouldBeEqual(mapping->numKnownNFAStates, 2);
-    shouldBeEqual(aStateNum.stateByte, 0);
-    shouldBeEqual((int)aStateNum.stateBit, 1);
-    aStateNum = mapping->getNFAStateNumber(nfaStartState->out);
-    shouldBeEqual(mapping->numKnownNFAStates, 2);
-    shouldBeEqual(aStateNum.stateByte, 0);
-    shouldBeEqual((int)aStateNum.stateBit, 2);
-    NFA::State *nextState = nfaStartState->out;
-    shouldNotBeNULL(nextState);
-    aStateNum = mapping->getNFAStateNumber(nextState->out);
-    shouldBeEqual(mapping->numKnownNFAStates, 3);
-    shouldBeEqual(aStateNum.stateByte, 0);
-    shouldBeEqual((int)aStateNum.stateBit, 4);
-    nextState = nextState->out;
-    shouldNotBeNULL(nextState);
-    aStateNum = mapping->getNFAStateNumber(nextState->out);
-    shouldBeEqual(mapping->numKnownNFAStates, 4);
-    shouldBeEqual(aStateNum.stateByte, 0);
-    shouldBeEqual((int)aStateNum.stateBit, 8);
     // stateMapper is owned by allocator
     delete allocator;
     delete nfaBuilder;
@@ -0,0 +1,121 @@
+#include <string.h>
+#include <stdio.h>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include <dynUtf8Parser/dfa/packratMemo.h>
+
+namespace DeterministicFiniteAutomaton {
+
+/// \brief Test the PackratMemo class.
+describe(DFA_PackratMemo) {
+
+  specSize(PackratMemo);
+  specSize(PackratMemo::Entry);
+
+  it("Should create a disabled instance") {
+    PackratMemo *memo = new PackratMemo();
+    shouldNotBeNULL(memo);
+    shouldBeFalse(memo->isEnabled());
+    shouldBeNULL(memo->entries);
+    shouldBeNULL(memo->lookup(1, 0));
+    // nothing is recorded while disabled
+    memo->recordFailure(1, 0);
+    shouldBeZero(memo->getNumEntries());
+    shouldBeEqual(memo->getNumLookups(), 1);
+    shouldBeZero(memo->getNumHits());
+    delete memo;
+  } endIt();
+
+  it("Should record matches and failures") {
+    PackratMemo *memo = new PackratMemo();
+    shouldNotBeNULL(memo);
+    memo->setBudget(1024*1024);
+    shouldBeTrue(memo->isEnabled());
+    Token *token = new Token(2, "ab");
+    memo->recordMatch(1, 3, 5, token);
+    memo->recordMatch(2, 3, 4, NULL);
+    memo->recordFailure(1, 4);
+    shouldBeEqual(memo->getNumEntries(), 3);
+    shouldBeEqual(memo->entriesSize, PackratMemo::initialNumEntries);
+    shouldBeEqual(memo->getNumBytes(),
+      PackratMemo::initialNumEntries*sizeof(PackratMemo::Entry) +
+      sizeof(Token));
+    const PackratMemo::Entry *entry = memo->lookup(1, 3);
+    shouldNotBeNULL(entry);
+    shouldBeTrue(entry->matched);
+    shouldBeEqual(entry->endOffset, 5);
+    shouldNotBeNULL(entry->token);
+    shouldNotBeEqual(entry->token, token);
+    shouldBeTrue(entry->token->ASSERT_EQUALS(2, "ab"));
+    entry = memo->lookup(2, 3);
+    shouldNotBeNULL(entry);
+    shouldBeTrue(entry->matched);
+    shouldBeNULL(entry->token);
+    entry = memo->lookup(1, 4);
+    shouldNotBeNULL(entry);
+    shouldBeFalse(entry->matched);
+    shouldBeNULL(memo->lookup(2, 4));
+    shouldBeEqual(memo->getNumLookups(), 4);
+    shouldBeEqual(memo->getNumHits(), 3);
+    // the first outcome recorded is kept
+    memo->recordFailure(1, 3);
+    entry = memo->lookup(1, 3);
+    shouldBeTrue(entry->matched);
+    memo->clear();
+    shouldBeZero(memo->getNumEntries());
+    shouldBeZero(memo->tokenBytes);
+    shouldBeNULL(memo->lookup(1, 3));
+    delete token;
+    delete memo;
+  } endIt();
+
+  it("Should share (rather than copy) tokens on request") {
+    PackratMemo *memo = new PackratMemo();
+    shouldNotBeNULL(memo);
+    memo->setBudget(1024*1024);
+    Token *token = new Token(2, "ab");
+    token->addChildToken(token);
+    memo->recordMatch(1, 3, 5, token, true);
+    shouldBeEqual(memo->getNumBytes(),
+      PackratMemo::initialNumEntries*sizeof(PackratMemo::Entry));
+    const PackratMemo::Entry *entry = memo->lookup(1, 3);
+    shouldNotBeNULL(entry);
+    shouldBeEqual(entry->token, token);
+    shouldBeFalse(entry->ownsToken);
+    // a shared token is not deleted by the memo
+    memo->clear();
+    shouldBeTrue(token->hasChildren(1));
+    delete token;
+    delete memo;
+  } endIt();
+
+  it("Should grow and then flush when over budget") {
+    PackratMemo *memo = new PackratMemo();
+    shouldNotBeNULL(memo);
+    size_t budget = 4*PackratMemo::initialNumEntries*sizeof(PackratMemo::Entry);
+    memo->setBudget(budget);
+    for (size_t i = 0; i < 1000; i++) {
+      memo->recordFailure(1, i);
+      shouldBeTrue(memo->getNumBytes() <= budget);
+    }
+    shouldBeEqual(memo->entriesSize, 4*PackratMemo::initialNumEntries);
+    shouldBeTrue(0 < memo->getNumFlushes());
+    // the most recent outcomes are still known
+    shouldNotBeNULL(memo->lookup(1, 999));
+    shouldBeTrue(memo->getNumEntries() < 1000);
+    memo->resetStatistics();
+    shouldBeZero(memo->getNumFlushes());
+    shouldBeZero(memo->getNumLookups());
+    memo->setBudget(0);
+    shouldBeZero(memo->getNumEntries());
+    delete memo;
+  } endIt();
+
+} endDescribe(DFA_PackratMemo);
+
+}; // namespace DeterministicFiniteAutomaton
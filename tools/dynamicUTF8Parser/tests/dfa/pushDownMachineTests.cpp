@@ -10,9 +10,123 @@
 
 #include "dynUtf8Parser/nfaBuilder.h"
 #include "dynUtf8Parser/dfa/pushDownMachine.h"
+#include "../allocationCounter.h"
 
 using namespace DeterministicFiniteAutomaton;
 
+/// \brief A TokenVisitor which records (and retracts) the events
+/// reported to it.
+class RecordingVisitor : public TokenVisitor {
+  public:
+    typedef struct Event {
+      char   type;
+      size_t id;
+      size_t start;
+      size_t end;
+    } Event;
+
+    RecordingVisitor(void) {
+      numRetractions = 0;
+    }
+
+    void enterToken(NFA::StartStateId startStateId, size_t start) {
+      addEvent('e', startStateId, start, start);
+    }
+
+    void leafToken(Token::TokenId tokenId, size_t start, size_t end) {
+      addEvent('f', tokenId, start, end);
+    }
+
+    void leaveToken(Token::TokenId tokenId, size_t start, size_t end) {
+      addEvent('l', tokenId, start, end);
+    }
+
+    void retractEvents(size_t numEvents) {
+      numRetractions++;
+      while (numEvents < events.getNumItems()) events.popItem();
+    }
+
+    void addEvent(char type, size_t id, size_t start, size_t end) {
+      Event event;
+      event.type  = type;
+      event.id    = id;
+      event.start = start;
+      event.end   = end;
+      events.pushItem(event);
+    }
+
+    bool hasEvent(size_t i, char type, size_t id,
+                  size_t start, size_t end) {
+      Event noEvent;
+      memset(&noEvent, 0, sizeof(Event));
+      Event event = events.getItem(i, noEvent);
+      return (event.type == type) && (event.id == id) &&
+        (event.start == start) && (event.end == end);
+    }
+
+    VarArray<Event> events;
+    size_t numRetractions;
+};
+
+/// \brief A TokenVisitor which (like a streaming consumer) holds only
+/// the events which have not yet been committed, releasing the rest.
+class ReleasingVisitor : public TokenVisitor {
+  public:
+    ReleasingVisitor(void) {
+      numReleased = 0;
+      numLeaves   = 0;
+      maxHeld     = 0;
+    }
+
+    void enterToken(NFA::StartStateId startStateId, size_t start) {
+      holdEvent('e');
+    }
+
+    void leafToken(Token::TokenId tokenId, size_t start, size_t end) {
+      holdEvent('f');
+    }
+
+    void leaveToken(Token::TokenId tokenId, size_t start, size_t end) {
+      holdEvent('l');
+    }
+
+    void retractEvents(size_t numEvents) {
+      if (numEvents < numReleased) {
+        // (only the failure of the whole run retracts released events)
+        numReleased = 0;
+        while (held.getNumItems()) held.popItem();
+        return;
+      }
+      while (numEvents - numReleased < held.getNumItems()) held.popItem();
+    }
+
+    void commitEvents(size_t numEvents) {
+      commits.pushItem(numEvents);
+      // act upon (and release) the committed events
+      size_t numToRelease = numEvents - numReleased;
+      for (size_t i = 0; i < numToRelease; i++) {
+        if (held.getItem(i, 0) == 'f') numLeaves++;
+      }
+      size_t numKept = held.getNumItems() - numToRelease;
+      for (size_t i = 0; i < numKept; i++) {
+        held.setItem(i, held.getItem(numToRelease + i, 0));
+      }
+      while (numKept < held.getNumItems()) held.popItem();
+      numReleased = numEvents;
+    }
+
+    void holdEvent(char type) {
+      held.pushItem(type);
+      if (maxHeld < held.getNumItems()) maxHeld = held.getNumItems();
+    }
+
+    VarArray<char> held;
+    VarArray<size_t> commits;
+    size_t numReleased;
+    size_t numLeaves;
+    size_t maxHeld;
+};
+
 /// \brief We test the AutomataState class.
 describe(DFA_PushDownMachine) {
 
@@ -33,12 +147,542 @@ describe(DFA_PushDownMachine) {
     shouldBeEqual(pdm->dfa, dfa);
     shouldBeEqual(pdm->nfa, nfa);
     shouldBeEqual(pdm->allocator, dfa->allocator);
-    shouldBeNULL(pdm->curState.token);
     shouldBeNULL(pdm->curState.stream);
-    shouldBeNULL(pdm->curState.iterator);
-    shouldBeNULL(pdm->curState.dState);
+    shouldBeZero(pdm->curState.nextReStart);
+    shouldBeNULL(pdm->curState.stateRecord);
     shouldBeNULL(pdm->curState.allocator);
     shouldBeZero(pdm->stack.getNumItems());
+    shouldBeEqual(pdm->stack.framesSize,
+                  PushDownMachine::AutomataStack::initialNumFrames);
+    shouldBeZero(pdm->tokenBuilder.getNumItems());
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should grow the AutomataStack geometrically") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    Utf8Chars *someChars = new Utf8Chars("abab");
+    pdm->curState.initialize(dfa, someChars, nfa->findStartStateId("start"));
+    for (size_t i = 0; i < 1000; i++) {
+      pdm->curState.startToken(i);
+      pdm->pushCurState();
+    }
+    shouldBeEqual(pdm->stack.getNumItems(), 1000);
+    shouldBeEqual(pdm->stack.framesSize,
+                  16*PushDownMachine::AutomataStack::initialNumFrames);
+    shouldBeTrue(pdm->stack.invariant());
+    shouldBeEqual(pdm->stack.getTop().tokenStart, 999);
+    shouldBeEqual(pdm->stack.getFrame(10).tokenStart, 10);
+    for (size_t i = 1000; 0 < i; i--) {
+      shouldBeEqual(pdm->stack.popFrame().tokenStart, i-1);
+    }
+    shouldBeZero(pdm->stack.getNumItems());
+    pdm->curState.clear();
+    delete someChars;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should build nested tokens using the token builder") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({a}{a}c|{b}{a})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    Utf8Chars *someChars = new Utf8Chars("aac");
+    Token *aToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "aac"));
+    shouldBeTrue(aToken->hasChildren(2));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(2, "a"));
+    shouldBeTrue(aToken->tokens.getItem(1, NULL)->ASSERT_EQUALS(2, "a"));
+    shouldBeZero(pdm->stack.getNumItems());
+    shouldBeZero(pdm->tokenBuilder.getNumItems());
+    delete aToken;
+    delete someChars;
+    // backtracking discards the tokens of the failed path
+    someChars = new Utf8Chars("ba");
+    aToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->hasChildren(2));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(3, "b"));
+    shouldBeTrue(aToken->tokens.getItem(1, NULL)->ASSERT_EQUALS(2, "a"));
+    delete aToken;
+    delete someChars;
+    // a failed parse leaves no tokens behind
+    someChars = new Utf8Chars("aa");
+    aToken = pdm->runFromUsing("start", someChars);
+    shouldBeNULL(aToken);
+    shouldBeZero(pdm->tokenBuilder.getNumItems());
+    delete someChars;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should memoize the outcome of each rule at each offset") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("f", "ab", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("r", "{f}c", 6);
+    nfaBuilder->compileRegularExpressionForTokenId("s", "{f}d", 7);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q}|{r}|{s})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    shouldBeFalse(pdm->getMemo()->isEnabled());
+    Utf8Chars *someChars = new Utf8Chars("aad");
+    Token *unMemoizedToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(unMemoizedToken);
+    shouldBeZero(pdm->getMemo()->getNumLookups());
+    // q reuses the two {a} matched (at offsets 0 and 1) by p
+    pdm->setMemoBudget(1024*1024);
+    Token *aToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "aad"));
+    shouldBeTrue(aToken->hasChildren(1));
+    Token *childToken = aToken->tokens.getItem(0, NULL);
+    shouldBeTrue(childToken->ASSERT_EQUALS(5, "aad"));
+    shouldBeTrue(childToken->hasChildren(2));
+    shouldBeTrue(childToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(2, "a"));
+    shouldBeTrue(childToken->tokens.getItem(1, NULL)->ASSERT_EQUALS(2, "a"));
+    shouldBeEqual(aToken->countTokens(), unMemoizedToken->countTokens());
+    shouldBeEqual(pdm->getMemo()->getNumHits(), 2);
+    shouldBeZero(pdm->stack.getNumItems());
+    shouldBeZero(pdm->tokenBuilder.getNumItems());
+    delete aToken;
+    delete unMemoizedToken;
+    delete someChars;
+    // s reuses the failure of {f} (at offset 0) in r
+    pdm->getMemo()->resetStatistics();
+    someChars = new Utf8Chars("ax");
+    aToken = pdm->runFromUsing("start", someChars);
+    shouldBeNULL(aToken);
+    shouldBeTrue(0 < pdm->getMemo()->getNumHits());
+    shouldBeZero(pdm->tokenBuilder.getNumItems());
+    delete someChars;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should allocate every token of a run in a TokenArena") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 3, true);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{ws}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{ws}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    shouldBeNULL(pdm->getTokenArena());
+    TokenArena *arena = new TokenArena();
+    pdm->setTokenArena(arena);
+    shouldBeEqual(pdm->getTokenArena(), arena);
+    Utf8Chars *someChars = new Utf8Chars("axad");
+    for (size_t memoize = 0; memoize < 2; memoize++) {
+      pdm->setMemoBudget(memoize*1024*1024);
+      Token *aToken = pdm->runFromUsing("start", someChars);
+      shouldNotBeNULL(aToken);
+      shouldBeTrue(aToken->ASSERT_EQUALS(1, "axad"));
+      Token *childToken = aToken->tokens.getItem(0, NULL);
+      shouldBeTrue(childToken->ASSERT_EQUALS(5, "axad"));
+      shouldBeTrue(childToken->hasChildren(2));
+      shouldBeTrue(childToken->tokens.getItem(1, NULL)->ASSERT_EQUALS(2, "a"));
+      // the discarded tokens are also in the arena
+      // (but the ignored tokens are never built)
+      shouldBeEqual(arena->getNumTokens(), (memoize ? 4 : 6));
+      if (memoize) {
+        // q shares (rather than copies) the {a} matched by p
+        const PackratMemo::Entry *entry =
+          pdm->getMemo()->lookup(nfa->findStartStateId("a"), 0);
+        shouldNotBeNULL(entry);
+        shouldBeEqual(entry->token, childToken->tokens.getItem(0, NULL));
+      }
+      shouldBeZero(pdm->tokenBuilder.getNumItems());
+      // the whole tree is released at once
+      arena->reset();
+    }
+    delete someChars;
+    someChars = new Utf8Chars("axay");
+    shouldBeNULL(pdm->runFromUsing("start", someChars));
+    arena->reset();
+    delete someChars;
+    delete arena;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should build a FlatTokenTree directly") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 3, true);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{ws}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{ws}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    FlatTokenTree *tree = new FlatTokenTree();
+    const char *cString = "axad";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    for (size_t memoize = 0; memoize < 2; memoize++) {
+      pdm->setMemoBudget(memoize*1024*1024);
+      shouldBeTrue(pdm->runFromUsingInto(nfa->findStartStateId("start"),
+                                         someChars, tree));
+      // the Nodes of p (and the ignored {ws}) have been discarded
+      shouldBeEqual(tree->getNumNodes(), 4);
+      size_t root = tree->getRoot();
+      shouldBeEqual(root, 3);
+      const FlatTokenTree::Node *node = tree->getNode(root);
+      shouldBeEqual(node->tokenId, 1);
+      shouldBeZero(node->start);
+      shouldBeEqual(node->end, 4);
+      shouldBeEqual(tree->getTextStart(root), cString);
+      shouldBeEqual(tree->getNumChildren(root), 1);
+      size_t child = node->firstChild;
+      shouldBeEqual(tree->getNode(child)->tokenId, 5);
+      shouldBeEqual(tree->getNumChildren(child), 2);
+      size_t grandChild = tree->getNode(child)->firstChild;
+      shouldBeEqual(tree->getNode(grandChild)->tokenId, 2);
+      grandChild = tree->getNode(grandChild)->nextSibling;
+      shouldBeEqual(tree->getNode(grandChild)->start, 2);
+      shouldBeEqual(tree->getTextLength(grandChild), 1);
+      shouldBeZero(pdm->flatBuilder.getNumItems());
+      shouldBeZero(pdm->tokenBuilder.getNumItems());
+      shouldBeNULL(pdm->flatTree);
+    }
+    delete someChars;
+    someChars = new Utf8Chars("axay");
+    shouldBeFalse(pdm->runFromUsingInto(nfa->findStartStateId("start"),
+                                        someChars, tree));
+    shouldBeZero(tree->getNumNodes());
+    shouldBeEqual(tree->getRoot(), FlatTokenTree::noNode);
+    delete someChars;
+    delete tree;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should report tokens to a TokenVisitor") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 3, true);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{ws}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{ws}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q})", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    NFA::StartStateId startId = nfa->findStartStateId("start");
+    NFA::StartStateId qId = nfa->findStartStateId("q");
+    NFA::StartStateId aId = nfa->findStartStateId("a");
+    Utf8Chars *someChars = new Utf8Chars("axad");
+    for (size_t memoize = 0; memoize < 2; memoize++) {
+      RecordingVisitor visitor;
+      pdm->setMemoBudget(memoize*1024*1024);
+      shouldBeTrue(pdm->runFromUsingVisiting(startId, someChars, &visitor));
+      // the events of p (and of the ignored {ws}) have been retracted
+      shouldBeTrue(0 < visitor.numRetractions);
+      shouldBeEqual(visitor.events.getNumItems(), 8);
+      shouldBeTrue(visitor.hasEvent(0, 'e', startId, 0, 0));
+      shouldBeTrue(visitor.hasEvent(1, 'e', qId, 0, 0));
+      shouldBeTrue(visitor.hasEvent(2, 'e', aId, 0, 0));
+      shouldBeTrue(visitor.hasEvent(3, 'f', 2, 0, 1));
+      shouldBeTrue(visitor.hasEvent(4, 'e', aId, 2, 2));
+      shouldBeTrue(visitor.hasEvent(5, 'f', 2, 2, 3));
+      shouldBeTrue(visitor.hasEvent(6, 'l', 5, 0, 4));
+      shouldBeTrue(visitor.hasEvent(7, 'l', 1, 0, 4));
+      shouldBeZero(pdm->tokenBuilder.getNumItems());
+      shouldBeNULL(pdm->visitor);
+    }
+    delete someChars;
+    // a failed run retracts every event
+    someChars = new Utf8Chars("axay");
+    RecordingVisitor visitor;
+    shouldBeFalse(pdm->runFromUsingVisiting(startId, someChars, &visitor));
+    shouldBeZero(visitor.events.getNumItems());
+    delete someChars;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should commit events part way through a run") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 4, true);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "{a}{b}{ws}{a}{b}", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    NFA::StartStateId startId = nfa->findStartStateId("start");
+    Utf8Chars *someChars = new Utf8Chars("abxxab");
+    ReleasingVisitor visitor;
+    shouldBeTrue(pdm->runFromUsingVisiting(startId, someChars, &visitor));
+    // the start token's enterToken event and each (closed) child
+    // token's events are committed as soon as the child matches
+    // (the events of the ignored {ws} are retracted, not committed)
+    shouldBeEqual(visitor.commits.getNumItems(), 5);
+    shouldBeEqual(visitor.commits.getItem(0, 0), 3);
+    shouldBeEqual(visitor.commits.getItem(1, 0), 5);
+    shouldBeEqual(visitor.commits.getItem(2, 0), 7);
+    shouldBeEqual(visitor.commits.getItem(3, 0), 9);
+    shouldBeEqual(visitor.commits.getItem(4, 0), 10);
+    shouldBeEqual(visitor.numLeaves, 4);
+    shouldBeZero(visitor.held.getNumItems());
+    shouldBeTrue(visitor.maxHeld <= 3);
+    delete someChars;
+    // a failed run retracts every (even committed) event
+    someChars = new Utf8Chars("abxxay");
+    ReleasingVisitor failedVisitor;
+    shouldBeFalse(pdm->runFromUsingVisiting(startId, someChars,
+                                            &failedVisitor));
+    shouldBeTrue(0 < failedVisitor.commits.getNumItems());
+    shouldBeZero(failedVisitor.numReleased);
+    shouldBeZero(failedVisitor.held.getNumItems());
+    delete someChars;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should make no heap allocations once warmed up") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 3, true);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{ws}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{ws}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q})*", 1);
+    NFA::StartStateId startId = nfa->findStartStateId("start");
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    TokenArena *arena = new TokenArena();
+    FlatTokenTree *flatTree = new FlatTokenTree();
+    RecordingVisitor visitor;
+    Utf8Chars *someChars = new Utf8Chars("axxadaxacaxxxad");
+    for (size_t memoize = 0; memoize < 2; memoize++) {
+      pdm->setMemoBudget(memoize*1024*1024);
+      // the first (warm up) run of each kind may allocate
+      for (size_t run = 0; run < 2; run++) {
+        pdm->setTokenArena(arena);
+        startCountingAllocations();
+        Token *aToken = pdm->runFromUsing(startId, someChars);
+        size_t numAllocations = stopCountingAllocations();
+        shouldNotBeNULL(aToken);
+        shouldBeTrue(aToken->hasChildren(3));
+        if (run) shouldBeZero(numAllocations);
+        arena->reset();
+        pdm->setTokenArena(NULL);
+        startCountingAllocations();
+        bool matched = pdm->runFromUsingInto(startId, someChars, flatTree);
+        numAllocations = stopCountingAllocations();
+        shouldBeTrue(matched);
+        shouldBeEqual(flatTree->getNumChildren(flatTree->getRoot()), 3);
+        if (run) shouldBeZero(numAllocations);
+        visitor.retractEvents(0);
+        startCountingAllocations();
+        matched = pdm->runFromUsingVisiting(startId, someChars, &visitor);
+        numAllocations = stopCountingAllocations();
+        shouldBeTrue(matched);
+        shouldBeTrue(visitor.hasEvent(0, 'e', startId, 0, 0));
+        if (run) shouldBeZero(numAllocations);
+      }
+    }
+    delete someChars;
+    delete flatTree;
+    delete arena;
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should parse a document fed in chunks") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "(a|€)", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("ws", "x+", 3, true);
+    nfaBuilder->compileRegularExpressionForTokenId("p", "{a}{ws}{a}c", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("q", "{a}{ws}{a}d", 5);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({p}|{q})*", 1);
+    nfaBuilder->compileRegularExpressionForTokenId("plain", "(ax+)*d", 6);
+    NFA::StartStateId startId = nfa->findStartStateId("start");
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    shouldBeEqual(pdm->getPushStatus(), PushDownMachine::PushIdle);
+    shouldBeEqual(pdm->feed("a", 1), PushDownMachine::PushIdle);
+    // the (euro sign's) bytes are fed one at a time
+    const char *cString = "axx€daxacaxxxad";
+    size_t numBytes = strlen(cString);
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    RecordingVisitor pullVisitor;
+    shouldBeTrue(pdm->runFromUsingVisiting(startId, someChars, &pullVisitor));
+    delete someChars;
+    RecordingVisitor visitor;
+    pdm->startPushing(startId, &visitor);
+    shouldBeEqual(pdm->getPushStatus(), PushDownMachine::PushSuspended);
+    for (size_t i = 0; i < numBytes; i++) {
+      shouldBeEqual(pdm->feed(cString + i, 1), PushDownMachine::PushSuspended);
+    }
+    shouldBeEqual(pdm->finish(), PushDownMachine::PushMatched);
+    shouldBeEqual(pdm->finish(), PushDownMachine::PushMatched);
+    shouldBeNULL(pdm->visitor);
+    shouldBeEqual(visitor.events.getNumItems(), pullVisitor.events.getNumItems());
+    for (size_t i = 0; i < visitor.events.getNumItems(); i++) {
+      RecordingVisitor::Event event = pullVisitor.events.getItem(i, event);
+      shouldBeTrue(visitor.hasEvent(i, event.type, event.id,
+                                    event.start, event.end));
+    }
+    shouldBeTrue(visitor.hasEvent(visitor.events.getNumItems()-1,
+                                  'l', 1, 0, numBytes));
+    // a document can fail before it is finished
+    pdm->startPushing(startId, &visitor);
+    shouldBeEqual(pdm->feed("axay", 4), PushDownMachine::PushFailed);
+    shouldBeZero(visitor.events.getNumItems());
+    shouldBeEqual(pdm->feed("d", 1), PushDownMachine::PushFailed);
+    // ... or end part way through a UTF8 character
+    pdm->startPushing(startId, &visitor);
+    shouldBeEqual(pdm->feed("axad\xE2\x82", 6), PushDownMachine::PushSuspended);
+    shouldBeEqual(pdm->finish(), PushDownMachine::PushFailed);
+    shouldBeZero(visitor.events.getNumItems());
+    // the bytes which will never be read again are discarded
+    pdm->startPushing(nfa->findStartStateId("plain"), &visitor);
+    for (size_t i = 0; i < 2000; i++) {
+      shouldBeEqual(pdm->feed("axxx", 4), PushDownMachine::PushSuspended);
+    }
+    shouldBeTrue(pdm->getPushStream()->getNumBytes() < 4*1000);
+    shouldBeTrue(0 < pdm->getPushStream()->getNumDiscardedBytes());
+    shouldBeEqual(pdm->feed("d", 1), PushDownMachine::PushSuspended);
+    shouldBeEqual(pdm->finish(), PushDownMachine::PushMatched);
+    shouldBeTrue(visitor.hasEvent(1, 'f', 6, 0, 8001));
+    delete pdm;
+    delete dfa;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  it("Should not try ReStarts which can not start with the next character") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("a", "a", 2);
+    nfaBuilder->compileRegularExpressionForTokenId("b", "b", 3);
+    nfaBuilder->compileRegularExpressionForTokenId("opt", "x*", 4);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "({a}|{b}|{opt}c)", 1);
+    DFA *dfa = new DFA(nfa);
+    shouldNotBeNULL(dfa);
+    PushDownMachine *pdm = new PushDownMachine(dfa);
+    shouldNotBeNULL(pdm);
+    shouldBeZero(pdm->getNumPrunedReStarts());
+    // only {b} and the nullable {opt} can start with a b
+    Utf8Chars *someChars = new Utf8Chars("b");
+    Token *aToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->hasChildren(1));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(3, "b"));
+    shouldBeEqual(pdm->getNumPrunedReStarts(), 1);
+    delete aToken;
+    delete someChars;
+    // the nullable {opt} is always tried
+    pdm->resetPrunedReStarts();
+    someChars = new Utf8Chars("c");
+    aToken = pdm->runFromUsing("start", someChars);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "c"));
+    shouldBeEqual(pdm->getNumPrunedReStarts(), 2);
+    delete aToken;
+    delete someChars;
     delete pdm;
     delete dfa;
     delete nfaBuilder;
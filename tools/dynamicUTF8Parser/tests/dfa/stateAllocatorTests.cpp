@@ -32,8 +32,11 @@ describe(DFA_StateAllocator) {
     shouldNotBeNULL(allocator);
     shouldBeEqual(allocator->nfa, nfa);
     shouldNotBeNULL(allocator->nfaStateMapping);
-    shouldBeEqual(allocator->stateSize, 2); // at most 16 NFA state bits
-    shouldNotBeNULL(allocator->stateAllocator);
+    // at most 16 NFA state bits padded to a 32 byte bit set
+    shouldBeEqual(allocator->stateSize, 32);
+    shouldBeEqual(allocator->stateWords, 4);
+    shouldBeZero(allocator->stateBlocks.getNumItems());
+    shouldBeTrue(StateAllocator::supportsBitSetKernels(StateAllocator::WordKernels));
     shouldBeZero(allocator->allocatedUnusedStack.getNumItems());
     delete allocator;
     delete nfaBuilder;
@@ -121,6 +124,90 @@ describe(DFA_StateAllocator) {
     delete classifier;
   } endIt();
 
+  /// Show that DFA::States are aligned and padded.
+  it("Allocate aligned States") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    nfaBuilder->compileRegularExpressionForTokenId("start", "(abab|abbb)", 1);
+    StateAllocator *allocator = new StateAllocator(nfa);
+    shouldNotBeNULL(allocator);
+    for (size_t i = 0; i < 50; i++) {
+      State *aState = allocator->allocateANewState();
+      shouldNotBeNULL((void*)aState);
+      shouldBeZero(((size_t)aState) % StateAllocator::stateAlignment);
+      shouldBeTrue(allocator->isStateEmpty(aState));
+    }
+    shouldBeEqual(allocator->stateBlocks.getNumItems(), 3);
+    delete allocator;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
+  /// Show that every supported BitSetKernels implementation computes
+  /// the same results, including for bits in the last word of a
+  /// multi-vector bit set.
+  it("Bit set methods agree for all BitSetKernels") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    shouldNotBeNULL(nfa);
+    NFABuilder *nfaBuilder = new NFABuilder(nfa);
+    shouldNotBeNULL(nfaBuilder);
+    // a regular expression with more than 256 NFA::States
+    char longRegExp[301];
+    memset(longRegExp, 'a', 300);
+    longRegExp[300] = 0;
+    nfaBuilder->compileRegularExpressionForTokenId("start", longRegExp, 1);
+    StateAllocator *allocator = new StateAllocator(nfa);
+    shouldNotBeNULL(allocator);
+    shouldBeEqual(allocator->stateSize, 64);
+    for (size_t kernels = StateAllocator::WordKernels;
+         kernels <= StateAllocator::AVX2Kernels; kernels++) {
+      StateAllocator::BitSetKernels someKernels =
+        (StateAllocator::BitSetKernels)kernels;
+      if (!StateAllocator::supportsBitSetKernels(someKernels)) {
+        shouldBeFalse(allocator->useBitSetKernels(someKernels));
+        continue;
+      }
+      shouldBeTrue(allocator->useBitSetKernels(someKernels));
+      shouldBeEqual(allocator->getBitSetKernels(), someKernels);
+      State *aState     = allocator->allocateANewState();
+      State *otherState = allocator->allocateANewState();
+      shouldBeTrue(allocator->isStateEmpty(aState));
+      shouldBeTrue(allocator->isSubStateOf(aState, otherState));
+      aState[61] = 4;
+      shouldBeFalse(allocator->isStateEmpty(aState));
+      shouldBeFalse(allocator->isSubStateOf(aState, otherState));
+      shouldBeTrue(allocator->isSubStateOf(otherState, aState));
+      otherState[3] = 1;
+      allocator->mergeStateWith(otherState, aState);
+      shouldBeEqual((int)otherState[3], 1);
+      shouldBeEqual((int)otherState[61], 4);
+      for (size_t i = 0; i < allocator->stateSize; i++) {
+        if ((i == 3) || (i == 61)) continue;
+        shouldBeZero((int)otherState[i]);
+      }
+      shouldBeTrue(allocator->isSubStateOf(aState, otherState));
+      shouldBeFalse(allocator->isSubStateOf(otherState, aState));
+      State *cloneState = allocator->clone(otherState);
+      shouldBeZero(memcmp(cloneState, otherState, allocator->stateSize));
+      allocator->emptyState(cloneState);
+      shouldBeTrue(allocator->isStateEmpty(cloneState));
+      allocator->unallocateState(cloneState);
+      allocator->unallocateState(otherState);
+      allocator->unallocateState(aState);
+    }
+    delete allocator;
+    delete nfaBuilder;
+    delete nfa;
+    delete classifier;
+  } endIt();
+
   it("Allocate and unallocate lots of states") {
     State *someNewDStates[100];
     Classifier *classifier = new Classifier();
@@ -0,0 +1,77 @@
+#include <string.h>
+#include <stdio.h>
+#include <exception>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include <dynUtf8Parser/nfa.h>
+#include <dynUtf8Parser/flatTokenTree.h>
+
+/// \brief We test the FlatTokenTree class.
+describe(FlatTokenTree) {
+
+  specSize(FlatTokenTree);
+  specSize(FlatTokenTree::Node);
+
+  it("Should create an empty FlatTokenTree") {
+    FlatTokenTree *tree = new FlatTokenTree();
+    shouldNotBeNULL(tree);
+    shouldBeZero(tree->getNumNodes());
+    shouldBeEqual(tree->getRoot(), FlatTokenTree::noNode);
+    shouldBeNULL(tree->getNode(0));
+    shouldBeNULL(tree->getTextStart(0));
+    delete tree;
+  } endIt();
+
+  it("Should link nodes in postorder") {
+    FlatTokenTree *tree = new FlatTokenTree();
+    shouldNotBeNULL(tree);
+    const char *someText = "abc";
+    tree->setText(someText);
+    VarArray<size_t> builder;
+    builder.pushItem(tree->addNode(2, 0, 1, NULL, 0));
+    builder.pushItem(tree->addNode(3, 1, 3, NULL, 0));
+    size_t root = tree->addNode(1, 0, 3, &builder, 0);
+    tree->setRoot(root);
+    shouldBeEqual(root, 2);
+    shouldBeEqual(tree->getNumNodes(), 3);
+    shouldBeEqual(tree->getNumChildren(root), 2);
+    const FlatTokenTree::Node *node = tree->getNode(root);
+    shouldBeEqual(node->tokenId, 1);
+    shouldBeEqual(node->firstChild, 0);
+    shouldBeEqual(node->nextSibling, FlatTokenTree::noNode);
+    node = tree->getNode(node->firstChild);
+    shouldBeEqual(node->tokenId, 2);
+    shouldBeEqual(node->nextSibling, 1);
+    shouldBeEqual(tree->getTextStart(1), someText+1);
+    shouldBeEqual(tree->getTextLength(1), 2);
+    shouldBeEqual(tree->getNodes() + root, tree->getNode(root));
+    // truncating removes the root
+    tree->truncate(1);
+    shouldBeEqual(tree->getNumNodes(), 1);
+    shouldBeEqual(tree->getRoot(), FlatTokenTree::noNode);
+    tree->clear();
+    shouldBeZero(tree->getNumNodes());
+    delete tree;
+  } endIt();
+
+  it("Should grow its array of nodes") {
+    FlatTokenTree *tree = new FlatTokenTree();
+    shouldNotBeNULL(tree);
+    VarArray<size_t> builder;
+    for (size_t i = 0; i < 1000; i++) {
+      builder.pushItem(tree->addNode(i, i, i+1, NULL, 0));
+    }
+    size_t root = tree->addNode(1000, 0, 1000, &builder, 500);
+    shouldBeEqual(tree->nodesSize, 4*FlatTokenTree::initialNumNodes);
+    shouldBeEqual(tree->getNumChildren(root), 500);
+    shouldBeEqual(tree->getNode(root)->firstChild, 500);
+    shouldBeEqual(tree->getNode(999)->nextSibling, FlatTokenTree::noNode);
+    delete tree;
+  } endIt();
+
+} endDescribe(FlatTokenTree);
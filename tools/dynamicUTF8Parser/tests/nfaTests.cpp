@@ -48,11 +48,30 @@ describe(NFA) {
     shouldNotBeNULL(nfa->startStateIds);
     shouldBeZero(nfa->startState.getNumItems());
     shouldBeZero(nfa->numKnownStates);
+    shouldBeZero(nfa->states.getNumItems());
     shouldBeEqual(nfa->utf8Classifier, classifier);
     delete nfa;
     delete classifier;
   } endIt();
 
+  it("should give each NFA::State a dense id") {
+    Classifier *classifier = new Classifier();
+    shouldNotBeNULL(classifier);
+    NFA *nfa = new NFA(classifier);
+    NFA::MatchData noMatchData;
+    noMatchData.c.u = 0;
+    for (size_t i = 0; i < 100; i++) {
+      NFA::State *aState =
+        nfa->addState(NFA::Split, noMatchData, NULL, NULL, "test");
+      shouldBeEqual(aState->id, i);
+      shouldBeEqual(nfa->getState(i), aState);
+      shouldBeEqual(nfa->getNumberStates(), i+1);
+    }
+    shouldBeNULL(nfa->getState(100));
+    delete nfa;
+    delete classifier;
+  } endIt();
+
   it("should be able to register lots of start states") {
     Classifier *classifier = new Classifier();
     shouldNotBeNULL(classifier);
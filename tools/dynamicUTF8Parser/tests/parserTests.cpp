@@ -10,6 +10,7 @@
 #endif
 
 #include <dynUtf8Parser/parser.h>
+#include "allocationCounter.h"
 
 enum ParserTestTokens {
   WhiteSpace=1,
@@ -153,4 +154,402 @@ describe(Parser) {
     delete parser;
   } endIt();
 
+  it("Eagerly compile a Parser and tokenize 'if A then B else C'") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    EagerCompileReport report = parser->getEagerCompileReport("whiteSpace");
+    shouldBeFalse(report.compiled);
+    parser->compile(Parser::Eager);
+    shouldNotBeNULL(parser->dfa);
+    report = parser->getEagerCompileReport("whiteSpace");
+    shouldBeTrue(report.compiled);
+    shouldBeEqual(report.numStates, 3);
+    shouldBeEqual(report.numMinimizedStates, 3);
+    report = parser->getEagerCompileReport("nonWhiteSpace");
+    shouldBeTrue(report.compiled);
+    report = parser->getEagerCompileReport("start");
+    shouldBeFalse(report.compiled);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokenId, 4);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    shouldBeEqual(aToken->tokens.itemArray[1]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[1]->textStart[0], ('i'));
+    shouldBeEqual(aToken->tokens.itemArray[1]->textLength, (2));
+    shouldBeEqual(aToken->tokens.itemArray[12]->tokenId, (1));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Eagerly compile a lazily compiled Parser") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    delete aToken;
+    EagerCompileReport report = parser->getEagerCompileReport("whiteSpace");
+    shouldBeFalse(report.compiled);
+    DFA *lazyDFA = parser->dfa;
+    parser->compile(Parser::Eager);
+    shouldBeEqual(parser->dfa, lazyDFA);
+    report = parser->getEagerCompileReport("whiteSpace");
+    shouldBeTrue(report.compiled);
+    report = parser->getEagerCompileReport("nonWhiteSpace");
+    shouldBeTrue(report.compiled);
+    aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' with a tiny DFA cache budget") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->setCacheBudget(1);
+    shouldBeZero(parser->getNumCacheFlushes());
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    shouldBeEqual(parser->dfa->getCacheBudget(), 1);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(0 < parser->getNumCacheFlushes());
+    shouldBeEqual(aToken->tokenId, 4);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    shouldBeEqual(aToken->tokens.itemArray[5]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textStart[0], ('t'));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textLength, (4));
+    shouldBeEqual(aToken->tokens.itemArray[12]->tokenId, (1));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' memoizing rules") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->setMemoBudget(64*1024);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(0 < parser->getNumMemoLookups());
+    shouldBeTrue(parser->getNumMemoHits() <= parser->getNumMemoLookups());
+    shouldBeEqual(aToken->tokenId, 4);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    shouldBeEqual(aToken->tokens.itemArray[5]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textStart[0], ('t'));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textLength, (4));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' breadth first") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    VarArray<Token*> parses;
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    shouldBeZero(parser->allParsesFromUsing("start", someChars, &parses));
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    shouldBeEqual(parser->allParsesFromUsing("start", someChars, &parses), 1);
+    Token *aToken = parses.getItem(0, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->tokenId, 4);
+    shouldBeEqual(aToken->tokens.getNumItems(), (13));
+    shouldBeEqual(aToken->tokens.itemArray[5]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textStart[0], ('t'));
+    shouldBeEqual(aToken->tokens.itemArray[5]->textLength, (4));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' into a FlatTokenTree") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    FlatTokenTree *tree = new FlatTokenTree();
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    shouldBeFalse(parser->parseFromUsingInto("start", someChars, tree));
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    shouldBeTrue(parser->parseFromUsingInto("start", someChars, tree));
+    shouldBeEqual(tree->getNumNodes(), 14);
+    size_t root = tree->getRoot();
+    shouldBeEqual(tree->getNode(root)->tokenId, 4);
+    shouldBeEqual(tree->getNumChildren(root), 13);
+    // the children precede their parent
+    for (size_t i = 0; i < 13; i++) {
+      shouldBeEqual(tree->getNode(i)->nextSibling, (i < 12 ? i+1 : FlatTokenTree::noNode));
+    }
+    shouldBeEqual(tree->getNode(5)->tokenId, (2));
+    shouldBeEqual(tree->getTextStart(5)[0], ('t'));
+    shouldBeEqual(tree->getTextLength(5), (4));
+    delete someChars;
+    delete tree;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' reporting to a TokenVisitor") {
+    /// \brief A TokenVisitor which counts the (committed) tokens of
+    /// each id.
+    class CountingVisitor : public TokenVisitor {
+      public:
+        void enterToken(NFA::StartStateId startStateId, size_t start) {
+          ids.pushItem(0);
+        }
+        void leafToken(Token::TokenId tokenId, size_t start, size_t end) {
+          ids.pushItem(tokenId);
+        }
+        void leaveToken(Token::TokenId tokenId, size_t start, size_t end) {
+          ids.pushItem(tokenId);
+        }
+        void retractEvents(size_t numEvents) {
+          while (numEvents < ids.getNumItems()) ids.popItem();
+        }
+        size_t count(Token::TokenId tokenId) {
+          size_t numIds = 0;
+          for (size_t i = 0; i < ids.getNumItems(); i++) {
+            if (ids.getItem(i, 0) == tokenId) numIds++;
+          }
+          return numIds;
+        }
+        VarArray<Token::TokenId> ids;
+    };
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    CountingVisitor visitor;
+    shouldBeTrue(parser->parseFromUsingVisiting("start", someChars, &visitor));
+    shouldBeEqual(visitor.ids.getNumItems(), 28);
+    shouldBeEqual(visitor.count(WhiteSpace), 7);
+    shouldBeEqual(visitor.count(NonWhiteSpace), 6);
+    shouldBeEqual(visitor.count(Text), 1);
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' into a TokenArena without allocating") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->setMemoBudget(64*1024);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    shouldBeNULL(parser->pdm);
+    TokenArena *arena = new TokenArena();
+    parser->setTokenArena(arena);
+    const char *cString ="  if A then B else C ";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    // the first (warm up) parse may allocate
+    for (size_t parse = 0; parse < 3; parse++) {
+      startCountingAllocations();
+      Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+      size_t numAllocations = stopCountingAllocations();
+      shouldNotBeNULL(aToken);
+      shouldBeEqual(aToken->tokens.getNumItems(), (13));
+      if (parse) shouldBeZero(numAllocations);
+      arena->reset();
+    }
+    // every parse reuses the same PushDownMachine
+    shouldNotBeNULL(parser->pdm);
+    shouldBeTrue(0 < parser->getNumMemoLookups());
+    delete someChars;
+    delete parser;
+    delete arena;
+  } endIt();
+
+  it("Tokenize 'if A then B else C' fed in chunks") {
+    /// \brief A TokenVisitor which counts the (committed) tokens.
+    class CountingVisitor : public TokenVisitor {
+      public:
+        CountingVisitor(void) {
+          numEvents = 0;
+        }
+        void enterToken(NFA::StartStateId startStateId, size_t start) {
+          numEvents++;
+        }
+        void leafToken(Token::TokenId tokenId, size_t start, size_t end) {
+          numEvents++;
+        }
+        void leaveToken(Token::TokenId tokenId, size_t start, size_t end) {
+          numEvents++;
+        }
+        void retractEvents(size_t someNumEvents) {
+          numEvents = someNumEvents;
+        }
+        size_t numEvents;
+    };
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    CountingVisitor visitor;
+    shouldBeFalse(parser->startPushing("start", &visitor));
+    shouldBeEqual(parser->feed("  if", 4), PushDownMachine::PushIdle);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    shouldBeTrue(parser->startPushing("start", &visitor));
+    shouldBeEqual(parser->feed("  if A th", 9), PushDownMachine::PushSuspended);
+    shouldBeEqual(parser->feed("en B el", 7), PushDownMachine::PushSuspended);
+    shouldBeEqual(parser->feed("se C ", 5), PushDownMachine::PushSuspended);
+    shouldBeEqual(parser->finish(), PushDownMachine::PushMatched);
+    shouldBeEqual(visitor.numEvents, 28);
+    delete parser;
+  } endIt();
+
+  it("Tokenize text containing an embedded NUL") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->classifyWhiteSpace();
+    parser->addRule("whiteSpace", "[whiteSpace]+", WhiteSpace);
+    parser->addRule("nonWhiteSpace", "[!whiteSpace]+", NonWhiteSpace);
+    parser->addRule("start", "({whiteSpace}|{nonWhiteSpace})*", Text);
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    Utf8Chars *someChars = new Utf8Chars("if\0A then", 9);
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeEqual(aToken->textLength, 9);
+    shouldBeEqual(aToken->tokens.getNumItems(), (3));
+    // the NUL does not end the first token
+    shouldBeEqual(aToken->tokens.itemArray[0]->tokenId, (2));
+    shouldBeEqual(aToken->tokens.itemArray[0]->textLength, (4));
+    shouldBeEqual(aToken->tokens.itemArray[2]->textStart[0], ('t'));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Inline the ignored plain rules when compiling a Parser") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->addRuleIgnoreToken("ws", "x+", 2);
+    parser->addRule("word", "a+", 3);
+    parser->addRuleIgnoreToken("sep", "{ws}y", 5);
+    parser->addRule("start", "{word}{ws}b", 1);
+    parser->addRule("other", "{ws}?{word}", 4);
+    parser->addRule("list", "a{sep}b", 6);
+    NFA *nfa = parser->nfa;
+    // {ws} is inlined into sep and start, and then sep into list
+    // ({ws} competes with {word} in other, so is not inlined)
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    NFA::StartStateId wsId  = nfa->findStartStateId("ws");
+    NFA::StartStateId sepId = nfa->findStartStateId("sep");
+    size_t numWSReStarts  = 0;
+    size_t numSepReStarts = 0;
+    for (size_t i = 0; i < nfa->getNumberStates(); i++) {
+      NFA::State *nfaState = nfa->getState(i);
+      if (nfaState->matchType != NFA::ReStart) continue;
+      if (nfaState->matchData.r == wsId)  numWSReStarts++;
+      if (nfaState->matchData.r == sepId) numSepReStarts++;
+    }
+    shouldBeEqual(numWSReStarts, 1);
+    shouldBeZero(numSepReStarts);
+    shouldBeZero(parser->nfa->inlineIgnoredReStarts());
+
+    Utf8Chars *someChars = new Utf8Chars("aaxxb");
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(1, "aaxxb"));
+    shouldBeTrue(aToken->hasChildren(1));
+    shouldBeTrue(aToken->tokens.getItem(0, NULL)->ASSERT_EQUALS(3, "aa"));
+    delete aToken;
+    delete someChars;
+    someChars = new Utf8Chars("axxyb");
+    aToken = parser->parseFromUsing("list", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->ASSERT_EQUALS(6, "axxyb"));
+    shouldBeTrue(aToken->hasChildren(0));
+    delete aToken;
+    delete someChars;
+    someChars = new Utf8Chars("aab");
+    aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldBeNULL(aToken);
+    delete someChars;
+    someChars = new Utf8Chars("xa");
+    aToken = parser->parseFromUsing("other", someChars, NULL);
+    shouldNotBeNULL(aToken);
+    shouldBeTrue(aToken->hasChildren(1));
+    delete aToken;
+    delete someChars;
+    delete parser;
+  } endIt();
+
+  it("Not inline an ignored rule which could consume its successor") {
+    Parser *parser = new Parser();
+    shouldNotBeNULL(parser);
+    parser->addRuleIgnoreToken("ws", "x+", 2);
+    parser->addRule("start", "{ws}xb", 1);
+    NFA *nfa = parser->nfa;
+    // {ws} swallows every x, so start can never match
+    parser->compile();
+    shouldNotBeNULL(parser->dfa);
+    NFA::StartStateId wsId = nfa->findStartStateId("ws");
+    size_t numWSReStarts = 0;
+    for (size_t i = 0; i < nfa->getNumberStates(); i++) {
+      NFA::State *nfaState = nfa->getState(i);
+      if (nfaState->matchType != NFA::ReStart) continue;
+      if (nfaState->matchData.r == wsId) numWSReStarts++;
+    }
+    shouldBeEqual(numWSReStarts, 1);
+    Utf8Chars *someChars = new Utf8Chars("xxb");
+    Token *aToken = parser->parseFromUsing("start", someChars, NULL);
+    shouldBeNULL(aToken);
+    delete someChars;
+    delete parser;
+  } endIt();
+
 } endDescribe(Parser);
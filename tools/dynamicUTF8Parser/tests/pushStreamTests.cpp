@@ -0,0 +1,99 @@
+#include <string.h>
+#include <stdio.h>
+#include <exception>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include <dynUtf8Parser/nfa.h>
+#include <dynUtf8Parser/pushStream.h>
+
+/// \brief We test the PushStream class.
+describe(PushStream) {
+
+  specSize(PushStream);
+
+  it("Should create an empty PushStream") {
+    PushStream *pushStream = new PushStream();
+    shouldNotBeNULL(pushStream);
+    shouldBeZero(pushStream->getNumBytes());
+    shouldBeZero(pushStream->getNumDiscardedBytes());
+    shouldBeFalse(pushStream->isFinished());
+    shouldBeFalse(pushStream->endsMidCharacter());
+    shouldNotBeNULL(pushStream->getStream());
+    shouldBeTrue(pushStream->getStream()->atEnd());
+    pushStream->finish();
+    shouldBeTrue(pushStream->isFinished());
+    pushStream->clear();
+    shouldBeFalse(pushStream->isFinished());
+    delete pushStream;
+  } endIt();
+
+  it("Should hold back an incomplete UTF8 character") {
+    PushStream *pushStream = new PushStream();
+    shouldNotBeNULL(pushStream);
+    // the first two bytes of a euro sign
+    pushStream->append("a\xE2\x82", 3);
+    shouldBeEqual(pushStream->getNumBytes(), 3);
+    shouldBeTrue(pushStream->endsMidCharacter());
+    Utf8Chars *stream = pushStream->getStream();
+    shouldBeEqual(stream->getNumberOfBytesToRead(), 1);
+    shouldBeEqual(stream->nextUtf8Char().c[0], 'a');
+    shouldBeTrue(stream->atEnd());
+    // ... and its last byte
+    pushStream->append("\xAC", 1);
+    shouldBeFalse(pushStream->endsMidCharacter());
+    stream = pushStream->getStream();
+    shouldBeEqual(stream->getNumberOfBytesToRead(), 4);
+    Utf8Chars::Cursor cursor = stream->getCursor();
+    stream->nextUtf8Char(&cursor);
+    utf8Char_t expectedChar = Utf8Chars::codePoint2utf8Char(0x20AC);
+    shouldBeEqual(stream->nextUtf8Char(&cursor).u, expectedChar.u);
+    shouldBeTrue(stream->atEnd(&cursor));
+    delete pushStream;
+  } endIt();
+
+  it("Should discard bytes which will never be read again") {
+    PushStream *pushStream = new PushStream();
+    shouldNotBeNULL(pushStream);
+    pushStream->append("0123456789", 10);
+    Utf8Chars *origStream = pushStream->getStream();
+    // too few bytes to be worth moving
+    pushStream->discardBefore(3);
+    shouldBeZero(pushStream->getNumDiscardedBytes());
+    shouldBeEqual(pushStream->getNumBytes(), 10);
+    pushStream->discardBefore(6);
+    shouldBeEqual(pushStream->getNumDiscardedBytes(), 6);
+    shouldBeEqual(pushStream->getNumBytes(), 4);
+    // the window's Cursors are measured from the start of the document
+    // (the window itself is updated in place)
+    Utf8Chars *stream = pushStream->getStream();
+    shouldBeEqual((void*)stream, (void*)origStream);
+    shouldBeEqual(stream->baseOffset, 6);
+    shouldBeEqual((void*)stream->origUtf8Chars, (void*)pushStream->bytes);
+    Utf8Chars::Cursor cursor = stream->getCursor();
+    shouldBeEqual(cursor.start, 6);
+    shouldBeEqual(cursor.next, 6);
+    shouldBeEqual(stream->nextUtf8Char(&cursor).c[0], '6');
+    shouldBeEqual(cursor.next, 7);
+    shouldBeEqual(stream->getStart(&cursor)[0], '6');
+    // the buffer grows (keeping the discarded offset)
+    char chunk[1000];
+    memset(chunk, 'x', 1000);
+    for (size_t i = 0; i < 10; i++) pushStream->append(chunk, 1000);
+    shouldBeEqual(pushStream->getNumBytes(), 10004);
+    shouldBeEqual(pushStream->bytesSize, 4*PushStream::initialNumBytes);
+    stream = pushStream->getStream();
+    shouldBeEqual((void*)stream, (void*)origStream);
+    shouldBeEqual(stream->baseOffset, 6);
+    cursor = stream->getCursor();
+    cursor.next = 10009;
+    shouldBeEqual(stream->nextUtf8Char(&cursor).c[0], 'x');
+    shouldBeTrue(stream->atEnd(&cursor));
+    delete pushStream;
+  } endIt();
+
+} endDescribe(PushStream);
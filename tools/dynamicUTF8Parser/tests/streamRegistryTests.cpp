@@ -1,5 +1,7 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
 #include <exception>
 
 #include <cUtils/specs/specs.h>
@@ -50,6 +52,31 @@ describe(StreamRegistry) {
     delete someStreams;
   } endIt();
 
+  it("Should own the memory mapped files added to the registry") {
+    char path[] = "/tmp/streamRegistryTestsXXXXXX";
+    int fd = mkstemp(path);
+    shouldBeTrue(0 <= fd);
+    shouldBeEqual(write(fd, "silly", 5), 5);
+    close(fd);
+    StreamRegistry *someStreams = new StreamRegistry();
+    shouldNotBeNULL(someStreams);
+    someStreams->addStream("silly\0sillier", 13);
+    shouldBeEqual(someStreams->streams.getNumItems(), 1);
+    shouldBeEqual(someStreams->streams.getItem(0, NULL)->getNumberOfBytesToRead(), 13);
+    Utf8Chars *aStream = someStreams->addMappedFile(path);
+    shouldNotBeNULL(aStream);
+    shouldBeEqual(someStreams->streams.getNumItems(), 2);
+    shouldBeEqual(someStreams->streams.getItem(1, NULL), aStream);
+    shouldBeTrue(aStream->ownsString);
+    shouldBeTrue(aStream->isMapped);
+    shouldBeEqual(aStream->getNumberOfBytesToRead(), 5);
+    unlink(path);
+    shouldBeNULL(someStreams->addMappedFile(path));
+    shouldBeEqual(someStreams->streams.getNumItems(), 2);
+    // the mapping is unmapped with the registry
+    delete someStreams;
+  } endIt();
+
   it("should be able to add lots of streams") {
     Utf8Chars *prevChars[30];
     StreamRegistry *someStreams = new StreamRegistry();
@@ -0,0 +1,93 @@
+#include <string.h>
+#include <stdio.h>
+#include <exception>
+
+#include <cUtils/specs/specs.h>
+
+#ifndef protected
+#define protected public
+#endif
+
+#include <dynUtf8Parser/tokenArena.h>
+
+/// \brief We test the TokenArena class.
+describe(TokenArena) {
+
+  specSize(TokenArena);
+
+  it("Should create an empty TokenArena") {
+    TokenArena *arena = new TokenArena();
+    shouldNotBeNULL(arena);
+    shouldBeEqual(arena->blockSize, TokenArena::defaultBlockSize);
+    shouldBeZero(arena->getNumTokens());
+    shouldBeZero(arena->getNumBytes());
+    shouldBeZero(arena->getNumBlocks());
+    delete arena;
+  } endIt();
+
+  it("Should build token trees in place") {
+    TokenArena *arena = new TokenArena();
+    shouldNotBeNULL(arena);
+    const char *someText = "abc";
+    VarArray<Token*> children;
+    children.pushItem(NULL);
+    children.pushItem(arena->newToken(2, someText, 1, NULL, 0));
+    children.pushItem(arena->newToken(3, someText+1, 2, NULL, 0));
+    Token *token = arena->newToken(1, someText, 3, &children, 1);
+    shouldNotBeNULL(token);
+    shouldBeTrue(token->ASSERT_EQUALS(1, "abc"));
+    shouldBeTrue(token->hasChildren(2));
+    shouldBeEqual(token->tokens.arraySize, 2);
+    shouldBeTrue(token->tokens.getItem(0, NULL)->ASSERT_EQUALS(2, "a"));
+    shouldBeTrue(token->tokens.getItem(1, NULL)->ASSERT_EQUALS(3, "bc"));
+    shouldBeTrue(token->invariant());
+    // siblings sit next to each other
+    shouldBeEqual((char*)token->tokens.getItem(1, NULL) -
+                  (char*)token->tokens.getItem(0, NULL),
+                  (long)((sizeof(Token) + sizeof(void*) - 1) &
+                         ~(sizeof(void*) - 1)));
+    shouldBeEqual(arena->getNumTokens(), 3);
+    shouldBeEqual(arena->getNumBlocks(), 1);
+    // a heap clone outlives the arena, an arena clone does not
+    Token *heapClone = token->clone();
+    Token *arenaClone = arena->cloneToken(token);
+    shouldBeEqual(arena->getNumTokens(), 6);
+    shouldBeTrue(arenaClone->hasChildren(2));
+    shouldNotBeEqual(arenaClone->tokens.getItem(1, NULL),
+                     token->tokens.getItem(1, NULL));
+    arena->reset();
+    shouldBeZero(arena->getNumTokens());
+    shouldBeZero(arena->getNumBytes());
+    shouldBeEqual(arena->getNumBlocks(), 1);
+    shouldBeTrue(heapClone->hasChildren(2));
+    shouldBeTrue(heapClone->tokens.getItem(1, NULL)->ASSERT_EQUALS(3, "bc"));
+    delete heapClone;
+    delete arena;
+  } endIt();
+
+  it("Should reuse its blocks after a reset") {
+    TokenArena *arena = new TokenArena(16*sizeof(Token));
+    shouldNotBeNULL(arena);
+    for (size_t i = 0; i < 100; i++) {
+      shouldNotBeNULL(arena->newToken(i, "a", 1, NULL, 0));
+    }
+    size_t numBlocks = arena->getNumBlocks();
+    shouldBeTrue(5 < numBlocks);
+    arena->reset();
+    for (size_t i = 0; i < 100; i++) {
+      shouldNotBeNULL(arena->newToken(i, "a", 1, NULL, 0));
+    }
+    shouldBeEqual(arena->getNumBlocks(), numBlocks);
+    // over sized requests get a block of their own
+    VarArray<Token*> children;
+    for (size_t i = 0; i < 100; i++) children.pushItem(NULL);
+    Token *token = arena->newToken(1, "a", 1, &children, 0);
+    shouldBeEqual(token->tokens.getNumItems(), 100);
+    shouldBeEqual(arena->largeBlocks.getNumItems(), 1);
+    shouldBeEqual(arena->getNumBlocks(), numBlocks);
+    arena->reset();
+    shouldBeZero(arena->largeBlocks.getNumItems());
+    delete arena;
+  } endIt();
+
+} endDescribe(TokenArena);
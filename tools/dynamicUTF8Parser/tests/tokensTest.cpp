@@ -183,4 +183,21 @@ describe(Tokens) {
     delete token0;
  } endIt();
 
+  it("Should adopt (without copying) a range of child tokens") {
+    VarArray<Token*> someTokens;
+    Token *child0 = new Token(1, "a");
+    Token *child1 = new Token(2, "b");
+    Token *child2 = new Token(3, "c");
+    someTokens.pushItem(child0);
+    someTokens.pushItem(child1);
+    someTokens.pushItem(child2);
+    Token *token = new Token(4, "abc");
+    token->adoptChildTokens(&someTokens, 1);
+    shouldBeTrue(token->hasChildren(2));
+    shouldBeEqual(token->tokens.itemArray[0], child1);
+    shouldBeEqual(token->tokens.itemArray[1], child2);
+    delete token;
+    delete child0;
+  } endIt();
+
 } endDescribe(Tokens);
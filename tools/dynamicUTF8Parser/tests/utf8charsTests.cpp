@@ -1,5 +1,8 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
 
 #include <cUtils/specs/specs.h>
 
@@ -398,5 +401,137 @@ describe(Utf8Chars) {
     delete someChars;
   } endIt();
 
+  it("Should read a shared Utf8Chars using Cursors") {
+    const char *cString = "some ch€racters";
+    Utf8Chars *someChars = new Utf8Chars(cString);
+    someChars->nextUtf8Char();
+    Utf8Chars::Cursor cursor = someChars->getCursor(false);
+    shouldBeZero(cursor.start);
+    shouldBeEqual(cursor.next, 1);
+    Utf8Chars::Cursor subCursor = someChars->getCursor(true);
+    shouldBeEqual(subCursor.start, 1);
+    shouldBeEqual(subCursor.next, 1);
+    for (size_t i = 1; i < 7; i++) someChars->nextUtf8Char(&cursor);
+    utf8Char_t expectedChar = Utf8Chars::codePoint2utf8Char(0x20AC);
+    shouldBeEqual(someChars->nextUtf8Char(&cursor).u, expectedChar.u);
+    shouldBeEqual(cursor.next, 10);
+    // reading using a Cursor does not move the Utf8Chars itself
+    shouldBeEqual((void*)someChars->nextByte, (void*)(cString+1));
+    someChars->backup(&cursor);
+    shouldBeEqual(cursor.next, 7);
+    shouldBeEqual(someChars->getStart(&cursor), cString);
+    shouldBeEqual(someChars->getNumberOfBytesRead(&cursor), 7);
+    char *text = someChars->getCopyOfTextRead(&cursor);
+    shouldBeZero(strcmp(text, "some ch"));
+    free(text);
+    // a backup never leaves the Cursor's sub stream
+    someChars->backup(&subCursor);
+    shouldBeEqual(subCursor.next, 1);
+    shouldBeZero(someChars->getNumberOfBytesRead(&subCursor));
+    shouldBeFalse(someChars->atEnd(&subCursor));
+    while (someChars->nextUtf8Char(&subCursor).u) ;
+    shouldBeTrue(someChars->atEnd(&subCursor));
+    shouldBeEqual(someChars->getNumberOfBytesRead(&subCursor), strlen(cString)-1);
+    delete someChars;
+  } endIt();
+
+  it("Should read embedded NULs from a pointer and length") {
+    // the trailing 'c' is NOT part of the stream
+    const char *bytes = "a\0bc";
+    Utf8Chars *someChars = new Utf8Chars(bytes, 3);
+    shouldNotBeNULL(someChars);
+    shouldBeFalse(someChars->ownsString);
+    shouldBeEqual((void*)someChars->lastByte, (void*)(bytes+3));
+    shouldBeEqual(someChars->getNumberOfBytesToRead(), 3);
+    shouldBeEqual(someChars->nextUtf8Char().c[0], 'a');
+    // an embedded NUL is NOT the end of the stream
+    utf8Char_t nulChar = someChars->nextUtf8Char();
+    shouldBeEqual(nulChar.c[0], (char)0xC0);
+    shouldBeEqual(nulChar.c[1], (char)0x80);
+    shouldBeEqual(nulChar.c[2], 0);
+    shouldBeFalse(someChars->atEnd());
+    shouldBeEqual(someChars->nextUtf8Char().c[0], 'b');
+    shouldBeTrue(someChars->atEnd());
+    shouldBeZero(someChars->nextUtf8Char().u);
+    someChars->backup();
+    someChars->backup();
+    shouldBeEqual((void*)someChars->nextByte, (void*)(bytes+1));
+    // clones (and Cursors) stop at the same last byte
+    Utf8Chars *clonedChars = someChars->clone(true);
+    shouldBeEqual((void*)clonedChars->lastByte, (void*)(bytes+3));
+    shouldBeEqual(clonedChars->getNumberOfBytesToRead(), 2);
+    delete clonedChars;
+    Utf8Chars::Cursor cursor = someChars->getCursor(false);
+    while (someChars->nextUtf8Char(&cursor).u) ;
+    shouldBeEqual(cursor.next, 3);
+    char *text = someChars->getCopyOfTextToRead(30);
+    shouldBeZero(strlen(text));
+    free(text);
+    delete someChars;
+    // a duplicate is NUL terminated
+    someChars = new Utf8Chars(bytes, 3, Utf8Chars::Duplicate);
+    shouldBeTrue(someChars->ownsString);
+    shouldNotBeEqual((void*)someChars->utf8Chars, (void*)bytes);
+    shouldBeZero(memcmp(someChars->utf8Chars, bytes, 3));
+    shouldBeZero(someChars->lastByte[0]);
+    delete someChars;
+  } endIt();
+
+  it("Should not read past a truncated UTF8 character") {
+    // the trailing byte would complete the euro sign, but is NOT part
+    // of the (3 byte) stream
+    //
+    // (a truncated stream fails the Utf8Chars invariant, so we decode
+    // it directly, as every Utf8Chars and Cursor does in an unchecked
+    // build)
+    const char *bytes    = "a\xE2\x82\xAC";
+    const char *lastByte = bytes + 3;
+    const char *nextByte = bytes;
+    shouldBeEqual(Utf8Chars::decodeUtf8Char(&nextByte, lastByte).c[0], 'a');
+    shouldBeEqual((void*)nextByte, (void*)(bytes+1));
+    shouldBeZero(Utf8Chars::decodeUtf8Char(&nextByte, lastByte).u);
+    shouldBeEqual((void*)nextByte, (void*)lastByte);
+    shouldBeZero(Utf8Chars::decodeUtf8Char(&nextByte, lastByte).u);
+    // ... as is one truncated after its first byte
+    nextByte = bytes + 1;
+    shouldBeZero(Utf8Chars::decodeUtf8Char(&nextByte, bytes + 2).u);
+    shouldBeEqual((void*)nextByte, (void*)(bytes+2));
+  } endIt();
+
+  it("Should read a memory mapped file") {
+    char path[] = "/tmp/utf8charsTestsXXXXXX";
+    int fd = mkstemp(path);
+    shouldBeTrue(0 <= fd);
+    const char *bytes = "some\0ch\xE2\x82\xACracters";
+    size_t numBytes = 17;
+    shouldBeEqual(write(fd, bytes, numBytes), numBytes);
+    close(fd);
+    Utf8Chars *someChars = Utf8Chars::fromMappedFile(path);
+    shouldNotBeNULL(someChars);
+    shouldBeTrue(someChars->ownsString);
+    shouldBeTrue(someChars->isMapped);
+    shouldBeEqual(someChars->getNumberOfBytesToRead(), numBytes);
+    shouldBeZero(memcmp(someChars->utf8Chars, bytes, numBytes));
+    size_t numChars = 0;
+    while (someChars->nextUtf8Char().u) numChars++;
+    shouldBeEqual(numChars, 15);
+    shouldBeTrue(someChars->atEnd());
+    // the mapping is unmapped by delete
+    delete someChars;
+    // an empty file is an empty stream
+    fd = open(path, O_WRONLY | O_TRUNC);
+    shouldBeTrue(0 <= fd);
+    close(fd);
+    someChars = Utf8Chars::fromMappedFile(path);
+    shouldNotBeNULL(someChars);
+    shouldBeFalse(someChars->isMapped);
+    shouldBeTrue(someChars->atEnd());
+    delete someChars;
+    unlink(path);
+    // a missing file can not be mapped
+    shouldBeNULL(Utf8Chars::fromMappedFile(path));
+    shouldBeNULL(Utf8Chars::fromMappedFile(NULL));
+  } endIt();
+
 } endDescribe(Utf8Chars);
 